@@ -1,18 +1,83 @@
 #include "tlv.h"
+#include "tlv_private.h"
+#include "tlv_dump.h"
 #include <stdio.h>
 #include <string.h>
 #include <stdarg.h>
 
-#define LINE_END "\n"
+#define ARENA_DEFAULT_BLOCK_SIZE 65536
+#define ARENA_ALIGNMENT 8
+
+
+/**
+ * A block of memory in an arena
+ */
+typedef struct stTLVArenaBlock {
+    struct stTLVArenaBlock *next;   /**< @brief Next block in the arena */
+    size_t size;                    /**< @brief Size of data in bytes */
+    size_t used;                    /**< @brief Number of used bytes of data */
+    uint8_t data[];                 /**< @brief Memory handed out by the arena */
+} arena_block_t;
+
+
+/**
+ * Struct representing an arena
+ */
+struct stTLVArena {
+    arena_block_t *first;           /**< @brief First block of the arena */
+    arena_block_t *current;         /**< @brief Block to allocate from */
+    size_t block_size;              /**< @brief Default size of new blocks */
+};
+
+
+/**
+ * Options used when converting a byte array to a tlv object
+ */
+typedef struct {
+    tlv_arena_t *arena;             /**< @brief Arena to allocate in or NULL to use malloc */
+    uint32_t flags;                 /**< @brief Decode options, see tlv_decode_flags_t */
+    tlv_t *objects;                 /**< @brief Next preallocated object or NULL */
+    uint8_t *values;                /**< @brief Next preallocated value or NULL */
+} decode_ctx_t;
+
+
+/**
+ * String growing while tlv_dump writes into it
+ */
+typedef struct {
+    char *str;                      /**< @brief The string, not null terminated until the end */
+    size_t length;                  /**< @brief Number of written characters */
+    size_t capacity;                /**< @brief Size of str */
+} string_buffer_t;
 
 
 /********** PRIVATE DECLARATIONS **********************************************/
+static tlv_debug_sink_t debug_sink = NULL;
+
 /**
  * @brief Creates a new tlv object
- * Allocates memory for the tlv struct
+ * Allocates memory for the tlv struct, in the arena if there is one
+ * @param[in] arena Arena to allocate the object in or NULL to use malloc
  * @return Pointer to the struct or NULL if allocation failed
  */
-static tlv_t* tlv_new(void);
+static tlv_t* tlv_new(tlv_arena_t *arena);
+
+
+/**
+ * @brief Allocates memory for the value of a PDO
+ * @param[in] arena Arena to allocate the value in or NULL to use malloc
+ * @param[in] length Length of the value
+ * @return Pointer to the value or NULL if allocation failed
+ */
+static uint8_t* value_new(tlv_arena_t *arena, const size_t length);
+
+
+/**
+ * @brief Allocates a new block for an arena
+ * @param[in] size Size of the data in the block
+ * @return The block or NULL if allocation failed
+ */
+static arena_block_t* arena_block_new(const size_t size);
 
 
 /**
@@ -35,11 +100,57 @@ static tlv_t* tlv_set_child(tlv_t *tlv, tlv_t *child);
 
 /**
  * @brief Returns the total length of the specified tlv object
+ * The object is encoded with wide headers if a length does not fit in the 5 byte headers
+ * @param[in] tlv Tlv object to get the length for
+ * @param[out] length The length of the tlv object in bytes
+ * @param[out] wide True if the object must be encoded with wide headers
+ * @return True if the function succeeded, false otherwise
+ */
+static bool get_total_length(const tlv_t *tlv, size_t *length, bool *wide);
+
+
+/**
+ * @brief Sums up the length of a tlv object with one kind of headers
  * @param[in] tlv Tlv object to get the length for
+ * @param[in] wide True to sum up with wide headers, the cached lengths are not used then
  * @param[out] length The length of the tlv object in bytes
+ * @param[out] fits False if a length does not fit in the headers
  * @return True if the function succeeded, false otherwise
  */
-static bool get_total_length(const tlv_t *tlv, size_t *length);
+static bool sum_length(const tlv_t *tlv, const bool wide, size_t *length, bool *fits);
+
+
+/**
+ * @brief Sums up the lengths of the CDO's of a tlv object and caches them in the CDO's
+ * @param[in] tlv Tlv object to size
+ * @param[out] length The length of the tlv object in bytes, counted with 5 byte headers
+ * @return True if the function succeeded, false otherwise
+ */
+static bool update_length(tlv_t *tlv, size_t *length);
+
+
+/**
+ * @brief Returns the length of the encoded children of a lazy CDO with one kind of headers
+ * The headers are counted by a scan over the encoding if it has the other kind of headers
+ * @param[in] tlv Lazy CDO to get the length for
+ * @param[in] wide True to count wide headers
+ * @param[out] length The length of the children in bytes
+ * @return True if the function succeeded, false if the encoding is malformed
+ */
+static bool lazy_length(const tlv_t *tlv, const bool wide, size_t *length);
+
+
+/**
+ * @brief Writes the encoded children of a lazy CDO into an array
+ * The encoding is copied as it is if it has the requested kind of headers, otherwise the headers are rewritten
+ * @param[in] tlv Lazy CDO to write the children of
+ * @param[in,out] array Array to write the children in
+ * @param[in] index Pointer to the index of the array
+ * @param[in] length Total length of the array
+ * @param[in] wide True to write wide headers
+ * @return True if conversion succeeded, false otherwise
+ */
+static bool lazy_to_byte_array(const tlv_t *tlv, uint8_t *array, size_t *index, const size_t length, const bool wide);
 
 
 /**
@@ -48,65 +159,123 @@ static bool get_total_length(const tlv_t *tlv, size_t *length);
  * @param[in,out] array Array to save the header in
  * @param[in] index Pointer to the index of the array
  * @param[in] length Total length of the array
+ * @param[in] wide True to write a wide header
  * @return True if setting header succeeded, false otherwise
  */
-static bool set_header(const tlv_t *tlv, uint8_t *array, uint32_t *index, const size_t length);
+static bool set_header(const tlv_t *tlv, uint8_t *array, size_t *index, const size_t length, const bool wide);
 
 
 /**
  * @brief Converts a Tlv to a byte array
  * @param[in] tlv Tlv to convert
- * @param[in,out] array Return point of the array
+ * @param[in,out] array Array to write the Tlv in
  * @param[in] index Pointer to the index of the array
  * @param[in] length Total length of the array
+ * @param[in] wide True to write wide headers
  * @return True if conversion succeeded, false otherwise
  */
-static bool to_byte_array(const tlv_t *tlv, uint8_t **array, uint32_t *index, const size_t length);
+static bool to_byte_array(const tlv_t *tlv, uint8_t *array, size_t *index, const size_t length, const bool wide);
+
+
+/**
+ * @brief Fills an iovec array with the headers in scratch and the values in place
+ * Only counts the needed entries and bytes when a capacity is exceeded
+ * @param[in] tlv Tlv object to convert
+ * @param[out] iov Array of iovec entries
+ * @param[in,out] iov_count Capacity of iov, on return the number of entries used or needed
+ * @param[out] scratch Buffer for the headers
+ * @param[in,out] scratch_size Capacity of scratch, on return the number of bytes used or needed
+ * @param[in] wide True to write wide headers
+ * @return True if all entries and headers fit, false otherwise
+ */
+static bool to_iovec(const tlv_t *tlv, struct iovec *iov, size_t *iov_count, uint8_t *scratch, size_t *scratch_size, const bool wide);
+
+
+/**
+ * @brief Walks a tlv object and its encoding in parallel and rewrites the dirty objects
+ * @param[in] tlv Tlv object which was encoded into bytes
+ * @param[in,out] bytes Encoded tlv object
+ * @param[in] size Size of the encoded tlv object
+ * @param[in] write False to only check that the encoding matches, true to write and clear the dirty flags
+ * @return True if the encoding matches the tlv object, false otherwise
+ */
+static bool patch_array(tlv_t *tlv, uint8_t *bytes, const size_t size, const bool write);
+
+
+/**
+ * @brief Deletes a tlv object, its children and its next chain without recursion
+ * @param[in] tlv Tlv object to delete
+ * @param[in] delete_values True if the values shall be freed too
+ */
+static void delete_tree(tlv_t *tlv, const bool delete_values);
 
 
 /**
  * @brief Converts an array of bytes to a Tlv structure
+ * On failure the already converted part is returned in tlv and must be deleted by the caller
+ * @param[in] ctx Decode options
  * @param[out] tlv Return point of the converted Tlv
  * @param[in] bytes Bytes to convert
  * @param[in] length Length of the array
  * @return True if conversion succeeded, false otherwise
  */
-static bool array_to_tlv(tlv_t **tlv, uint8_t **bytes, tlv_length_t *length);
+static bool array_to_tlv(decode_ctx_t *ctx, tlv_t **tlv, const uint8_t *bytes, const size_t length);
+
+
+/**
+ * @brief Checks a byte array without decoding it, see tlv_validate
+ */
+static bool validate_array(const uint8_t *barray, const size_t size, tlv_stats_t *stats);
 
 
 /**
- * @brief Returns the string representation of a tlv object
- *
- * @param[in] tlv TLV object to represent as string
- * @param[out] str Pointer to string to be filled with the representation of the tlv object
- * @param[in] size Length of the string
- * @param[in] level Corresponds to the level of the TLV object in the thread structure
- * @return True if printing is succeeded, False in case of the string is truncated by <code>snprintf()</code>
+ * @brief Converts a TLV object to a new byte array, see tlv_to_byte_array
  */
-static bool to_string(const tlv_t *tlv, char *str, size_t size, tlv_level_t level);
+static bool encode_array(const tlv_t *tlv, uint8_t **barray, size_t *size);
 
 
 /**
- * Converts bytes from an array to a tlv-tag
- * @param[in] array Array with bytes
- * @return tlv tag;
+ * @brief Converts a TLV object into a buffer, see tlv_to_buffer
  */
-static tlv_tag_t array_to_tlv_tag(uint8_t *array);
+static bool encode_buffer(const tlv_t *tlv, uint8_t *buffer, const size_t capacity, size_t *size);
 
 
 /**
- * Converts bytes whitin an array to tlv-length
- * @param[in] array array with bytes
- * @return tlv-length
+ * @brief Describes the encoding of a TLV object as I/O vectors, see tlv_to_iovec
+ * @param[out] length Size of the encoding
  */
-static tlv_length_t array_to_tlv_length(uint8_t *array);
+static bool encode_iovec(const tlv_t *tlv, struct iovec *iov, size_t *iov_count, uint8_t *scratch, size_t *scratch_size, size_t *length);
+
+
+/**
+ * @brief Writes the modified objects of a tree into its byte array, see tlv_patch_byte_array
+ */
+static bool patch_byte_array(tlv_t *tlv, uint8_t *barray, const size_t size);
+
+
+/**
+ * @brief Finds an object by tag, see tlv_find_by_tag
+ */
+static const tlv_t* find_by_tag(const tlv_t *tlv, const tlv_tag_t tag);
+
+
+/**
+ * @brief Allocates the string representation of a TLV object, see tlv_to_string
+ */
+static const char* string_new(const tlv_t *tlv);
+
+
+/**
+ * @brief Appends a chunk of tlv_dump to a string_buffer_t, doubling it when full
+ */
+static bool string_write(void *arg, const char *data, const size_t size);
 
 
 /********** PUBLIC DEFINITIONS ************************************************/
 tlv_t* tlv_new_cdo(const tlv_tag_t tag) {
     tlv_t *tlv;
 
-    if ((tlv = tlv_new()) == NULL) {
+    if ((tlv = tlv_new(NULL)) == NULL) {
         tlv_debug_cb("Error - Failed to create CDO");
         return NULL;
     }
@@ -120,7 +289,7 @@ tlv_t* tlv_new_cdo(const tlv_tag_t tag) {
 tlv_t* tlv_new_pdo(const tlv_tag_t tag, const tlv_length_t length, uint8_t *value) {
     tlv_t*tlv;
 
-    if ((tlv = tlv_new()) == NULL) {
+    if ((tlv = tlv_new(NULL)) == NULL) {
         tlv_debug_cb("Error - Failed to create PDO");
         return NULL;
     }
@@ -142,7 +311,13 @@ tlv_t* tlv_append_next(tlv_t *tlv, tlv_t *next) {
             tmp = tmp->next;
         }
         tmp->next = next;
-        next->level = tmp->level;
+        for (tlv_t *appended = next; appended != NULL; appended = appended->next) {
+            appended->parent = tmp->parent;
+            appended->level = tmp->level;
+            appended->flags |= TLV_FLAG_DIRTY;
+        }
+        tlv_invalidate_length(tmp->parent);
+        tlv_mark_dirty(tmp->parent);
         return next;
     }
 
@@ -153,10 +328,13 @@ tlv_t* tlv_append_next(tlv_t *tlv, tlv_t *next) {
 tlv_t* tlv_append_child(tlv_t *tlv, tlv_t*child) {
     if (tlv && child) {
         if (tlv->type != TLV_CDO) {
-            tlv_debug_cb("Error - Cannot append child. Tlv is not CDO");
+            TLV_FAIL(TLV_FAILURE_ARGUMENT, "Error - Cannot append child. Tlv is not CDO");
             return NULL;
         }
 
+        if (!tlv_materialize(tlv)) {
+            return NULL;
+        }
         if (tlv->child == NULL) {
             tlv_set_child(tlv, child);
         } else {
@@ -165,359 +343,1389 @@ tlv_t* tlv_append_child(tlv_t *tlv, tlv_t*child) {
 
         return child;
     }
-    tlv_debug_cb("Error - Append failed, argument is null");
+    TLV_FAIL(TLV_FAILURE_ARGUMENT, "Error - Append failed, argument is null");
     return NULL;
 }
 
 
-const tlv_t* tlv_find_by_tag(const tlv_t *tlv, const tlv_tag_t tag) {
-    const tlv_t *out_tlv = NULL;
-    if (tlv) {
-        if (tlv->tag == tag) {
-            out_tlv = tlv;
-        } else {
-            if ((out_tlv = tlv_find_by_tag(tlv->next, tag)) == NULL) {
-                out_tlv = tlv_find_by_tag(tlv->child, tag);
-            }
-        }
+bool tlv_set_tag(tlv_t *tlv, const tlv_tag_t tag) {
+    if (tlv == NULL) {
+        TLV_FAIL(TLV_FAILURE_ARGUMENT, "Error - Tlv is null when setting tag");
+        return false;
+    }
+    if (tlv->tag != tag) {
+        tlv->tag = tag;
+        tlv_mark_dirty(tlv);
     }
 
-    return out_tlv;
+    return true;
 }
 
 
-void tlv_delete(tlv_t **tlv) {
-    if (tlv != NULL && *tlv != NULL) {
-        tlv_delete(&(*tlv)->next);
-        tlv_delete(&(*tlv)->child);
-        (*tlv)->value = NULL;
-        (*tlv)->length = 0;
-        free(*tlv);
-
-        *tlv = NULL;
+bool tlv_set_value(tlv_t *tlv, const tlv_length_t length, uint8_t *value) {
+    if (tlv == NULL || tlv->type != TLV_PDO || (length > 0 && value == NULL)) {
+        TLV_FAIL(TLV_FAILURE_ARGUMENT, "Error - Cannot set value, tlv is not PDO or value is null");
+        return false;
     }
-}
-
-
-void tlv_delete_all(tlv_t **tlv) {
-    if (tlv != NULL && *tlv != NULL) {
-        tlv_delete_all(&(*tlv)->next);
-        tlv_delete_all(&(*tlv)->child);
-        if ((*tlv)->value != NULL) {
-            free((*tlv)->value);
-            (*tlv)->value = NULL;
-            (*tlv)->length = 0;
-        }
-
-        free(*tlv);
-        *tlv = NULL;
+    // Objects of a malloc'd block are no arena objects, the values they take over are freed one by one
+    if (tlv->flags & TLV_FLAG_ARENA) {
+        TLV_FAIL(TLV_FAILURE_ARGUMENT, "Error - Cannot take over value in an arena object, use tlv_arena_set_value");
+        return false;
+    }
+    if (tlv->value != NULL && tlv->value != value && !(tlv->flags & TLV_FLAG_BORROWED)) {
+        free(tlv->value);
     }
+    if (tlv->length != length) {
+        tlv_invalidate_length(tlv->parent);
+    }
+    tlv->value = value;
+    tlv->length = length;
+    tlv->flags &= (uint8_t) ~TLV_FLAG_BORROWED;
+    tlv_mark_dirty(tlv);
+
+    return true;
 }
 
 
-bool tlv_to_byte_array(const tlv_t *tlv, uint8_t **barray, size_t *size) {
+bool tlv_update_length(tlv_t *tlv, size_t *size) {
     size_t length = 0;
-    if (barray != NULL && size != NULL) {
-        if (get_total_length(tlv, &length)) {
-            printf("Length: %u\n", (unsigned) length);
-            uint8_t *array = malloc(length);
+    bool wide;
 
-            if (array != NULL) {
-                memset(array, 0, length);
-                uint32_t index = 0;
-                to_byte_array(tlv, &array, &index, length);
-                *barray = array;
-                *size = length;
-                return true;
-            }
-            tlv_debug_cb("Fatal - Failed to allocate memory for array");
-            return false;
-        }
+    // The cached lengths count 5 byte headers, the encoded size may need wide headers
+    if (!update_length(tlv, &length) || !get_total_length(tlv, &length, &wide)) {
         tlv_debug_cb("Error - Failed to get size of the object");
         return false;
     }
+    if (size != NULL) {
+        *size = length;
+    }
 
-    return false;
+    return true;
 }
 
 
-tlv_t* tlv_from_byte_array(const uint8_t *barray, const size_t size) {
-    tlv_t *tlv = NULL;
+bool tlv_materialize(tlv_t *tlv) {
+    decode_ctx_t ctx = {NULL, TLV_DECODE_LAZY | TLV_DECODE_BORROW, NULL, NULL};
 
-    if (barray != NULL && size >= BER_HEADER_BYTE_LENGTH) {
-        if (size > 65535) {
-            tlv_debug_cb("ERROR - Too long array: %u", size);
-            return tlv;
-        }
-        uint8_t *bytes = (uint8_t*) barray;
-        tlv_length_t length = (tlv_length_t) size;
-        if (!array_to_tlv(&tlv, &bytes, &length)) {
-            tlv_debug_cb("ERROR - Converting to tlv failed");
-        }
+    if (tlv == NULL) {
+        return false;
+    }
+    if (!(tlv->flags & TLV_FLAG_LAZY)) {
+        return true;
+    }
+    if (!array_to_tlv(&ctx, &tlv->child, tlv->value, tlv->length)) {
+        tlv_debug_cb("ERROR - Decoding the children of CDO(%u) failed", tlv->tag);
+        tlv_delete_all(&tlv->child);
+        return false;
     }
+    for (tlv_t *child = tlv->child; child != NULL; child = child->next) {
+        child->parent = tlv;
+        child->level = (tlv_level_t) (tlv->level + 1);
+    }
+    tlv->value = NULL;
+    tlv->flags &= (uint8_t) ~(TLV_FLAG_LAZY | TLV_FLAG_WIDE | TLV_FLAG_BORROWED);
 
-    return tlv;
+    return true;
 }
 
 
-const char* tlv_to_string(const tlv_t *tlv) {
-    if (tlv != NULL) {
-        size_t tlv_length = 0;
-        if (!get_total_length(tlv, &tlv_length)) {
-            tlv_debug_cb("Error - Got wrong tlv length(%u) when printing object", (unsigned) tlv_length);
-            return NULL;
-        }
+tlv_t* tlv_get_child(tlv_t *tlv) {
+    return tlv_materialize(tlv) ? tlv->child : NULL;
+}
 
-        size_t total_length = tlv_length * 5;
-        char *instr = malloc(total_length);
-        memset(instr, 0, total_length);
-        if (!to_string(tlv, instr, total_length, 0)) {
-            tlv_debug_cb("Warning - The string may not be complete");
-        }
 
-        return instr;
+tlv_t* tlv_find_child(tlv_t *tlv, const tlv_tag_t tag) {
+    for (tlv_t *child = tlv_get_child(tlv); child != NULL; child = child->next) {
+        if (child->tag == tag) {
+            return child;
+        }
     }
 
-    tlv_debug_cb("Error - Tlv is null when trying to convert it to string");
     return NULL;
 }
 
 
-void __attribute__ ((weak)) tlv_debug_cb(const char *txt, ...) {
-    va_list args;
-    va_start(args, txt);
-    vprintf(txt, args);
-    printf(LINE_END);
-    va_end(args);
+const tlv_t* tlv_find_by_tag(const tlv_t *tlv, const tlv_tag_t tag) {
+    TLV_TRACE_BEGIN(TLV_API_FIND);
+    const tlv_t *found = find_by_tag(tlv, tag);
+
+    TLV_TRACE_END(TLV_API_FIND, found != NULL);
+
+    return found;
 }
 
 
-/********** PRIVATE DEFINITIONS ***********************************************/
-static tlv_t* tlv_new(void) {
-    tlv_t *tlv;
+void tlv_delete(tlv_t **tlv) {
+    if (tlv != NULL && *tlv != NULL) {
+        tlv_t *block = ((*tlv)->flags & TLV_FLAG_BLOCK) ? *tlv : NULL;
 
-    tlv = (tlv_t*) malloc(sizeof (*tlv));
-    if (tlv == NULL) {
-        tlv_debug_cb("Fatal - Out of memory");
-        return NULL;
+        delete_tree(*tlv, false);
+        free(block);
+        *tlv = NULL;
     }
-
-    return tlv_reset(tlv);
 }
 
 
-static tlv_t* tlv_reset(tlv_t *tlv) {
-    tlv->child = NULL;
-    tlv->next = NULL;
-    tlv->length = 0;
-    tlv->tag = 0;
-    tlv->value = NULL;
-    tlv->type = TLV_NOT_SET;
-    tlv->level = 0;
+void tlv_delete_all(tlv_t **tlv) {
+    if (tlv != NULL && *tlv != NULL) {
+        TLV_TRACE_BEGIN(TLV_API_DELETE);
+        tlv_t *block = ((*tlv)->flags & TLV_FLAG_BLOCK) ? *tlv : NULL;
 
-    return tlv;
+        delete_tree(*tlv, true);
+        free(block);
+        *tlv = NULL;
+        TLV_TRACE_END(TLV_API_DELETE, true);
+    }
 }
 
 
-static tlv_t* tlv_set_child(tlv_t *tlv, tlv_t *child) {
-    if (tlv && child) {
-        if (tlv->type != TLV_CDO) {
-            tlv_debug_cb("Error - Set_child failed. Tlv is not CDO");
-            return NULL;
-        }
-        if (tlv->child != NULL) {
-            tlv_debug_cb("Warning - Deleting already existing child");
-            tlv_delete(&tlv->child);
-        }
-        tlv->child = child;
-        child->level = tlv->level + 1;
-        return child;
+bool tlv_to_byte_array(const tlv_t *tlv, uint8_t **barray, size_t *size) {
+    TLV_TRACE_BEGIN(TLV_API_ENCODE);
+    bool ok = encode_array(tlv, barray, size);
+
+    if (ok) {
+        TLV_COUNT(encoded_messages, 1);
+        TLV_COUNT(encoded_bytes, *size);
     }
+    TLV_TRACE_END(TLV_API_ENCODE, ok);
 
-    return NULL;
+    return ok;
 }
 
 
-static bool get_total_length(const tlv_t *tlv, size_t *length) {
-    size_t buffer_length = BER_HEADER_BYTE_LENGTH;
-    size_t tmp_len = 0;
+bool tlv_to_buffer(const tlv_t *tlv, uint8_t *buffer, const size_t capacity, size_t *size) {
+    TLV_TRACE_BEGIN(TLV_API_ENCODE_BUFFER);
+    bool ok = encode_buffer(tlv, buffer, capacity, size);
 
-    if (tlv != NULL) {
-        if (tlv->type == TLV_PDO) {
-            buffer_length += tlv->length; // value length + header length
-        }
-        if (tlv->child != NULL) {
-            get_total_length(tlv->child, &tmp_len);
-            buffer_length += tmp_len;
-            ((tlv_t*) tlv)->length = tmp_len;
-        }
+    if (ok) {
+        TLV_COUNT(encoded_messages, 1);
+        TLV_COUNT(encoded_bytes, *size);
+    }
+    TLV_TRACE_END(TLV_API_ENCODE_BUFFER, ok);
 
-        if (tlv->next != NULL) {
-            get_total_length(tlv->next, &tmp_len);
-            buffer_length += tmp_len;
-        }
+    return ok;
+}
 
-        *length = buffer_length;
-        return true;
+
+bool tlv_to_iovec(const tlv_t *tlv, struct iovec *iov, size_t *iov_count, uint8_t *scratch, size_t *scratch_size) {
+    size_t length = 0;
+    TLV_TRACE_BEGIN(TLV_API_ENCODE_IOVEC);
+    bool ok = encode_iovec(tlv, iov, iov_count, scratch, scratch_size, &length);
+
+    if (ok) {
+        TLV_COUNT(encoded_messages, 1);
+        TLV_COUNT(encoded_bytes, length);
     }
-    return false;
+    TLV_TRACE_END(TLV_API_ENCODE_IOVEC, ok);
+
+    return ok;
 }
 
 
-static bool set_header(const tlv_t *tlv, uint8_t *array, uint32_t *index, const size_t length) {
-    if (*index + BER_HEADER_BYTE_LENGTH > length) {
-        tlv_debug_cb("Error - not enough room for tlv header");
-        return false;
-    }
+bool tlv_patch_byte_array(tlv_t *tlv, uint8_t *barray, const size_t size) {
+    TLV_TRACE_BEGIN(TLV_API_PATCH);
+    bool ok = patch_byte_array(tlv, barray, size);
 
-    array[(*index)++] = tlv->type;
-    array[(*index)++] = (uint8_t) (tlv->tag >> 8);
-    array[(*index)++] = (uint8_t) (tlv->tag & 0x00ff);
-    array[(*index)++] = (uint8_t) (tlv->length >> 8);
-    array[(*index)++] = (uint8_t) (tlv->length & 0x00ff);
+    TLV_TRACE_END(TLV_API_PATCH, ok);
 
-    return true;
+    return ok;
 }
 
 
-static bool to_byte_array(const tlv_t *tlv, uint8_t **array, uint32_t *index, const size_t length) {
-    if (set_header(tlv, *array, index, length)) {
-        uint16_t len = BER_HEADER_BYTE_LENGTH;
-        if (tlv->type == TLV_CDO) {
-            if (tlv->child != NULL) {
-                if (!to_byte_array(tlv->child, array, index, length)) {
-                    return false;
-                }
-            }
-        } else { //pdo
-            uint8_t *a = *array;
-            memcpy(&a[*index], tlv->value, tlv->length);
-            *index += tlv->length;
-            len += tlv->length;
-        }
-        //set_length
-
-        if (tlv->next != NULL) {
-            return to_byte_array(tlv->next, array, index, length);
-        }
-        return true;
-    }
-    return false;
+tlv_t* tlv_from_byte_array(const uint8_t *barray, const size_t size) {
+    return tlv_from_byte_array_ex(barray, size, NULL, TLV_DECODE_COPY);
 }
 
 
-static bool array_to_tlv(tlv_t **tlv, uint8_t **bytes, tlv_length_t *length) {
-    uint8_t *header = *bytes;
-    bool ret_value = true;
-    tlv_length_t value_length = 0;
+tlv_t* tlv_from_byte_array_ex(const uint8_t *barray, const size_t size, tlv_arena_t *arena, const uint32_t flags) {
+    TLV_TRACE_BEGIN(TLV_API_DECODE);
+    tlv_t *tlv = tlv_decode_array(barray, size, arena, flags);
 
-    if (*length == 0) {
-        // Nothing to do
-        *tlv = NULL;
-        return ret_value;
+    if (tlv != NULL) {
+        TLV_COUNT(decoded_messages, 1);
+        TLV_COUNT(decoded_bytes, size);
     }
+    TLV_TRACE_END(TLV_API_DECODE, tlv != NULL);
 
-    if (*length < BER_HEADER_BYTE_LENGTH || *bytes == NULL) {
-        tlv_debug_cb("ERROR - Failed to deserialize, wrong length");
-        return false;
-    }
+    return tlv;
+}
 
-    value_length = array_to_tlv_length(&header[3]);
 
-    *bytes += BER_HEADER_BYTE_LENGTH;
-    *length -= BER_HEADER_BYTE_LENGTH;
+bool tlv_validate(const uint8_t *barray, const size_t size, tlv_stats_t *stats) {
+    TLV_TRACE_BEGIN(TLV_API_VALIDATE);
+    bool ok = validate_array(barray, size, stats);
 
-    if (header[0] == TLV_PDO) {
-        *tlv = tlv_new_pdo(array_to_tlv_tag(&header[1]), value_length, NULL);
-        (*tlv)->value = malloc(value_length);
-        if ((*tlv)->value == NULL) {
-            tlv_debug_cb("FATAL - Out of memory when allocating (*tlv)->value");
-            return false;
-        }
-        memcpy((*tlv)->value, *bytes, value_length);
+    TLV_TRACE_END(TLV_API_VALIDATE, ok);
 
-        *bytes += value_length;
-        *length -= value_length;
-    } else {
-        *tlv = tlv_new_cdo(array_to_tlv_tag(&header[1]));
-        if (value_length > 0) {
-            *length -= value_length;
-            ret_value = array_to_tlv(&(*tlv)->child, bytes, &value_length);
-            if (ret_value == false) {
-                tlv_debug_cb("ERROR - Failed to convert cdo->child");
-                return ret_value;
-            }
-        }
-    }
+    return ok;
+}
 
-    if (*length > 0) {
-        ret_value = array_to_tlv(&(*tlv)->next, bytes, length);
-        if (ret_value == false) {
-            tlv_debug_cb("ERROR - Failed to convert tlv->next");
-            return ret_value;
-        }
+
+tlv_arena_t* tlv_arena_new(const size_t block_size) {
+    tlv_arena_t *arena = malloc(sizeof (*arena));
+
+    if (arena == NULL) {
+        TLV_FAIL(TLV_FAILURE_MEMORY, "Fatal - Out of memory when allocating arena");
+        return NULL;
+    }
+    arena->block_size = block_size > 0 ? block_size : ARENA_DEFAULT_BLOCK_SIZE;
+    arena->first = arena_block_new(arena->block_size);
+    if (arena->first == NULL) {
+        free(arena);
+        return NULL;
     }
+    arena->current = arena->first;
 
-    return ret_value;
+    return arena;
 }
 
 
-static bool to_string(const tlv_t *tlv, char *str, size_t size, tlv_level_t level) {
-    int ret;
-    char space[(4 * level) + 1];
+void tlv_arena_reset(tlv_arena_t *arena) {
+    if (arena != NULL) {
+        for (arena_block_t *block = arena->first; block != NULL; block = block->next) {
+            block->used = 0;
+        }
+        arena->current = arena->first;
+    }
+}
 
-    memset(space, ' ', (sizeof (space) - 1));
-    space[sizeof (space) - 1] = '\0';
 
-    if (tlv->type == TLV_CDO) {
-        ret = snprintf(str, size, "%s|cdo+%u|-[]\n", space, tlv->tag);
-        if (ret < 0 || (size_t) ret > size) {
-            return false;
-        }
-        if (tlv->child != NULL) {
-            size_t len = strlen(str);
+void tlv_arena_delete(tlv_arena_t **arena) {
+    if (arena != NULL && *arena != NULL) {
+        arena_block_t *block = (*arena)->first;
 
-            if (!to_string(tlv->child, &str[len], size - len, (level + 1))) {
-                return false;
-            }
+        while (block != NULL) {
+            arena_block_t *next = block->next;
+            free(block);
+            block = next;
         }
-    } else {
-        if (tlv->length > 0) {
-            char value[(tlv->length * 5) + 1];
+        free(*arena);
+        *arena = NULL;
+    }
+}
 
-            for (uint16_t i = 0; i < tlv->length; i++) {
-                ret = snprintf(&value[i * 5], sizeof (value), "0x%02X ", tlv->value[i]);
-                if (ret < 0 || (size_t) ret > sizeof (value)) {
-                    return false;
-                }
-            }
-            value[(tlv->length * 5)] = 0;
 
-            ret = snprintf(str, size, "%s|pdo+%u|-[ %s]\n", space, tlv->tag, value);
-            if (ret < 0 || (size_t) ret > size) {
-                return false;
-            }
-        } else {
-            ret = snprintf(str, size, "%s|pdo+%u|-[]\n", space, tlv->tag);
-            if (ret < 0 || (size_t) ret > size) {
-                return false;
+void* tlv_arena_alloc(tlv_arena_t *arena, const size_t size) {
+    if (arena == NULL) {
+        return NULL;
+    }
+    size_t aligned = (size + (ARENA_ALIGNMENT - 1)) & ~((size_t) ARENA_ALIGNMENT - 1);
+    arena_block_t *block = arena->current;
+
+    // Blocks after the current one are free after a reset, use the first one big enough
+    while (block->size - block->used < aligned) {
+        if (block->next == NULL) {
+            arena_block_t *new_block = arena_block_new(aligned > arena->block_size ? aligned : arena->block_size);
+            if (new_block == NULL) {
+                return NULL;
             }
+            block->next = new_block;
         }
+        block = block->next;
+    }
+    arena->current = block;
+
+    void *ptr = &block->data[block->used];
+    block->used += aligned;
+
+    return ptr;
+}
+
+
+tlv_t* tlv_arena_new_cdo(tlv_arena_t *arena, const tlv_tag_t tag) {
+    tlv_t *tlv;
+
+    if (arena == NULL || (tlv = tlv_new(arena)) == NULL) {
+        tlv_debug_cb("Error - Failed to create CDO in arena");
+        return NULL;
+    }
+    tlv->type = TLV_CDO;
+    tlv->tag = tag;
+
+    return tlv;
+}
+
+
+tlv_t* tlv_arena_new_pdo(tlv_arena_t *arena, const tlv_tag_t tag, const tlv_length_t length, const uint8_t *value) {
+    tlv_t *tlv;
+
+    if (arena == NULL || (tlv = tlv_new(arena)) == NULL) {
+        tlv_debug_cb("Error - Failed to create PDO in arena");
+        return NULL;
+    }
+    tlv->type = TLV_PDO;
+    tlv->tag = tag;
+    tlv->length = length;
+    if (length > 0) {
+        if ((tlv->value = value_new(arena, length)) == NULL) {
+            tlv_debug_cb("Error - Failed to allocate PDO value in arena");
+            return NULL;
+        }
+        if (value != NULL) {
+            memcpy(tlv->value, value, length);
+        }
+    }
+
+    return tlv;
+}
+
+
+bool tlv_arena_set_value(tlv_arena_t *arena, tlv_t *tlv, const tlv_length_t length, const uint8_t *value) {
+    uint8_t *copy = NULL;
+
+    if (arena == NULL || tlv == NULL || tlv->type != TLV_PDO || (length > 0 && value == NULL)) {
+        TLV_FAIL(TLV_FAILURE_ARGUMENT, "Error - Cannot set value, arena is null or tlv is not PDO");
+        return false;
+    }
+    if (length > 0) {
+        if ((copy = value_new(arena, length)) == NULL) {
+            tlv_debug_cb("Error - Failed to allocate PDO value in arena");
+            return false;
+        }
+        memcpy(copy, value, length);
+    }
+    if (tlv->value != NULL && !(tlv->flags & TLV_FLAG_BORROWED)) {
+        free(tlv->value);
+    }
+    if (tlv->length != length) {
+        tlv_invalidate_length(tlv->parent);
+    }
+    tlv->value = copy;
+    tlv->length = length;
+    tlv->flags |= TLV_FLAG_BORROWED;
+    tlv_mark_dirty(tlv);
+
+    return true;
+}
+
+
+tlv_t* tlv_arena_from_byte_array(tlv_arena_t *arena, const uint8_t *barray, const size_t size) {
+    if (arena == NULL) {
+        TLV_FAIL(TLV_FAILURE_ARGUMENT, "Error - Arena is null when converting byte array");
+        return NULL;
+    }
+
+    return tlv_from_byte_array_ex(barray, size, arena, TLV_DECODE_COPY);
+}
+
+
+const char* tlv_to_string(const tlv_t *tlv) {
+    TLV_TRACE_BEGIN(TLV_API_TO_STRING);
+    const char *str = string_new(tlv);
+
+    TLV_TRACE_END(TLV_API_TO_STRING, str != NULL);
+
+    return str;
+}
+
+
+void tlv_set_debug_sink(tlv_debug_sink_t sink) {
+    debug_sink = sink;
+}
+
+
+void __attribute__ ((weak)) tlv_debug_cb(const char *txt, ...) {
+    // Nothing is formatted unless a sink is installed
+    if (debug_sink != NULL) {
+        va_list args;
+        va_start(args, txt);
+        debug_sink(txt, args);
+        va_end(args);
+    }
+}
+
+
+/********** PRIVATE DEFINITIONS ***********************************************/
+static tlv_t* tlv_new(tlv_arena_t *arena) {
+    tlv_t *tlv;
+
+    if (arena != NULL) {
+        tlv = (tlv_t*) tlv_arena_alloc(arena, sizeof (*tlv));
+    } else {
+        tlv = (tlv_t*) malloc(sizeof (*tlv));
+    }
+    if (tlv == NULL) {
+        TLV_FAIL(TLV_FAILURE_MEMORY, "Fatal - Out of memory");
+        return NULL;
+    }
+
+    tlv_reset(tlv);
+    TLV_COUNT(nodes_allocated, 1);
+    if (arena != NULL) {
+        tlv->flags = TLV_FLAG_ARENA | TLV_FLAG_BORROWED;
+    }
+
+    return tlv;
+}
+
+
+static uint8_t* value_new(tlv_arena_t *arena, const size_t length) {
+    if (arena != NULL) {
+        return (uint8_t*) tlv_arena_alloc(arena, length);
+    }
+    return (uint8_t*) malloc(length);
+}
+
+
+static arena_block_t* arena_block_new(const size_t size) {
+    arena_block_t *block = malloc(sizeof (*block) + size);
+
+    if (block == NULL) {
+        TLV_FAIL(TLV_FAILURE_MEMORY, "Fatal - Out of memory when allocating arena block");
+        return NULL;
+    }
+    block->next = NULL;
+    block->size = size;
+    block->used = 0;
+
+    return block;
+}
+
+
+static tlv_t* tlv_reset(tlv_t *tlv) {
+    tlv->child = NULL;
+    tlv->next = NULL;
+    tlv->parent = NULL;
+    tlv->length = 0;
+    tlv->tag = 0;
+    tlv->value = NULL;
+    tlv->type = TLV_NOT_SET;
+    tlv->flags = TLV_FLAG_NONE;
+    tlv->level = 0;
+
+    return tlv;
+}
+
+
+static tlv_t* tlv_set_child(tlv_t *tlv, tlv_t *child) {
+    if (tlv && child) {
+        if (tlv->type != TLV_CDO) {
+            TLV_FAIL(TLV_FAILURE_ARGUMENT, "Error - Set_child failed. Tlv is not CDO");
+            return NULL;
+        }
+        if (tlv->child != NULL) {
+            tlv_debug_cb("Warning - Deleting already existing child");
+            tlv_delete(&tlv->child);
+        }
+        tlv->child = child;
+        for (tlv_t *appended = child; appended != NULL; appended = appended->next) {
+            appended->parent = tlv;
+            appended->level = tlv->level + 1;
+            appended->flags |= TLV_FLAG_DIRTY;
+        }
+        tlv_invalidate_length(tlv);
+        tlv_mark_dirty(tlv);
+        return child;
+    }
+
+    return NULL;
+}
+
+
+static bool get_total_length(const tlv_t *tlv, size_t *length, bool *wide) {
+    bool fits;
+
+    if (!sum_length(tlv, false, length, &fits)) {
+        return false;
+    }
+    *wide = !fits;
+    if (!fits && (!sum_length(tlv, true, length, &fits) || !fits)) {
+        TLV_FAIL(TLV_FAILURE_SIZE, "Error - Too long tlv, a length does not fit in 32 bits");
+        return false;
+    }
+
+    return true;
+}
+
+
+static bool sum_length(const tlv_t *tlv, const bool wide, size_t *length, bool *fits) {
+    struct {
+        const tlv_t *cdo;
+        size_t outer_length;
+    } stack[TLV_MAX_DEPTH];
+    size_t depth = 0;
+    size_t buffer_length = 0;
+    const size_t header_size = wide ? BER_WIDE_HEADER_BYTE_LENGTH : BER_HEADER_BYTE_LENGTH;
+    const size_t max_length = wide ? UINT32_MAX : UINT16_MAX;
+
+    if (tlv == NULL) {
+        return false;
+    }
+
+    // Lengths of the CDO's are known when leaving them, the stack holds the length summed so far on the outer levels
+    *fits = false;
+    while (true) {
+        while (tlv != NULL) {
+            buffer_length += header_size;
+            if (tlv->flags & TLV_FLAG_LAZY) {
+                size_t lazy;
+
+                if (!lazy_length(tlv, wide, &lazy)) {
+                    return false;
+                }
+                if (lazy > max_length) {
+                    return true;
+                }
+                buffer_length += lazy;
+            } else if (tlv->type == TLV_PDO || (!wide && (tlv->flags & TLV_FLAG_SIZED))) {
+                if (tlv->length > max_length) {
+                    return true;
+                }
+                buffer_length += tlv->length; // value length or cached length of the children
+            } else if (tlv->child != NULL) {
+                if (depth == TLV_MAX_DEPTH) {
+                    TLV_FAIL(TLV_FAILURE_DEPTH, "Error - Tlv is deeper than %u levels", TLV_MAX_DEPTH);
+                    return false;
+                }
+                stack[depth].cdo = tlv;
+                stack[depth++].outer_length = buffer_length;
+                buffer_length = 0;
+                tlv = tlv->child;
+                continue;
+            }
+            tlv = tlv->next;
+        }
+
+        if (depth == 0) {
+            break;
+        }
+        depth--;
+        if (buffer_length > max_length) {
+            return true;
+        }
+        buffer_length += stack[depth].outer_length;
+        tlv = stack[depth].cdo->next;
+    }
+
+    *length = buffer_length;
+    *fits = true;
+    return true;
+}
+
+
+static bool update_length(tlv_t *tlv, size_t *length) {
+    struct {
+        tlv_t *cdo;
+        size_t outer_length;
+    } stack[TLV_MAX_DEPTH];
+    size_t depth = 0;
+    size_t buffer_length = 0;
+
+    if (tlv == NULL) {
+        return false;
+    }
+
+    // Same walk as get_total_length, the summed lengths are stored in the CDO's
+    while (true) {
+        while (tlv != NULL) {
+            buffer_length += BER_HEADER_BYTE_LENGTH;
+            if (tlv->flags & TLV_FLAG_LAZY) {
+                // The length of a lazy CDO describes its encoding and is not replaced
+                size_t lazy;
+
+                if (!lazy_length(tlv, false, &lazy)) {
+                    return false;
+                }
+                buffer_length += lazy;
+            } else if (tlv->type == TLV_PDO || (tlv->flags & TLV_FLAG_SIZED)) {
+                buffer_length += tlv->length;
+            } else if (tlv->child != NULL) {
+                if (depth == TLV_MAX_DEPTH) {
+                    TLV_FAIL(TLV_FAILURE_DEPTH, "Error - Tlv is deeper than %u levels", TLV_MAX_DEPTH);
+                    return false;
+                }
+                stack[depth].cdo = tlv;
+                stack[depth++].outer_length = buffer_length;
+                buffer_length = 0;
+                tlv = tlv->child;
+                continue;
+            } else {
+                tlv->length = 0;
+                tlv->flags |= TLV_FLAG_SIZED;
+            }
+            tlv = tlv->next;
+        }
+
+        if (depth == 0) {
+            break;
+        }
+        depth--;
+        if (buffer_length > UINT32_MAX) {
+            TLV_FAIL(TLV_FAILURE_SIZE, "Error - Too long CDO(%u): %zu", stack[depth].cdo->tag, buffer_length);
+            return false;
+        }
+        stack[depth].cdo->length = (tlv_length_t) buffer_length;
+        stack[depth].cdo->flags |= TLV_FLAG_SIZED;
+        buffer_length += stack[depth].outer_length;
+        tlv = stack[depth].cdo->next;
+    }
+
+    *length = buffer_length;
+    return true;
+}
+
+
+static bool lazy_length(const tlv_t *tlv, const bool wide, size_t *length) {
+    const size_t header_size = wide ? BER_WIDE_HEADER_BYTE_LENGTH : BER_HEADER_BYTE_LENGTH;
+    size_t index = 0;
+    size_t total = 0;
+
+    if (((tlv->flags & TLV_FLAG_WIDE) != 0) == wide) {
+        *length = tlv->length;
+        return true;
+    }
+
+    // The children of a CDO follow its header, every header is reached by skipping the values only
+    while (index < tlv->length) {
+        tlv_header_t header;
+
+        if (!tlv_header_read(&tlv->value[index], tlv->length - index, &header) || header.length > tlv->length - index - header.size) {
+            TLV_FAIL(TLV_FAILURE_MALFORMED, "Error - Lazy CDO(%u) has a wrong header at %u", tlv->tag, (unsigned) index);
+            return false;
+        }
+        total += header_size;
+        index += header.size;
+        if (header.type == TLV_PDO) {
+            total += header.length;
+            index += header.length;
+        }
+    }
+    *length = total;
+
+    return true;
+}
+
+
+static bool lazy_to_byte_array(const tlv_t *tlv, uint8_t *array, size_t *index, const size_t length, const bool wide) {
+    struct {
+        tlv_tag_t tag;
+        size_t end;
+        size_t header;
+    } stack[TLV_MAX_DEPTH];
+    size_t depth = 0;
+    size_t position = 0;
+    const size_t header_size = wide ? BER_WIDE_HEADER_BYTE_LENGTH : BER_HEADER_BYTE_LENGTH;
+    const size_t max_length = wide ? UINT32_MAX : UINT16_MAX;
+
+    if (((tlv->flags & TLV_FLAG_WIDE) != 0) == wide) {
+        if (*index + tlv->length > length) {
+            TLV_FAIL(TLV_FAILURE_SIZE, "Error - not enough room for lazy CDO(%u)", tlv->tag);
+            return false;
+        }
+        memcpy(&array[*index], tlv->value, tlv->length);
+        *index += tlv->length;
+        return true;
+    }
+
+    // Same as to_byte_array on the encoding, the lengths of the CDO's are written when leaving them
+    while (true) {
+        while (depth > 0 && position == stack[depth - 1].end) {
+            size_t cdo_length = *index - stack[--depth].header - header_size;
+
+            if (cdo_length > max_length) {
+                TLV_FAIL(TLV_FAILURE_SIZE, "Error - Too long CDO(%u): %zu", stack[depth].tag, cdo_length);
+                return false;
+            }
+            tlv_header_write(&array[stack[depth].header], TLV_CDO, stack[depth].tag, (tlv_length_t) cdo_length, wide);
+        }
+        if (position == tlv->length) {
+            break;
+        }
+
+        size_t end = depth > 0 ? stack[depth - 1].end : tlv->length;
+        tlv_header_t header;
+        if (!tlv_header_read(&tlv->value[position], end - position, &header) || header.length > end - position - header.size) {
+            TLV_FAIL(TLV_FAILURE_MALFORMED, "Error - Lazy CDO(%u) has a wrong header at %u", tlv->tag, (unsigned) position);
+            return false;
+        }
+        if (*index + header_size + (header.type == TLV_PDO ? header.length : 0) > length) {
+            TLV_FAIL(TLV_FAILURE_SIZE, "Error - not enough room for lazy CDO(%u)", tlv->tag);
+            return false;
+        }
+        if (header.type == TLV_PDO) {
+            if (header.length > max_length) {
+                TLV_FAIL(TLV_FAILURE_SIZE, "Error - Too long PDO(%u): %u", header.tag, header.length);
+                return false;
+            }
+            *index += tlv_header_write(&array[*index], TLV_PDO, header.tag, header.length, wide);
+            memcpy(&array[*index], &tlv->value[position + header.size], header.length);
+            *index += header.length;
+            position += header.size + header.length;
+            continue;
+        }
+        if (depth == TLV_MAX_DEPTH) {
+            TLV_FAIL(TLV_FAILURE_DEPTH, "Error - Tlv is deeper than %u levels", TLV_MAX_DEPTH);
+            return false;
+        }
+        stack[depth].tag = header.tag;
+        stack[depth].end = position + header.size + header.length;
+        stack[depth++].header = *index;
+        *index += tlv_header_write(&array[*index], TLV_CDO, header.tag, 0, wide);
+        position += header.size;
+    }
+
+    return true;
+}
+
+
+static bool set_header(const tlv_t *tlv, uint8_t *array, size_t *index, const size_t length, const bool wide) {
+    if (*index + (wide ? BER_WIDE_HEADER_BYTE_LENGTH : BER_HEADER_BYTE_LENGTH) > length) {
+        TLV_FAIL(TLV_FAILURE_SIZE, "Error - not enough room for tlv header");
+        return false;
+    }
+
+    // Lengths of CDO's are written when all children are written
+    *index += tlv_header_write(&array[*index], tlv->type, tlv->tag, tlv->type == TLV_PDO ? tlv->length : 0, wide);
+
+    return true;
+}
+
+
+static bool to_byte_array(const tlv_t *tlv, uint8_t *array, size_t *index, const size_t length, const bool wide) {
+    struct {
+        const tlv_t *cdo;
+        size_t header;
+    } stack[TLV_MAX_DEPTH];
+    size_t depth = 0;
+    const size_t header_size = wide ? BER_WIDE_HEADER_BYTE_LENGTH : BER_HEADER_BYTE_LENGTH;
+    const size_t max_length = wide ? UINT32_MAX : UINT16_MAX;
+
+    // The lengths of the CDO's are written when leaving them, the tree is never modified
+    while (tlv != NULL) {
+        size_t header = *index;
+
+        if (!set_header(tlv, array, index, length, wide)) {
+            return false;
+        }
+        if (tlv->type == TLV_CDO) {
+            if (tlv->flags & TLV_FLAG_LAZY) {
+                size_t cdo_length;
+
+                if (!lazy_to_byte_array(tlv, array, index, length, wide)) {
+                    return false;
+                }
+                if ((cdo_length = *index - header - header_size) > max_length) {
+                    TLV_FAIL(TLV_FAILURE_SIZE, "Error - Too long CDO(%u): %zu", tlv->tag, cdo_length);
+                    return false;
+                }
+                tlv_header_write(&array[header], TLV_CDO, tlv->tag, (tlv_length_t) cdo_length, wide);
+            } else if (tlv->child != NULL) {
+                if (depth == TLV_MAX_DEPTH) {
+                    TLV_FAIL(TLV_FAILURE_DEPTH, "Error - Tlv is deeper than %u levels", TLV_MAX_DEPTH);
+                    return false;
+                }
+                stack[depth].cdo = tlv;
+                stack[depth++].header = header;
+                tlv = tlv->child;
+                continue;
+            }
+        } else { //pdo
+            if (*index + tlv->length > length) {
+                TLV_FAIL(TLV_FAILURE_SIZE, "Error - not enough room for tlv value");
+                return false;
+            }
+            if (tlv->length > 0) {
+                memcpy(&array[*index], tlv->value, tlv->length);
+            }
+            *index += tlv->length;
+        }
+
+        tlv = tlv->next;
+        while (tlv == NULL && depth > 0) {
+            size_t cdo_length = *index - stack[--depth].header - header_size;
+
+            if (cdo_length > max_length) {
+                TLV_FAIL(TLV_FAILURE_SIZE, "Error - Too long CDO(%u): %zu", stack[depth].cdo->tag, cdo_length);
+                return false;
+            }
+            tlv_header_write(&array[stack[depth].header], TLV_CDO, stack[depth].cdo->tag, (tlv_length_t) cdo_length, wide);
+            tlv = stack[depth].cdo->next;
+        }
+    }
+
+    return true;
+}
+
+
+static bool to_iovec(const tlv_t *tlv, struct iovec *iov, size_t *iov_count, uint8_t *scratch, size_t *scratch_size, const bool wide) {
+    struct {
+        const tlv_t *cdo;
+        size_t header;
+        size_t position;
+    } stack[TLV_MAX_DEPTH];
+    size_t depth = 0;
+    const size_t iov_capacity = *iov_count;
+    const size_t scratch_capacity = *scratch_size;
+    size_t count = 0;
+    size_t used = 0;
+    size_t position = 0;
+    bool in_headers = false;
+    const size_t header_size = wide ? BER_WIDE_HEADER_BYTE_LENGTH : BER_HEADER_BYTE_LENGTH;
+    const size_t max_length = wide ? UINT32_MAX : UINT16_MAX;
+
+    // As in to_byte_array the lengths of the CDO's are written into their headers when leaving them
+    while (tlv != NULL) {
+        // A header directly after another header extends its entry
+        if (!in_headers) {
+            if (count < iov_capacity) {
+                iov[count].iov_base = &scratch[used];
+                iov[count].iov_len = 0;
+            }
+            count++;
+            in_headers = true;
+        }
+        size_t header = used;
+        bool fits = used + header_size <= scratch_capacity && count <= iov_capacity;
+        if (fits) {
+            tlv_header_write(&scratch[used], tlv->type, tlv->tag, tlv->type == TLV_PDO ? tlv->length : 0, wide);
+            iov[count - 1].iov_len += header_size;
+        }
+        used += header_size;
+        position += header_size;
+
+        if (tlv->type == TLV_CDO && (tlv->flags & TLV_FLAG_LAZY)) {
+            // The encoding of a lazy CDO is referenced in place like a value, it cannot get other headers
+            if (((tlv->flags & TLV_FLAG_WIDE) != 0) != wide) {
+                TLV_FAIL(TLV_FAILURE_ARGUMENT, "Error - Headers of lazy CDO(%u) differ, materialize it first", tlv->tag);
+                *iov_count = 0;
+                *scratch_size = 0;
+                return false;
+            }
+            if (fits) {
+                tlv_header_write(&scratch[header], TLV_CDO, tlv->tag, tlv->length, wide);
+            }
+            if (count < iov_capacity) {
+                iov[count].iov_base = tlv->value;
+                iov[count].iov_len = tlv->length;
+            }
+            count++;
+            position += tlv->length;
+            in_headers = false;
+        } else if (tlv->type == TLV_CDO) {
+            if (tlv->child != NULL) {
+                if (depth == TLV_MAX_DEPTH) {
+                    TLV_FAIL(TLV_FAILURE_DEPTH, "Error - Tlv is deeper than %u levels", TLV_MAX_DEPTH);
+                    *iov_count = 0;
+                    *scratch_size = 0;
+                    return false;
+                }
+                stack[depth].cdo = tlv;
+                stack[depth].header = fits ? header : SIZE_MAX;
+                stack[depth++].position = position;
+                tlv = tlv->child;
+                continue;
+            }
+        } else if (tlv->length > 0) {
+            if (count < iov_capacity) {
+                iov[count].iov_base = tlv->value;
+                iov[count].iov_len = tlv->length;
+            }
+            count++;
+            position += tlv->length;
+            in_headers = false;
+        }
+
+        tlv = tlv->next;
+        while (tlv == NULL && depth > 0) {
+            size_t cdo_length = position - stack[--depth].position;
+
+            if (cdo_length > max_length) {
+                TLV_FAIL(TLV_FAILURE_SIZE, "Error - Too long CDO(%u): %zu", stack[depth].cdo->tag, cdo_length);
+                *iov_count = 0;
+                *scratch_size = 0;
+                return false;
+            }
+            if (stack[depth].header != SIZE_MAX) {
+                tlv_header_write(&scratch[stack[depth].header], TLV_CDO, stack[depth].cdo->tag, (tlv_length_t) cdo_length, wide);
+            }
+            tlv = stack[depth].cdo->next;
+        }
+    }
+    *iov_count = count;
+    *scratch_size = used;
+
+    return count <= iov_capacity && used <= scratch_capacity;
+}
+
+
+static bool patch_array(tlv_t *tlv, uint8_t *bytes, const size_t size, const bool write) {
+    struct {
+        tlv_t *cdo;
+        size_t end;
+    } stack[TLV_MAX_DEPTH];
+    size_t depth = 0;
+    size_t index = 0;
+    size_t end = size;
+
+    // Only dirty subtrees are compared, clean ones are skipped by the lengths in the encoding
+    while (true) {
+        while (tlv != NULL) {
+            tlv_header_t header;
+
+            if (!tlv_header_read(&bytes[index], end - index, &header) || header.type != tlv->type
+                    || header.length > end - index - header.size
+                    || (!(tlv->flags & TLV_FLAG_DIRTY) && header.tag != tlv->tag)) {
+                TLV_FAIL(TLV_FAILURE_MALFORMED, "Error - Byte array does not match the tlv at %u", (unsigned) index);
+                return false;
+            }
+            if (!(tlv->flags & TLV_FLAG_DIRTY)) {
+                index += header.size + header.length;
+                tlv = tlv->next;
+                continue;
+            }
+            // The encoding of a lazy CDO is patched like a value
+            bool leaf = tlv->type == TLV_PDO || (tlv->flags & TLV_FLAG_LAZY);
+            if (leaf && header.length != tlv->length) {
+                TLV_FAIL(TLV_FAILURE_SIZE, "Error - Size of object(%u) changed, cannot patch", tlv->tag);
+                return false;
+            }
+            if (write) {
+                tlv_header_write(&bytes[index], tlv->type, tlv->tag, header.length, header.size == BER_WIDE_HEADER_BYTE_LENGTH);
+                tlv->flags &= (uint8_t) ~TLV_FLAG_DIRTY;
+            }
+            index += header.size;
+
+            if (leaf) {
+                if (write && tlv->length > 0 && tlv->value != &bytes[index]) {
+                    memcpy(&bytes[index], tlv->value, tlv->length);
+                }
+                index += tlv->length;
+                tlv = tlv->next;
+                continue;
+            }
+            if (depth == TLV_MAX_DEPTH) {
+                TLV_FAIL(TLV_FAILURE_DEPTH, "Error - Tlv is deeper than %u levels", TLV_MAX_DEPTH);
+                return false;
+            }
+            stack[depth].cdo = tlv;
+            stack[depth++].end = end;
+            end = index + header.length;
+            tlv = tlv->child;
+        }
+
+        if (index != end) {
+            TLV_FAIL(TLV_FAILURE_SIZE, "Error - Size of the tlv changed, cannot patch at %u", (unsigned) index);
+            return false;
+        }
+        if (depth == 0) {
+            break;
+        }
+        depth--;
+        end = stack[depth].end;
+        tlv = stack[depth].cdo->next;
+    }
+
+    return true;
+}
+
+
+static bool array_to_tlv(decode_ctx_t *ctx, tlv_t **tlv, const uint8_t *bytes, const size_t length) {
+    struct {
+        tlv_t *cdo;
+        size_t end;
+    } stack[TLV_MAX_DEPTH];
+    size_t depth = 0;
+    size_t index = 0;
+    size_t end = length;
+    tlv_t **link = tlv;
+
+    *tlv = NULL;
+
+    // Every object is linked in as soon as it is created, so the tree can be deleted on failure
+    while (true) {
+        while (index < end) {
+            tlv_header_t header;
+            tlv_t *object;
+
+            if (!tlv_header_read(&bytes[index], end - index, &header)) {
+                TLV_FAIL(TLV_FAILURE_MALFORMED, "ERROR - Failed to deserialize, wrong header at %u", (unsigned) index);
+                return false;
+            }
+            tlv_length_t value_length = header.length;
+            index += header.size;
+            if (value_length > end - index) {
+                TLV_FAIL(TLV_FAILURE_MALFORMED, "ERROR - Failed to deserialize, value length(%u) exceeds the array", value_length);
+                return false;
+            }
+
+            if (ctx->objects != NULL) {
+                object = tlv_reset(ctx->objects++);
+                TLV_COUNT(nodes_allocated, 1);
+                object->flags = (ctx->arena != NULL ? TLV_FLAG_ARENA : TLV_FLAG_IN_BLOCK) | TLV_FLAG_BORROWED;
+            } else if ((object = tlv_new(ctx->arena)) == NULL) {
+                tlv_debug_cb("FATAL - Out of memory when allocating tlv");
+                return false;
+            }
+            *link = object;
+            object->tag = header.tag;
+            object->type = header.type;
+            object->length = value_length;
+            object->level = (tlv_level_t) depth;
+            object->parent = depth > 0 ? stack[depth - 1].cdo : NULL;
+            if (object->type == TLV_CDO && header.size == BER_HEADER_BYTE_LENGTH) {
+                object->flags |= TLV_FLAG_SIZED;
+            }
+
+            if (object->type == TLV_PDO) {
+                if (ctx->flags & TLV_DECODE_BORROW) {
+                    object->value = (uint8_t*) &bytes[index];
+                    object->flags |= TLV_FLAG_BORROWED;
+                } else if (ctx->values != NULL) {
+                    object->value = ctx->values;
+                    ctx->values += value_length;
+                    memcpy(object->value, &bytes[index], value_length);
+                } else {
+                    object->value = value_new(ctx->arena, value_length);
+                    if (object->value == NULL) {
+                        TLV_FAIL(TLV_FAILURE_MEMORY, "FATAL - Out of memory when allocating tlv->value");
+                        return false;
+                    }
+                    memcpy(object->value, &bytes[index], value_length);
+                }
+                index += value_length;
+            } else if (value_length > 0 && (ctx->flags & TLV_DECODE_LAZY)) {
+                object->value = (uint8_t*) &bytes[index];
+                object->flags |= TLV_FLAG_LAZY | TLV_FLAG_BORROWED;
+                if (header.size == BER_WIDE_HEADER_BYTE_LENGTH) {
+                    object->flags |= TLV_FLAG_WIDE;
+                }
+                index += value_length;
+            } else if (value_length > 0) {
+                if (depth == TLV_MAX_DEPTH) {
+                    TLV_FAIL(TLV_FAILURE_DEPTH, "ERROR - Failed to deserialize, deeper than %u levels", TLV_MAX_DEPTH);
+                    return false;
+                }
+                stack[depth].cdo = object;
+                stack[depth++].end = end;
+                end = index + value_length;
+                link = &object->child;
+                continue;
+            }
+            link = &object->next;
+        }
+
+        if (depth == 0) {
+            break;
+        }
+        depth--;
+        end = stack[depth].end;
+        link = &stack[depth].cdo->next;
+    }
+
+    return true;
+}
+
+
+static void delete_tree(tlv_t *tlv, const bool delete_values) {
+    // Rotates the first child up in place of its parent until there is no child left, then deletes along next
+    while (tlv != NULL) {
+        if (tlv->child != NULL) {
+            tlv_t *child = tlv->child;
+
+            tlv->child = child->next;
+            child->next = tlv;
+            tlv = child;
+        } else {
+            tlv_t *next = tlv->next;
+
+            if (delete_values && tlv->value != NULL && !(tlv->flags & TLV_FLAG_BORROWED)) {
+                free(tlv->value);
+            }
+            tlv->value = NULL;
+            tlv->length = 0;
+            if (!(tlv->flags & (TLV_FLAG_ARENA | TLV_FLAG_IN_BLOCK))) {
+                free(tlv);
+            }
+            tlv = next;
+        }
+    }
+}
+
+
+tlv_t* tlv_decode_array(const uint8_t *barray, const size_t size, tlv_arena_t *arena, const uint32_t flags) {
+    tlv_t *tlv = NULL;
+
+    if ((flags & TLV_DECODE_LAZY) && (arena != NULL || (flags & TLV_DECODE_PREALLOC))) {
+        TLV_FAIL(TLV_FAILURE_ARGUMENT, "Error - Lazy decoding cannot use an arena or preallocation");
+        return NULL;
+    }
+    if (barray != NULL && size >= BER_HEADER_BYTE_LENGTH) {
+        // Lazy CDO's point into the byte array anyway, so the values are borrowed too
+        decode_ctx_t ctx = {arena, (flags & TLV_DECODE_LAZY) ? flags | TLV_DECODE_BORROW : flags, NULL, NULL};
+        void *block = NULL;
+        if (flags & TLV_DECODE_PREALLOC) {
+            tlv_stats_t stats;
+
+            if (!validate_array(barray, size, &stats)) {
+                tlv_debug_cb("ERROR - Converting to tlv failed, malformed array");
+                return NULL;
+            }
+            size_t values_size = (flags & TLV_DECODE_BORROW) ? 0 : stats.value_bytes;
+            size_t block_size = stats.objects * sizeof (tlv_t) + values_size;
+            block = arena != NULL ? tlv_arena_alloc(arena, block_size) : malloc(block_size);
+            if (block == NULL) {
+                TLV_FAIL(TLV_FAILURE_MEMORY, "FATAL - Out of memory when allocating %u bytes for tlv", (unsigned) block_size);
+                return NULL;
+            }
+            ctx.objects = (tlv_t*) block;
+            ctx.values = (uint8_t*) block + stats.objects * sizeof (tlv_t);
+        }
+        if (!array_to_tlv(&ctx, &tlv, barray, size)) {
+            tlv_debug_cb("ERROR - Converting to tlv failed");
+            tlv_delete_all(&tlv);
+            if (arena == NULL) {
+                free(block);
+            }
+            return NULL;
+        }
+        // The root is the first object of the block, deleting it releases the whole block
+        if (block != NULL && arena == NULL) {
+            tlv->flags |= TLV_FLAG_BLOCK;
+        }
+    }
+
+    return tlv;
+}
+
+
+static bool validate_array(const uint8_t *barray, const size_t size, tlv_stats_t *stats) {
+    size_t stack[TLV_MAX_DEPTH];
+    size_t depth = 0;
+    size_t index = 0;
+    size_t end = size;
+    tlv_stats_t counted = {0, 0, 0};
+
+    if (barray == NULL || size < BER_HEADER_BYTE_LENGTH) {
+        TLV_FAIL(TLV_FAILURE_MALFORMED, "Error - Array is null or too short to validate");
+        return false;
+    }
+
+    while (true) {
+        while (index < end) {
+            tlv_header_t header;
+
+            if (!tlv_header_read(&barray[index], end - index, &header)) {
+                TLV_FAIL(TLV_FAILURE_MALFORMED, "Error - Wrong header at %u", (unsigned) index);
+                return false;
+            }
+            index += header.size;
+            if (header.length > end - index) {
+                TLV_FAIL(TLV_FAILURE_MALFORMED, "Error - Length(%u) at %u exceeds the enclosing object", header.length, (unsigned) index);
+                return false;
+            }
+            counted.objects++;
+            if (depth + 1 > counted.depth) {
+                counted.depth = depth + 1;
+            }
+
+            if (header.type == TLV_PDO) {
+                counted.value_bytes += header.length;
+                index += header.length;
+            } else if (header.length > 0) {
+                if (depth == TLV_MAX_DEPTH) {
+                    TLV_FAIL(TLV_FAILURE_DEPTH, "Error - Array is deeper than %u levels", TLV_MAX_DEPTH);
+                    return false;
+                }
+                stack[depth++] = end;
+                end = index + header.length;
+            }
+        }
+
+        if (depth == 0) {
+            break;
+        }
+        end = stack[--depth];
+    }
+    if (stats != NULL) {
+        *stats = counted;
+    }
+
+    return true;
+}
+
+
+static bool encode_array(const tlv_t *tlv, uint8_t **barray, size_t *size) {
+    size_t length = 0;
+    bool wide;
+    if (barray != NULL && size != NULL) {
+        if (get_total_length(tlv, &length, &wide)) {
+            uint8_t *array = malloc(length);
+
+            if (array != NULL) {
+                size_t index = 0;
+                if (!to_byte_array(tlv, array, &index, length, wide)) {
+                    free(array);
+                    return false;
+                }
+                // Values and lengths changed without the setters leave the cached CDO lengths stale
+                if (index != length) {
+                    TLV_FAIL(TLV_FAILURE_ARGUMENT, "Error - Encoded %zu bytes instead of %zu, a value was changed without tlv_set_value", index, length);
+                    free(array);
+                    return false;
+                }
+                *barray = array;
+                *size = length;
+                return true;
+            }
+            TLV_FAIL(TLV_FAILURE_MEMORY, "Fatal - Failed to allocate memory for array");
+            return false;
+        }
+        tlv_debug_cb("Error - Failed to get size of the object");
+        return false;
+    }
+
+    return false;
+}
+
+
+static bool encode_buffer(const tlv_t *tlv, uint8_t *buffer, const size_t capacity, size_t *size) {
+    size_t length = 0;
+    size_t index = 0;
+    bool wide;
+
+    if (size == NULL) {
+        return false;
+    }
+    *size = 0;
+    if (!get_total_length(tlv, &length, &wide)) {
+        tlv_debug_cb("Error - Failed to get size of the object");
+        return false;
+    }
+    *size = length;
+    if (buffer == NULL || length > capacity) {
+        return false;
+    }
+    if (!to_byte_array(tlv, buffer, &index, length, wide)) {
+        *size = 0;
+        return false;
+    }
+    if (index != length) {
+        TLV_FAIL(TLV_FAILURE_ARGUMENT, "Error - Encoded %zu bytes instead of %zu, a value was changed without tlv_set_value", index, length);
+        *size = 0;
+        return false;
     }
-    if (tlv->next != NULL) {
-        size_t len = strlen(str);
-        return to_string(tlv->next, &str[len], size - len, level);
-    }
 
     return true;
 }
 
 
-static tlv_tag_t array_to_tlv_tag(uint8_t *array) {
-    return (array[0] << 8 | array[1]);
+static bool encode_iovec(const tlv_t *tlv, struct iovec *iov, size_t *iov_count, uint8_t *scratch, size_t *scratch_size, size_t *length) {
+    bool wide;
+
+    if (iov_count == NULL || scratch_size == NULL) {
+        return false;
+    }
+    if (!get_total_length(tlv, length, &wide)) {
+        tlv_debug_cb("Error - Failed to get size of the object");
+        *iov_count = 0;
+        *scratch_size = 0;
+        return false;
+    }
+    if (iov == NULL || scratch == NULL) {
+        *iov_count = 0;
+        *scratch_size = 0;
+    }
+
+    return to_iovec(tlv, iov, iov_count, scratch, scratch_size, wide);
+}
+
+
+static bool patch_byte_array(tlv_t *tlv, uint8_t *barray, const size_t size) {
+    if (tlv == NULL || barray == NULL) {
+        TLV_FAIL(TLV_FAILURE_ARGUMENT, "Error - Tlv or array is null when patching");
+        return false;
+    }
+
+    // Nothing is written unless the whole encoding matches
+    return patch_array(tlv, barray, size, false) && patch_array(tlv, barray, size, true);
+}
+
+
+static const tlv_t* find_by_tag(const tlv_t *tlv, const tlv_tag_t tag) {
+    const tlv_t *stack[TLV_MAX_DEPTH];
+    const tlv_t **pending = stack;
+    const tlv_t *found = NULL;
+    size_t capacity = TLV_MAX_DEPTH;
+    size_t count = 0;
+
+    // An object, then its next chain, then the children of the chain from the last sibling to the first
+    while (tlv != NULL && found == NULL) {
+        for (; tlv != NULL; tlv = tlv->next) {
+            if (tlv->tag == tag) {
+                found = tlv;
+                break;
+            }
+            if (tlv->child == NULL) {
+                continue;
+            }
+            // Every sibling with children waits here, so wide trees outgrow the stack array
+            if (count == capacity) {
+                const tlv_t **grown = malloc(2 * capacity * sizeof (*grown));
+
+                if (grown == NULL) {
+                    TLV_FAIL(TLV_FAILURE_MEMORY, "Fatal - Out of memory when searching tlv");
+                    count = 0;
+                    tlv = NULL;
+                    break;
+                }
+                memcpy(grown, pending, count * sizeof (*grown));
+                if (pending != stack) {
+                    free(pending);
+                }
+                pending = grown;
+                capacity *= 2;
+            }
+            pending[count++] = tlv;
+        }
+        if (found == NULL && count > 0) {
+            tlv = pending[--count]->child;
+        }
+    }
+    if (pending != stack) {
+        free(pending);
+    }
+
+    return found;
 }
 
 
-static tlv_length_t array_to_tlv_length(uint8_t *array) {
-    return (array[0] << 8 | array[1]);
+static const char* string_new(const tlv_t *tlv) {
+    string_buffer_t buffer = {NULL, 0, 0};
+
+    if (tlv == NULL) {
+        TLV_FAIL(TLV_FAILURE_ARGUMENT, "Error - Tlv is null when trying to convert it to string");
+        return NULL;
+    }
+    // The text is the one of the tree dump, the null character is written as a last chunk
+    if (!tlv_dump(tlv, TLV_DUMP_TREE, string_write, &buffer) || !string_write(&buffer, "", 1)) {
+        tlv_debug_cb("Error - Failed to convert tlv to string");
+        free(buffer.str);
+        return NULL;
+    }
+
+    return buffer.str;
+}
+
+
+static bool string_write(void *arg, const char *data, const size_t size) {
+    string_buffer_t *buffer = arg;
+
+    if (buffer->capacity - buffer->length < size) {
+        size_t capacity = buffer->capacity > 0 ? buffer->capacity : TLV_DUMP_CHUNK_SIZE;
+        char *str;
+
+        while (capacity - buffer->length < size) {
+            capacity *= 2;
+        }
+        if ((str = realloc(buffer->str, capacity)) == NULL) {
+            TLV_FAIL(TLV_FAILURE_MEMORY, "Fatal - Failed to allocate memory for string");
+            return false;
+        }
+        buffer->str = str;
+        buffer->capacity = capacity;
+    }
+    memcpy(&buffer->str[buffer->length], data, size);
+    buffer->length += size;
+
+    return true;
 }
@@ -18,8 +18,10 @@
  */
 
 #include <stdlib.h>
+#include <stdarg.h>
 #include <inttypes.h>
 #include <stdbool.h>
+#include <sys/uio.h>
 
 
 #ifdef __cplusplus
@@ -38,6 +40,11 @@ extern "C" {
     //      - bytes 2-3 holds the TAG of the TLV, it is an uint16_t
     //      - bytes 4-5 holds the LENGTH of the TLV
     //
+    // Wide header of a TLV object, used when a length does not fit in 16 bits:
+    //      - byte 1 holds the TYPE, 0xFB or 0xBB for CDO/PDO
+    //      - bytes 2-3 holds the TAG of the TLV
+    //      - bytes 4-7 holds the LENGTH of the TLV, it is an uint32_t
+    //
     // Structure:
     //   Example 1:
     //   |cdo+10|-[]                - root CDO
@@ -54,15 +61,28 @@ extern "C" {
     //
     // TLV structures starts always with a CDO, the root
     // CDO's contains only other CDO's and PDO's, no data(value)
-    // The total length of a TLV structure, inclusive the length of value cannot be greater then 65535 bytes since the length is represented by an uint16_t
+    // The total length of a TLV structure with 5 byte headers, inclusive the length of value cannot be greater then 65535 bytes
+    // since the length is represented by an uint16_t. Larger structures are encoded with wide headers on all objects,
+    // the decoder accepts both kinds of headers.
     //
 
     typedef struct stTLV tlv_t;
+    typedef struct stTLVArena tlv_arena_t;
     typedef uint16_t tlv_tag_t;
-    typedef uint16_t tlv_length_t;
+    typedef uint32_t tlv_length_t;
     typedef uint8_t tlv_type_t;
     typedef uint16_t tlv_level_t;
     static const uint8_t BER_HEADER_BYTE_LENGTH = 5; // 1 byte type, 2 bytes tag(uint16_t) and 2 bytes length(uint16_t)
+    static const uint8_t BER_WIDE_HEADER_BYTE_LENGTH = 7; // 1 byte type, 2 bytes tag(uint16_t) and 4 bytes length(uint32_t)
+
+    //
+    // Maximum nesting depth of CDO's handled by the library.
+    // The tree walks are iterative and keep one entry per open CDO on a fixed size stack, deeper
+    // structures are rejected. Define TLV_MAX_DEPTH when building the library to change the limit.
+    //
+#ifndef TLV_MAX_DEPTH
+#define TLV_MAX_DEPTH 64
+#endif
 
     /**
      * Represents the types of a TLV object
@@ -70,20 +90,60 @@ extern "C" {
     typedef enum {
         TLV_NOT_SET = 0,        /**< @brief Not set */
         TLV_CDO = 0xFA,         /**< @brief CDO - Constructed Data Object, acts as a directory contains other CDO's or PDO's, cannot hold data(value) */
-        TLV_PDO = 0xBA          /**< @brief PDO - Primitive Data Object, can only hold data (value) */
+        TLV_PDO = 0xBA,         /**< @brief PDO - Primitive Data Object, can only hold data (value) */
+        TLV_CDO_WIDE = 0xFB,    /**< @brief Type byte of a CDO with wide header, only used on the wire */
+        TLV_PDO_WIDE = 0xBB     /**< @brief Type byte of a PDO with wide header, only used on the wire */
     } tlv_types_t;
 
+    /**
+     * Represents the ownership flags of a TLV object
+     */
+    typedef enum {
+        TLV_FLAG_NONE = 0x00,       /**< @brief Object and value are owned by the object itself */
+        TLV_FLAG_ARENA = 0x01,      /**< @brief Object is allocated in an arena and released together with the arena */
+        TLV_FLAG_BORROWED = 0x02,   /**< @brief Value is not owned by the object and is never freed by tlv_delete_all */
+        TLV_FLAG_SIZED = 0x04,      /**< @brief Length of the CDO is the exact length of its children, no need to sum them up */
+        TLV_FLAG_DIRTY = 0x08,      /**< @brief Object or one of its children was modified since the last tlv_patch_byte_array */
+        TLV_FLAG_BLOCK = 0x10,      /**< @brief Object starts a block holding the whole decoded tree, freed by tlv_delete_all */
+        TLV_FLAG_LAZY = 0x20,       /**< @brief Children of the CDO are not decoded yet, value and length refer to their encoding */
+        TLV_FLAG_WIDE = 0x40,       /**< @brief Encoding of the children of a lazy CDO uses wide headers */
+        TLV_FLAG_IN_BLOCK = 0x80    /**< @brief Object is allocated in the block of its root (TLV_FLAG_BLOCK) and released with it */
+    } tlv_flags_t;
+
+    /**
+     * Represents the options of decoding a byte array
+     */
+    typedef enum {
+        TLV_DECODE_COPY = 0x00,     /**< @brief PDO values are copied from the byte array */
+        TLV_DECODE_BORROW = 0x01,   /**< @brief PDO values point into the byte array, no value is copied */
+        TLV_DECODE_PREALLOC = 0x02, /**< @brief The array is validated first, then all objects and values are allocated in one block */
+        TLV_DECODE_LAZY = 0x04      /**< @brief Children of CDO's are decoded when accessed, values are borrowed as with TLV_DECODE_BORROW */
+    } tlv_decode_flags_t;
+
+    /**
+     * Statistics of an encoded TLV structure, filled by tlv_validate
+     */
+    typedef struct {
+        size_t objects;         /**< @brief Number of CDO's and PDO's */
+        size_t value_bytes;     /**< @brief Sum of the lengths of the PDO values */
+        size_t depth;           /**< @brief Number of levels, 1 if there is no CDO with children */
+    } tlv_stats_t;
+
     /**
      * Struct representing a TLV object
+     * Value and length must only be changed through tlv_set_value and tlv_update_length, never directly.
+     * The encoders rely on the cached CDO lengths and fail if a direct change left them stale.
      */
     struct stTLV {
         tlv_t *next;            /**< @brief Pointer to a "next" TLV object */
         tlv_t *child;           /**< @brief Pointer to a "child" TLV object */
+        tlv_t *parent;          /**< @brief Pointer to the parent CDO or NULL for the root */
         uint8_t *value;         /**< @brief Pointer to value, used only in PDO's */
+        tlv_length_t length;    /**< @brief Length of data in PDO's, total length of childs with 5 byte headers for CDO's */
         tlv_tag_t tag;          /**< @brief Tag of the TLV */
-        tlv_length_t length;    /**< @brief Length of data in PDO's, total length of childs for CDO's */
-        tlv_type_t type;        /**< @brief Type of the TLV (CDO/PDO) */
         tlv_level_t level;      /**< @brief Level, used when (debug) printing the TLV */
+        tlv_type_t type;        /**< @brief Type of the TLV (CDO/PDO) */
+        uint8_t flags;          /**< @brief Ownership flags of the TLV, see tlv_flags_t */
     };
 
 
@@ -107,6 +167,7 @@ extern "C" {
 
     /**
      * @brief Appends a TLV object to the end of "next" chain
+     * The chain is walked to its end, use a tlv_builder_t to build long chains
      * @param[in] tlv Tlv object to append the next element on
      * @param[in] next Tlv object to append
      * @return Pointer to "next" or NULL if "next" or "tlv" is null
@@ -123,8 +184,71 @@ extern "C" {
     tlv_t* tlv_append_child(tlv_t *tlv, tlv_t *child);
 
 
+    /**
+     * @brief Sets the tag of a TLV object
+     * @param[in] tlv Tlv object to modify
+     * @param[in] tag The new tag
+     * @return True if successful, false otherwise
+     */
+    bool tlv_set_tag(tlv_t *tlv, const tlv_tag_t tag);
+
+
+    /**
+     * @brief Replaces the value of a PDO
+     * The value is taken over as in tlv_new_pdo, the old value is freed unless it is borrowed.
+     * Use tlv_arena_set_value for objects allocated in an arena. Objects in a block decoded with
+     * TLV_DECODE_PREALLOC without an arena take over values like any other object.
+     * @param[in] tlv PDO to modify
+     * @param[in] length The length of the data
+     * @param[in] value Pointer to data to set
+     * @return True if successful, false otherwise
+     */
+    bool tlv_set_value(tlv_t *tlv, const tlv_length_t length, uint8_t *value);
+
+
+    /**
+     * @brief Sums up and caches the lengths of all CDO's in a tlv object
+     * The lengths stay cached (TLV_FLAG_SIZED) until the children change, so encoding a tree
+     * which was modified through the setters only sums up the CDO's on the modified paths.
+     * Decoded and built trees are already sized.
+     * @param[in] tlv Tlv object to size
+     * @param[out] size Encoded size of the tlv object, may be NULL
+     * @return True if successful, false otherwise
+     */
+    bool tlv_update_length(tlv_t *tlv, size_t *size);
+
+
+    /**
+     * @brief Decodes the children of a lazy CDO
+     * Only one level is decoded, the CDO's among the children stay lazy. Nothing is done for other objects.
+     * @param[in] tlv Tlv object to decode the children of
+     * @return True if successful or the object is not lazy, false if the children are malformed
+     */
+    bool tlv_materialize(tlv_t *tlv);
+
+
+    /**
+     * @brief Returns the first child of a CDO, decoding the children of a lazy CDO first
+     * @param[in] tlv CDO to get the child of
+     * @return The first child or NULL if there is none or decoding failed
+     */
+    tlv_t* tlv_get_child(tlv_t *tlv);
+
+
+    /**
+     * @brief Finds a direct child of a CDO with the specified tag, decoding the children of a lazy CDO first
+     * @param[in] tlv CDO to search in
+     * @param[in] tag Tag of the child to search for
+     * @return The first child with the tag or NULL if not found
+     */
+    tlv_t* tlv_find_child(tlv_t *tlv, const tlv_tag_t tag);
+
+
     /**
      * @brief Finds a tlv object with the specified tag
+     * The object and its next chain are searched first, then the children of the chain from the last sibling
+     * to the first, each in the same order.
+     * Children of lazy CDO's are not searched, see tlv_find_child.
      * @param[in] tlv The tlv object to search recursively
      * @param[in] tag Tag of the tlv to search for
      * @return The requested tlv object or NULL if not found 
@@ -135,6 +259,8 @@ extern "C" {
     /**
      * @brief Deletes a tlv object recursively
      * The function deletes the allocated resources for the tlv objects but not for the values
+     * Objects allocated in an arena are not freed, they are released with the arena
+     * A tree decoded with TLV_DECODE_PREALLOC is freed as one block, its values inclusive
      * @param[in] tlv Tlv object to delete
      */
     void tlv_delete(tlv_t **tlv);
@@ -143,6 +269,7 @@ extern "C" {
     /**
      * @brief Deletes a tlv object recursively
      * Also deletes the value, child and next struct recursively
+     * Objects allocated in an arena and borrowed values are not freed
      * @param[in] tlv Tlv object to delete
      */
     void tlv_delete_all(tlv_t **tlv);
@@ -158,6 +285,48 @@ extern "C" {
     bool tlv_to_byte_array(const tlv_t *tlv, uint8_t **barray, size_t *size);
 
 
+    /**
+     * @brief Converts a tlv object into a caller supplied buffer
+     * Call it with a NULL buffer to get the needed size.
+     * @param[in] tlv Tlv object to convert
+     * @param[out] buffer Buffer to write the bytes to or NULL
+     * @param[in] capacity Size of the buffer
+     * @param[out] size Number of bytes written, or the needed size if the buffer is too small, 0 on error
+     * @return True if successful, false if the buffer is too small or the conversion failed
+     */
+    bool tlv_to_buffer(const tlv_t *tlv, uint8_t *buffer, const size_t capacity, size_t *size);
+
+
+    /**
+     * @brief Converts a tlv object to an iovec array to be written with writev
+     * The headers are written into the scratch buffer, the values of the PDO's are referenced in place,
+     * so the tree and the scratch buffer must stay unchanged until the iovec array is written.
+     * Headers following each other share one iovec entry. Every object needs BER_WIDE_HEADER_BYTE_LENGTH
+     * bytes of scratch at most, and at most two iovec entries. A lazy CDO whose encoding has other headers
+     * than the tlv object must be materialized first.
+     * @param[in] tlv Tlv object to convert
+     * @param[out] iov Array of iovec entries to fill
+     * @param[in,out] iov_count Capacity of iov, on return the number of entries used or needed
+     * @param[out] scratch Buffer for the headers
+     * @param[in,out] scratch_size Capacity of scratch, on return the number of bytes used or needed
+     * @return True if successful, false if iov or scratch is too small or the conversion failed
+     */
+    bool tlv_to_iovec(const tlv_t *tlv, struct iovec *iov, size_t *iov_count, uint8_t *scratch, size_t *scratch_size);
+
+
+    /**
+     * @brief Rewrites the modified objects of a tlv object in its existing encoding
+     * Only the headers and values of the objects modified through the setters (TLV_FLAG_DIRTY) are
+     * written, unmodified subtrees are skipped. Nothing is written if the encoded size of a modified
+     * object changed, then the tlv object must be encoded again. The dirty flags are cleared on success.
+     * @param[in] tlv Tlv object which was encoded into barray
+     * @param[in,out] barray Encoded tlv object to patch
+     * @param[in] size Size of the encoded tlv object
+     * @return True if successful, false if the sizes differ or barray does not match the tlv object
+     */
+    bool tlv_patch_byte_array(tlv_t *tlv, uint8_t *barray, const size_t size);
+
+
     /**
      * @brief Converts a byte array to a TLV object
      * @param[in] barray Byte array to convert
@@ -167,9 +336,43 @@ extern "C" {
     tlv_t* tlv_from_byte_array(const uint8_t *barray, const size_t size);
 
 
+    /**
+     * @brief Converts a byte array to a TLV object with decode options
+     * With TLV_DECODE_BORROW the values of the PDO's point straight into barray and are flagged as
+     * TLV_FLAG_BORROWED, so barray must outlive the tree and the values must not be modified.
+     * tlv_delete_all never frees borrowed values.
+     * With TLV_DECODE_PREALLOC the objects and values are allocated in one block, sized by tlv_validate.
+     * The block is freed by tlv_delete_all on the root, or allocated in the arena if there is one.
+     * Values set later by tlv_set_value are owned by their objects and freed with them, not with the block.
+     * With TLV_DECODE_LAZY only the top level is decoded, the children of every CDO are decoded on first access
+     * through tlv_get_child, tlv_find_child or tlv_materialize. barray must outlive the tree, an untouched lazy
+     * CDO is encoded again by copying its bytes. Lazy decoding cannot be combined with an arena or TLV_DECODE_PREALLOC.
+     * @param[in] barray Byte array to convert
+     * @param[in] size The size of the byte array
+     * @param[in] arena Arena to allocate the objects in or NULL to use malloc
+     * @param[in] flags Decode options, see tlv_decode_flags_t
+     * @return TLV object converted from the byte array or NULL if conversion failed
+     */
+    tlv_t* tlv_from_byte_array_ex(const uint8_t *barray, const size_t size, tlv_arena_t *arena, const uint32_t flags);
+
+
+    /**
+     * @brief Checks that a byte array holds a well formed TLV structure
+     * The array is scanned once without allocating. The type bytes are checked, every object must fit
+     * in its CDO and the objects must fill the array exactly.
+     * @param[in] barray Byte array to check
+     * @param[in] size The size of the byte array
+     * @param[out] stats Return point of the statistics of the structure, may be NULL
+     * @return True if the byte array is well formed, false otherwise
+     */
+    bool tlv_validate(const uint8_t *barray, const size_t size, tlv_stats_t *stats);
+
+
     /**
      * Returns the string representation of the tlv object
      * Note: the returned string is dynamically allocated and must be released (free) after use
+     * The text is the TLV_DUMP_TREE format of tlv_dump, see tlv_dump.h, which streams it in chunks
+     * without building the whole string. The children of lazy CDO's are printed from their encoding.
      * 
      * @param[in] tlv Tlv object to "stringify"
      * @return The string or null
@@ -178,7 +381,102 @@ extern "C" {
 
 
     /**
-     * Callback function for debug information
+     * @brief Creates a new arena
+     * An arena allocates TLV objects and values in large blocks, all of them are released at once
+     * by tlv_arena_reset() or tlv_arena_delete(). An arena is not thread safe, use one arena per thread
+     * and reset it between the messages to reuse the already allocated blocks.
+     * @param[in] block_size Size of the blocks in bytes, 0 for default size
+     * @return The arena or NULL
+     */
+    tlv_arena_t* tlv_arena_new(const size_t block_size);
+
+
+    /**
+     * @brief Releases all objects allocated in the arena
+     * The blocks are kept for reuse, all trees allocated in the arena are invalid after the call
+     * @param[in] arena Arena to reset
+     */
+    void tlv_arena_reset(tlv_arena_t *arena);
+
+
+    /**
+     * @brief Deletes an arena and all objects allocated in it
+     * @param[in] arena Arena to delete
+     */
+    void tlv_arena_delete(tlv_arena_t **arena);
+
+
+    /**
+     * @brief Allocates memory in an arena
+     * The memory is aligned for any TLV object and is released together with the arena
+     * @param[in] arena Arena to allocate in
+     * @param[in] size Number of bytes to allocate
+     * @return Pointer to the memory or NULL
+     */
+    void* tlv_arena_alloc(tlv_arena_t *arena, const size_t size);
+
+
+    /**
+     * @brief Creates a new TLV object of CDO type in an arena
+     * @param[in] arena Arena to allocate the object in
+     * @param[in] tag The tag of the tlv object
+     * @return The tlv object or NULL
+     */
+    tlv_t* tlv_arena_new_cdo(tlv_arena_t *arena, const tlv_tag_t tag);
+
+
+    /**
+     * @brief Creates a new TLV object of PDO type in an arena
+     * The value is copied into the arena, if value is NULL the allocated value is left uninitialized
+     * @param[in] arena Arena to allocate the object and the value in
+     * @param[in] tag The tag of the object
+     * @param[in] length The length of the data
+     * @param[in] value Pointer to data to copy or NULL
+     * @return The tlv object or NULL
+     */
+    tlv_t* tlv_arena_new_pdo(tlv_arena_t *arena, const tlv_tag_t tag, const tlv_length_t length, const uint8_t *value);
+
+
+    /**
+     * @brief Replaces the value of a PDO with a copy allocated in an arena
+     * @param[in] arena Arena to allocate the value in
+     * @param[in] tlv PDO to modify
+     * @param[in] length The length of the data
+     * @param[in] value Pointer to data to copy
+     * @return True if successful, false otherwise
+     */
+    bool tlv_arena_set_value(tlv_arena_t *arena, tlv_t *tlv, const tlv_length_t length, const uint8_t *value);
+
+
+    /**
+     * @brief Converts a byte array to a TLV object allocated in an arena
+     * The returned tree must not be deleted, it is released by resetting or deleting the arena
+     * @param[in] arena Arena to allocate the objects and values in
+     * @param[in] barray Byte array to convert
+     * @param[in] size The size of the byte array
+     * @return TLV object converted from the byte array or NULL if conversion failed
+     */
+    tlv_t* tlv_arena_from_byte_array(tlv_arena_t *arena, const uint8_t *barray, const size_t size);
+
+
+    /**
+     * Receiver of the debug information, txt is a printf format without line end
+     */
+    typedef void (*tlv_debug_sink_t)(const char *txt, va_list args);
+
+
+    /**
+     * @brief Installs the receiver of the debug information
+     * Without a sink the library writes nothing to stdout or stderr, for example
+     * install a sink calling vfprintf(stderr, txt, args) to print the errors.
+     * Install it before the library is used from several threads
+     * @param[in] sink Receiver of the debug information or NULL to drop it
+     */
+    void tlv_set_debug_sink(tlv_debug_sink_t sink);
+
+
+    /**
+     * Callback function for debug information, passes the text to the installed sink
      * Note: This function is defined with the weak attribute, hence override is possible
      * 
      * @param[in] txt Debug text
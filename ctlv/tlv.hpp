@@ -0,0 +1,460 @@
+#ifndef TLV_HPP_2016
+#define TLV_HPP_2016
+
+/**
+ * File:   tlv.hpp
+ *
+ * @brief C++17 wrapper of the ctlv library, header only
+ * tlv::tree owns a tree and deletes it with tlv_delete_all when it goes out of scope, it can be moved
+ * but not copied. tlv::node is a non-owning view of one object, as cheap to copy as a pointer.
+ * Values are returned as spans pointing into the tree, nothing is copied when reading.
+ *
+ * Every value in a tlv::tree is either owned by its object or flagged as borrowed, so the tree never
+ * needs tlv_delete and never frees a value it does not own. Trees allocated in an arena are released
+ * with the arena, wrap their roots in a tlv::node instead of a tlv::tree.
+ *
+ * All members are inline calls of the C functions, failures return empty nodes and trees or false
+ * as the C functions do. Only to_string can throw, std::bad_alloc when the std::string can not be
+ * allocated, all other members are noexcept and encode into a vector returns false if the vector can
+ * not grow. An empty node is safe to use, its tag is 0, its value is an empty span and its relatives
+ * and ranges are empty.
+ *
+ * Usage:
+ *   tlv::tree tree = tlv::tree::decode(tlv::span<const uint8_t>(bytes, size));
+ *   for (tlv::node child : tree.root().children()) {
+ *       tlv::span<const uint8_t> value = child.value();
+ *   }
+ *   std::vector<uint8_t> out;
+ *   tree.encode(out);
+ */
+
+#include "tlv.h"
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if __cplusplus > 201703L && __has_include(<span>)
+#include <span>
+#endif
+
+namespace tlv {
+
+#if __cplusplus > 201703L && __has_include(<span>)
+    template <typename T> using span = std::span<T>;
+#else
+
+    /**
+     * Minimal replacement of std::span for C++17, a pointer and a size
+     */
+    template <typename T>
+    class span {
+    public:
+        using element_type = T;
+        using value_type = std::remove_cv_t<T>;
+        using size_type = std::size_t;
+        using iterator = T*;
+
+        constexpr span() noexcept = default;
+
+        constexpr span(T *data, size_type size) noexcept : data_(data), size_(size) {
+        }
+
+        template <typename Container, typename = decltype(std::declval<Container&>().data())>
+        constexpr span(Container &container) noexcept : data_(container.data()), size_(container.size()) {
+        }
+
+        constexpr T* data() const noexcept {
+            return data_;
+        }
+
+        constexpr size_type size() const noexcept {
+            return size_;
+        }
+
+        constexpr bool empty() const noexcept {
+            return size_ == 0;
+        }
+
+        constexpr T& operator[](size_type index) const noexcept {
+            return data_[index];
+        }
+
+        constexpr iterator begin() const noexcept {
+            return data_;
+        }
+
+        constexpr iterator end() const noexcept {
+            return data_ + size_;
+        }
+
+    private:
+        T *data_ = nullptr;
+        size_type size_ = 0;
+    };
+#endif
+
+    class node_range;
+
+
+    /**
+     * Non-owning view of a TLV object, empty if it refers to no object
+     */
+    class node {
+    public:
+        constexpr node() noexcept = default;
+
+        constexpr explicit node(tlv_t *tlv) noexcept : tlv_(tlv) {
+        }
+
+        constexpr explicit operator bool() const noexcept {
+            return tlv_ != nullptr;
+        }
+
+        /**
+         * @brief Returns the C object to use with the functions of tlv.h
+         */
+        constexpr tlv_t* get() const noexcept {
+            return tlv_;
+        }
+
+        tlv_tag_t tag() const noexcept {
+            return tlv_ != nullptr ? tlv_->tag : 0;
+        }
+
+        bool is_cdo() const noexcept {
+            return tlv_ != nullptr && tlv_->type == TLV_CDO;
+        }
+
+        bool is_pdo() const noexcept {
+            return tlv_ != nullptr && tlv_->type == TLV_PDO;
+        }
+
+        /**
+         * @brief Returns the value of a PDO in place, empty for CDO's
+         */
+        span<const uint8_t> value() const noexcept {
+            return is_pdo() ? span<const uint8_t>(tlv_->value, tlv_->length) : span<const uint8_t>();
+        }
+
+        node parent() const noexcept {
+            return tlv_ != nullptr ? node(tlv_->parent) : node();
+        }
+
+        node next() const noexcept {
+            return tlv_ != nullptr ? node(tlv_->next) : node();
+        }
+
+        /**
+         * @brief Returns the first child, the children of a lazy CDO are decoded first
+         */
+        node first_child() const noexcept {
+            return node(tlv_get_child(tlv_));
+        }
+
+        /**
+         * @brief Returns the children for a range based for loop
+         */
+        node_range children() const noexcept;
+
+        /**
+         * @brief Returns the next siblings for a range based for loop, the node itself is not included
+         */
+        node_range siblings() const noexcept;
+
+        /**
+         * @brief Finds a direct child with a tag, see tlv_find_child
+         */
+        node child(const tlv_tag_t tag) const noexcept {
+            return node(tlv_find_child(tlv_, tag));
+        }
+
+        /**
+         * @brief Finds an object with a tag, see tlv_find_by_tag
+         */
+        node find(const tlv_tag_t tag) const noexcept {
+            return node(const_cast<tlv_t*> (tlv_find_by_tag(tlv_, tag)));
+        }
+
+        bool set_tag(const tlv_tag_t tag) const noexcept {
+            return tlv_set_tag(tlv_, tag);
+        }
+
+        /**
+         * @brief Replaces the value of a PDO with a copy of value
+         */
+        bool set_value(span<const uint8_t> value) const noexcept {
+            uint8_t *copy = copy_value(value);
+
+            if (copy == nullptr && !value.empty()) {
+                return false;
+            }
+            if (!tlv_set_value(tlv_, static_cast<tlv_length_t> (value.size()), copy)) {
+                free(copy);
+                return false;
+            }
+            return true;
+        }
+
+        /**
+         * @brief Appends a new CDO to the children of a CDO
+         * @return The new CDO or an empty node
+         */
+        node append_cdo(const tlv_tag_t tag) const noexcept {
+            return append(tlv_new_cdo(tag));
+        }
+
+        /**
+         * @brief Appends a new PDO holding a copy of value to the children of a CDO
+         * @return The new PDO or an empty node
+         */
+        node append_pdo(const tlv_tag_t tag, span<const uint8_t> value) const noexcept {
+            uint8_t *copy = copy_value(value);
+
+            if (copy == nullptr && !value.empty()) {
+                return node();
+            }
+            tlv_t *pdo = tlv_new_pdo(tag, static_cast<tlv_length_t> (value.size()), copy);
+            if (pdo == nullptr) {
+                free(copy);
+            }
+            return append(pdo);
+        }
+
+        /**
+         * @brief Returns the string representation of the object, its children and its next chain
+         */
+        std::string to_string() const {
+            std::unique_ptr<char, void (*)(void*)> str(const_cast<char*> (tlv_to_string(tlv_)), free);
+
+            return str != nullptr ? std::string(str.get()) : std::string();
+        }
+
+        friend bool operator==(const node &a, const node &b) noexcept {
+            return a.tlv_ == b.tlv_;
+        }
+
+        friend bool operator!=(const node &a, const node &b) noexcept {
+            return a.tlv_ != b.tlv_;
+        }
+
+    private:
+        static uint8_t* copy_value(span<const uint8_t> value) noexcept {
+            uint8_t *copy = value.empty() ? nullptr : static_cast<uint8_t*> (malloc(value.size()));
+
+            if (copy != nullptr) {
+                std::memcpy(copy, value.data(), value.size());
+            }
+            return copy;
+        }
+
+        node append(tlv_t *tlv) const noexcept {
+            if (tlv != nullptr && tlv_append_child(tlv_, tlv) == nullptr) {
+                tlv_delete_all(&tlv);
+            }
+            return node(tlv);
+        }
+
+        tlv_t *tlv_ = nullptr;
+    };
+
+
+    /**
+     * Forward iterator along a next chain
+     */
+    class node_iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = node;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const node*;
+        using reference = const node&;
+
+        constexpr node_iterator() noexcept = default;
+
+        constexpr explicit node_iterator(tlv_t *tlv) noexcept : node_(tlv) {
+        }
+
+        reference operator*() const noexcept {
+            return node_;
+        }
+
+        pointer operator->() const noexcept {
+            return &node_;
+        }
+
+        node_iterator& operator++() noexcept {
+            node_ = node_.next();
+            return *this;
+        }
+
+        node_iterator operator++(int) noexcept {
+            node_iterator previous = *this;
+            ++*this;
+            return previous;
+        }
+
+        friend bool operator==(const node_iterator &a, const node_iterator &b) noexcept {
+            return a.node_ == b.node_;
+        }
+
+        friend bool operator!=(const node_iterator &a, const node_iterator &b) noexcept {
+            return a.node_ != b.node_;
+        }
+
+    private:
+        node node_;
+    };
+
+
+    /**
+     * Range of objects along a next chain
+     */
+    class node_range {
+    public:
+        constexpr explicit node_range(tlv_t *first) noexcept : first_(first) {
+        }
+
+        node_iterator begin() const noexcept {
+            return node_iterator(first_);
+        }
+
+        node_iterator end() const noexcept {
+            return node_iterator();
+        }
+
+        bool empty() const noexcept {
+            return first_ == nullptr;
+        }
+
+    private:
+        tlv_t *first_;
+    };
+
+
+    inline node_range node::children() const noexcept {
+        return node_range(tlv_get_child(tlv_));
+    }
+
+    inline node_range node::siblings() const noexcept {
+        return node_range(tlv_ != nullptr ? tlv_->next : nullptr);
+    }
+
+
+    /**
+     * Owner of a TLV tree, deletes it with tlv_delete_all
+     */
+    class tree {
+    public:
+        tree() noexcept = default;
+
+        /**
+         * @brief Takes over a tree, it must not be allocated in an arena
+         */
+        explicit tree(tlv_t *root) noexcept : root_(root) {
+        }
+
+        ~tree() {
+            tlv_delete_all(&root_);
+        }
+
+        tree(const tree&) = delete;
+        tree& operator=(const tree&) = delete;
+
+        tree(tree &&other) noexcept : root_(other.release()) {
+        }
+
+        tree& operator=(tree &&other) noexcept {
+            reset(other.release());
+            return *this;
+        }
+
+        /**
+         * @brief Creates a tree with an empty root CDO
+         */
+        static tree cdo(const tlv_tag_t tag) noexcept {
+            return tree(tlv_new_cdo(tag));
+        }
+
+        /**
+         * @brief Converts a byte array to a tree, see tlv_from_byte_array_ex
+         * With TLV_DECODE_BORROW or TLV_DECODE_LAZY bytes must outlive the tree
+         * @return The tree, empty if conversion failed
+         */
+        static tree decode(span<const uint8_t> bytes, const uint32_t flags = TLV_DECODE_COPY) noexcept {
+            return tree(tlv_from_byte_array_ex(bytes.data(), bytes.size(), nullptr, flags));
+        }
+
+        explicit operator bool() const noexcept {
+            return root_ != nullptr;
+        }
+
+        node root() const noexcept {
+            return node(root_);
+        }
+
+        tlv_t* get() const noexcept {
+            return root_;
+        }
+
+        /**
+         * @brief Gives up the ownership of the tree
+         */
+        tlv_t* release() noexcept {
+            return std::exchange(root_, nullptr);
+        }
+
+        /**
+         * @brief Deletes the tree and takes over another one
+         */
+        void reset(tlv_t *root = nullptr) noexcept {
+            tlv_t *old = std::exchange(root_, root);
+            tlv_delete_all(&old);
+        }
+
+        /**
+         * @brief Converts the tree into a caller supplied buffer, see tlv_to_buffer
+         */
+        bool encode(uint8_t *buffer, const size_t capacity, size_t &size) const noexcept {
+            return tlv_to_buffer(root_, buffer, capacity, &size);
+        }
+
+        /**
+         * @brief Appends the encoding of the tree to a vector, which is grown once
+         */
+        bool encode(std::vector<uint8_t> &out) const noexcept {
+            size_t size = 0;
+            size_t offset = out.size();
+
+            tlv_to_buffer(root_, nullptr, 0, &size);
+            if (size == 0) {
+                return false;
+            }
+            try {
+                out.resize(offset + size);
+            } catch (...) {
+                return false;
+            }
+            if (!tlv_to_buffer(root_, out.data() + offset, size, &size)) {
+                out.resize(offset);
+                return false;
+            }
+            return true;
+        }
+
+        std::string to_string() const {
+            return root().to_string();
+        }
+
+    private:
+        tlv_t *root_ = nullptr;
+    };
+
+} // namespace tlv
+
+#endif /* TLV_HPP_2016 */
@@ -0,0 +1,86 @@
+#include "tlv_batch.h"
+#include "tlv_private.h"
+#include <string.h>
+
+
+/********** PUBLIC DEFINITIONS ************************************************/
+size_t tlv_batch_decode(const tlv_batch_input_t *inputs, const size_t count, tlv_arena_t *arena, const uint32_t flags, tlv_t **trees) {
+    size_t decoded = 0;
+
+    if (inputs == NULL || trees == NULL) {
+        return 0;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        trees[i] = tlv_from_byte_array_ex(inputs[i].bytes, inputs[i].size, arena, flags);
+        if (trees[i] == NULL) {
+            tlv_debug_cb("Error - Failed to convert message %zu of the batch", i);
+            continue;
+        }
+        decoded++;
+    }
+
+    return decoded;
+}
+
+
+size_t tlv_batch_decode_flat(const tlv_batch_input_t *inputs, const size_t count, tlv_arena_t *arena, tlv_flat_t *flats) {
+    size_t decoded = 0;
+
+    if (inputs == NULL || arena == NULL || flats == NULL) {
+        return 0;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        tlv_flat_node_t *nodes;
+        tlv_stats_t stats;
+
+        memset(&flats[i], 0, sizeof (flats[i]));
+        if (!tlv_validate(inputs[i].bytes, inputs[i].size, &stats) || stats.objects > UINT32_MAX) {
+            tlv_debug_cb("Error - Failed to convert message %zu of the batch", i);
+            continue;
+        }
+        if ((nodes = tlv_arena_alloc(arena, stats.objects * sizeof (*nodes))) == NULL) {
+            TLV_FAIL(TLV_FAILURE_MEMORY, "Fatal - Out of memory when converting message %zu of the batch", i);
+            continue;
+        }
+        if (tlv_flat_init(&flats[i], inputs[i].bytes, inputs[i].size, nodes, (tlv_index_t) stats.objects)) {
+            decoded++;
+        }
+    }
+
+    return decoded;
+}
+
+
+size_t tlv_batch_encode(const tlv_t * const *trees, const size_t count, uint8_t *buffer, const size_t capacity, tlv_batch_span_t *spans, size_t *size) {
+    size_t encoded = 0;
+    size_t used = 0;
+
+    if (trees == NULL || spans == NULL || size == NULL) {
+        return 0;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        size_t length = 0;
+
+        spans[i].offset = used;
+        spans[i].size = 0;
+        if (buffer == NULL) {
+            // Sizing only, tlv_to_buffer reports the needed size of a tree which can be encoded
+            tlv_to_buffer(trees[i], NULL, 0, &length);
+            used += length;
+            continue;
+        }
+        if (!tlv_to_buffer(trees[i], &buffer[used], capacity - used, &length)) {
+            tlv_debug_cb("Error - Failed to convert tree %zu of the batch", i);
+            continue;
+        }
+        spans[i].size = length;
+        used += length;
+        encoded++;
+    }
+    *size = used;
+
+    return encoded;
+}
@@ -0,0 +1,85 @@
+#ifndef TLV_BATCH_H_2016
+#define TLV_BATCH_H_2016
+
+/**
+ * File:   tlv_batch.h
+ *
+ * @brief Decoding and encoding of many small messages per call
+ * The decoders take an array of byte arrays and allocate all objects of all messages in one
+ * shared arena, the whole batch is released at once by resetting the arena. The encoder writes
+ * the messages back to back into one buffer and fills a table with their offsets.
+ *
+ * A malformed message does not abort the batch, it is reported in its own entry of the output.
+ */
+
+#include "tlv.h"
+#include "tlv_flat.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    /**
+     * An encoded message in a batch
+     */
+    typedef struct {
+        const uint8_t *bytes;   /**< @brief Byte array of the message */
+        size_t size;            /**< @brief Size of the byte array */
+    } tlv_batch_input_t;
+
+    /**
+     * Position of an encoded message in the output buffer of a batch
+     */
+    typedef struct {
+        size_t offset;          /**< @brief Offset of the message in the buffer */
+        size_t size;            /**< @brief Size of the message, 0 if it was not encoded */
+    } tlv_batch_span_t;
+
+
+    /**
+     * @brief Converts a batch of byte arrays to TLV objects
+     * Every message is decoded as by tlv_from_byte_array_ex. With an arena all trees share it and are
+     * released with it, otherwise every tree is deleted on its own with tlv_delete_all.
+     * @param[in] inputs Messages to convert
+     * @param[in] count Number of messages
+     * @param[in] arena Arena to allocate the objects in or NULL to use malloc
+     * @param[in] flags Decode options, see tlv_decode_flags_t
+     * @param[out] trees Return point of count trees, NULL for the messages which failed
+     * @return Number of converted messages
+     */
+    size_t tlv_batch_decode(const tlv_batch_input_t *inputs, const size_t count, tlv_arena_t *arena, const uint32_t flags, tlv_t **trees);
+
+
+    /**
+     * @brief Converts a batch of byte arrays to flat TLV structures with the objects allocated in an arena
+     * Every message is validated to allocate the exact number of objects. The flat structures refer to
+     * the byte arrays and the arena, they must not be deleted with tlv_flat_delete.
+     * @param[in] inputs Messages to convert
+     * @param[in] count Number of messages
+     * @param[in] arena Arena to allocate the objects in
+     * @param[out] flats Return point of count flat structures, empty (count 0) for the messages which failed
+     * @return Number of converted messages
+     */
+    size_t tlv_batch_decode_flat(const tlv_batch_input_t *inputs, const size_t count, tlv_arena_t *arena, tlv_flat_t *flats);
+
+
+    /**
+     * @brief Converts a batch of tlv objects back to back into a caller supplied buffer
+     * A tree which fails to encode or does not fit in the rest of the buffer gets an empty span and is
+     * skipped, the following trees are still written. Call it with a NULL buffer to get the needed size.
+     * @param[in] trees Tlv objects to convert
+     * @param[in] count Number of tlv objects
+     * @param[out] buffer Buffer to write the messages to or NULL
+     * @param[in] capacity Size of the buffer
+     * @param[out] spans Return point of count spans of the messages in the buffer
+     * @param[out] size Number of bytes written, or the needed size if buffer is NULL
+     * @return Number of converted tlv objects, 0 if buffer is NULL
+     */
+    size_t tlv_batch_encode(const tlv_t * const *trees, const size_t count, uint8_t *buffer, const size_t capacity, tlv_batch_span_t *spans, size_t *size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TLV_BATCH_H_2016 */
@@ -0,0 +1,1108 @@
+/**
+ * File:   tlv_bench.c
+ *
+ * @brief Benchmarks for the ctlv library
+ * Run "make bench" to build and run the benchmarks, "make -s bench BENCH_FORMAT=--csv" or
+ * "make -s bench BENCH_FORMAT=--json" prints machine readable results to compare across commits
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include "tlv.h"
+#include "tlv_flat.h"
+#include "tlv_tag_index.h"
+#include "tlv_builder.h"
+#include "tlv_batch.h"
+#include "tlv_parallel.h"
+#include "tlv_path.h"
+#include "tlv_dump.h"
+#include "tlv_diff.h"
+#include "tlv_cache.h"
+#include "tlv_log.h"
+#include "tlv_io.h"
+#include "tlv_template.h"
+#include "tlv_bench_report.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_MIN_NS 200000000ULL
+#define BENCH_LOOKUPS 20
+#define BENCH_BUILD_COUNT 2000
+#define BENCH_MAX_MESSAGE 65540
+#define BENCH_BATCH_COUNT 256
+#define BENCH_DEEP_LEVELS 48
+#define BENCH_LOG_COUNT 256
+#define BENCH_LOG_PATH "tlv_bench.log"
+#define BENCH_IO_COUNT 1024
+#define BENCH_EVENT_FIELDS 12
+
+
+/**
+ * A benchmarked operation, returns false on failure
+ */
+typedef bool (*bench_fn_t)(void *arg);
+
+
+/**
+ * Input of the benchmarked operations
+ */
+typedef struct {
+    const uint8_t *bytes;           /**< @brief Encoded message */
+    size_t size;                    /**< @brief Size of the encoded message */
+    tlv_t *tlv;                     /**< @brief Decoded message */
+    tlv_flat_t *flat;               /**< @brief Decoded message in flat form */
+    tlv_tag_t tag;                  /**< @brief Tag to search for */
+    uint8_t *patched;               /**< @brief Copy of the encoded message to patch */
+    uint8_t *buffer;                /**< @brief Buffer of the size of the encoded message */
+    tlv_path_t path;                /**< @brief Path to the object with the tag */
+    tlv_t *victim;                  /**< @brief Decoded message for the next delete */
+    tlv_t *changed;                 /**< @brief Decoded message with the value of the last PDO changed */
+    uint8_t *delta;                 /**< @brief Delta from tlv to changed */
+    size_t delta_size;              /**< @brief Size of the delta */
+    tlv_cache_t *cache;             /**< @brief Decode cache holding the message */
+} bench_arg_t;
+
+
+/********** PRIVATE DEFINITIONS ***********************************************/
+static uint64_t now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+
+static void run(const char *name, bench_fn_t fn, void *arg, size_t bytes_per_op) {
+    uint64_t iterations = 0;
+    uint64_t allocs = bench_report_allocs();
+    uint64_t start = now_ns();
+    uint64_t elapsed;
+
+    do {
+        for (int i = 0; i < 16; i++) {
+            if (!fn(arg)) {
+                bench_report_failed(name);
+                return;
+            }
+        }
+        iterations += 16;
+        elapsed = now_ns() - start;
+    } while (elapsed < BENCH_MIN_NS);
+
+    allocs = bench_report_allocs() - allocs;
+    bench_report(name, (double) elapsed / (double) iterations, bytes_per_op, (double) allocs / (double) iterations);
+}
+
+
+/**
+ * @brief Runs a benchmark with a setup before every operation, only the operation is measured
+ */
+static void run_setup(const char *name, bench_fn_t setup, bench_fn_t fn, void *arg, size_t bytes_per_op) {
+    uint64_t iterations = 0;
+    uint64_t allocs = 0;
+    uint64_t elapsed = 0;
+    uint64_t start = now_ns();
+
+    do {
+        if (!setup(arg)) {
+            bench_report_failed(name);
+            return;
+        }
+        uint64_t allocs_before = bench_report_allocs();
+        uint64_t before = now_ns();
+        if (!fn(arg)) {
+            bench_report_failed(name);
+            return;
+        }
+        elapsed += now_ns() - before;
+        allocs += bench_report_allocs() - allocs_before;
+        iterations++;
+    } while (now_ns() - start < BENCH_MIN_NS || iterations < 16);
+
+    bench_report(name, (double) elapsed / (double) iterations, bytes_per_op, (double) allocs / (double) iterations);
+}
+
+
+static bool bench_decode(void *arg) {
+    bench_arg_t *a = arg;
+    tlv_t *tlv = tlv_from_byte_array(a->bytes, a->size);
+
+    if (tlv == NULL) {
+        return false;
+    }
+    tlv_delete_all(&tlv);
+    return true;
+}
+
+
+static bool bench_cache_decode(void *arg) {
+    bench_arg_t *a = arg;
+    const tlv_t *tlv = tlv_cache_decode(a->cache, a->bytes, a->size);
+
+    if (tlv == NULL) {
+        return false;
+    }
+    tlv_cache_release(a->cache, &tlv);
+    return true;
+}
+
+
+static bool bench_validate(void *arg) {
+    bench_arg_t *a = arg;
+
+    return tlv_validate(a->bytes, a->size, NULL);
+}
+
+
+static bool bench_decode_prealloc(void *arg) {
+    bench_arg_t *a = arg;
+    tlv_t *tlv = tlv_from_byte_array_ex(a->bytes, a->size, NULL, TLV_DECODE_PREALLOC);
+
+    if (tlv == NULL) {
+        return false;
+    }
+    tlv_delete_all(&tlv);
+    return true;
+}
+
+
+static bool bench_decode_lazy(void *arg) {
+    bench_arg_t *a = arg;
+    tlv_t *tlv = tlv_from_byte_array_ex(a->bytes, a->size, NULL, TLV_DECODE_LAZY);
+
+    // Only the children of the root are decoded
+    if (tlv == NULL || tlv_get_child(tlv) == NULL) {
+        tlv_delete_all(&tlv);
+        return false;
+    }
+    tlv_delete_all(&tlv);
+    return true;
+}
+
+
+static bool bench_encode_lazy(void *arg) {
+    bench_arg_t *a = arg;
+    tlv_t *tlv = tlv_from_byte_array_ex(a->bytes, a->size, NULL, TLV_DECODE_LAZY);
+    size_t size;
+
+    bool ok = tlv != NULL && tlv_to_buffer(tlv, a->buffer, a->size, &size);
+    tlv_delete_all(&tlv);
+    return ok;
+}
+
+
+static bool bench_encode(void *arg) {
+    bench_arg_t *a = arg;
+    uint8_t *bytes;
+    size_t size;
+
+    if (!tlv_to_byte_array(a->tlv, &bytes, &size)) {
+        return false;
+    }
+    free(bytes);
+    return true;
+}
+
+
+static bool bench_encode_buffer(void *arg) {
+    bench_arg_t *a = arg;
+    size_t size;
+
+    return tlv_to_buffer(a->tlv, a->buffer, a->size, &size);
+}
+
+
+static bool bench_encode_iovec(void *arg) {
+    static struct iovec iov[2 * (BENCH_MAX_MESSAGE / 5)];
+    static uint8_t scratch[BENCH_MAX_MESSAGE];
+    bench_arg_t *a = arg;
+    size_t iov_count = sizeof (iov) / sizeof (iov[0]);
+    size_t scratch_size = sizeof (scratch);
+
+    return tlv_to_iovec(a->tlv, iov, &iov_count, scratch, &scratch_size);
+}
+
+
+static bool bench_patch(void *arg) {
+    bench_arg_t *a = arg;
+    tlv_t *last = (tlv_t*) tlv_find_by_tag(a->tlv, a->tag);
+
+    // The tag is changed back before the search of the next round
+    return tlv_set_tag(last, (tlv_tag_t) (a->tag ^ 0x8000)) && tlv_patch_byte_array(a->tlv, a->patched, a->size)
+            && tlv_set_tag(last, a->tag) && tlv_patch_byte_array(a->tlv, a->patched, a->size);
+}
+
+
+static bool bench_delete_setup(void *arg) {
+    bench_arg_t *a = arg;
+
+    a->victim = tlv_from_byte_array(a->bytes, a->size);
+    return a->victim != NULL;
+}
+
+
+static bool bench_delete(void *arg) {
+    bench_arg_t *a = arg;
+
+    tlv_delete_all(&a->victim);
+    return true;
+}
+
+
+static bool bench_to_string(void *arg) {
+    bench_arg_t *a = arg;
+    const char *str = tlv_to_string(a->tlv);
+
+    if (str == NULL) {
+        return false;
+    }
+    free((char*) str);
+    return true;
+}
+
+
+static bool bench_dump_discard(void *arg, const char *data, const size_t size) {
+    (void) data;
+    *(size_t*) arg += size;
+    return true;
+}
+
+
+static bool bench_dump_tree(void *arg) {
+    bench_arg_t *a = arg;
+    size_t written = 0;
+
+    return tlv_dump(a->tlv, TLV_DUMP_TREE, bench_dump_discard, &written) && written > 0;
+}
+
+
+static bool bench_dump_json(void *arg) {
+    bench_arg_t *a = arg;
+    size_t written = 0;
+
+    return tlv_dump(a->tlv, TLV_DUMP_JSON, bench_dump_discard, &written) && written > 0;
+}
+
+
+static bool bench_dump_bytes_hex(void *arg) {
+    bench_arg_t *a = arg;
+    size_t written = 0;
+
+    return tlv_dump_bytes(a->bytes, a->size, TLV_DUMP_HEX, bench_dump_discard, &written) && written > 0;
+}
+
+
+static bool bench_hash(void *arg) {
+    bench_arg_t *a = arg;
+    uint64_t hash;
+
+    return tlv_hash(a->tlv, &hash);
+}
+
+
+static bool bench_hash_bytes(void *arg) {
+    bench_arg_t *a = arg;
+    uint64_t hash;
+
+    return tlv_hash_bytes(a->bytes, a->size, &hash);
+}
+
+
+static bool bench_equal(void *arg) {
+    bench_arg_t *a = arg;
+
+    return !tlv_equal(a->tlv, a->changed);
+}
+
+
+/**
+ * @brief Compares as done without tlv_equal, both trees are encoded
+ */
+static bool bench_equal_encode(void *arg) {
+    bench_arg_t *a = arg;
+    uint8_t *bytes;
+    uint8_t *changed;
+    size_t size;
+    size_t changed_size;
+
+    if (!tlv_to_byte_array(a->tlv, &bytes, &size)) {
+        return false;
+    }
+    if (!tlv_to_byte_array(a->changed, &changed, &changed_size)) {
+        free(bytes);
+        return false;
+    }
+    bool equal = size == changed_size && memcmp(bytes, changed, size) == 0;
+    free(bytes);
+    free(changed);
+    return !equal;
+}
+
+
+static bool bench_diff(void *arg) {
+    bench_arg_t *a = arg;
+    uint8_t *delta;
+    size_t size;
+
+    if (!tlv_diff(a->tlv, a->changed, &delta, &size)) {
+        return false;
+    }
+    free(delta);
+    return true;
+}
+
+
+static bool bench_apply_setup(void *arg) {
+    bench_arg_t *a = arg;
+
+    tlv_delete_all(&a->victim);
+    return bench_delete_setup(arg);
+}
+
+
+static bool bench_apply(void *arg) {
+    bench_arg_t *a = arg;
+
+    return tlv_apply_delta(&a->victim, a->delta, a->delta_size);
+}
+
+
+static bool bench_find(void *arg) {
+    bench_arg_t *a = arg;
+
+    return tlv_find_by_tag(a->tlv, a->tag) != NULL;
+}
+
+
+static bool bench_path_find(void *arg) {
+    bench_arg_t *a = arg;
+    tlv_path_match_t match;
+
+    return tlv_path_find(&a->path, a->bytes, a->size, &match) && match.tag == a->tag;
+}
+
+
+static bool bench_decode_flat(void *arg) {
+    bench_arg_t *a = arg;
+    tlv_flat_t *flat = tlv_flat_from_byte_array(a->bytes, a->size);
+
+    if (flat == NULL) {
+        return false;
+    }
+    tlv_flat_delete(&flat);
+    return true;
+}
+
+
+static bool bench_find_flat(void *arg) {
+    bench_arg_t *a = arg;
+
+    return tlv_flat_find_by_tag(a->flat, 0, a->tag) != TLV_FLAT_NONE;
+}
+
+
+static bool bench_find_many(void *arg) {
+    bench_arg_t *a = arg;
+
+    for (tlv_tag_t i = 1; i <= BENCH_LOOKUPS; i++) {
+        if (tlv_find_by_tag(a->tlv, (tlv_tag_t) (a->tag * i / BENCH_LOOKUPS)) == NULL) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+static bool bench_index_find_many(void *arg) {
+    bench_arg_t *a = arg;
+    tlv_tag_index_t *index = tlv_tag_index_new(a->tlv);
+    bool found = index != NULL;
+
+    for (tlv_tag_t i = 1; found && i <= BENCH_LOOKUPS; i++) {
+        found = tlv_tag_index_find(index, (tlv_tag_t) (a->tag * i / BENCH_LOOKUPS)) != NULL;
+    }
+    tlv_tag_index_delete(&index);
+    return found;
+}
+
+
+static bool bench_build_append(void *arg) {
+    uint8_t value[8] = {0};
+    tlv_t *root = tlv_new_cdo(1);
+    uint8_t *bytes;
+    size_t size;
+
+    (void) arg;
+    for (tlv_tag_t i = 0; i < BENCH_BUILD_COUNT; i++) {
+        tlv_append_child(root, tlv_new_pdo(i, sizeof (value), value));
+    }
+    bool ok = tlv_to_byte_array(root, &bytes, &size);
+    tlv_delete(&root);
+    if (ok) {
+        free(bytes);
+    }
+    return ok;
+}
+
+
+static bool bench_build_builder(void *arg) {
+    uint8_t value[8] = {0};
+    tlv_builder_t *builder = arg;
+    uint8_t *bytes;
+    size_t size;
+
+    tlv_builder_begin_cdo(builder, 1);
+    for (tlv_tag_t i = 0; i < BENCH_BUILD_COUNT; i++) {
+        tlv_builder_add_pdo(builder, i, sizeof (value), value);
+    }
+    tlv_builder_end_cdo(builder);
+    tlv_t *root = tlv_builder_finish(builder);
+    bool ok = tlv_to_byte_array(root, &bytes, &size);
+    tlv_delete_all(&root);
+    if (ok) {
+        free(bytes);
+    }
+    return ok;
+}
+
+
+/**
+ * Input of the batch operations, the same small message repeated
+ */
+typedef struct {
+    tlv_batch_input_t inputs[BENCH_BATCH_COUNT];    /**< @brief Encoded messages */
+    tlv_t *trees[BENCH_BATCH_COUNT];                /**< @brief Decoded messages to encode */
+    tlv_t *decoded[BENCH_BATCH_COUNT];              /**< @brief Return point of the batch decoder */
+    tlv_flat_t flats[BENCH_BATCH_COUNT];            /**< @brief Decoded messages in flat form */
+    tlv_batch_span_t spans[BENCH_BATCH_COUNT];      /**< @brief Encoded messages in buffer */
+    tlv_arena_t *arena;                             /**< @brief Arena shared by the batch */
+    uint8_t *buffer;                                /**< @brief Buffer for the whole batch */
+    size_t size;                                    /**< @brief Size of the whole batch */
+} bench_batch_t;
+
+
+static bool bench_decode_single(void *arg) {
+    bench_batch_t *b = arg;
+
+    for (size_t i = 0; i < BENCH_BATCH_COUNT; i++) {
+        tlv_t *tlv = tlv_from_byte_array(b->inputs[i].bytes, b->inputs[i].size);
+
+        if (tlv == NULL) {
+            return false;
+        }
+        tlv_delete_all(&tlv);
+    }
+    return true;
+}
+
+
+static bool bench_batch_decode(void *arg) {
+    bench_batch_t *b = arg;
+    size_t decoded = tlv_batch_decode(b->inputs, BENCH_BATCH_COUNT, b->arena, TLV_DECODE_COPY, b->decoded);
+
+    tlv_arena_reset(b->arena);
+    return decoded == BENCH_BATCH_COUNT;
+}
+
+
+static bool bench_batch_decode_flat(void *arg) {
+    bench_batch_t *b = arg;
+    size_t decoded = tlv_batch_decode_flat(b->inputs, BENCH_BATCH_COUNT, b->arena, b->flats);
+
+    tlv_arena_reset(b->arena);
+    return decoded == BENCH_BATCH_COUNT;
+}
+
+
+static bool bench_batch_encode(void *arg) {
+    bench_batch_t *b = arg;
+    size_t size;
+
+    return tlv_batch_encode((const tlv_t * const *) b->trees, BENCH_BATCH_COUNT, b->buffer, b->size, b->spans, &size) == BENCH_BATCH_COUNT;
+}
+
+
+/**
+ * Input of the parallel decoder
+ */
+typedef struct {
+    const uint8_t *bytes;           /**< @brief Encoded message */
+    size_t size;                    /**< @brief Size of the encoded message */
+    tlv_parallel_pool_t *pool;      /**< @brief Pool of the threads to decode with */
+} bench_parallel_t;
+
+
+static bool bench_decode_parallel(void *arg) {
+    bench_parallel_t *p = arg;
+    tlv_t *tlv = tlv_from_byte_array_parallel(p->pool, p->bytes, p->size, TLV_DECODE_COPY);
+
+    if (tlv == NULL) {
+        return false;
+    }
+    tlv_delete_all(&tlv);
+    return true;
+}
+
+
+/**
+ * Input of the log operations, the same message appended and read back
+ */
+typedef struct {
+    const uint8_t *bytes;           /**< @brief Encoded message */
+    size_t size;                    /**< @brief Size of the encoded message */
+    tlv_log_writer_t *writer;       /**< @brief Writer of a new log for the next append */
+} bench_log_t;
+
+
+static bool bench_log_append_setup(void *arg) {
+    bench_log_t *l = arg;
+
+    tlv_log_writer_close(&l->writer);
+    unlink(BENCH_LOG_PATH);
+    unlink(BENCH_LOG_PATH ".idx");
+    return (l->writer = tlv_log_writer_open(BENCH_LOG_PATH, 0)) != NULL;
+}
+
+
+static bool bench_log_append(void *arg) {
+    bench_log_t *l = arg;
+
+    for (size_t i = 0; i < BENCH_LOG_COUNT; i++) {
+        if (!tlv_log_append(l->writer, l->bytes, l->size)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+static bool bench_log_replay(void *arg) {
+    tlv_log_reader_t *reader = tlv_log_reader_open(BENCH_LOG_PATH);
+    tlv_log_record_t record;
+    size_t count = tlv_log_count(reader);
+
+    (void) arg;
+    for (size_t i = 0; i < count; i++) {
+        tlv_t *tlv;
+
+        if (!tlv_log_get(reader, i, &record)
+                || (tlv = tlv_from_byte_array_ex(record.bytes, record.size, NULL, TLV_DECODE_BORROW)) == NULL) {
+            tlv_log_reader_close(&reader);
+            return false;
+        }
+        tlv_delete_all(&tlv);
+    }
+    tlv_log_reader_close(&reader);
+    return count == BENCH_LOG_COUNT;
+}
+
+
+/**
+ * Input of the transport operations, messages sent from one end of a socket pair to the other
+ */
+typedef struct {
+    const uint8_t *bytes;           /**< @brief Encoded message */
+    size_t size;                    /**< @brief Size of the encoded message */
+    int fds[2];                     /**< @brief The socket pair */
+    tlv_io_pool_t *pool;            /**< @brief Pool of both connections */
+    tlv_io_t *writer;               /**< @brief Connection of the sending end */
+    tlv_io_poll_t *poll;            /**< @brief Poll of the receiving end */
+    size_t received;                /**< @brief Frames received so far */
+} bench_io_t;
+
+
+static bool bench_io_count(tlv_io_t *io, const tlv_io_frame_t *frame, void *arg) {
+    bench_io_t *b = arg;
+
+    (void) io;
+    if (frame == NULL) {
+        return false;
+    }
+    b->received++;
+    return true;
+}
+
+
+static bool bench_io_framed(void *arg) {
+    bench_io_t *b = arg;
+    size_t sent = 0;
+
+    b->received = 0;
+    while (b->received < BENCH_IO_COUNT) {
+        for (; sent < BENCH_IO_COUNT && tlv_io_pending(b->writer) < TLV_IO_BUFFER_SIZE; sent++) {
+            if (!tlv_io_send(b->writer, b->bytes, b->size)) {
+                return false;
+            }
+        }
+        if (tlv_io_flush(b->writer) > TLV_IO_AGAIN || tlv_io_poll_wait(b->poll, 0, bench_io_count, b) < 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+/**
+ * @brief Frames like a hand written loop: a write per message, the header and the value read
+ * separately into a new buffer and decoded
+ */
+static bool bench_io_naive(void *arg) {
+    bench_io_t *b = arg;
+    uint8_t header[BER_HEADER_BYTE_LENGTH];
+
+    for (size_t i = 0; i < BENCH_IO_COUNT; i++) {
+        uint8_t *message;
+        size_t length;
+        tlv_t *tlv;
+
+        if (write(b->fds[0], b->bytes, b->size) != (ssize_t) b->size
+                || read(b->fds[1], header, sizeof (header)) != (ssize_t) sizeof (header)) {
+            return false;
+        }
+        length = (size_t) (header[3] << 8 | header[4]);
+        if ((message = malloc(sizeof (header) + length)) == NULL) {
+            return false;
+        }
+        memcpy(message, header, sizeof (header));
+        if (read(b->fds[1], &message[sizeof (header)], length) != (ssize_t) length
+                || (tlv = tlv_from_byte_array(message, sizeof (header) + length)) == NULL) {
+            free(message);
+            return false;
+        }
+        tlv_delete_all(&tlv);
+        free(message);
+    }
+    return true;
+}
+
+
+static bool bench_io_framed_decode_count(tlv_io_t *io, const tlv_io_frame_t *frame, void *arg) {
+    tlv_t *tlv;
+
+    if (frame == NULL || (tlv = tlv_from_byte_array_ex(frame->bytes, frame->size, NULL, TLV_DECODE_BORROW)) == NULL) {
+        return false;
+    }
+    tlv_delete_all(&tlv);
+    return bench_io_count(io, frame, arg);
+}
+
+
+static bool bench_io_framed_decode(void *arg) {
+    bench_io_t *b = arg;
+    size_t sent = 0;
+
+    b->received = 0;
+    while (b->received < BENCH_IO_COUNT) {
+        for (; sent < BENCH_IO_COUNT && tlv_io_pending(b->writer) < TLV_IO_BUFFER_SIZE; sent++) {
+            if (!tlv_io_send(b->writer, b->bytes, b->size)) {
+                return false;
+            }
+        }
+        if (tlv_io_flush(b->writer) > TLV_IO_AGAIN || tlv_io_poll_wait(b->poll, 0, bench_io_framed_decode_count, b) < 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+/**
+ * Input of the event emitters, an event of a fixed shape with an id, a time stamp and a name changing
+ */
+typedef struct {
+    tlv_template_t *tmpl;           /**< @brief Template of the event */
+    tlv_template_msg_t *msg;        /**< @brief Event made from the template */
+    size_t id;                      /**< @brief Slot of the id */
+    size_t stamp;                   /**< @brief Slot of the time stamp */
+    size_t name;                    /**< @brief Slot of the name */
+    uint8_t *buffer;                /**< @brief Buffer of the rebuilt event */
+    size_t capacity;                /**< @brief Size of the buffer */
+    uint32_t sequence;              /**< @brief Id of the next event */
+} bench_event_t;
+
+
+/**
+ * @brief Builds the event tree, a header CDO with the changing fields and a body of constant fields
+ */
+static tlv_t* make_event(uint32_t id, uint64_t stamp, const char *name) {
+    uint8_t constant[8] = {0, 1, 2, 3, 4, 5, 6, 7};
+    tlv_t *root = tlv_new_cdo(1);
+    tlv_t *head = tlv_append_child(root, tlv_new_cdo(2));
+    tlv_t *body = tlv_append_child(root, tlv_new_cdo(3));
+    uint8_t *value;
+
+    value = malloc(4);
+    for (size_t i = 0; i < 4; i++) {
+        value[i] = (uint8_t) (id >> (24 - 8 * i));
+    }
+    tlv_append_child(head, tlv_new_pdo(1, 4, value));
+    value = malloc(8);
+    for (size_t i = 0; i < 8; i++) {
+        value[i] = (uint8_t) (stamp >> (56 - 8 * i));
+    }
+    tlv_append_child(head, tlv_new_pdo(2, 8, value));
+    value = malloc(strlen(name));
+    memcpy(value, name, strlen(name));
+    tlv_append_child(head, tlv_new_pdo(3, (tlv_length_t) strlen(name), value));
+    for (size_t i = 0; i < BENCH_EVENT_FIELDS; i++) {
+        value = malloc(sizeof (constant));
+        memcpy(value, constant, sizeof (constant));
+        tlv_append_child(body, tlv_new_pdo((tlv_tag_t) (i + 1), sizeof (constant), value));
+    }
+    return root;
+}
+
+
+static bool bench_event_rebuild(void *arg) {
+    bench_event_t *e = arg;
+    tlv_t *event = make_event(e->sequence, e->sequence * 1000ULL, e->sequence & 1 ? "sensor-1" : "sensor-12");
+    size_t size;
+    bool ok = tlv_to_buffer(event, e->buffer, e->capacity, &size);
+
+    tlv_delete_all(&event);
+    e->sequence++;
+    return ok;
+}
+
+
+static bool bench_event_template(void *arg) {
+    bench_event_t *e = arg;
+    const char *name = e->sequence & 1 ? "sensor-1" : "sensor-12";
+    size_t size;
+
+    tlv_template_msg_reset(e->msg);
+    if (!tlv_template_msg_set_u32(e->msg, e->id, e->sequence) || !tlv_template_msg_set_u64(e->msg, e->stamp, e->sequence * 1000ULL)
+            || !tlv_template_msg_set(e->msg, e->name, (const uint8_t *) name, (tlv_length_t) strlen(name))) {
+        return false;
+    }
+    e->sequence++;
+    return tlv_template_msg_bytes(e->msg, &size) != NULL;
+}
+
+
+/**
+ * Builds a root CDO with as many PDO's of the specified value length as fits in a message
+ */
+static uint8_t* make_wide(size_t value_length, size_t *size) {
+    size_t count = (65535 - BER_HEADER_BYTE_LENGTH) / (BER_HEADER_BYTE_LENGTH + value_length);
+    size_t content = count * (BER_HEADER_BYTE_LENGTH + value_length);
+    uint8_t *bytes = malloc(BER_HEADER_BYTE_LENGTH + content);
+    size_t index = 0;
+
+    bytes[index++] = TLV_CDO;
+    bytes[index++] = 0;
+    bytes[index++] = 1;
+    bytes[index++] = (uint8_t) (content >> 8);
+    bytes[index++] = (uint8_t) (content & 0xff);
+    for (size_t i = 0; i < count; i++) {
+        bytes[index++] = TLV_PDO;
+        bytes[index++] = (uint8_t) ((i + 2) >> 8);
+        bytes[index++] = (uint8_t) ((i + 2) & 0xff);
+        bytes[index++] = (uint8_t) (value_length >> 8);
+        bytes[index++] = (uint8_t) (value_length & 0xff);
+        memset(&bytes[index], (int) i, value_length);
+        index += value_length;
+    }
+    *size = index;
+
+    return bytes;
+}
+
+
+/**
+ * Builds a root CDO with CDO's holding PDO's of 8 bytes, the tags are numbered in pre-order
+ */
+static uint8_t* make_nested(size_t cdos, size_t pdos, size_t *size, tlv_tag_t *last_tag) {
+    uint8_t value[8] = {0};
+    tlv_tag_t tag = 1;
+    tlv_t *root = tlv_new_cdo(tag++);
+    uint8_t *bytes = NULL;
+
+    for (size_t i = 0; i < cdos; i++) {
+        tlv_t *cdo = tlv_append_child(root, tlv_new_cdo(tag++));
+        for (size_t j = 0; j < pdos; j++) {
+            tlv_append_child(cdo, tlv_new_pdo(tag++, sizeof (value), value));
+        }
+    }
+    *last_tag = (tlv_tag_t) (tag - 1);
+    if (!tlv_to_byte_array(root, &bytes, size)) {
+        *size = 0;
+    }
+    tlv_delete(&root);
+
+    return bytes;
+}
+
+
+/**
+ * Builds a chain of nested CDO's holding PDO's of 8 bytes each, the tags are numbered in pre-order
+ * The path to the last PDO is written to path
+ */
+static uint8_t* make_deep(size_t levels, size_t pdos, size_t *size, tlv_tag_t *last_tag, char *path, size_t path_size) {
+    uint8_t value[8] = {0};
+    tlv_tag_t tag = 1;
+    tlv_t *root = tlv_new_cdo(tag++);
+    tlv_t *cdo = root;
+    uint8_t *bytes = NULL;
+    size_t length = (size_t) snprintf(path, path_size, "1");
+
+    for (size_t i = 0; i < levels; i++) {
+        for (size_t j = 0; j < pdos; j++) {
+            tlv_append_child(cdo, tlv_new_pdo(tag++, sizeof (value), value));
+        }
+        if (i + 1 < levels) {
+            cdo = tlv_append_child(cdo, tlv_new_cdo(tag++));
+            length += (size_t) snprintf(&path[length], path_size - length, "/*");
+        }
+    }
+    *last_tag = (tlv_tag_t) (tag - 1);
+    if (!tlv_to_byte_array(root, &bytes, size)) {
+        *size = 0;
+    }
+    tlv_delete(&root);
+
+    return bytes;
+}
+
+
+/**
+ * Builds a root CDO with PDO's of value_length bytes, wide headers are used above 65535 bytes
+ */
+static uint8_t* make_large(size_t pdos, size_t value_length, size_t *size, tlv_tag_t *last_tag) {
+    uint8_t *value = calloc(1, value_length);
+    tlv_builder_t *builder = tlv_builder_new(NULL);
+    uint8_t *bytes = NULL;
+    tlv_t *root;
+
+    tlv_builder_begin_cdo(builder, 1);
+    for (size_t i = 0; i < pdos; i++) {
+        tlv_builder_add_pdo(builder, (tlv_tag_t) (i + 2), (tlv_length_t) value_length, value);
+    }
+    tlv_builder_end_cdo(builder);
+    root = tlv_builder_finish(builder);
+    *last_tag = (tlv_tag_t) (pdos + 1);
+    if (!tlv_to_byte_array(root, &bytes, size)) {
+        *size = 0;
+    }
+    tlv_delete_all(&root);
+    tlv_builder_delete(&builder);
+    free(value);
+
+    return bytes;
+}
+
+
+static void bench_shape(const char *shape, uint8_t *bytes, size_t size, tlv_tag_t last_tag, const char *last_path) {
+    char name[256];
+    bench_arg_t arg = {bytes, size, tlv_from_byte_array(bytes, size), tlv_flat_from_byte_array(bytes, size), last_tag, malloc(size), malloc(size)};
+
+    memcpy(arg.patched, bytes, size);
+    arg.changed = tlv_from_byte_array(bytes, size);
+    tlv_t *last = (tlv_t*) tlv_find_by_tag(arg.changed, last_tag);
+    if (last != NULL && last->type == TLV_PDO) {
+        uint8_t *value = calloc(1, last->length + 1);
+
+        memcpy(value, last->value, last->length);
+        value[0] ^= 0x01;
+        tlv_set_value(last, last->length > 0 ? last->length : 1, value);
+    }
+    tlv_diff(arg.tlv, arg.changed, &arg.delta, &arg.delta_size);
+    arg.cache = tlv_cache_new(4 * size + (1 << 20));
+    snprintf(name, sizeof (name), "%s/%u", last_path, last_tag);
+    tlv_path_compile(&arg.path, name);
+
+    snprintf(name, sizeof (name), "decode/%s", shape);
+    run(name, bench_decode, &arg, size);
+    snprintf(name, sizeof (name), "cache_decode_hit/%s", shape);
+    run(name, bench_cache_decode, &arg, size);
+    snprintf(name, sizeof (name), "validate/%s", shape);
+    run(name, bench_validate, &arg, size);
+    snprintf(name, sizeof (name), "decode_prealloc/%s", shape);
+    run(name, bench_decode_prealloc, &arg, size);
+    snprintf(name, sizeof (name), "decode_lazy_root/%s", shape);
+    run(name, bench_decode_lazy, &arg, size);
+    snprintf(name, sizeof (name), "decode_encode_lazy/%s", shape);
+    run(name, bench_encode_lazy, &arg, size);
+    snprintf(name, sizeof (name), "encode/%s", shape);
+    run(name, bench_encode, &arg, size);
+    snprintf(name, sizeof (name), "encode_buffer/%s", shape);
+    run(name, bench_encode_buffer, &arg, size);
+    snprintf(name, sizeof (name), "encode_iovec/%s", shape);
+    run(name, bench_encode_iovec, &arg, size);
+    snprintf(name, sizeof (name), "patch_last_x2/%s", shape);
+    run(name, bench_patch, &arg, size);
+    snprintf(name, sizeof (name), "to_string/%s", shape);
+    run(name, bench_to_string, &arg, size);
+    snprintf(name, sizeof (name), "dump_tree/%s", shape);
+    run(name, bench_dump_tree, &arg, size);
+    snprintf(name, sizeof (name), "dump_json/%s", shape);
+    run(name, bench_dump_json, &arg, size);
+    snprintf(name, sizeof (name), "dump_bytes_hex/%s", shape);
+    run(name, bench_dump_bytes_hex, &arg, size);
+    snprintf(name, sizeof (name), "delete_all/%s", shape);
+    run_setup(name, bench_delete_setup, bench_delete, &arg, size);
+    snprintf(name, sizeof (name), "hash/%s", shape);
+    run(name, bench_hash, &arg, size);
+    snprintf(name, sizeof (name), "hash_bytes/%s", shape);
+    run(name, bench_hash_bytes, &arg, size);
+    snprintf(name, sizeof (name), "equal_last/%s", shape);
+    run(name, bench_equal, &arg, size);
+    snprintf(name, sizeof (name), "equal_encode_memcmp_last/%s", shape);
+    run(name, bench_equal_encode, &arg, size);
+    snprintf(name, sizeof (name), "diff_last/%s", shape);
+    run(name, bench_diff, &arg, size);
+    snprintf(name, sizeof (name), "apply_delta_last/%s", shape);
+    run_setup(name, bench_apply_setup, bench_apply, &arg, size);
+    snprintf(name, sizeof (name), "find_last/%s", shape);
+    run(name, bench_find, &arg, size);
+    if (last_tag >= BENCH_LOOKUPS) {
+        snprintf(name, sizeof (name), "find_%d/%s", BENCH_LOOKUPS, shape);
+        run(name, bench_find_many, &arg, size);
+        snprintf(name, sizeof (name), "index_find_%d/%s", BENCH_LOOKUPS, shape);
+        run(name, bench_index_find_many, &arg, size);
+    }
+    snprintf(name, sizeof (name), "path_find_last/%s", shape);
+    run(name, bench_path_find, &arg, size);
+    snprintf(name, sizeof (name), "decode_flat/%s", shape);
+    run(name, bench_decode_flat, &arg, size);
+    snprintf(name, sizeof (name), "find_last_flat/%s", shape);
+    run(name, bench_find_flat, &arg, size);
+
+    tlv_delete_all(&arg.tlv);
+    tlv_delete_all(&arg.changed);
+    tlv_delete_all(&arg.victim);
+    tlv_cache_delete(&arg.cache);
+    free(arg.delta);
+    tlv_flat_delete(&arg.flat);
+    free(arg.patched);
+    free(arg.buffer);
+    free(bytes);
+}
+
+
+int main(int argc, char **argv) {
+    char path[4 * BENCH_DEEP_LEVELS];
+    uint8_t *bytes;
+    size_t size;
+    tlv_tag_t last_tag;
+
+    if (!bench_report_init(argc, argv)) {
+        return 1;
+    }
+
+    bytes = make_wide(0, &size);
+    bench_shape("wide_empty", bytes, size, (tlv_tag_t) ((65535 - BER_HEADER_BYTE_LENGTH) / BER_HEADER_BYTE_LENGTH + 1), "1");
+    bytes = make_wide(1, &size);
+    bench_shape("wide_1b", bytes, size, (tlv_tag_t) ((65535 - BER_HEADER_BYTE_LENGTH) / (BER_HEADER_BYTE_LENGTH + 1) + 1), "1");
+    bytes = make_wide(8, &size);
+    bench_shape("wide_8b", bytes, size, (tlv_tag_t) ((65535 - BER_HEADER_BYTE_LENGTH) / (BER_HEADER_BYTE_LENGTH + 8) + 1), "1");
+    bytes = make_nested(20, 10, &size, &last_tag);
+    bench_shape("nested_20x10", bytes, size, last_tag, "1/*");
+    bytes = make_deep(BENCH_DEEP_LEVELS, 4, &size, &last_tag, path, sizeof (path));
+    bench_shape("deep_48x4", bytes, size, last_tag, path);
+    bytes = make_large(4, 1 << 20, &size, &last_tag);
+    bench_shape("large_4x1m", bytes, size, last_tag, "1");
+
+    bench_batch_t *batch = calloc(1, sizeof (*batch));
+    bytes = make_nested(2, 4, &size, &last_tag);
+    for (size_t i = 0; i < BENCH_BATCH_COUNT; i++) {
+        batch->inputs[i].bytes = bytes;
+        batch->inputs[i].size = size;
+        batch->trees[i] = tlv_from_byte_array(bytes, size);
+    }
+    batch->arena = tlv_arena_new(0);
+    batch->size = BENCH_BATCH_COUNT * size;
+    batch->buffer = malloc(batch->size);
+    run("decode_single/batch_256x2x4", bench_decode_single, batch, batch->size);
+    run("batch_decode/batch_256x2x4", bench_batch_decode, batch, batch->size);
+    run("batch_decode_flat/batch_256x2x4", bench_batch_decode_flat, batch, batch->size);
+    run("batch_encode/batch_256x2x4", bench_batch_encode, batch, batch->size);
+    for (size_t i = 0; i < BENCH_BATCH_COUNT; i++) {
+        tlv_delete_all(&batch->trees[i]);
+    }
+    tlv_arena_delete(&batch->arena);
+    free(batch->buffer);
+    free(batch);
+    free(bytes);
+
+    // The log is written to and replayed from the working directory
+    bench_log_t log = {NULL, 0, NULL};
+    log.bytes = bytes = make_nested(20, 10, &log.size, &last_tag);
+    run_setup("log_append/log_256xnested_20x10", bench_log_append_setup, bench_log_append, &log, BENCH_LOG_COUNT * log.size);
+    tlv_log_writer_close(&log.writer);
+    run("log_replay/log_256xnested_20x10", bench_log_replay, &log, BENCH_LOG_COUNT * log.size);
+    unlink(BENCH_LOG_PATH);
+    unlink(BENCH_LOG_PATH ".idx");
+    free(bytes);
+
+    // Messages over a local socket pair, framed by hand and by tlv_io
+    bench_io_t io = {NULL, 0, {-1, -1}, NULL, NULL, NULL, 0};
+    tlv_io_t *reader = NULL;
+    io.bytes = bytes = make_nested(2, 4, &io.size, &last_tag);
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, io.fds) == 0) {
+        run("io_naive_decode/io_1024x2x4", bench_io_naive, &io, BENCH_IO_COUNT * io.size);
+        io.pool = tlv_io_pool_new(0, 4);
+        io.writer = tlv_io_new(io.pool, io.fds[0], 0);
+        reader = tlv_io_new(io.pool, io.fds[1], 0);
+        io.poll = tlv_io_poll_new(0);
+        tlv_io_poll_add(io.poll, reader);
+        run("io_framed/io_1024x2x4", bench_io_framed, &io, BENCH_IO_COUNT * io.size);
+        run("io_framed_decode/io_1024x2x4", bench_io_framed_decode, &io, BENCH_IO_COUNT * io.size);
+        tlv_io_poll_delete(&io.poll);
+        tlv_io_delete(&reader);
+        tlv_io_delete(&io.writer);
+        tlv_io_pool_delete(&io.pool);
+        close(io.fds[0]);
+        close(io.fds[1]);
+    }
+    free(bytes);
+
+    // An event of a fixed shape, rebuilt and encoded or filled into a template
+    const tlv_template_slot_spec_t slots[] = {{"id", "1/2/1", 0}, {"stamp", "1/2/2", 0}, {"name", "1/2/3", 64}};
+    bench_event_t event;
+    tlv_t *prototype = make_event(0, 0, "");
+    event.tmpl = tlv_template_new(prototype, slots, sizeof (slots) / sizeof (slots[0]));
+    event.msg = tlv_template_msg_new(event.tmpl);
+    event.id = tlv_template_slot(event.tmpl, "id");
+    event.stamp = tlv_template_slot(event.tmpl, "stamp");
+    event.name = tlv_template_slot(event.tmpl, "name");
+    tlv_update_length(prototype, &size);
+    event.capacity = size + 64;
+    event.buffer = malloc(event.capacity);
+    event.sequence = 0;
+    run("event_rebuild/event_3+12", bench_event_rebuild, &event, size + 8);
+    run("event_template/event_3+12", bench_event_template, &event, size + 8);
+    free(event.buffer);
+    tlv_template_msg_delete(&event.msg);
+    tlv_template_delete(&event.tmpl);
+    tlv_delete_all(&prototype);
+
+    // Scaling of the parallel decoder from one thread to all online cores
+    bench_parallel_t parallel;
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    parallel.bytes = bytes = make_nested(512, 64, &parallel.size, &last_tag);
+    for (size_t threads = 1; threads <= (size_t) cores; threads *= 2) {
+        size_t used = threads * 2 > (size_t) cores ? (size_t) cores : threads;
+        char name[64];
+
+        // The last step runs on all cores even if their number is not a power of two
+        if ((parallel.pool = tlv_parallel_pool_new(used)) == NULL) {
+            return 1;
+        }
+        snprintf(name, sizeof (name), "decode_parallel_%zut/nested_512x64", used);
+        run(name, bench_decode_parallel, &parallel, parallel.size);
+        tlv_parallel_pool_delete(&parallel.pool);
+    }
+    free(bytes);
+
+    tlv_builder_t *builder = tlv_builder_new(NULL);
+    size = BENCH_BUILD_COUNT * (BER_HEADER_BYTE_LENGTH + 8);
+    run("build_append/wide_2000", bench_build_append, NULL, size);
+    run("build_builder/wide_2000", bench_build_builder, builder, size);
+    tlv_builder_delete(&builder);
+
+    return 0;
+}
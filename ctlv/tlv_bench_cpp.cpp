@@ -0,0 +1,265 @@
+/**
+ * File:   tlv_bench_cpp.cpp
+ *
+ * @brief Benchmarks for the C++ headers of the ctlv library
+ * Run "make bench" to build and run the benchmarks, takes the arguments of tlv_bench
+ */
+
+#include "tlv.h"
+#include "tlv_builder.h"
+#include "tlv.hpp"
+#include "tlv_bench_report.h"
+#include "tlv_schema.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+#define BENCH_MIN_NS 200000000ULL
+
+
+/**
+ * A message of a fixed schema
+ */
+struct Position {
+    uint32_t latitude;
+    uint32_t longitude;
+    std::optional<uint16_t> altitude;
+};
+
+struct Report {
+    uint64_t id;
+    uint32_t time;
+    Position position;
+    std::string_view name;
+    std::optional<uint8_t> flags;
+};
+
+using PositionFields = tlv::schema::fields<
+        tlv::schema::pdo<10, &Position::latitude>,
+        tlv::schema::pdo<11, &Position::longitude>,
+        tlv::schema::pdo<12, &Position::altitude>>;
+using ReportMessage = tlv::schema::message<1, tlv::schema::fields<
+        tlv::schema::pdo<2, &Report::id>,
+        tlv::schema::pdo<3, &Report::time>,
+        tlv::schema::cdo<4, &Report::position, PositionFields>,
+        tlv::schema::pdo<5, &Report::name>,
+        tlv::schema::pdo<6, &Report::flags>>>;
+
+
+/**
+ * Input of the benchmarked operations
+ */
+struct BenchArg {
+    std::vector<uint8_t> bytes;     /**< @brief Encoded message */
+    Report report;                  /**< @brief Decoded message */
+    uint8_t buffer[256];            /**< @brief Buffer to encode into */
+};
+
+
+/**
+ * Input of the wrapper benchmarks
+ */
+struct WalkArg {
+    std::vector<uint8_t> bytes;     /**< @brief Encoded message */
+    std::vector<uint8_t> out;       /**< @brief Vector to encode into */
+    uint64_t sum;                   /**< @brief Checksum of the values, keeps the walk alive */
+};
+
+
+/********** PRIVATE DEFINITIONS ***********************************************/
+template <typename F>
+static void run(const char *name, F fn, size_t bytes_per_op) {
+    uint64_t iterations = 0;
+    uint64_t allocs = bench_report_allocs();
+    auto start = std::chrono::steady_clock::now();
+    uint64_t elapsed;
+
+    do {
+        for (int i = 0; i < 16; i++) {
+            if (!fn()) {
+                bench_report_failed(name);
+                return;
+            }
+        }
+        iterations += 16;
+        elapsed = static_cast<uint64_t> (std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+    } while (elapsed < BENCH_MIN_NS);
+
+    allocs = bench_report_allocs() - allocs;
+    bench_report(name, static_cast<double> (elapsed) / static_cast<double> (iterations), bytes_per_op,
+            static_cast<double> (allocs) / static_cast<double> (iterations));
+}
+
+
+static uint64_t read_be(const tlv_t *tlv, size_t size) {
+    uint64_t value = 0;
+
+    for (size_t i = 0; i < size && i < tlv->length; i++) {
+        value = value << 8 | tlv->value[i];
+    }
+    return value;
+}
+
+
+/**
+ * Decodes the report through a tlv_t tree and hand written extraction
+ */
+static bool decode_tree(BenchArg &a) {
+    tlv_t *root = tlv_from_byte_array_ex(a.bytes.data(), a.bytes.size(), nullptr, TLV_DECODE_BORROW);
+    Report &r = a.report;
+
+    if (root == nullptr) {
+        return false;
+    }
+    r.flags.reset();
+    r.position.altitude.reset();
+    for (const tlv_t *child = root->child; child != nullptr; child = child->next) {
+        switch (child->tag) {
+            case 2: r.id = read_be(child, 8); break;
+            case 3: r.time = static_cast<uint32_t> (read_be(child, 4)); break;
+            case 5: r.name = std::string_view(reinterpret_cast<const char*> (child->value), child->length); break;
+            case 6: r.flags = static_cast<uint8_t> (read_be(child, 1)); break;
+            case 4:
+                for (const tlv_t *p = child->child; p != nullptr; p = p->next) {
+                    switch (p->tag) {
+                        case 10: r.position.latitude = static_cast<uint32_t> (read_be(p, 4)); break;
+                        case 11: r.position.longitude = static_cast<uint32_t> (read_be(p, 4)); break;
+                        case 12: r.position.altitude = static_cast<uint16_t> (read_be(p, 2)); break;
+                    }
+                }
+                break;
+        }
+    }
+    tlv_delete_all(&root);
+    return true;
+}
+
+
+/**
+ * Encodes the report through a builder
+ */
+static bool encode_builder(BenchArg &a, tlv_builder_t *builder) {
+    uint8_t value[8];
+    const Report &r = a.report;
+    size_t size;
+
+    tlv_builder_begin_cdo(builder, 1);
+    tlv::schema::codec<uint64_t>::write(r.id, value);
+    tlv_builder_add_pdo(builder, 2, 8, value);
+    tlv::schema::codec<uint32_t>::write(r.time, value);
+    tlv_builder_add_pdo(builder, 3, 4, value);
+    tlv_builder_begin_cdo(builder, 4);
+    tlv::schema::codec<uint32_t>::write(r.position.latitude, value);
+    tlv_builder_add_pdo(builder, 10, 4, value);
+    tlv::schema::codec<uint32_t>::write(r.position.longitude, value);
+    tlv_builder_add_pdo(builder, 11, 4, value);
+    if (r.position.altitude) {
+        tlv::schema::codec<uint16_t>::write(*r.position.altitude, value);
+        tlv_builder_add_pdo(builder, 12, 2, value);
+    }
+    tlv_builder_end_cdo(builder);
+    tlv_builder_add_pdo(builder, 5, static_cast<tlv_length_t> (r.name.size()), reinterpret_cast<const uint8_t*> (r.name.data()));
+    if (r.flags) {
+        tlv_builder_add_pdo(builder, 6, 1, &*r.flags);
+    }
+    tlv_builder_end_cdo(builder);
+
+    tlv_t *root = tlv_builder_finish(builder);
+    bool ok = tlv_to_buffer(root, a.buffer, sizeof (a.buffer), &size);
+    tlv_delete_all(&root);
+    return ok;
+}
+
+
+/**
+ * Decodes, walks and encodes a message through the C functions
+ */
+static bool walk_c(WalkArg &a) {
+    tlv_t *root = tlv_from_byte_array_ex(a.bytes.data(), a.bytes.size(), nullptr, TLV_DECODE_BORROW);
+    size_t size;
+
+    if (root == nullptr) {
+        return false;
+    }
+    for (const tlv_t *cdo = root->child; cdo != nullptr; cdo = cdo->next) {
+        for (const tlv_t *pdo = cdo->child; pdo != nullptr; pdo = pdo->next) {
+            a.sum += pdo->length + pdo->value[0];
+        }
+    }
+    tlv_to_buffer(root, nullptr, 0, &size);
+    a.out.resize(size);
+    bool ok = size > 0 && tlv_to_buffer(root, a.out.data(), size, &size);
+    tlv_delete_all(&root);
+    return ok;
+}
+
+
+/**
+ * Decodes, walks and encodes a message through tlv.hpp
+ */
+static bool walk_cpp(WalkArg &a) {
+    tlv::tree tree = tlv::tree::decode(a.bytes, TLV_DECODE_BORROW);
+
+    if (!tree) {
+        return false;
+    }
+    for (tlv::node cdo : tree.root().children()) {
+        for (tlv::node pdo : cdo.children()) {
+            tlv::span<const uint8_t> value = pdo.value();
+            a.sum += value.size() + value[0];
+        }
+    }
+    a.out.clear();
+    return tree.encode(a.out);
+}
+
+
+int main(int argc, char **argv) {
+    if (!bench_report_init(argc, argv)) {
+        return 1;
+    }
+
+    BenchArg arg;
+    Report report{42, 1476263000, {47497913, 19040236, 120}, "bus-4711", 3};
+    tlv_builder_t *builder = tlv_builder_new(nullptr);
+
+    ReportMessage::encode(report, arg.bytes);
+    arg.report = report;
+    size_t size = arg.bytes.size();
+
+    run("decode_tree/report", [&] {
+        return decode_tree(arg);
+    }, size);
+    run("decode_schema/report", [&] {
+        return ReportMessage::decode(arg.bytes.data(), arg.bytes.size(), arg.report);
+    }, size);
+    run("encode_builder/report", [&] {
+        return encode_builder(arg, builder);
+    }, size);
+    run("encode_schema/report", [&] {
+        size_t written;
+        return ReportMessage::encode(arg.report, arg.buffer, sizeof (arg.buffer), written);
+    }, size);
+
+    WalkArg walk{};
+    tlv::tree tree = tlv::tree::cdo(1);
+    for (uint16_t i = 0; i < 16; i++) {
+        tlv::node cdo = tree.root().append_cdo(i);
+        for (uint16_t j = 0; j < 8; j++) {
+            uint8_t value[8] = {static_cast<uint8_t> (j + 1)};
+            cdo.append_pdo(j, tlv::span<const uint8_t>(value, sizeof (value)));
+        }
+    }
+    tree.encode(walk.bytes);
+    size = walk.bytes.size();
+
+    run("walk_c/16x8", [&] {
+        return walk_c(walk);
+    }, size);
+    run("walk_cpp/16x8", [&] {
+        return walk_cpp(walk);
+    }, size);
+
+    tlv_builder_delete(&builder);
+    return walk.sum == 0;
+}
@@ -0,0 +1,126 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "tlv_bench_report.h"
+#include <stdio.h>
+#include <string.h>
+#include <sys/resource.h>
+
+
+/**
+ * Output formats of the results
+ */
+typedef enum {
+    BENCH_TEXT,
+    BENCH_CSV,
+    BENCH_JSON
+} bench_format_t;
+
+
+/********** PRIVATE DECLARATIONS **********************************************/
+static bench_format_t format = BENCH_TEXT;
+static uint64_t allocs = 0;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void *__wrap_malloc(size_t size);
+void *__wrap_calloc(size_t count, size_t size);
+void *__wrap_realloc(void *ptr, size_t size);
+
+/**
+ * @brief Returns the peak resident set size of the process in kB
+ */
+static long peak_rss_kb(void);
+
+
+/********** PUBLIC DEFINITIONS ************************************************/
+bool bench_report_init(int argc, char **argv) {
+    bool header = true;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--csv") == 0) {
+            format = BENCH_CSV;
+        } else if (strcmp(argv[i], "--json") == 0) {
+            format = BENCH_JSON;
+        } else if (strcmp(argv[i], "--no-header") == 0) {
+            header = false;
+        } else {
+            fprintf(stderr, "usage: %s [--csv|--json] [--no-header]\n", argv[0]);
+            return false;
+        }
+    }
+    if (format == BENCH_CSV && header) {
+        printf("name,ns_per_op,mb_per_s,allocs_per_op,peak_rss_kb\n");
+    }
+
+    return true;
+}
+
+
+uint64_t bench_report_allocs(void) {
+    return __atomic_load_n(&allocs, __ATOMIC_RELAXED);
+}
+
+
+void bench_report(const char *name, double ns_per_op, size_t bytes_per_op, double allocs_per_op) {
+    double mb_per_s = (double) bytes_per_op * 1000.0 / ns_per_op;
+
+    switch (format) {
+        case BENCH_CSV:
+            printf("%s,%.1f,%.1f,%.2f,%ld\n", name, ns_per_op, mb_per_s, allocs_per_op, peak_rss_kb());
+            break;
+        case BENCH_JSON:
+            printf("{\"name\": \"%s\", \"ns_per_op\": %.1f, \"mb_per_s\": %.1f, \"allocs_per_op\": %.2f, \"peak_rss_kb\": %ld}\n",
+                    name, ns_per_op, mb_per_s, allocs_per_op, peak_rss_kb());
+            break;
+        default:
+            printf("%-32s %12.1f ns/op %10.1f MB/s %10.1f allocs/op %8ld kB rss\n", name, ns_per_op, mb_per_s, allocs_per_op, peak_rss_kb());
+            break;
+    }
+    fflush(stdout);
+}
+
+
+void bench_report_failed(const char *name) {
+    switch (format) {
+        case BENCH_CSV:
+            printf("%s,,,,\n", name);
+            break;
+        case BENCH_JSON:
+            printf("{\"name\": \"%s\", \"failed\": true}\n", name);
+            break;
+        default:
+            printf("%-32s FAILED\n", name);
+            break;
+    }
+    fflush(stdout);
+}
+
+
+void *__wrap_malloc(size_t size) {
+    __atomic_fetch_add(&allocs, 1, __ATOMIC_RELAXED);
+    return __real_malloc(size);
+}
+
+
+void *__wrap_calloc(size_t count, size_t size) {
+    __atomic_fetch_add(&allocs, 1, __ATOMIC_RELAXED);
+    return __real_calloc(count, size);
+}
+
+
+void *__wrap_realloc(void *ptr, size_t size) {
+    __atomic_fetch_add(&allocs, 1, __ATOMIC_RELAXED);
+    return __real_realloc(ptr, size);
+}
+
+
+/********** PRIVATE DEFINITIONS ***********************************************/
+static long peak_rss_kb(void) {
+    struct rusage usage;
+
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+    return usage.ru_maxrss;
+}
@@ -0,0 +1,61 @@
+#ifndef TLV_BENCH_REPORT_H_2016
+#define TLV_BENCH_REPORT_H_2016
+
+/**
+ * File:   tlv_bench_report.h
+ *
+ * @brief Measurements and output shared by the benchmark programs
+ * The benchmarks are linked with -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc, every allocation
+ * of the library passes the wrappers and is counted. Allocations of operator new are not counted.
+ *
+ * A result is printed as a line of text, a CSV row or a JSON object per line, selected by the
+ * first argument of the program ("--csv" or "--json"), so runs can be saved and compared.
+ * Every row holds the name, ns/op, MB/s, allocations per op and the peak RSS of the process so far.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    /**
+     * @brief Selects the output format from the arguments of the program
+     * "--csv" or "--json" selects the format, "--no-header" leaves out the CSV header
+     * @param[in] argc Number of arguments
+     * @param[in] argv Arguments of the program
+     * @return True if successful, false on unknown arguments
+     */
+    bool bench_report_init(int argc, char **argv);
+
+
+    /**
+     * @brief Returns the number of allocations made since the program started
+     */
+    uint64_t bench_report_allocs(void);
+
+
+    /**
+     * @brief Prints the result of a benchmark
+     * @param[in] name Name of the benchmark, "operation/shape"
+     * @param[in] ns_per_op Nanoseconds per operation
+     * @param[in] bytes_per_op Bytes processed per operation
+     * @param[in] allocs_per_op Allocations per operation
+     */
+    void bench_report(const char *name, double ns_per_op, size_t bytes_per_op, double allocs_per_op);
+
+
+    /**
+     * @brief Prints a failed benchmark
+     * @param[in] name Name of the benchmark
+     */
+    void bench_report_failed(const char *name);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TLV_BENCH_REPORT_H_2016 */
@@ -0,0 +1,183 @@
+#include "tlv_builder.h"
+#include "tlv_private.h"
+#include <string.h>
+
+
+/**
+ * An open CDO of the builder
+ */
+typedef struct {
+    tlv_t *cdo;                     /**< @brief The open CDO */
+    tlv_t *last;                    /**< @brief Last child of the CDO or NULL */
+    size_t length;                  /**< @brief Running length of the children */
+} builder_frame_t;
+
+
+/**
+ * Struct representing a builder
+ */
+struct stTLVBuilder {
+    tlv_arena_t *arena;             /**< @brief Arena to allocate in or NULL to use malloc */
+    tlv_t *root;                    /**< @brief First object on the top level */
+    tlv_t *last;                    /**< @brief Last object on the top level */
+    size_t depth;                   /**< @brief Number of open CDO's */
+    builder_frame_t stack[TLV_MAX_DEPTH]; /**< @brief The open CDO's */
+};
+
+
+/********** PRIVATE DECLARATIONS **********************************************/
+/**
+ * @brief Links an object after the last object on the current level
+ * @param[in] builder Builder to add the object to
+ * @param[in] tlv Object to add
+ * @param[in] length Encoded length of the object inclusive header
+ */
+static void builder_link(tlv_builder_t *builder, tlv_t *tlv, const size_t length);
+
+
+/********** PUBLIC DEFINITIONS ************************************************/
+tlv_builder_t* tlv_builder_new(tlv_arena_t *arena) {
+    tlv_builder_t *builder = malloc(sizeof (*builder));
+
+    if (builder == NULL) {
+        TLV_FAIL(TLV_FAILURE_MEMORY, "Fatal - Out of memory when allocating builder");
+        return NULL;
+    }
+    builder->arena = arena;
+    builder->root = NULL;
+    builder->last = NULL;
+    builder->depth = 0;
+
+    return builder;
+}
+
+
+void tlv_builder_delete(tlv_builder_t **builder) {
+    if (builder != NULL && *builder != NULL) {
+        tlv_delete_all(&(*builder)->root);
+        free(*builder);
+        *builder = NULL;
+    }
+}
+
+
+bool tlv_builder_begin_cdo(tlv_builder_t *builder, const tlv_tag_t tag) {
+    tlv_t *cdo;
+
+    if (builder == NULL) {
+        return false;
+    }
+    if (builder->depth == TLV_MAX_DEPTH) {
+        TLV_FAIL(TLV_FAILURE_DEPTH, "Error - Builder is deeper than %u levels", TLV_MAX_DEPTH);
+        return false;
+    }
+    cdo = builder->arena ? tlv_arena_new_cdo(builder->arena, tag) : tlv_new_cdo(tag);
+    if (cdo == NULL) {
+        return false;
+    }
+    builder_link(builder, cdo, 0);
+
+    builder_frame_t *frame = &builder->stack[builder->depth++];
+    frame->cdo = cdo;
+    frame->last = NULL;
+    frame->length = 0;
+
+    return true;
+}
+
+
+bool tlv_builder_add_pdo(tlv_builder_t *builder, const tlv_tag_t tag, const tlv_length_t length, const uint8_t *value) {
+    tlv_t *pdo;
+
+    if (builder == NULL || (length > 0 && value == NULL)) {
+        return false;
+    }
+    if (builder->arena != NULL) {
+        pdo = tlv_arena_new_pdo(builder->arena, tag, length, value);
+    } else {
+        uint8_t *copy = NULL;
+
+        // An empty PDO has no value, malloc(0) may return NULL
+        if (length > 0) {
+            if ((copy = malloc(length)) == NULL) {
+                TLV_FAIL(TLV_FAILURE_MEMORY, "Fatal - Out of memory when copying PDO value");
+                return false;
+            }
+            memcpy(copy, value, length);
+        }
+        if ((pdo = tlv_new_pdo(tag, length, copy)) == NULL) {
+            free(copy);
+        }
+    }
+    if (pdo == NULL) {
+        return false;
+    }
+    builder_link(builder, pdo, BER_HEADER_BYTE_LENGTH + (size_t) length);
+
+    return true;
+}
+
+
+bool tlv_builder_end_cdo(tlv_builder_t *builder) {
+    if (builder == NULL || builder->depth == 0) {
+        TLV_FAIL(TLV_FAILURE_ARGUMENT, "Error - No open CDO to end");
+        return false;
+    }
+
+    builder_frame_t *frame = &builder->stack[builder->depth - 1];
+    if (frame->length > UINT32_MAX) {
+        TLV_FAIL(TLV_FAILURE_SIZE, "Error - Too long CDO(%u): %zu", frame->cdo->tag, frame->length);
+        return false;
+    }
+    frame->cdo->length = (tlv_length_t) frame->length;
+    frame->cdo->flags |= TLV_FLAG_SIZED;
+    builder->depth--;
+    if (builder->depth > 0) {
+        builder->stack[builder->depth - 1].length += BER_HEADER_BYTE_LENGTH + frame->length;
+    }
+
+    return true;
+}
+
+
+tlv_t* tlv_builder_finish(tlv_builder_t *builder) {
+    tlv_t *root;
+
+    if (builder == NULL) {
+        return NULL;
+    }
+    if (builder->depth > 0) {
+        TLV_FAIL(TLV_FAILURE_ARGUMENT, "Error - Cannot finish builder with %u open CDO's", (unsigned) builder->depth);
+        return NULL;
+    }
+    root = builder->root;
+    builder->root = NULL;
+    builder->last = NULL;
+
+    return root;
+}
+
+
+/********** PRIVATE DEFINITIONS ***********************************************/
+static void builder_link(tlv_builder_t *builder, tlv_t *tlv, const size_t length) {
+    if (builder->depth == 0) {
+        if (builder->last == NULL) {
+            builder->root = tlv;
+        } else {
+            builder->last->next = tlv;
+        }
+        builder->last = tlv;
+        return;
+    }
+
+    builder_frame_t *frame = &builder->stack[builder->depth - 1];
+    if (frame->last == NULL) {
+        frame->cdo->child = tlv;
+    } else {
+        frame->last->next = tlv;
+    }
+    frame->last = tlv;
+    frame->length += length;
+    tlv->parent = frame->cdo;
+    tlv->level = frame->cdo->level + 1;
+}
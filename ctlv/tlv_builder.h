@@ -0,0 +1,88 @@
+#ifndef TLV_BUILDER_H_2016
+#define TLV_BUILDER_H_2016
+
+/**
+ * File:   tlv_builder.h
+ *
+ * @brief Streaming builder of TLV structures
+ * The builder keeps the last child of every open CDO, so each object is appended in constant time.
+ * It also keeps the running length of the open CDO's, the finished tree is already sized
+ * (TLV_FLAG_SIZED) and tlv_to_byte_array() does not need to sum the lengths up again.
+ *
+ * Usage:
+ *   tlv_builder_begin_cdo(builder, 1);
+ *       tlv_builder_add_pdo(builder, 2, 3, "abc");
+ *       tlv_builder_begin_cdo(builder, 3);
+ *           tlv_builder_add_pdo(builder, 35, 4, "abcd");
+ *       tlv_builder_end_cdo(builder);
+ *   tlv_builder_end_cdo(builder);
+ *   tlv_t *tlv = tlv_builder_finish(builder);
+ */
+
+#include "tlv.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    typedef struct stTLVBuilder tlv_builder_t;
+
+
+    /**
+     * @brief Creates a new builder
+     * @param[in] arena Arena to allocate the objects and values in or NULL to use malloc
+     * @return The builder or NULL
+     */
+    tlv_builder_t* tlv_builder_new(tlv_arena_t *arena);
+
+
+    /**
+     * @brief Deletes a builder and the unfinished tree in it
+     * @param[in] builder Builder to delete
+     */
+    void tlv_builder_delete(tlv_builder_t **builder);
+
+
+    /**
+     * @brief Opens a new CDO, the following objects are added as its children
+     * @param[in] builder Builder to add the CDO to
+     * @param[in] tag The tag of the CDO
+     * @return True if successful, false otherwise
+     */
+    bool tlv_builder_begin_cdo(tlv_builder_t *builder, const tlv_tag_t tag);
+
+
+    /**
+     * @brief Adds a PDO to the open CDO, the value is copied
+     * @param[in] builder Builder to add the PDO to
+     * @param[in] tag The tag of the PDO
+     * @param[in] length The length of the data
+     * @param[in] value Pointer to data to copy
+     * @return True if successful, false otherwise
+     */
+    bool tlv_builder_add_pdo(tlv_builder_t *builder, const tlv_tag_t tag, const tlv_length_t length, const uint8_t *value);
+
+
+    /**
+     * @brief Closes the open CDO and sets its length
+     * @param[in] builder Builder to close the CDO in
+     * @return True if successful, false if no CDO is open or it is too long
+     */
+    bool tlv_builder_end_cdo(tlv_builder_t *builder);
+
+
+    /**
+     * @brief Returns the built tree, the builder is ready to build the next one
+     * All CDO's must be closed. The tree belongs to the caller, it is deleted with tlv_delete_all
+     * or released with the arena of the builder.
+     * @param[in] builder Builder to finish
+     * @return The tree or NULL if nothing was built or a CDO is still open
+     */
+    tlv_t* tlv_builder_finish(tlv_builder_t *builder);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TLV_BUILDER_H_2016 */
@@ -0,0 +1,421 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "tlv_cache.h"
+#include "tlv_private.h"
+#include <pthread.h>
+#include <string.h>
+
+#define CACHE_MIN_BUCKETS 64
+
+
+/**
+ * A decoded message, the copy of the message follows the struct and the values of the tree point into it
+ */
+typedef struct cache_entry {
+    struct cache_entry *newer;      /**< @brief More recently used cached entry or NULL */
+    struct cache_entry *older;      /**< @brief Less recently used cached entry or NULL */
+    struct cache_entry *next_key;   /**< @brief Next entry in the bucket of the hash */
+    struct cache_entry *next_tree;  /**< @brief Next entry in the bucket of the tree */
+    tlv_t *tlv;                     /**< @brief The decoded tree */
+    uint64_t hash;                  /**< @brief Hash of the message */
+    size_t size;                    /**< @brief Size of the message */
+    size_t cost;                    /**< @brief Memory of the entry */
+    size_t references;              /**< @brief Number of callers holding the tree */
+    bool cached;                    /**< @brief True if the entry can be found by its message */
+    uint8_t bytes[];                /**< @brief Copy of the message */
+} cache_entry_t;
+
+/**
+ * The cache, entries are found by their hash and by their tree
+ */
+struct stTLVCache {
+    pthread_mutex_t lock;           /**< @brief Guards all members */
+    cache_entry_t **keys;           /**< @brief Cached entries by the hash of the message */
+    cache_entry_t **trees;          /**< @brief All entries not deleted yet by their tree */
+    size_t buckets;                 /**< @brief Number of buckets of both tables, a power of two */
+    cache_entry_t *newest;          /**< @brief Most recently used cached entry */
+    cache_entry_t *oldest;          /**< @brief Least recently used cached entry */
+    size_t capacity;                /**< @brief Maximum memory of the cached entries */
+    tlv_cache_stats_t stats;        /**< @brief Counters */
+};
+
+
+/********** PRIVATE DECLARATIONS **********************************************/
+/**
+ * @brief Returns the bucket of a tree
+ */
+static size_t tree_bucket(const tlv_cache_t *cache, const tlv_t *tlv);
+
+/**
+ * @brief Finds the cached entry of a message
+ * @return The entry or NULL
+ */
+static cache_entry_t* find_key(tlv_cache_t *cache, const uint64_t hash, const uint8_t *bytes, const size_t size);
+
+/**
+ * @brief Decodes a message into a new entry, outside of the lock
+ * @return The entry holding one reference or NULL
+ */
+static cache_entry_t* entry_new(const uint64_t hash, const uint8_t *bytes, const size_t size);
+
+/**
+ * @brief Deletes an entry and its tree
+ */
+static void entry_delete(cache_entry_t *entry);
+
+/**
+ * @brief Adds an entry to the tables and, if it fits, to the cache
+ */
+static void insert(tlv_cache_t *cache, cache_entry_t *entry);
+
+/**
+ * @brief Drops the least recently used entry from the cache, it is deleted if it is not held
+ */
+static void evict(tlv_cache_t *cache);
+
+/**
+ * @brief Removes an entry from the table of trees
+ */
+static void remove_tree(tlv_cache_t *cache, cache_entry_t *entry);
+
+/**
+ * @brief Moves an entry to the front of the list of cached entries
+ */
+static void touch(tlv_cache_t *cache, cache_entry_t *entry);
+
+/**
+ * @brief Unlinks an entry from the list of cached entries
+ */
+static void unlink_entry(tlv_cache_t *cache, cache_entry_t *entry);
+
+/**
+ * @brief Doubles the number of buckets of both tables
+ */
+static void grow(tlv_cache_t *cache);
+
+
+/********** PUBLIC DEFINITIONS ************************************************/
+tlv_cache_t* tlv_cache_new(const size_t capacity) {
+    tlv_cache_t *cache;
+
+    if ((cache = calloc(1, sizeof (*cache))) == NULL) {
+        TLV_FAIL(TLV_FAILURE_MEMORY, "Fatal - Out of memory when creating cache");
+        return NULL;
+    }
+    cache->buckets = CACHE_MIN_BUCKETS;
+    cache->keys = calloc(cache->buckets, sizeof (*cache->keys));
+    cache->trees = calloc(cache->buckets, sizeof (*cache->trees));
+    if (cache->keys == NULL || cache->trees == NULL || pthread_mutex_init(&cache->lock, NULL) != 0) {
+        TLV_FAIL(TLV_FAILURE_MEMORY, "Fatal - Out of memory when creating cache");
+        free(cache->keys);
+        free(cache->trees);
+        free(cache);
+        return NULL;
+    }
+    cache->capacity = capacity;
+
+    return cache;
+}
+
+
+void tlv_cache_delete(tlv_cache_t **cache) {
+    if (cache != NULL && *cache != NULL) {
+        tlv_cache_t *c = *cache;
+
+        if (c->stats.held > 0) {
+            tlv_debug_cb("Warning - Deleting cache with %u trees not released", (unsigned) c->stats.held);
+        }
+        for (size_t i = 0; i < c->buckets; i++) {
+            while (c->trees[i] != NULL) {
+                cache_entry_t *entry = c->trees[i];
+
+                c->trees[i] = entry->next_tree;
+                entry_delete(entry);
+            }
+        }
+        pthread_mutex_destroy(&c->lock);
+        free(c->keys);
+        free(c->trees);
+        free(c);
+        *cache = NULL;
+    }
+}
+
+
+const tlv_t* tlv_cache_decode(tlv_cache_t *cache, const uint8_t *barray, const size_t size) {
+    cache_entry_t *entry;
+
+    if (cache == NULL || barray == NULL) {
+        TLV_FAIL(TLV_FAILURE_ARGUMENT, "Error - Cache or byte array is null");
+        return NULL;
+    }
+    uint64_t hash = tlv_hash_raw(barray, size);
+
+    pthread_mutex_lock(&cache->lock);
+    if ((entry = find_key(cache, hash, barray, size)) != NULL) {
+        cache->stats.hits++;
+        entry->references++;
+        if (entry->references == 1) {
+            cache->stats.held++;
+        }
+        touch(cache, entry);
+        pthread_mutex_unlock(&cache->lock);
+        return entry->tlv;
+    }
+    cache->stats.misses++;
+    pthread_mutex_unlock(&cache->lock);
+
+    // Decoded without the lock, a thread decoding the same message meanwhile wins
+    if ((entry = entry_new(hash, barray, size)) == NULL) {
+        return NULL;
+    }
+    pthread_mutex_lock(&cache->lock);
+    cache_entry_t *found = find_key(cache, hash, barray, size);
+    if (found != NULL) {
+        found->references++;
+        if (found->references == 1) {
+            cache->stats.held++;
+        }
+        touch(cache, found);
+    } else {
+        insert(cache, entry);
+    }
+    pthread_mutex_unlock(&cache->lock);
+    if (found != NULL) {
+        entry_delete(entry);
+        return found->tlv;
+    }
+
+    return entry->tlv;
+}
+
+
+void tlv_cache_release(tlv_cache_t *cache, const tlv_t **tlv) {
+    cache_entry_t *entry;
+
+    if (cache == NULL || tlv == NULL || *tlv == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&cache->lock);
+    for (entry = cache->trees[tree_bucket(cache, *tlv)]; entry != NULL; entry = entry->next_tree) {
+        if (entry->tlv == *tlv) {
+            break;
+        }
+    }
+    if (entry == NULL || entry->references == 0) {
+        pthread_mutex_unlock(&cache->lock);
+        TLV_FAIL(TLV_FAILURE_ARGUMENT, "Error - Tree is not held from this cache");
+        return;
+    }
+    if (--entry->references == 0) {
+        cache->stats.held--;
+        if (!entry->cached) {
+            remove_tree(cache, entry);
+        } else {
+            entry = NULL;
+        }
+    } else {
+        entry = NULL;
+    }
+    pthread_mutex_unlock(&cache->lock);
+    if (entry != NULL) {
+        entry_delete(entry);
+    }
+    *tlv = NULL;
+}
+
+
+void tlv_cache_get_stats(tlv_cache_t *cache, tlv_cache_stats_t *stats) {
+    if (cache != NULL && stats != NULL) {
+        pthread_mutex_lock(&cache->lock);
+        *stats = cache->stats;
+        pthread_mutex_unlock(&cache->lock);
+    }
+}
+
+
+/********** PRIVATE DEFINITIONS ***********************************************/
+static size_t tree_bucket(const tlv_cache_t *cache, const tlv_t *tlv) {
+    return (size_t) (((uint64_t) (uintptr_t) tlv * TLV_HASH_SEED) >> 32) & (cache->buckets - 1);
+}
+
+
+static cache_entry_t* find_key(tlv_cache_t *cache, const uint64_t hash, const uint8_t *bytes, const size_t size) {
+    for (cache_entry_t *entry = cache->keys[hash & (cache->buckets - 1)]; entry != NULL; entry = entry->next_key) {
+        if (entry->hash == hash && entry->size == size && memcmp(entry->bytes, bytes, size) == 0) {
+            return entry;
+        }
+    }
+
+    return NULL;
+}
+
+
+static cache_entry_t* entry_new(const uint64_t hash, const uint8_t *bytes, const size_t size) {
+    cache_entry_t *entry;
+    tlv_stats_t stats;
+
+    if (!tlv_validate(bytes, size, &stats)) {
+        tlv_debug_cb("Error - Cannot cache malformed array");
+        return NULL;
+    }
+    if ((entry = malloc(sizeof (*entry) + size)) == NULL) {
+        TLV_FAIL(TLV_FAILURE_MEMORY, "Fatal - Out of memory when caching %u bytes", (unsigned) size);
+        return NULL;
+    }
+    memcpy(entry->bytes, bytes, size);
+    // All objects in one block, the values point into the copy of the message
+    entry->tlv = tlv_from_byte_array_ex(entry->bytes, size, NULL, TLV_DECODE_PREALLOC | TLV_DECODE_BORROW);
+    if (entry->tlv == NULL) {
+        tlv_debug_cb("Error - Failed to decode array to cache");
+        free(entry);
+        return NULL;
+    }
+    entry->newer = NULL;
+    entry->older = NULL;
+    entry->next_key = NULL;
+    entry->next_tree = NULL;
+    entry->hash = hash;
+    entry->size = size;
+    entry->cost = sizeof (*entry) + size + stats.objects * sizeof (tlv_t);
+    entry->references = 1;
+    entry->cached = false;
+
+    return entry;
+}
+
+
+static void entry_delete(cache_entry_t *entry) {
+    tlv_delete_all(&entry->tlv);
+    free(entry);
+}
+
+
+static void insert(tlv_cache_t *cache, cache_entry_t *entry) {
+    size_t bucket;
+
+    if (cache->stats.held + cache->stats.entries >= cache->buckets) {
+        grow(cache);
+    }
+    bucket = tree_bucket(cache, entry->tlv);
+    entry->next_tree = cache->trees[bucket];
+    cache->trees[bucket] = entry;
+    cache->stats.held++;
+
+    if (entry->cost > cache->capacity) {
+        return;
+    }
+    bucket = entry->hash & (cache->buckets - 1);
+    entry->next_key = cache->keys[bucket];
+    cache->keys[bucket] = entry;
+    entry->cached = true;
+    touch(cache, entry);
+    cache->stats.entries++;
+    cache->stats.bytes += entry->cost;
+    while (cache->stats.bytes > cache->capacity) {
+        evict(cache);
+    }
+}
+
+
+static void evict(tlv_cache_t *cache) {
+    cache_entry_t *entry = cache->oldest;
+    cache_entry_t **link = &cache->keys[entry->hash & (cache->buckets - 1)];
+
+    while (*link != entry) {
+        link = &(*link)->next_key;
+    }
+    *link = entry->next_key;
+    entry->next_key = NULL;
+    unlink_entry(cache, entry);
+    entry->cached = false;
+    cache->stats.entries--;
+    cache->stats.bytes -= entry->cost;
+    cache->stats.evictions++;
+
+    // Trees still held are deleted by the last release
+    if (entry->references == 0) {
+        remove_tree(cache, entry);
+        entry_delete(entry);
+    }
+}
+
+
+static void remove_tree(tlv_cache_t *cache, cache_entry_t *entry) {
+    cache_entry_t **link = &cache->trees[tree_bucket(cache, entry->tlv)];
+
+    while (*link != entry) {
+        link = &(*link)->next_tree;
+    }
+    *link = entry->next_tree;
+    entry->next_tree = NULL;
+}
+
+
+static void touch(tlv_cache_t *cache, cache_entry_t *entry) {
+    if (!entry->cached || cache->newest == entry) {
+        return;
+    }
+    unlink_entry(cache, entry);
+    entry->older = cache->newest;
+    if (cache->newest != NULL) {
+        cache->newest->newer = entry;
+    }
+    cache->newest = entry;
+    if (cache->oldest == NULL) {
+        cache->oldest = entry;
+    }
+}
+
+
+static void unlink_entry(tlv_cache_t *cache, cache_entry_t *entry) {
+    if (entry->newer != NULL) {
+        entry->newer->older = entry->older;
+    } else if (cache->newest == entry) {
+        cache->newest = entry->older;
+    }
+    if (entry->older != NULL) {
+        entry->older->newer = entry->newer;
+    } else if (cache->oldest == entry) {
+        cache->oldest = entry->newer;
+    }
+    entry->newer = NULL;
+    entry->older = NULL;
+}
+
+
+static void grow(tlv_cache_t *cache) {
+    size_t buckets = cache->buckets * 2;
+    cache_entry_t **keys = calloc(buckets, sizeof (*keys));
+    cache_entry_t **trees = calloc(buckets, sizeof (*trees));
+    size_t old_buckets = cache->buckets;
+
+    // Without memory the chains just get longer
+    if (keys == NULL || trees == NULL) {
+        free(keys);
+        free(trees);
+        return;
+    }
+    cache->buckets = buckets;
+    for (size_t i = 0; i < old_buckets; i++) {
+        while (cache->keys[i] != NULL) {
+            cache_entry_t *entry = cache->keys[i];
+
+            cache->keys[i] = entry->next_key;
+            entry->next_key = keys[entry->hash & (buckets - 1)];
+            keys[entry->hash & (buckets - 1)] = entry;
+        }
+        while (cache->trees[i] != NULL) {
+            cache_entry_t *entry = cache->trees[i];
+            size_t bucket = tree_bucket(cache, entry->tlv);
+
+            cache->trees[i] = entry->next_tree;
+            entry->next_tree = trees[bucket];
+            trees[bucket] = entry;
+        }
+    }
+    free(cache->keys);
+    free(cache->trees);
+    cache->keys = keys;
+    cache->trees = trees;
+}
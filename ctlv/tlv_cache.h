@@ -0,0 +1,90 @@
+#ifndef TLV_CACHE_H_2016
+#define TLV_CACHE_H_2016
+
+/**
+ * File:   tlv_cache.h
+ *
+ * @brief Decode cache sharing the trees of byte identical messages
+ * Messages are looked up by a hash of their bytes and compared in full, so a hit always returns the
+ * tree of the same bytes. A hit costs the hash and a memcmp of the message instead of a decode.
+ *
+ * The trees are shared between the callers and must not be modified. Each tlv_cache_decode is paired
+ * with a tlv_cache_release, never with tlv_delete_all. The least recently used trees are dropped
+ * from the cache when the memory of the cached trees exceeds the capacity, trees still held by a
+ * caller stay valid until they are released. A tree decoded on a miss holds a copy of the message,
+ * the message can be freed as soon as tlv_cache_decode returns.
+ *
+ * A cache can be used from several threads, the lookups are serialized by a mutex but the hashing
+ * and decoding are done outside of it.
+ */
+
+#include "tlv.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    typedef struct stTLVCache tlv_cache_t;
+
+    /**
+     * Counters of a cache
+     */
+    typedef struct {
+        uint64_t hits;              /**< @brief Decodes returning a cached tree */
+        uint64_t misses;            /**< @brief Decodes of messages not in the cache */
+        uint64_t evictions;         /**< @brief Trees dropped from the cache to stay within the capacity */
+        size_t entries;             /**< @brief Trees in the cache */
+        size_t bytes;               /**< @brief Memory of the trees in the cache */
+        size_t held;                /**< @brief Trees not released yet, in the cache or dropped from it */
+    } tlv_cache_stats_t;
+
+
+    /**
+     * @brief Creates a new decode cache
+     * @param[in] capacity Maximum memory of the cached trees in bytes, counting the objects, the copy of
+     * the message and the bookkeeping. Larger messages are decoded but not cached.
+     * @return The cache or NULL
+     */
+    tlv_cache_t* tlv_cache_new(const size_t capacity);
+
+
+    /**
+     * @brief Deletes a cache with all its trees
+     * All trees must be released before, trees still held are deleted too
+     * @param[in] cache Cache to delete
+     */
+    void tlv_cache_delete(tlv_cache_t **cache);
+
+
+    /**
+     * @brief Returns the tree of a byte array, decoded or shared from the cache
+     * @param[in] cache The cache
+     * @param[in] barray Byte array to decode
+     * @param[in] size Size of the byte array
+     * @return The read-only tree, to be released with tlv_cache_release, or NULL if the array is malformed
+     */
+    const tlv_t* tlv_cache_decode(tlv_cache_t *cache, const uint8_t *barray, const size_t size);
+
+
+    /**
+     * @brief Releases a tree returned by tlv_cache_decode
+     * The tree is deleted if it is not in the cache and no other caller holds it
+     * @param[in] cache The cache that returned the tree
+     * @param[in,out] tlv The tree, set to NULL
+     */
+    void tlv_cache_release(tlv_cache_t *cache, const tlv_t **tlv);
+
+
+    /**
+     * @brief Returns the counters of a cache
+     * @param[in] cache The cache
+     * @param[out] stats Return point of the counters
+     */
+    void tlv_cache_get_stats(tlv_cache_t *cache, tlv_cache_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TLV_CACHE_H_2016 */
@@ -0,0 +1,183 @@
+/**
+ * File:   tlv_core_test.c
+ *
+ * @brief Tests of tlv.h
+ * Run "make test" to build and run the tests
+ */
+#include "tlv_test.h"
+
+
+/********** PRIVATE DECLARATIONS **********************************************/
+/**
+ * @brief Checks which object tlv_find_by_tag finds in a tree
+ * @param[in] text The tree, see tlv_test_build
+ * @param[in] tag Tag to search for
+ * @param[in] expected Value of the object which must be found, NULL if none must be found
+ * @return True if the expected object was found
+ */
+static bool check_find(const char *text, const tlv_tag_t tag, const char *expected);
+
+
+/**
+ * @brief Checks that a tree encodes to the same bytes as the tree of a text
+ * @param[in] tlv The tree
+ * @param[in] text The expected tree, see tlv_test_build
+ * @return True if the encodings and encoded sizes are equal
+ */
+static bool check_encoding(tlv_t *tlv, const char *text);
+
+
+/**
+ * @brief Replaces the value of the PDO with tag 4 in the CDO with tag 3 in the children of a root
+ * @param[in] tlv The root
+ * @param[in] value The new value, copied
+ * @return True if successful
+ */
+static bool set_value(tlv_t *tlv, const char *value);
+
+
+/**
+ * A tag found in the next chain and among the children is found in the order of tlv_find_by_tag
+ */
+static bool test_find_order(void);
+
+
+/**
+ * Encoding a sized tree after tlv_set_value changed a length under its CDO's gives the encoding of a
+ * tree built with the new value, for built, decoded and preallocated trees. A length changed
+ * without the setter makes the encoding fail.
+ */
+static bool test_set_value_length(void);
+
+
+/********** PUBLIC DEFINITIONS ************************************************/
+int main(void) {
+    bool ok = true;
+
+    ok = test_find_order() && ok;
+    ok = test_set_value_length() && ok;
+
+    return tlv_test_result("tlv_core_test", ok);
+}
+
+
+/********** PRIVATE DEFINITIONS ***********************************************/
+static bool check_find(const char *text, const tlv_tag_t tag, const char *expected) {
+    tlv_t *tlv = tlv_test_build(text);
+    const tlv_t *found;
+    bool ok;
+
+    CHECK(tlv != NULL);
+    found = tlv_find_by_tag(tlv, tag);
+    if (expected == NULL) {
+        ok = found == NULL;
+    } else {
+        ok = found != NULL && found->type == TLV_PDO && found->length == strlen(expected)
+                && memcmp(found->value, expected, found->length) == 0;
+    }
+    tlv_delete_all(&tlv);
+    CHECK(ok);
+
+    return true;
+}
+
+
+static bool test_find_order(void) {
+    // The object itself before its children
+    CHECK(check_find("2=self", 2, "self"));
+    CHECK(check_find("1{2=child} 2=next", 2, "next"));
+
+    // The whole next chain before any children
+    CHECK(check_find("1{2=child} 3=b 4{2=other} 2=last", 2, "last"));
+
+    // The children of the last sibling first, each with its own chain before its children
+    CHECK(check_find("1{2=first} 3{2=last}", 2, "last"));
+    CHECK(check_find("1{2=first} 3{4{2=deep} 2=near}", 2, "near"));
+    CHECK(check_find("1{2=first} 3{4{2=deep}}", 2, "deep"));
+    CHECK(check_find("1{5{2=inner} 2=outer} 3{4=x}", 2, "outer"));
+    CHECK(check_find("1{2=a} 3{4=b}", 9, NULL));
+
+    return true;
+}
+
+
+static bool check_encoding(tlv_t *tlv, const char *text) {
+    tlv_t *expected = tlv_test_build(text);
+    uint8_t *barray = NULL;
+    uint8_t *expected_barray = NULL;
+    size_t size = 0;
+    size_t expected_size = 0;
+    size_t updated = 0;
+    bool ok;
+
+    CHECK(expected != NULL);
+    ok = tlv_to_byte_array(tlv, &barray, &size) && tlv_to_byte_array(expected, &expected_barray, &expected_size)
+            && size == expected_size && memcmp(barray, expected_barray, size) == 0;
+    ok = ok && tlv_update_length(tlv, &updated) && updated == size;
+    free(barray);
+    free(expected_barray);
+    tlv_delete_all(&expected);
+    CHECK(ok);
+
+    return true;
+}
+
+
+static bool set_value(tlv_t *tlv, const char *value) {
+    size_t length = strlen(value);
+    tlv_t *pdo = tlv_find_child(tlv_find_child(tlv, 3), 4);
+    uint8_t *copy = length > 0 ? malloc(length) : NULL;
+
+    CHECK(pdo != NULL && (length == 0 || copy != NULL));
+    if (length > 0) {
+        memcpy(copy, value, length);
+    }
+    if (!tlv_set_value(pdo, (tlv_length_t) length, copy)) {
+        free(copy);
+        return false;
+    }
+
+    return true;
+}
+
+
+static bool test_set_value_length(void) {
+    const char *text = "1{2=ab 3{4=cd 6=ef} 7=gh} 5=ij";
+    tlv_t *built = tlv_test_build(text);
+    tlv_t *decoded = NULL;
+    tlv_t *block = NULL;
+    uint8_t *barray = NULL;
+    size_t size = 0;
+    bool ok;
+
+    CHECK(built != NULL && tlv_to_byte_array(built, &barray, &size));
+    decoded = tlv_from_byte_array(barray, size);
+    block = tlv_from_byte_array_ex(barray, size, NULL, TLV_DECODE_PREALLOC);
+    ok = decoded != NULL && block != NULL;
+
+    // The value grows, shrinks and empties, each time encoded from the sized tree
+    for (int i = 0; ok && i < 3; i++) {
+        tlv_t *tlv = i == 0 ? built : (i == 1 ? decoded : block);
+
+        ok = check_encoding(tlv, text)
+                && set_value(tlv, "alongervalue") && check_encoding(tlv, "1{2=ab 3{4=alongervalue 6=ef} 7=gh} 5=ij")
+                && set_value(tlv, "x") && check_encoding(tlv, "1{2=ab 3{4=x 6=ef} 7=gh} 5=ij")
+                && set_value(tlv, "") && check_encoding(tlv, "1{2=ab 3{4= 6=ef} 7=gh} 5=ij");
+    }
+
+    // A length changed directly leaves the cached lengths stale and the encoding fails
+    if (ok) {
+        uint8_t *stale = NULL;
+
+        tlv_find_child(tlv_find_child(built, 3), 6)->length = 1;
+        ok = !tlv_to_byte_array(built, &stale, &size) && stale == NULL;
+        free(stale);
+    }
+    free(barray);
+    tlv_delete_all(&built);
+    tlv_delete_all(&decoded);
+    tlv_delete_all(&block);
+    CHECK(ok);
+
+    return true;
+}
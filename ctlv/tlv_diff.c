@@ -0,0 +1,801 @@
+#include "tlv_diff.h"
+#include "tlv_private.h"
+#include <string.h>
+
+#define EVENT_END 1
+
+
+/**
+ * An object or the end of a CDO met by a cursor
+ */
+typedef struct {
+    tlv_type_t type;            /**< @brief TLV_CDO, TLV_PDO, EVENT_END or TLV_NOT_SET after the last object */
+    tlv_tag_t tag;              /**< @brief Tag of the object, 0 for EVENT_END */
+    tlv_length_t length;        /**< @brief Length of the value of a PDO, 0 otherwise */
+    const uint8_t *value;       /**< @brief Value of a PDO */
+} event_t;
+
+/**
+ * Objects of one level still to walk, either tree objects or an encoding
+ */
+typedef struct {
+    const tlv_t *tlv;           /**< @brief Next tree object, NULL at the end of the level */
+    const uint8_t *bytes;       /**< @brief Encoding walked instead of tree objects or NULL */
+    size_t index;               /**< @brief Index of the next object in bytes */
+    size_t end;                 /**< @brief End of the level in bytes */
+} frame_t;
+
+/**
+ * Walks a tree and the encodings of its lazy CDO's, or a byte array, as the same events
+ */
+typedef struct {
+    frame_t frame;              /**< @brief Level being walked */
+    frame_t stack[TLV_MAX_DEPTH]; /**< @brief Levels of the open CDO's */
+    size_t depth;               /**< @brief Number of open CDO's */
+    bool single;                /**< @brief True to stop after the first top level object of a tree */
+} cursor_t;
+
+/**
+ * State of tlv_diff, the delta is written into a growing buffer
+ */
+typedef struct {
+    uint8_t *buffer;            /**< @brief The delta */
+    size_t size;                /**< @brief Number of bytes in buffer */
+    size_t capacity;            /**< @brief Size of buffer */
+    bool failed;                /**< @brief True if writing the delta failed */
+    size_t depth;               /**< @brief Number of steps in path */
+    uint8_t path[TLV_MAX_DEPTH * TLV_DELTA_STEP_SIZE]; /**< @brief Path of the CDO's being compared */
+} delta_ctx_t;
+
+/**
+ * Children of a pair of matched CDO's being compared
+ */
+typedef struct {
+    const tlv_t *from;          /**< @brief Next object of the old CDO not matched yet */
+    const tlv_t *to;            /**< @brief Next object of the new CDO */
+    size_t position;            /**< @brief Position of to among its siblings */
+} level_t;
+
+
+/********** PRIVATE DECLARATIONS **********************************************/
+/**
+ * @brief Starts a cursor on a tree
+ * @param[out] cursor Cursor to start
+ * @param[in] tlv The tree
+ * @param[in] single True to walk only the first object, false to walk the next chain too
+ */
+static void cursor_tree(cursor_t *cursor, const tlv_t *tlv, const bool single);
+
+/**
+ * @brief Starts a cursor on a byte array
+ */
+static void cursor_bytes(cursor_t *cursor, const uint8_t *bytes, const size_t size);
+
+/**
+ * @brief Moves a cursor to the next event
+ * @param[in] cursor The cursor
+ * @param[out] event Return point of the event, TLV_NOT_SET after the last object
+ * @return True if successful, false if the walk is too deep or an encoding is malformed
+ */
+static bool cursor_next(cursor_t *cursor, event_t *event);
+
+/**
+ * @brief Hashes the events of a cursor
+ */
+static bool hash_walk(cursor_t *cursor, uint64_t *hash);
+
+/**
+ * @brief Compares the events of two cursors
+ */
+static bool equal_walk(cursor_t *a, cursor_t *b);
+
+/**
+ * @brief Finds the object of an old CDO matching an object of the new one
+ * @param[in] from Next unmatched object of the old CDO
+ * @param[in] to Object of the new CDO
+ * @return The first object with the type and tag of to within TLV_DIFF_WINDOW objects or NULL
+ */
+static const tlv_t* match(const tlv_t *from, const tlv_t *to);
+
+/**
+ * @brief Writes the delta of two trees into the context
+ */
+static bool diff_tree(delta_ctx_t *ctx, const tlv_t *from, const tlv_t *to);
+
+/**
+ * @brief Makes room for n bytes at the end of the delta
+ * @return Pointer to the room or NULL if out of memory
+ */
+static uint8_t* reserve(delta_ctx_t *ctx, const size_t n);
+
+/**
+ * @brief Writes a header with 5 bytes if the length fits
+ */
+static void put_header(delta_ctx_t *ctx, const tlv_type_t type, const tlv_tag_t tag, const tlv_length_t length);
+
+/**
+ * @brief Writes the header of a CDO whose length is set by end_cdo
+ * @return Offset of the header
+ */
+static size_t begin_cdo(delta_ctx_t *ctx, const tlv_tag_t tag);
+
+/**
+ * @brief Sets the length of a CDO, the header is shrunk to 5 bytes if the length fits
+ */
+static void end_cdo(delta_ctx_t *ctx, const size_t offset);
+
+/**
+ * @brief Writes the path of the compared CDO's followed by the step to an object
+ */
+static void put_path(delta_ctx_t *ctx, const tlv_tag_t tag, const size_t position);
+
+/**
+ * @brief Writes an object with its children
+ */
+static void put_object(delta_ctx_t *ctx, const tlv_t *tlv);
+
+/**
+ * @brief Writes a remove operation
+ */
+static void put_remove(delta_ctx_t *ctx, const tlv_tag_t tag, const size_t position);
+
+/**
+ * @brief Writes an insert operation
+ */
+static void put_insert(delta_ctx_t *ctx, const tlv_t *tlv, const size_t position);
+
+/**
+ * @brief Writes a set operation
+ */
+static void put_set(delta_ctx_t *ctx, const tlv_t *tlv, const size_t position);
+
+/**
+ * @brief Applies the operations of a delta
+ */
+static bool apply_delta(tlv_t **tlv, const uint8_t *delta, const size_t size);
+
+/**
+ * @brief Applies one operation of a delta
+ * @param[in,out] tlv The tree
+ * @param[in] operation Tag of the operation
+ * @param[in] bytes Children of the operation
+ * @param[in] size Length of the children
+ * @return True if successful, false otherwise
+ */
+static bool apply_operation(tlv_t **tlv, const tlv_tag_t operation, const uint8_t *bytes, const size_t size);
+
+/**
+ * @brief Follows a path, materializing the CDO's on the way
+ * @param[in] tlv The tree
+ * @param[in] steps Steps of the path
+ * @param[in] count Number of steps
+ * @param[out] link Return point of the link to the object at the last step, or to append there
+ * @param[out] parent Return point of the CDO holding the link, NULL on the top level
+ * @return True if successful, false if the path does not fit the tree
+ */
+static bool find_link(tlv_t **tlv, const uint8_t *steps, const size_t count, tlv_t ***link, tlv_t **parent);
+
+
+/********** PUBLIC DEFINITIONS ************************************************/
+bool tlv_hash(const tlv_t *tlv, uint64_t *hash) {
+    cursor_t cursor;
+
+    if (hash == NULL) {
+        TLV_FAIL(TLV_FAILURE_ARGUMENT, "Error - Hash is null");
+        return false;
+    }
+    cursor_tree(&cursor, tlv, false);
+
+    return hash_walk(&cursor, hash);
+}
+
+
+bool tlv_hash_bytes(const uint8_t *barray, const size_t size, uint64_t *hash) {
+    cursor_t cursor;
+
+    if ((barray == NULL && size > 0) || hash == NULL) {
+        TLV_FAIL(TLV_FAILURE_ARGUMENT, "Error - Byte array or hash is null");
+        return false;
+    }
+    cursor_bytes(&cursor, barray, size);
+
+    return hash_walk(&cursor, hash);
+}
+
+
+bool tlv_equal(const tlv_t *a, const tlv_t *b) {
+    cursor_t cursor_a;
+    cursor_t cursor_b;
+
+    if (a == b) {
+        return true;
+    }
+    cursor_tree(&cursor_a, a, false);
+    cursor_tree(&cursor_b, b, false);
+
+    return equal_walk(&cursor_a, &cursor_b);
+}
+
+
+bool tlv_equal_bytes(const tlv_t *tlv, const uint8_t *barray, const size_t size) {
+    cursor_t cursor_a;
+    cursor_t cursor_b;
+
+    if (barray == NULL && size > 0) {
+        TLV_FAIL(TLV_FAILURE_ARGUMENT, "Error - Byte array is null");
+        return false;
+    }
+    cursor_tree(&cursor_a, tlv, false);
+    cursor_bytes(&cursor_b, barray, size);
+
+    return equal_walk(&cursor_a, &cursor_b);
+}
+
+
+bool tlv_diff(const tlv_t *from, const tlv_t *to, uint8_t **delta, size_t *size) {
+    delta_ctx_t ctx;
+
+    if (delta == NULL || size == NULL) {
+        TLV_FAIL(TLV_FAILURE_ARGUMENT, "Error - Delta or size is null");
+        return false;
+    }
+    TLV_TRACE_BEGIN(TLV_API_DIFF);
+    ctx.buffer = NULL;
+    ctx.size = 0;
+    ctx.capacity = 0;
+    ctx.failed = false;
+    ctx.depth = 0;
+
+    size_t offset = begin_cdo(&ctx, TLV_DELTA_TAG);
+    bool ok = diff_tree(&ctx, from, to);
+    end_cdo(&ctx, offset);
+    if (ok && !ctx.failed) {
+        *delta = ctx.buffer;
+        *size = ctx.size;
+    } else {
+        tlv_debug_cb("Error - Failed to create delta");
+        free(ctx.buffer);
+        ok = false;
+    }
+    TLV_TRACE_END(TLV_API_DIFF, ok);
+
+    return ok;
+}
+
+
+bool tlv_apply_delta(tlv_t **tlv, const uint8_t *delta, const size_t size) {
+    TLV_TRACE_BEGIN(TLV_API_APPLY_DELTA);
+    bool ok = apply_delta(tlv, delta, size);
+
+    TLV_TRACE_END(TLV_API_APPLY_DELTA, ok);
+
+    return ok;
+}
+
+
+/********** PRIVATE DEFINITIONS ***********************************************/
+static void cursor_tree(cursor_t *cursor, const tlv_t *tlv, const bool single) {
+    cursor->frame.tlv = tlv;
+    cursor->frame.bytes = NULL;
+    cursor->frame.index = 0;
+    cursor->frame.end = 0;
+    cursor->depth = 0;
+    cursor->single = single;
+}
+
+
+static void cursor_bytes(cursor_t *cursor, const uint8_t *bytes, const size_t size) {
+    cursor->frame.tlv = NULL;
+    cursor->frame.bytes = bytes;
+    cursor->frame.index = 0;
+    cursor->frame.end = size;
+    cursor->depth = 0;
+    cursor->single = false;
+}
+
+
+static bool cursor_next(cursor_t *cursor, event_t *event) {
+    frame_t *frame = &cursor->frame;
+    frame_t children;
+
+    if (frame->bytes == NULL ? frame->tlv == NULL : frame->index >= frame->end) {
+        event->type = TLV_NOT_SET;
+        if (cursor->depth > 0) {
+            *frame = cursor->stack[--cursor->depth];
+            event->type = EVENT_END;
+        }
+        event->tag = 0;
+        event->length = 0;
+        event->value = NULL;
+        return true;
+    }
+
+    if (frame->bytes == NULL) {
+        const tlv_t *tlv = frame->tlv;
+
+        frame->tlv = (cursor->single && cursor->depth == 0) ? NULL : tlv->next;
+        event->type = tlv->type;
+        event->tag = tlv->tag;
+        if (tlv->type != TLV_CDO) {
+            event->length = tlv->length;
+            event->value = tlv->value;
+            return true;
+        }
+        // The children of a lazy CDO are walked in its encoding
+        children.tlv = (tlv->flags & TLV_FLAG_LAZY) ? NULL : tlv->child;
+        children.bytes = (tlv->flags & TLV_FLAG_LAZY) ? tlv->value : NULL;
+        children.index = 0;
+        children.end = (tlv->flags & TLV_FLAG_LAZY) ? tlv->length : 0;
+    } else {
+        tlv_header_t header;
+        size_t index = frame->index;
+
+        if (!tlv_header_read(&frame->bytes[index], frame->end - index, &header) || header.length > frame->end - index - header.size) {
+            TLV_FAIL(TLV_FAILURE_MALFORMED, "Error - Wrong header at %u when comparing", (unsigned) index);
+            return false;
+        }
+        index += header.size;
+        frame->index = index + header.length;
+        event->type = header.type;
+        event->tag = header.tag;
+        if (header.type == TLV_PDO) {
+            event->length = header.length;
+            event->value = &frame->bytes[index];
+            return true;
+        }
+        children.tlv = NULL;
+        children.bytes = frame->bytes;
+        children.index = index;
+        children.end = index + header.length;
+    }
+
+    if (cursor->depth == TLV_MAX_DEPTH) {
+        TLV_FAIL(TLV_FAILURE_DEPTH, "Error - Tlv is deeper than %u levels when comparing", TLV_MAX_DEPTH);
+        return false;
+    }
+    cursor->stack[cursor->depth++] = *frame;
+    *frame = children;
+    event->length = 0;
+    event->value = NULL;
+
+    return true;
+}
+
+
+static bool hash_walk(cursor_t *cursor, uint64_t *hash) {
+    uint64_t h = TLV_HASH_SEED;
+    event_t event;
+
+    while (cursor_next(cursor, &event)) {
+        if (event.type == TLV_NOT_SET) {
+            *hash = tlv_hash_final(h);
+            return true;
+        }
+        h = tlv_hash_mix(h, (uint64_t) event.type << 56 | (uint64_t) event.tag << 32 | event.length);
+
+        // The value is read as little endian words, the same on every platform
+        const uint8_t *value = event.value;
+        size_t i = 0;
+        for (; i + 8 <= event.length; i += 8) {
+            h = tlv_hash_mix(h, tlv_load_le64(&value[i]));
+        }
+        if (i < event.length) {
+            uint64_t tail = 0;
+
+            for (unsigned shift = 0; i < event.length; i++, shift += 8) {
+                tail |= (uint64_t) value[i] << shift;
+            }
+            h = tlv_hash_mix(h, tail);
+        }
+    }
+
+    return false;
+}
+
+
+static bool equal_walk(cursor_t *a, cursor_t *b) {
+    event_t event_a;
+    event_t event_b;
+
+    do {
+        if (!cursor_next(a, &event_a) || !cursor_next(b, &event_b)) {
+            return false;
+        }
+        if (event_a.type != event_b.type || event_a.tag != event_b.tag || event_a.length != event_b.length) {
+            return false;
+        }
+        if (event_a.length > 0 && event_a.value != event_b.value && memcmp(event_a.value, event_b.value, event_a.length) != 0) {
+            return false;
+        }
+    } while (event_a.type != TLV_NOT_SET);
+
+    return true;
+}
+
+
+static const tlv_t* match(const tlv_t *from, const tlv_t *to) {
+    for (size_t i = 0; from != NULL && i < TLV_DIFF_WINDOW; from = from->next, i++) {
+        if (from->tag == to->tag && from->type == to->type) {
+            return from;
+        }
+    }
+
+    return NULL;
+}
+
+
+static bool diff_tree(delta_ctx_t *ctx, const tlv_t *from, const tlv_t *to) {
+    level_t stack[TLV_MAX_DEPTH];
+    level_t level = {from, to, 0};
+    size_t depth = 0;
+
+    // The objects of the new tree are walked in order, the objects before position are already updated.
+    // Old objects skipped by a match are removed, new objects without a match are inserted.
+    while (true) {
+        while (level.to != NULL && !ctx->failed) {
+            const tlv_t *tlv = level.to;
+            const tlv_t *old = match(level.from, tlv);
+            size_t position = level.position++;
+
+            level.to = tlv->next;
+            if (old == NULL) {
+                put_insert(ctx, tlv, position);
+                continue;
+            }
+            for (; level.from != old; level.from = level.from->next) {
+                put_remove(ctx, level.from->tag, position);
+            }
+            level.from = old->next;
+
+            if (tlv->type != TLV_CDO) {
+                if (old->length != tlv->length || (tlv->length > 0 && old->value != tlv->value
+                        && memcmp(old->value, tlv->value, tlv->length) != 0)) {
+                    put_set(ctx, tlv, position);
+                }
+            } else if ((old->flags | tlv->flags) & TLV_FLAG_LAZY) {
+                cursor_t cursor_old;
+                cursor_t cursor_new;
+
+                cursor_tree(&cursor_old, old, true);
+                cursor_tree(&cursor_new, tlv, true);
+                if (!equal_walk(&cursor_old, &cursor_new)) {
+                    put_remove(ctx, old->tag, position);
+                    put_insert(ctx, tlv, position);
+                }
+            } else if (old->child != NULL || tlv->child != NULL) {
+                if (depth == TLV_MAX_DEPTH) {
+                    TLV_FAIL(TLV_FAILURE_DEPTH, "Error - Tlv is deeper than %u levels when creating delta", TLV_MAX_DEPTH);
+                    return false;
+                }
+                uint8_t *step = &ctx->path[depth * TLV_DELTA_STEP_SIZE];
+                step[0] = (uint8_t) (tlv->tag >> 8);
+                step[1] = (uint8_t) (tlv->tag & 0x00ff);
+                step[2] = (uint8_t) (position >> 24);
+                step[3] = (uint8_t) (position >> 16);
+                step[4] = (uint8_t) (position >> 8);
+                step[5] = (uint8_t) (position & 0x00ff);
+                stack[depth++] = level;
+                ctx->depth = depth;
+                level.from = old->child;
+                level.to = tlv->child;
+                level.position = 0;
+            }
+        }
+        for (; level.from != NULL; level.from = level.from->next) {
+            put_remove(ctx, level.from->tag, level.position);
+        }
+
+        if (depth == 0 || ctx->failed) {
+            break;
+        }
+        level = stack[--depth];
+        ctx->depth = depth;
+    }
+
+    return !ctx->failed;
+}
+
+
+static uint8_t* reserve(delta_ctx_t *ctx, const size_t n) {
+    if (ctx->failed) {
+        return NULL;
+    }
+    if (ctx->capacity - ctx->size < n) {
+        size_t capacity = ctx->capacity > 0 ? ctx->capacity : 256;
+        uint8_t *buffer;
+
+        while (capacity - ctx->size < n) {
+            capacity *= 2;
+        }
+        if ((buffer = realloc(ctx->buffer, capacity)) == NULL) {
+            TLV_FAIL(TLV_FAILURE_MEMORY, "Fatal - Out of memory when writing delta");
+            ctx->failed = true;
+            return NULL;
+        }
+        ctx->buffer = buffer;
+        ctx->capacity = capacity;
+    }
+    ctx->size += n;
+
+    return &ctx->buffer[ctx->size - n];
+}
+
+
+static void put_header(delta_ctx_t *ctx, const tlv_type_t type, const tlv_tag_t tag, const tlv_length_t length) {
+    bool wide = length > UINT16_MAX;
+    uint8_t *bytes = reserve(ctx, wide ? BER_WIDE_HEADER_BYTE_LENGTH : BER_HEADER_BYTE_LENGTH);
+
+    if (bytes != NULL) {
+        tlv_header_write(bytes, type, tag, length, wide);
+    }
+}
+
+
+static size_t begin_cdo(delta_ctx_t *ctx, const tlv_tag_t tag) {
+    size_t offset = ctx->size;
+    uint8_t *bytes = reserve(ctx, BER_WIDE_HEADER_BYTE_LENGTH);
+
+    if (bytes != NULL) {
+        tlv_header_write(bytes, TLV_CDO, tag, 0, true);
+    }
+
+    return offset;
+}
+
+
+static void end_cdo(delta_ctx_t *ctx, const size_t offset) {
+    if (ctx->failed) {
+        return;
+    }
+    uint8_t *bytes = &ctx->buffer[offset];
+    tlv_tag_t tag = (tlv_tag_t) (bytes[1] << 8 | bytes[2]);
+    size_t length = ctx->size - offset - BER_WIDE_HEADER_BYTE_LENGTH;
+
+    if (length <= UINT16_MAX) {
+        tlv_header_write(bytes, TLV_CDO, tag, (tlv_length_t) length, false);
+        memmove(&bytes[BER_HEADER_BYTE_LENGTH], &bytes[BER_WIDE_HEADER_BYTE_LENGTH], length);
+        ctx->size -= BER_WIDE_HEADER_BYTE_LENGTH - BER_HEADER_BYTE_LENGTH;
+    } else if (length <= UINT32_MAX) {
+        tlv_header_write(bytes, TLV_CDO, tag, (tlv_length_t) length, true);
+    } else {
+        TLV_FAIL(TLV_FAILURE_SIZE, "Error - CDO(%u) of the delta is too long", tag);
+        ctx->failed = true;
+    }
+}
+
+
+static void put_path(delta_ctx_t *ctx, const tlv_tag_t tag, const size_t position) {
+    size_t length = (ctx->depth + 1) * TLV_DELTA_STEP_SIZE;
+
+    put_header(ctx, TLV_PDO, TLV_DELTA_PATH, (tlv_length_t) length);
+    uint8_t *bytes = reserve(ctx, length);
+    if (bytes != NULL) {
+        uint8_t *step = &bytes[length - TLV_DELTA_STEP_SIZE];
+
+        memcpy(bytes, ctx->path, length - TLV_DELTA_STEP_SIZE);
+        step[0] = (uint8_t) (tag >> 8);
+        step[1] = (uint8_t) (tag & 0x00ff);
+        step[2] = (uint8_t) (position >> 24);
+        step[3] = (uint8_t) (position >> 16);
+        step[4] = (uint8_t) (position >> 8);
+        step[5] = (uint8_t) (position & 0x00ff);
+    }
+}
+
+
+static void put_object(delta_ctx_t *ctx, const tlv_t *tlv) {
+    const tlv_t *stack[TLV_MAX_DEPTH];
+    size_t offsets[TLV_MAX_DEPTH];
+    size_t depth = 0;
+
+    while (tlv != NULL && !ctx->failed) {
+        if (tlv->type != TLV_CDO || (tlv->flags & TLV_FLAG_LAZY)) {
+            // Values of PDO's and the encoded children of lazy CDO's are copied as they are
+            put_header(ctx, tlv->type, tlv->tag, tlv->length);
+            uint8_t *bytes = reserve(ctx, tlv->length);
+            if (bytes != NULL && tlv->length > 0) {
+                memcpy(bytes, tlv->value, tlv->length);
+            }
+        } else if (tlv->child != NULL) {
+            if (depth == TLV_MAX_DEPTH) {
+                TLV_FAIL(TLV_FAILURE_DEPTH, "Error - Tlv is deeper than %u levels when creating delta", TLV_MAX_DEPTH);
+                ctx->failed = true;
+                return;
+            }
+            offsets[depth] = begin_cdo(ctx, tlv->tag);
+            stack[depth++] = tlv;
+            tlv = tlv->child;
+            continue;
+        } else {
+            put_header(ctx, TLV_CDO, tlv->tag, 0);
+        }
+
+        tlv = depth > 0 ? tlv->next : NULL;
+        while (tlv == NULL && depth > 0) {
+            end_cdo(ctx, offsets[--depth]);
+            tlv = depth > 0 ? stack[depth]->next : NULL;
+        }
+    }
+}
+
+
+static void put_remove(delta_ctx_t *ctx, const tlv_tag_t tag, const size_t position) {
+    size_t offset = begin_cdo(ctx, TLV_DELTA_REMOVE);
+
+    put_path(ctx, tag, position);
+    end_cdo(ctx, offset);
+}
+
+
+static void put_insert(delta_ctx_t *ctx, const tlv_t *tlv, const size_t position) {
+    size_t offset = begin_cdo(ctx, TLV_DELTA_INSERT);
+
+    put_path(ctx, tlv->tag, position);
+    put_object(ctx, tlv);
+    end_cdo(ctx, offset);
+}
+
+
+static void put_set(delta_ctx_t *ctx, const tlv_t *tlv, const size_t position) {
+    size_t offset = begin_cdo(ctx, TLV_DELTA_SET);
+
+    put_path(ctx, tlv->tag, position);
+    put_header(ctx, TLV_PDO, TLV_DELTA_VALUE, tlv->length);
+    uint8_t *bytes = reserve(ctx, tlv->length);
+    if (bytes != NULL && tlv->length > 0) {
+        memcpy(bytes, tlv->value, tlv->length);
+    }
+    end_cdo(ctx, offset);
+}
+
+
+static bool apply_delta(tlv_t **tlv, const uint8_t *delta, const size_t size) {
+    tlv_header_t header;
+    size_t index;
+
+    if (tlv == NULL || delta == NULL) {
+        TLV_FAIL(TLV_FAILURE_ARGUMENT, "Error - Tlv or delta is null");
+        return false;
+    }
+    if (*tlv != NULL && ((*tlv)->flags & (TLV_FLAG_ARENA | TLV_FLAG_IN_BLOCK))) {
+        TLV_FAIL(TLV_FAILURE_ARGUMENT, "Error - Cannot apply delta to a tree in an arena or block");
+        return false;
+    }
+    if (!tlv_header_read(delta, size, &header) || header.type != TLV_CDO || header.tag != TLV_DELTA_TAG
+            || header.length != size - header.size) {
+        TLV_FAIL(TLV_FAILURE_MALFORMED, "Error - Byte array is not a delta");
+        return false;
+    }
+
+    for (index = header.size; index < size; index += header.length) {
+        if (!tlv_header_read(&delta[index], size - index, &header) || header.type != TLV_CDO
+                || header.length > size - index - header.size) {
+            TLV_FAIL(TLV_FAILURE_MALFORMED, "Error - Wrong operation at %u of the delta", (unsigned) index);
+            return false;
+        }
+        index += header.size;
+        if (!apply_operation(tlv, header.tag, &delta[index], header.length)) {
+            tlv_debug_cb("Error - Failed to apply the operation at %u of the delta", (unsigned) (index - header.size));
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+static bool apply_operation(tlv_t **tlv, const tlv_tag_t operation, const uint8_t *bytes, const size_t size) {
+    tlv_header_t path;
+    tlv_header_t header;
+    tlv_t **link;
+    tlv_t *parent;
+    tlv_t *object;
+
+    if (!tlv_header_read(bytes, size, &path) || path.type != TLV_PDO || path.tag != TLV_DELTA_PATH || path.length == 0
+            || path.length % TLV_DELTA_STEP_SIZE != 0 || path.length > size - path.size) {
+        TLV_FAIL(TLV_FAILURE_MALFORMED, "Error - Wrong path in delta");
+        return false;
+    }
+    const uint8_t *steps = &bytes[path.size];
+    size_t index = path.size + path.length;
+    tlv_tag_t tag = (tlv_tag_t) (steps[path.length - TLV_DELTA_STEP_SIZE] << 8 | steps[path.length - TLV_DELTA_STEP_SIZE + 1]);
+
+    if (!find_link(tlv, steps, path.length / TLV_DELTA_STEP_SIZE, &link, &parent)) {
+        return false;
+    }
+    object = *link;
+
+    switch (operation) {
+        case TLV_DELTA_REMOVE:
+            if (object == NULL || object->tag != tag) {
+                TLV_FAIL(TLV_FAILURE_MALFORMED, "Error - No object(%u) to remove", tag);
+                return false;
+            }
+            *link = object->next;
+            object->next = NULL;
+            tlv_delete_all(&object);
+            break;
+        case TLV_DELTA_INSERT:
+            if (!tlv_header_read(&bytes[index], size - index, &header) || header.tag != tag
+                    || header.length != size - index - header.size) {
+                TLV_FAIL(TLV_FAILURE_MALFORMED, "Error - Wrong object(%u) to insert", tag);
+                return false;
+            }
+            if ((object = tlv_from_byte_array(&bytes[index], size - index)) == NULL) {
+                tlv_debug_cb("Error - Failed to decode object(%u) to insert", tag);
+                return false;
+            }
+            object->next = *link;
+            object->parent = parent;
+            object->level = parent != NULL ? (tlv_level_t) (parent->level + 1) : 0;
+            object->flags |= TLV_FLAG_DIRTY;
+            *link = object;
+            break;
+        case TLV_DELTA_SET:
+            if (!tlv_header_read(&bytes[index], size - index, &header) || header.type != TLV_PDO || header.tag != TLV_DELTA_VALUE
+                    || header.length != size - index - header.size) {
+                TLV_FAIL(TLV_FAILURE_MALFORMED, "Error - Wrong value of PDO(%u) in delta", tag);
+                return false;
+            }
+            if (object == NULL || object->tag != tag || object->type != TLV_PDO) {
+                TLV_FAIL(TLV_FAILURE_MALFORMED, "Error - No PDO(%u) to set", tag);
+                return false;
+            }
+            uint8_t *value = NULL;
+            if (header.length > 0) {
+                if ((value = malloc(header.length)) == NULL) {
+                    TLV_FAIL(TLV_FAILURE_MEMORY, "Fatal - Out of memory when setting value of PDO(%u)", tag);
+                    return false;
+                }
+                memcpy(value, &bytes[index + header.size], header.length);
+            }
+            if (!tlv_set_value(object, header.length, value)) {
+                free(value);
+                return false;
+            }
+            return true;
+        default:
+            TLV_FAIL(TLV_FAILURE_MALFORMED, "Error - Unknown operation(%u) in delta", operation);
+            return false;
+    }
+    tlv_invalidate_length(parent);
+    tlv_mark_dirty(parent);
+
+    return true;
+}
+
+
+static bool find_link(tlv_t **tlv, const uint8_t *steps, const size_t count, tlv_t ***link, tlv_t **parent) {
+    tlv_t **slot = tlv;
+    tlv_t *cdo = NULL;
+
+    for (size_t i = 0; i < count; i++) {
+        const uint8_t *step = &steps[i * TLV_DELTA_STEP_SIZE];
+        tlv_tag_t tag = (tlv_tag_t) (step[0] << 8 | step[1]);
+        uint32_t position = (uint32_t) step[2] << 24 | (uint32_t) step[3] << 16 | (uint32_t) step[4] << 8 | step[5];
+
+        for (; position > 0 && *slot != NULL; position--) {
+            slot = &(*slot)->next;
+        }
+        if (position > 0) {
+            TLV_FAIL(TLV_FAILURE_MALFORMED, "Error - Position in delta path is out of range at level %u", (unsigned) i);
+            return false;
+        }
+        if (i + 1 == count) {
+            break;
+        }
+        if (*slot == NULL || (*slot)->tag != tag || (*slot)->type != TLV_CDO) {
+            TLV_FAIL(TLV_FAILURE_MALFORMED, "Error - Delta path does not fit the tree at level %u", (unsigned) i);
+            return false;
+        }
+        cdo = *slot;
+        if (!tlv_materialize(cdo)) {
+            return false;
+        }
+        slot = &cdo->child;
+    }
+    *link = slot;
+    *parent = cdo;
+
+    return true;
+}
@@ -0,0 +1,120 @@
+#ifndef TLV_DIFF_H_2016
+#define TLV_DIFF_H_2016
+
+/**
+ * File:   tlv_diff.h
+ *
+ * @brief Structural hash, equality and deltas of TLV structures
+ * The hash and the equality depend only on the types, tags and values of the objects and on how they
+ * are nested, not on the width of the headers or on how a tree was decoded. A tree and its encoding
+ * hash to the same value, on every platform. Lazy CDO's are read from their encoding, nothing is
+ * decoded or encoded.
+ *
+ * A delta holds the changes from one tree to another and is an ordinary TLV message:
+ *   |cdo+TLV_DELTA_TAG|
+ *      |cdo+TLV_DELTA_REMOVE|          - removes an object
+ *         |pdo+TLV_DELTA_PATH|
+ *      |cdo+TLV_DELTA_INSERT|          - inserts the encoded object following the path
+ *         |pdo+TLV_DELTA_PATH|
+ *         |cdo or pdo|
+ *      |cdo+TLV_DELTA_SET|             - sets the value of a PDO
+ *         |pdo+TLV_DELTA_PATH|
+ *         |pdo+TLV_DELTA_VALUE|
+ *
+ * A path holds one step of 6 bytes per level, starting with the top level objects of the next chain:
+ * the tag of the object (2 bytes) and its position among its siblings (4 bytes), big endian.
+ * The operations are applied in order, the positions refer to the tree as updated by the operations
+ * before. Children of a CDO are matched by their tags in order, objects which were moved, removed or
+ * added are removed and inserted, values of matched PDO's are set. Lazy CDO's are compared from their
+ * encoding and sent whole if they differ, materialize them to get finer deltas.
+ */
+
+#include "tlv.h"
+
+
+#ifndef TLV_DIFF_WINDOW
+#define TLV_DIFF_WINDOW 32
+#endif
+
+#define TLV_DELTA_TAG 0xFFF0
+#define TLV_DELTA_REMOVE 1
+#define TLV_DELTA_INSERT 2
+#define TLV_DELTA_SET 3
+#define TLV_DELTA_PATH 1
+#define TLV_DELTA_VALUE 2
+#define TLV_DELTA_STEP_SIZE 6
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    /**
+     * @brief Calculates the structural hash of a tree with its next chain
+     * @param[in] tlv The tree, NULL hashes as an empty byte array
+     * @param[out] hash Return point of the 64-bit hash
+     * @return True if successful, false if the tree is too deep or a lazy CDO is malformed
+     */
+    bool tlv_hash(const tlv_t *tlv, uint64_t *hash);
+
+
+    /**
+     * @brief Calculates the structural hash of an encoded byte array, equal to the hash of its tree
+     * @param[in] barray Byte array holding one or more messages
+     * @param[in] size Size of the byte array
+     * @param[out] hash Return point of the 64-bit hash
+     * @return True if successful, false if the array is malformed or too deep
+     */
+    bool tlv_hash_bytes(const uint8_t *barray, const size_t size, uint64_t *hash);
+
+
+    /**
+     * @brief Compares two trees with their next chains
+     * The walk stops at the first difference
+     * @param[in] a First tree
+     * @param[in] b Second tree
+     * @return True if the trees hold the same objects, false if not or on failure
+     */
+    bool tlv_equal(const tlv_t *a, const tlv_t *b);
+
+
+    /**
+     * @brief Compares a tree with an encoded byte array without decoding or encoding
+     * @param[in] tlv The tree
+     * @param[in] barray Byte array holding one or more messages
+     * @param[in] size Size of the byte array
+     * @return True if the array is an encoding of the tree, false if not or on failure
+     */
+    bool tlv_equal_bytes(const tlv_t *tlv, const uint8_t *barray, const size_t size);
+
+
+    /**
+     * @brief Creates the delta changing a tree into another one
+     * Children are matched in order within TLV_DIFF_WINDOW objects, so the delta is small for
+     * changed values and a few added or removed objects, but not minimal after large moves.
+     * A delta without changes is BER_HEADER_BYTE_LENGTH bytes long.
+     * @param[in] from The tree the peer has, NULL for none
+     * @param[in] to The tree the peer shall get, NULL for none
+     * @param[out] delta Return point of the encoded delta, must be freed by the caller
+     * @param[out] size Size of the delta
+     * @return True if successful, false on failure
+     */
+    bool tlv_diff(const tlv_t *from, const tlv_t *to, uint8_t **delta, size_t *size);
+
+
+    /**
+     * @brief Applies a delta of tlv_diff to a tree
+     * Inserted objects and set values are copied from the delta, objects on the paths are materialized.
+     * The tree must not be allocated in an arena or a preallocated block.
+     * On failure the operations before the failing one stay applied.
+     * @param[in,out] tlv The tree, may be NULL or change if top level objects are inserted or removed
+     * @param[in] delta The encoded delta
+     * @param[in] size Size of the delta
+     * @return True if successful, false if the delta is malformed or does not fit the tree
+     */
+    bool tlv_apply_delta(tlv_t **tlv, const uint8_t *delta, const size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TLV_DIFF_H_2016 */
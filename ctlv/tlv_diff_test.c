@@ -0,0 +1,70 @@
+/**
+ * File:   tlv_diff_test.c
+ *
+ * @brief Tests of tlv_diff.h
+ * Run "make test" to build and run the tests
+ */
+#include "tlv_diff.h"
+#include "tlv_test.h"
+
+/**
+ * Pairs of trees, see tlv_test_build
+ */
+static const char *const TEST_PAIRS[][2] = {
+    {"1{2=alpha 3=beta 4{5=x 6=y} 7=gamma} 8=tail", "1{2=alpha 3=beta 4{5=x 6=y} 7=gamma} 8=tail"},
+    {"1{2=alpha 3=beta 4{5=x 6=y} 7=gamma} 8=tail", "1{2=alpha 3=BETA! 4{5=x 6=} 7=gamma} 8=tail"},
+    {"1{2=alpha 3=beta 4{5=x 6=y} 7=gamma} 8=tail", "1{2=alpha 4{6=y 9=new 9=again} 10=added} 8=tail"},
+    {"1{2=a 3=b 4=c 5=d}", "1{5=d 4=c 3=b 2=a}"},
+    {"1{2=a 2=b 2=c}", "1{2=b 2=c 2=a 2=b}"},
+    {"1{2=value 3{}}", "1{2{4=cdo} 3=pdo}"},
+    {"1{2=a} 3=b", "3=b 1{2=a} 4{5{6{7=deep}}}"},
+    {"1{2=a} 3=b 4=c", "1{2=a}"},
+    {"", "1{2=a 3{4=b}} 5=c"},
+    {"1{2=a 3{4=b}} 5=c", ""},
+};
+
+
+/********** PRIVATE DECLARATIONS **********************************************/
+/**
+ * tlv_apply_delta of the delta of tlv_diff changes the first tree of a pair into the second one
+ */
+static bool test_round_trip(const char *from_text, const char *to_text);
+
+
+/********** PUBLIC DEFINITIONS ************************************************/
+int main(void) {
+    bool ok = true;
+
+    for (size_t i = 0; i < sizeof (TEST_PAIRS) / sizeof (TEST_PAIRS[0]); i++) {
+        if (!test_round_trip(TEST_PAIRS[i][0], TEST_PAIRS[i][1])) {
+            fprintf(stderr, "failed: \"%s\" -> \"%s\"\n", TEST_PAIRS[i][0], TEST_PAIRS[i][1]);
+            ok = false;
+        }
+    }
+
+    return tlv_test_result("tlv_diff_test", ok);
+}
+
+
+/********** PRIVATE DEFINITIONS ***********************************************/
+static bool test_round_trip(const char *from_text, const char *to_text) {
+    tlv_t *from = tlv_test_build(from_text);
+    tlv_t *to = tlv_test_build(to_text);
+    uint8_t *delta = NULL;
+    size_t size = 0;
+    bool ok;
+
+    CHECK((from != NULL || *from_text == '\0') && (to != NULL || *to_text == '\0'));
+    CHECK(tlv_diff(from, to, &delta, &size));
+    if (strcmp(from_text, to_text) == 0) {
+        CHECK(size == BER_HEADER_BYTE_LENGTH);
+    }
+    CHECK(tlv_apply_delta(&from, delta, size));
+    ok = to == NULL ? from == NULL : tlv_equal(from, to);
+    free(delta);
+    tlv_delete_all(&from);
+    tlv_delete_all(&to);
+    CHECK(ok);
+
+    return true;
+}
@@ -0,0 +1,436 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "tlv_dump.h"
+#include "tlv_private.h"
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+
+/**
+ * State of a dump, the output is collected in buffer and written in chunks
+ */
+typedef struct {
+    tlv_dump_format_t format;           /**< @brief Output format */
+    tlv_dump_write_t write;             /**< @brief Writer of the chunks */
+    void *arg;                          /**< @brief User argument of the writer */
+    bool failed;                        /**< @brief True if the writer failed */
+    bool first;                         /**< @brief True if the next object is the first of its CDO */
+    size_t used;                        /**< @brief Number of bytes in buffer */
+    char buffer[TLV_DUMP_CHUNK_SIZE];   /**< @brief Output not yet written */
+} dump_ctx_t;
+
+
+/********** PRIVATE DECLARATIONS **********************************************/
+static const char hex_digits[16] = {'0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'A', 'B', 'C', 'D', 'E', 'F'};
+
+/**
+ * @brief Dumps a tree with its next chain
+ * @param[in] ctx State of the dump
+ * @param[in] tlv The tree
+ * @return True if successful, false if the tree is too deep or the writer failed
+ */
+static bool dump_tree(dump_ctx_t *ctx, const tlv_t *tlv);
+
+/**
+ * @brief Dumps the objects of a byte array
+ * @param[in] ctx State of the dump
+ * @param[in] bytes The byte array
+ * @param[in] size Size of the byte array
+ * @param[in] level Level of the first objects
+ * @param[in] top True if the objects are top level objects, each one ends a line in the HEX and JSON formats
+ * @return True if successful, false if the array is malformed or the writer failed
+ */
+static bool dump_array(dump_ctx_t *ctx, const uint8_t *bytes, const size_t size, const size_t level, const bool top);
+
+/**
+ * @brief Writes the beginning of a CDO, its children follow
+ */
+static void begin_cdo(dump_ctx_t *ctx, const tlv_tag_t tag, const size_t level);
+
+/**
+ * @brief Writes the end of a CDO after its children
+ */
+static void end_cdo(dump_ctx_t *ctx);
+
+/**
+ * @brief Writes a PDO
+ */
+static void put_pdo(dump_ctx_t *ctx, const tlv_tag_t tag, const uint8_t *value, const tlv_length_t length, const size_t level);
+
+/**
+ * @brief Ends a top level object
+ */
+static void end_top(dump_ctx_t *ctx);
+
+/**
+ * @brief Writes the buffer to the writer
+ */
+static void flush(dump_ctx_t *ctx);
+
+/**
+ * @brief Appends bytes to the output
+ */
+static void put(dump_ctx_t *ctx, const char *data, size_t size);
+
+/**
+ * @brief Appends the indentation of a level to the output
+ */
+static void put_indent(dump_ctx_t *ctx, size_t level);
+
+/**
+ * @brief Appends an unsigned number in decimal to the output
+ */
+static void put_uint(dump_ctx_t *ctx, uint32_t value);
+
+/**
+ * @brief Appends a value in hex to the output, as "0xAB " per byte if spaced
+ */
+static void put_hex(dump_ctx_t *ctx, const uint8_t *value, const tlv_length_t length, const bool spaced);
+
+/**
+ * @brief Writer to a FILE*
+ */
+static bool write_file(void *arg, const char *data, const size_t size);
+
+/**
+ * @brief Writer to a file descriptor
+ */
+static bool write_fd(void *arg, const char *data, const size_t size);
+
+
+/********** PUBLIC DEFINITIONS ************************************************/
+bool tlv_dump(const tlv_t *tlv, const tlv_dump_format_t format, tlv_dump_write_t write, void *arg) {
+    dump_ctx_t ctx;
+
+    if (write == NULL) {
+        return false;
+    }
+    ctx.format = format;
+    ctx.write = write;
+    ctx.arg = arg;
+    ctx.failed = false;
+    ctx.first = true;
+    ctx.used = 0;
+
+    bool ok = dump_tree(&ctx, tlv);
+    flush(&ctx);
+
+    return ok && !ctx.failed;
+}
+
+
+bool tlv_dump_bytes(const uint8_t *barray, const size_t size, const tlv_dump_format_t format, tlv_dump_write_t write, void *arg) {
+    dump_ctx_t ctx;
+
+    if (barray == NULL || write == NULL) {
+        return false;
+    }
+    ctx.format = format;
+    ctx.write = write;
+    ctx.arg = arg;
+    ctx.failed = false;
+    ctx.first = true;
+    ctx.used = 0;
+
+    bool ok = dump_array(&ctx, barray, size, 0, true);
+    flush(&ctx);
+
+    return ok && !ctx.failed;
+}
+
+
+bool tlv_dump_file(const tlv_t *tlv, const tlv_dump_format_t format, FILE *file) {
+    if (file == NULL) {
+        return false;
+    }
+
+    return tlv_dump(tlv, format, write_file, file);
+}
+
+
+bool tlv_dump_fd(const tlv_t *tlv, const tlv_dump_format_t format, const int fd) {
+    int arg = fd;
+
+    return tlv_dump(tlv, format, write_fd, &arg);
+}
+
+
+/********** PRIVATE DEFINITIONS ***********************************************/
+static bool dump_tree(dump_ctx_t *ctx, const tlv_t *tlv) {
+    const tlv_t *stack[TLV_MAX_DEPTH];
+    size_t depth = 0;
+
+    while (tlv != NULL && !ctx->failed) {
+        if (tlv->type == TLV_CDO) {
+            begin_cdo(ctx, tlv->tag, depth);
+            if (tlv->flags & TLV_FLAG_LAZY) {
+                // The children are still encoded, they are dumped from the byte array
+                if (!dump_array(ctx, tlv->value, tlv->length, depth + 1, false)) {
+                    return false;
+                }
+            } else if (tlv->child != NULL) {
+                if (depth == TLV_MAX_DEPTH) {
+                    TLV_FAIL(TLV_FAILURE_DEPTH, "Error - Tlv is deeper than %u levels when dumping", TLV_MAX_DEPTH);
+                    return false;
+                }
+                stack[depth++] = tlv;
+                tlv = tlv->child;
+                continue;
+            }
+            end_cdo(ctx);
+        } else {
+            put_pdo(ctx, tlv->tag, tlv->value, tlv->length, depth);
+        }
+        if (depth == 0) {
+            end_top(ctx);
+        }
+
+        tlv = tlv->next;
+        while (tlv == NULL && depth > 0) {
+            end_cdo(ctx);
+            tlv = stack[--depth]->next;
+            if (depth == 0) {
+                end_top(ctx);
+            }
+        }
+    }
+
+    return !ctx->failed;
+}
+
+
+static bool dump_array(dump_ctx_t *ctx, const uint8_t *bytes, const size_t size, const size_t level, const bool top) {
+    size_t stack[TLV_MAX_DEPTH];
+    size_t depth = 0;
+    size_t index = 0;
+    size_t end = size;
+
+    while (!ctx->failed) {
+        while (index < end && !ctx->failed) {
+            tlv_header_t header;
+
+            if (!tlv_header_read(&bytes[index], end - index, &header) || header.length > end - index - header.size) {
+                TLV_FAIL(TLV_FAILURE_MALFORMED, "Error - Wrong header at %u when dumping", (unsigned) index);
+                return false;
+            }
+            index += header.size;
+
+            if (header.type == TLV_PDO) {
+                put_pdo(ctx, header.tag, &bytes[index], header.length, level + depth);
+                index += header.length;
+            } else {
+                begin_cdo(ctx, header.tag, level + depth);
+                if (header.length > 0) {
+                    if (depth == TLV_MAX_DEPTH) {
+                        TLV_FAIL(TLV_FAILURE_DEPTH, "Error - Array is deeper than %u levels when dumping", TLV_MAX_DEPTH);
+                        return false;
+                    }
+                    stack[depth++] = end;
+                    end = index + header.length;
+                    continue;
+                }
+                end_cdo(ctx);
+            }
+            if (top && depth == 0) {
+                end_top(ctx);
+            }
+        }
+
+        if (depth == 0) {
+            break;
+        }
+        end = stack[--depth];
+        end_cdo(ctx);
+        if (top && depth == 0) {
+            end_top(ctx);
+        }
+    }
+
+    return !ctx->failed;
+}
+
+
+static void begin_cdo(dump_ctx_t *ctx, const tlv_tag_t tag, const size_t level) {
+    switch (ctx->format) {
+        case TLV_DUMP_HEX:
+            if (!ctx->first) {
+                put(ctx, " ", 1);
+            }
+            put_uint(ctx, tag);
+            put(ctx, "{", 1);
+            break;
+        case TLV_DUMP_JSON:
+            put(ctx, ctx->first ? "{\"tag\":" : ",{\"tag\":", ctx->first ? 7 : 8);
+            put_uint(ctx, tag);
+            put(ctx, ",\"children\":[", 13);
+            break;
+        default:
+            put_indent(ctx, level);
+            put(ctx, "|cdo+", 5);
+            put_uint(ctx, tag);
+            put(ctx, "|-[]\n", 5);
+            break;
+    }
+    ctx->first = true;
+}
+
+
+static void end_cdo(dump_ctx_t *ctx) {
+    switch (ctx->format) {
+        case TLV_DUMP_HEX:
+            put(ctx, "}", 1);
+            break;
+        case TLV_DUMP_JSON:
+            put(ctx, "]}", 2);
+            break;
+        default:
+            break;
+    }
+    ctx->first = false;
+}
+
+
+static void put_pdo(dump_ctx_t *ctx, const tlv_tag_t tag, const uint8_t *value, const tlv_length_t length, const size_t level) {
+    switch (ctx->format) {
+        case TLV_DUMP_HEX:
+            if (!ctx->first) {
+                put(ctx, " ", 1);
+            }
+            put_uint(ctx, tag);
+            put(ctx, "=", 1);
+            put_hex(ctx, value, length, false);
+            break;
+        case TLV_DUMP_JSON:
+            put(ctx, ctx->first ? "{\"tag\":" : ",{\"tag\":", ctx->first ? 7 : 8);
+            put_uint(ctx, tag);
+            put(ctx, ",\"value\":\"", 10);
+            put_hex(ctx, value, length, false);
+            put(ctx, "\"}", 2);
+            break;
+        default:
+            put_indent(ctx, level);
+            put(ctx, "|pdo+", 5);
+            put_uint(ctx, tag);
+            put(ctx, length > 0 ? "|-[ " : "|-[", length > 0 ? 4 : 3);
+            put_hex(ctx, value, length, true);
+            put(ctx, "]\n", 2);
+            break;
+    }
+    ctx->first = false;
+}
+
+
+static void end_top(dump_ctx_t *ctx) {
+    if (ctx->format != TLV_DUMP_TREE) {
+        put(ctx, "\n", 1);
+    }
+    ctx->first = true;
+}
+
+
+static void flush(dump_ctx_t *ctx) {
+    if (ctx->used > 0 && !ctx->failed) {
+        ctx->failed = !ctx->write(ctx->arg, ctx->buffer, ctx->used);
+    }
+    ctx->used = 0;
+}
+
+
+static void put(dump_ctx_t *ctx, const char *data, size_t size) {
+    while (size > 0) {
+        size_t room = TLV_DUMP_CHUNK_SIZE - ctx->used;
+        size_t n = size < room ? size : room;
+
+        memcpy(&ctx->buffer[ctx->used], data, n);
+        ctx->used += n;
+        data += n;
+        size -= n;
+        if (ctx->used == TLV_DUMP_CHUNK_SIZE) {
+            flush(ctx);
+        }
+    }
+}
+
+
+static void put_indent(dump_ctx_t *ctx, size_t level) {
+    static const char spaces[] = "                                                                ";
+    size_t count = 4 * level;
+
+    while (count > 0) {
+        size_t n = count < sizeof (spaces) - 1 ? count : sizeof (spaces) - 1;
+
+        put(ctx, spaces, n);
+        count -= n;
+    }
+}
+
+
+static void put_uint(dump_ctx_t *ctx, uint32_t value) {
+    char digits[10];
+    size_t count = 0;
+
+    do {
+        digits[sizeof (digits) - ++count] = (char) ('0' + value % 10);
+        value /= 10;
+    } while (value > 0);
+    put(ctx, &digits[sizeof (digits) - count], count);
+}
+
+
+static void put_hex(dump_ctx_t *ctx, const uint8_t *value, const tlv_length_t length, const bool spaced) {
+    size_t step = spaced ? 5 : 2;
+    size_t i = 0;
+
+    // Written straight into the buffer as many bytes at a time as fit, then the buffer is flushed
+    while (i < length) {
+        size_t count = (TLV_DUMP_CHUNK_SIZE - ctx->used) / step;
+        char *out = &ctx->buffer[ctx->used];
+
+        if (count == 0) {
+            flush(ctx);
+            continue;
+        }
+        if (count > length - i) {
+            count = length - i;
+        }
+        for (size_t end = i + count; i < end; i++) {
+            if (spaced) {
+                *out++ = '0';
+                *out++ = 'x';
+                *out++ = hex_digits[value[i] >> 4];
+                *out++ = hex_digits[value[i] & 0x0f];
+                *out++ = ' ';
+            } else {
+                *out++ = hex_digits[value[i] >> 4];
+                *out++ = hex_digits[value[i] & 0x0f];
+            }
+        }
+        ctx->used += count * step;
+    }
+}
+
+
+static bool write_file(void *arg, const char *data, const size_t size) {
+    return fwrite(data, 1, size, (FILE*) arg) == size;
+}
+
+
+static bool write_fd(void *arg, const char *data, const size_t size) {
+    int fd = *(int*) arg;
+    size_t written = 0;
+
+    while (written < size) {
+        ssize_t ret = write(fd, &data[written], size - written);
+
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        written += (size_t) ret;
+    }
+
+    return true;
+}
@@ -0,0 +1,100 @@
+#ifndef TLV_DUMP_H_2016
+#define TLV_DUMP_H_2016
+
+/**
+ * File:   tlv_dump.h
+ *
+ * @brief Streaming output of trees and byte arrays as text, hex or JSON
+ * The output is formatted into a fixed buffer on the stack and handed out in chunks to a writer
+ * callback, a FILE* or a file descriptor. Nothing is allocated, the time is linear in the size of
+ * the output and the memory is bounded by the chunk size and TLV_MAX_DEPTH.
+ *
+ * Formats, with top level objects of a next chain or a byte array holding several messages
+ * written after each other:
+ *   TLV_DUMP_TREE  The text of tlv_to_string, one object per line indented by level
+ *   TLV_DUMP_HEX   One line per top level object, "1{2=0A0B 3{}}" for a CDO(1) holding a PDO(2)
+ *                  with the value 0x0A 0x0B and an empty CDO(3)
+ *   TLV_DUMP_JSON  One JSON object per line, {"tag":1,"children":[{"tag":2,"value":"0A0B"}]}
+ *
+ * The children of lazy CDO's are dumped from their encoding without decoding them.
+ */
+
+#include "tlv.h"
+#include <stdio.h>
+
+#ifndef TLV_DUMP_CHUNK_SIZE
+#define TLV_DUMP_CHUNK_SIZE 4096
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    /**
+     * Output formats of the dumper
+     */
+    typedef enum {
+        TLV_DUMP_TREE = 0,      /**< @brief Indented text, as tlv_to_string */
+        TLV_DUMP_HEX,           /**< @brief Compact hex, one line per top level object */
+        TLV_DUMP_JSON           /**< @brief JSON, one object per line */
+    } tlv_dump_format_t;
+
+    /**
+     * @brief Receives a chunk of the output
+     * @param[in] arg User argument of the dumper
+     * @param[in] data The chunk, not null terminated
+     * @param[in] size Size of the chunk
+     * @return True to go on, false to stop the dumper
+     */
+    typedef bool (*tlv_dump_write_t)(void *arg, const char *data, const size_t size);
+
+
+    /**
+     * @brief Dumps a tree with its next chain
+     * @param[in] tlv The tree
+     * @param[in] format Output format
+     * @param[in] write Writer of the chunks
+     * @param[in] arg User argument passed to write
+     * @return True if successful, false if the tree is too deep or the writer failed
+     */
+    bool tlv_dump(const tlv_t *tlv, const tlv_dump_format_t format, tlv_dump_write_t write, void *arg);
+
+
+    /**
+     * @brief Dumps an encoded byte array without decoding it
+     * The output up to a malformed object is written before the function fails
+     * @param[in] barray Byte array holding one or more messages
+     * @param[in] size Size of the byte array
+     * @param[in] format Output format
+     * @param[in] write Writer of the chunks
+     * @param[in] arg User argument passed to write
+     * @return True if successful, false if the array is malformed or the writer failed
+     */
+    bool tlv_dump_bytes(const uint8_t *barray, const size_t size, const tlv_dump_format_t format, tlv_dump_write_t write, void *arg);
+
+
+    /**
+     * @brief Dumps a tree with its next chain to a stream
+     * @param[in] tlv The tree
+     * @param[in] format Output format
+     * @param[in] file Stream to write to
+     * @return True if successful, false on failure
+     */
+    bool tlv_dump_file(const tlv_t *tlv, const tlv_dump_format_t format, FILE *file);
+
+
+    /**
+     * @brief Dumps a tree with its next chain to a file descriptor
+     * Interrupted and partial writes are continued
+     * @param[in] tlv The tree
+     * @param[in] format Output format
+     * @param[in] fd File descriptor to write to
+     * @return True if successful, false on failure
+     */
+    bool tlv_dump_fd(const tlv_t *tlv, const tlv_dump_format_t format, const int fd);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TLV_DUMP_H_2016 */
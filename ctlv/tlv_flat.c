@@ -0,0 +1,333 @@
+#include "tlv_flat.h"
+#include "tlv_private.h"
+#include <string.h>
+
+#define FLAT_INITIAL_CAPACITY 64
+
+
+/********** PRIVATE DECLARATIONS **********************************************/
+/**
+ * @brief Appends a new object to a flat structure, grows the array if needed
+ * @param[in] flat Flat structure to append the object to
+ * @return Index of the new object or TLV_FLAT_NONE if allocation failed
+ */
+static tlv_index_t flat_append(tlv_flat_t *flat);
+
+
+/**
+ * @brief Builds the objects of a flat structure from its byte array
+ * @param[in,out] flat Flat structure with the byte array set
+ * @return True if conversion succeeded, false otherwise
+ */
+static bool flat_parse(tlv_flat_t *flat);
+
+
+/********** PUBLIC DEFINITIONS ************************************************/
+tlv_flat_t* tlv_flat_from_byte_array(const uint8_t *barray, const size_t size) {
+    tlv_flat_t *flat;
+
+    if (barray == NULL || size < BER_HEADER_BYTE_LENGTH) {
+        TLV_FAIL(TLV_FAILURE_MALFORMED, "Error - Wrong byte array when creating flat tlv");
+        return NULL;
+    }
+    if (size > UINT32_MAX) {
+        TLV_FAIL(TLV_FAILURE_SIZE, "ERROR - Too long array: %zu", size);
+        return NULL;
+    }
+    if ((flat = calloc(1, sizeof (*flat))) == NULL) {
+        TLV_FAIL(TLV_FAILURE_MEMORY, "Fatal - Out of memory when allocating flat tlv");
+        return NULL;
+    }
+    flat->bytes = barray;
+    flat->size = size;
+
+    if (!flat_parse(flat)) {
+        tlv_debug_cb("ERROR - Converting to flat tlv failed");
+        tlv_flat_delete(&flat);
+    }
+
+    return flat;
+}
+
+
+bool tlv_flat_init(tlv_flat_t *flat, const uint8_t *barray, const size_t size, tlv_flat_node_t *nodes, const tlv_index_t capacity) {
+    if (flat == NULL || barray == NULL || size < BER_HEADER_BYTE_LENGTH || nodes == NULL) {
+        TLV_FAIL(TLV_FAILURE_MALFORMED, "Error - Wrong byte array when creating flat tlv");
+        return false;
+    }
+    if (size > UINT32_MAX) {
+        TLV_FAIL(TLV_FAILURE_SIZE, "ERROR - Too long array: %zu", size);
+        return false;
+    }
+    memset(flat, 0, sizeof (*flat));
+    flat->nodes = nodes;
+    flat->capacity = capacity;
+    flat->bytes = barray;
+    flat->size = size;
+    flat->fixed = true;
+
+    if (!flat_parse(flat)) {
+        tlv_debug_cb("ERROR - Converting to flat tlv failed");
+        flat->count = 0;
+        return false;
+    }
+
+    return true;
+}
+
+
+tlv_flat_t* tlv_flat_from_tlv(const tlv_t *tlv) {
+    uint8_t *barray;
+    size_t size;
+    tlv_flat_t *flat;
+
+    if (!tlv_to_byte_array(tlv, &barray, &size)) {
+        return NULL;
+    }
+    if ((flat = tlv_flat_from_byte_array(barray, size)) == NULL) {
+        free(barray);
+        return NULL;
+    }
+    flat->owned = barray;
+
+    return flat;
+}
+
+
+tlv_t* tlv_flat_to_tlv(const tlv_flat_t *flat, tlv_arena_t *arena, const uint32_t flags) {
+    tlv_t **objects;
+
+    if (flat == NULL || flat->count == 0) {
+        return NULL;
+    }
+    if ((objects = malloc(flat->count * sizeof (*objects))) == NULL) {
+        TLV_FAIL(TLV_FAILURE_MEMORY, "Fatal - Out of memory when converting flat tlv");
+        return NULL;
+    }
+
+    for (tlv_index_t i = 0; i < flat->count; i++) {
+        const tlv_flat_node_t *node = &flat->nodes[i];
+        tlv_t *object;
+
+        if (node->type == TLV_CDO) {
+            object = arena ? tlv_arena_new_cdo(arena, node->tag) : tlv_new_cdo(node->tag);
+        } else if (flags & TLV_DECODE_BORROW) {
+            object = arena ? tlv_arena_new_pdo(arena, node->tag, 0, NULL) : tlv_new_pdo(node->tag, 0, NULL);
+            if (object != NULL) {
+                object->value = (uint8_t*) &flat->bytes[node->offset];
+                object->length = node->length;
+                object->flags |= TLV_FLAG_BORROWED;
+            }
+        } else if (arena != NULL) {
+            object = tlv_arena_new_pdo(arena, node->tag, node->length, &flat->bytes[node->offset]);
+        } else if (node->length == 0) {
+            // An empty PDO has no value, malloc(0) may return NULL
+            object = tlv_new_pdo(node->tag, 0, NULL);
+        } else {
+            uint8_t *value = malloc(node->length);
+            if (value != NULL) {
+                memcpy(value, &flat->bytes[node->offset], node->length);
+            }
+            object = value ? tlv_new_pdo(node->tag, node->length, value) : NULL;
+            if (object == NULL) {
+                free(value);
+            }
+        }
+        if (object == NULL) {
+            for (tlv_index_t j = 0; j < i; j++) {
+                tlv_delete_all(&objects[j]);
+            }
+            free(objects);
+            return NULL;
+        }
+        object->length = node->length;
+        if (node->type == TLV_CDO && node->header == BER_HEADER_BYTE_LENGTH) {
+            object->flags |= TLV_FLAG_SIZED;
+        }
+        objects[i] = object;
+    }
+
+    // Parents precede their children in pre-order, so the levels are set top down
+    for (tlv_index_t i = 0; i < flat->count; i++) {
+        const tlv_flat_node_t *node = &flat->nodes[i];
+        tlv_t *object = objects[i];
+
+        object->child = node->child != TLV_FLAT_NONE ? objects[node->child] : NULL;
+        object->next = node->next != TLV_FLAT_NONE ? objects[node->next] : NULL;
+        object->parent = node->parent != TLV_FLAT_NONE ? objects[node->parent] : NULL;
+        object->level = node->parent != TLV_FLAT_NONE ? objects[node->parent]->level + 1 : 0;
+    }
+    tlv_t *root = objects[0];
+    free(objects);
+
+    return root;
+}
+
+
+void tlv_flat_delete(tlv_flat_t **flat) {
+    if (flat != NULL && *flat != NULL) {
+        free((*flat)->nodes);
+        free((*flat)->owned);
+        free(*flat);
+        *flat = NULL;
+    }
+}
+
+
+tlv_index_t tlv_flat_end(const tlv_flat_t *flat, const tlv_index_t index) {
+    tlv_index_t i = index;
+
+    while (i != TLV_FLAT_NONE) {
+        if (flat->nodes[i].next != TLV_FLAT_NONE) {
+            return flat->nodes[i].next;
+        }
+        i = flat->nodes[i].parent;
+    }
+
+    return flat->count;
+}
+
+
+tlv_index_t tlv_flat_find_by_tag(const tlv_flat_t *flat, const tlv_index_t index, const tlv_tag_t tag) {
+    if (flat != NULL && index < flat->count) {
+        tlv_index_t end = tlv_flat_end(flat, index);
+
+        for (tlv_index_t i = index; i < end; i++) {
+            if (flat->nodes[i].tag == tag) {
+                return i;
+            }
+        }
+    }
+
+    return TLV_FLAT_NONE;
+}
+
+
+const uint8_t* tlv_flat_value(const tlv_flat_t *flat, const tlv_index_t index) {
+    if (flat != NULL && index < flat->count) {
+        return &flat->bytes[flat->nodes[index].offset];
+    }
+
+    return NULL;
+}
+
+
+bool tlv_flat_to_byte_array(const tlv_flat_t *flat, const tlv_index_t index, uint8_t **barray, size_t *size) {
+    if (flat == NULL || index >= flat->count || barray == NULL || size == NULL) {
+        return false;
+    }
+
+    // The encoding of a subtree is contiguous in the byte array
+    const tlv_flat_node_t *node = &flat->nodes[index];
+    size_t length = node->header + (size_t) node->length;
+    uint8_t *array = malloc(length);
+
+    if (array == NULL) {
+        TLV_FAIL(TLV_FAILURE_MEMORY, "Fatal - Failed to allocate memory for array");
+        return false;
+    }
+    memcpy(array, &flat->bytes[node->offset - node->header], length);
+
+    *barray = array;
+    *size = length;
+    return true;
+}
+
+
+/********** PRIVATE DEFINITIONS ***********************************************/
+static tlv_index_t flat_append(tlv_flat_t *flat) {
+    if (flat->count == flat->capacity) {
+        if (flat->fixed) {
+            TLV_FAIL(TLV_FAILURE_SIZE, "Error - Flat tlv holds more than %u objects", flat->capacity);
+            return TLV_FLAT_NONE;
+        }
+        tlv_index_t capacity = flat->capacity ? flat->capacity * 2 : FLAT_INITIAL_CAPACITY;
+        tlv_flat_node_t *nodes = realloc(flat->nodes, capacity * sizeof (*nodes));
+
+        if (nodes == NULL) {
+            TLV_FAIL(TLV_FAILURE_MEMORY, "Fatal - Out of memory when growing flat tlv");
+            return TLV_FLAT_NONE;
+        }
+        flat->nodes = nodes;
+        flat->capacity = capacity;
+    }
+
+    return flat->count++;
+}
+
+
+static bool flat_parse(tlv_flat_t *flat) {
+    struct {
+        tlv_index_t cdo;
+        tlv_index_t previous;
+        size_t end;
+    } stack[TLV_MAX_DEPTH];
+    size_t depth = 0;
+    size_t index = 0;
+    size_t end = flat->size;
+    tlv_index_t parent = TLV_FLAT_NONE;
+    tlv_index_t previous = TLV_FLAT_NONE;
+
+    while (true) {
+        while (index < end) {
+            tlv_header_t header;
+            tlv_index_t i;
+
+            if (!tlv_header_read(&flat->bytes[index], end - index, &header)) {
+                TLV_FAIL(TLV_FAILURE_MALFORMED, "ERROR - Failed to deserialize, wrong header at %u", (unsigned) index);
+                return false;
+            }
+            index += header.size;
+            if (header.length > end - index) {
+                TLV_FAIL(TLV_FAILURE_MALFORMED, "ERROR - Failed to deserialize, value length(%u) exceeds the array", header.length);
+                return false;
+            }
+            if ((i = flat_append(flat)) == TLV_FLAT_NONE) {
+                return false;
+            }
+
+            tlv_flat_node_t *node = &flat->nodes[i];
+            node->parent = parent;
+            node->next = TLV_FLAT_NONE;
+            node->child = TLV_FLAT_NONE;
+            node->offset = (uint32_t) index;
+            node->length = header.length;
+            node->tag = header.tag;
+            node->type = header.type;
+            node->header = header.size;
+            if (previous != TLV_FLAT_NONE) {
+                flat->nodes[previous].next = i;
+            } else if (parent != TLV_FLAT_NONE) {
+                flat->nodes[parent].child = i;
+            }
+            previous = i;
+
+            if (header.type == TLV_CDO && header.length > 0) {
+                if (depth == TLV_MAX_DEPTH) {
+                    TLV_FAIL(TLV_FAILURE_DEPTH, "ERROR - Failed to deserialize, deeper than %u levels", TLV_MAX_DEPTH);
+                    return false;
+                }
+                stack[depth].cdo = parent;
+                stack[depth].previous = i;
+                stack[depth++].end = end;
+                end = index + header.length;
+                parent = i;
+                previous = TLV_FLAT_NONE;
+                continue;
+            }
+            if (header.type == TLV_PDO) {
+                index += header.length;
+            }
+        }
+
+        if (depth == 0) {
+            break;
+        }
+        depth--;
+        parent = stack[depth].cdo;
+        previous = stack[depth].previous;
+        end = stack[depth].end;
+    }
+
+    return true;
+}
@@ -0,0 +1,150 @@
+#ifndef TLV_FLAT_H_2016
+#define TLV_FLAT_H_2016
+
+/**
+ * File:   tlv_flat.h
+ *
+ * @brief Flat representation of a decoded TLV structure
+ * The objects are stored in one contiguous array in pre-order, linked by 32 bit indices.
+ * Values are not copied, they are referenced by their offset in the decoded byte array.
+ *
+ * Since the array is in pre-order, a full traversal is a plain loop over the nodes and the
+ * subtree of a node is the contiguous range of nodes between the node and tlv_flat_end().
+ */
+
+#include "tlv.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    typedef struct stTLVFlatNode tlv_flat_node_t;
+    typedef struct stTLVFlat tlv_flat_t;
+    typedef uint32_t tlv_index_t;
+    static const tlv_index_t TLV_FLAT_NONE = UINT32_MAX; // Index of a missing parent, sibling or child
+
+    /**
+     * Struct representing one TLV object in a flat structure
+     */
+    struct stTLVFlatNode {
+        tlv_index_t parent;     /**< @brief Index of the parent CDO or TLV_FLAT_NONE */
+        tlv_index_t next;       /**< @brief Index of the next sibling or TLV_FLAT_NONE */
+        tlv_index_t child;      /**< @brief Index of the first child or TLV_FLAT_NONE */
+        uint32_t offset;        /**< @brief Offset of the value (PDO) or of the children (CDO) in the byte array */
+        tlv_length_t length;    /**< @brief Length of data in PDO's, total length of childs for CDO's */
+        tlv_tag_t tag;          /**< @brief Tag of the TLV */
+        tlv_type_t type;        /**< @brief Type of the TLV (CDO/PDO) */
+        uint8_t header;         /**< @brief Size of the header in the byte array */
+    };
+
+    /**
+     * Struct representing a flat TLV structure
+     */
+    struct stTLVFlat {
+        tlv_flat_node_t *nodes; /**< @brief Objects in pre-order, the first one is the root */
+        tlv_index_t count;      /**< @brief Number of objects */
+        tlv_index_t capacity;   /**< @brief Number of allocated objects */
+        const uint8_t *bytes;   /**< @brief Byte array the offsets refer to */
+        size_t size;            /**< @brief Size of the byte array */
+        uint8_t *owned;         /**< @brief Byte array owned by the structure or NULL if borrowed */
+        bool fixed;             /**< @brief Objects are stored in a caller supplied array which is never grown or freed */
+    };
+
+
+    /**
+     * @brief Converts a byte array to a flat TLV structure in a single pass
+     * The byte array is not copied and must outlive the flat structure
+     * @param[in] barray Byte array to convert
+     * @param[in] size The size of the byte array
+     * @return The flat structure or NULL if conversion failed
+     */
+    tlv_flat_t* tlv_flat_from_byte_array(const uint8_t *barray, const size_t size);
+
+
+    /**
+     * @brief Converts a byte array to a flat TLV structure stored in caller supplied memory
+     * Nothing is allocated, the conversion fails if the byte array holds more than capacity objects.
+     * The byte array is not copied, the structure must not be deleted with tlv_flat_delete.
+     * @param[out] flat Flat structure to initialize
+     * @param[in] barray Byte array to convert
+     * @param[in] size The size of the byte array
+     * @param[in] nodes Array to store the objects in
+     * @param[in] capacity Number of objects in nodes
+     * @return True if successful, false otherwise
+     */
+    bool tlv_flat_init(tlv_flat_t *flat, const uint8_t *barray, const size_t size, tlv_flat_node_t *nodes, const tlv_index_t capacity);
+
+
+    /**
+     * @brief Converts a tlv object to a flat TLV structure
+     * The tlv object is encoded into a byte array owned by the flat structure
+     * @param[in] tlv Tlv object to convert
+     * @return The flat structure or NULL if conversion failed
+     */
+    tlv_flat_t* tlv_flat_from_tlv(const tlv_t *tlv);
+
+
+    /**
+     * @brief Converts a flat TLV structure to a tlv object
+     * With TLV_DECODE_BORROW the values point into the byte array of the flat structure
+     * @param[in] flat Flat structure to convert
+     * @param[in] arena Arena to allocate the objects in or NULL to use malloc
+     * @param[in] flags Decode options, see tlv_decode_flags_t
+     * @return The tlv object or NULL if conversion failed
+     */
+    tlv_t* tlv_flat_to_tlv(const tlv_flat_t *flat, tlv_arena_t *arena, const uint32_t flags);
+
+
+    /**
+     * @brief Deletes a flat TLV structure
+     * @param[in] flat Flat structure to delete
+     */
+    void tlv_flat_delete(tlv_flat_t **flat);
+
+
+    /**
+     * @brief Returns the index after the last object in the subtree of an object
+     * @param[in] flat Flat structure
+     * @param[in] index Index of the object
+     * @return Index after the subtree, equals to count for the last subtree
+     */
+    tlv_index_t tlv_flat_end(const tlv_flat_t *flat, const tlv_index_t index);
+
+
+    /**
+     * @brief Finds an object with the specified tag in a subtree
+     * The search is done in pre-order in the subtree of the specified object, inclusive the object
+     * @param[in] flat Flat structure to search
+     * @param[in] index Index of the object to search in, 0 for the root
+     * @param[in] tag Tag of the tlv to search for
+     * @return Index of the object or TLV_FLAT_NONE if not found
+     */
+    tlv_index_t tlv_flat_find_by_tag(const tlv_flat_t *flat, const tlv_index_t index, const tlv_tag_t tag);
+
+
+    /**
+     * @brief Returns the value of an object
+     * @param[in] flat Flat structure
+     * @param[in] index Index of the object
+     * @return Pointer to the value in the byte array, for CDO's the encoded children
+     */
+    const uint8_t* tlv_flat_value(const tlv_flat_t *flat, const tlv_index_t index);
+
+
+    /**
+     * @brief Converts the subtree of an object to a byte array
+     * The subtree is copied from the byte array as it is, inclusive the header of the object
+     * @param[in] flat Flat structure to convert
+     * @param[in] index Index of the object, 0 for the root
+     * @param[out] barray Return point of the byte array
+     * @param[out] size Size of the returned byte array
+     * @return True if successful, false otherwise
+     */
+    bool tlv_flat_to_byte_array(const tlv_flat_t *flat, const tlv_index_t index, uint8_t **barray, size_t *size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TLV_FLAT_H_2016 */
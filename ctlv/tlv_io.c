@@ -0,0 +1,619 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "tlv_io.h"
+#include "tlv_private.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#define IO_FLUSH_IOV 64
+#define IO_DEFAULT_EVENTS 64
+
+
+/**
+ * A receive or send buffer, the bytes between head and tail are not consumed yet
+ */
+typedef struct io_buffer {
+    struct io_buffer *next;         /**< @brief Next send buffer or next idle buffer of the pool */
+    size_t capacity;                /**< @brief Size of data */
+    size_t head;                    /**< @brief Start of the bytes not consumed yet */
+    size_t tail;                    /**< @brief End of the bytes */
+    uint8_t data[];                 /**< @brief The bytes */
+} io_buffer_t;
+
+/**
+ * Buffers of one size kept for reuse
+ */
+struct stTLVIOPool {
+    size_t buffer_size;             /**< @brief Capacity of the pooled buffers */
+    size_t max_idle;                /**< @brief Maximum number of idle buffers */
+    size_t idle;                    /**< @brief Number of idle buffers */
+    io_buffer_t *free;              /**< @brief Idle buffers */
+};
+
+/**
+ * A connection, its receive buffer and its queue of send buffers
+ */
+struct stTLVIO {
+    tlv_io_pool_t *pool;            /**< @brief Pool of the buffers */
+    int fd;                         /**< @brief The descriptor */
+    bool socket;                    /**< @brief True if the descriptor is a socket, written with sendmsg */
+    bool failed;                    /**< @brief A read, a write or a frame failed */
+    size_t max_frame;               /**< @brief Largest accepted frame */
+    io_buffer_t *rx;                /**< @brief Receive buffer or NULL while idle */
+    io_buffer_t *tx_head;           /**< @brief First send buffer or NULL */
+    io_buffer_t *tx_tail;           /**< @brief Last send buffer, the one appended to */
+    size_t pending;                 /**< @brief Queued bytes not written yet */
+};
+
+/**
+ * An epoll instance and its event array
+ */
+struct stTLVIOPoll {
+    int fd;                         /**< @brief The epoll descriptor */
+    size_t max_events;              /**< @brief Size of events */
+    struct epoll_event events[];    /**< @brief Events of the last wait */
+};
+
+
+/********** PRIVATE DECLARATIONS **********************************************/
+/**
+ * @brief Takes a buffer of at least the size from the pool or allocates it
+ * @return The empty buffer or NULL
+ */
+static io_buffer_t* pool_get(tlv_io_pool_t *pool, const size_t size);
+
+/**
+ * @brief Gives a buffer back to the pool or frees it
+ */
+static void pool_put(tlv_io_pool_t *pool, io_buffer_t *buffer);
+
+/**
+ * @brief Returns the size of the frame at the head of the receive buffer
+ * @return TLV_IO_OK, TLV_IO_AGAIN if the header is not complete, or TLV_IO_ERROR
+ */
+static tlv_io_status_t frame_size(tlv_io_t *io, size_t *size);
+
+/**
+ * @brief Makes room for the rest of the frame at the head of the receive buffer
+ */
+static tlv_io_status_t prepare_rx(tlv_io_t *io);
+
+/**
+ * @brief Returns space for a message at the end of the send queue
+ * @return Pointer to the space or NULL
+ */
+static uint8_t* reserve_tx(tlv_io_t *io, const size_t size);
+
+/**
+ * @brief Writes an I/O vector, without SIGPIPE for sockets
+ */
+static ssize_t write_iov(const tlv_io_t *io, struct iovec *iov, const int count);
+
+/**
+ * @brief Reads, passes the frames to the handler and flushes a ready connection
+ * @return False if the handler stopped or the connection was closed
+ */
+static bool serve(tlv_io_t *io, const uint32_t events, tlv_io_handler_t handler, void *arg);
+
+
+/********** PUBLIC DEFINITIONS ************************************************/
+tlv_io_pool_t* tlv_io_pool_new(const size_t buffer_size, const size_t max_idle) {
+    tlv_io_pool_t *pool;
+
+    if ((pool = calloc(1, sizeof (*pool))) == NULL) {
+        TLV_FAIL(TLV_FAILURE_MEMORY, "Fatal - Out of memory when creating buffer pool");
+        return NULL;
+    }
+    pool->buffer_size = buffer_size > 0 ? buffer_size : TLV_IO_BUFFER_SIZE;
+    pool->max_idle = max_idle;
+
+    return pool;
+}
+
+
+void tlv_io_pool_delete(tlv_io_pool_t **pool) {
+    if (pool != NULL && *pool != NULL) {
+        while ((*pool)->free != NULL) {
+            io_buffer_t *buffer = (*pool)->free;
+
+            (*pool)->free = buffer->next;
+            free(buffer);
+        }
+        free(*pool);
+        *pool = NULL;
+    }
+}
+
+
+tlv_io_t* tlv_io_new(tlv_io_pool_t *pool, const int fd, const size_t max_frame) {
+    struct stat info;
+    tlv_io_t *io;
+    int flags;
+
+    if (pool == NULL || fd < 0) {
+        TLV_FAIL(TLV_FAILURE_ARGUMENT, "Error - Pool is null or descriptor is invalid when creating connection");
+        return NULL;
+    }
+    if ((flags = fcntl(fd, F_GETFL)) < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0 || fstat(fd, &info) != 0) {
+        TLV_FAIL(TLV_FAILURE_IO, "Error - Failed to make descriptor non-blocking: %s", strerror(errno));
+        return NULL;
+    }
+    if ((io = calloc(1, sizeof (*io))) == NULL) {
+        TLV_FAIL(TLV_FAILURE_MEMORY, "Fatal - Out of memory when creating connection");
+        return NULL;
+    }
+    io->pool = pool;
+    io->fd = fd;
+    io->socket = S_ISSOCK(info.st_mode);
+    io->max_frame = max_frame > 0 ? max_frame : TLV_IO_MAX_FRAME;
+
+    return io;
+}
+
+
+void tlv_io_delete(tlv_io_t **io) {
+    if (io != NULL && *io != NULL) {
+        tlv_io_t *c = *io;
+
+        if (c->rx != NULL) {
+            pool_put(c->pool, c->rx);
+        }
+        while (c->tx_head != NULL) {
+            io_buffer_t *buffer = c->tx_head;
+
+            c->tx_head = buffer->next;
+            pool_put(c->pool, buffer);
+        }
+        free(c);
+        *io = NULL;
+    }
+}
+
+
+int tlv_io_fd(const tlv_io_t *io) {
+    return io != NULL ? io->fd : -1;
+}
+
+
+tlv_io_status_t tlv_io_read(tlv_io_t *io) {
+    tlv_io_status_t status;
+    io_buffer_t *rx;
+
+    if (io == NULL) {
+        TLV_FAIL(TLV_FAILURE_ARGUMENT, "Error - Connection is null when reading");
+        return TLV_IO_ERROR;
+    }
+    if (io->failed || (status = prepare_rx(io)) == TLV_IO_ERROR) {
+        return TLV_IO_ERROR;
+    }
+    rx = io->rx;
+
+    // A short read drains a stream, the read returning EAGAIN is saved
+    status = TLV_IO_FULL;
+    while (rx->tail < rx->capacity) {
+        size_t room = rx->capacity - rx->tail;
+        ssize_t n = read(io->fd, &rx->data[rx->tail], room);
+
+        if (n > 0) {
+            rx->tail += (size_t) n;
+            if ((size_t) n < room) {
+                status = TLV_IO_AGAIN;
+                break;
+            }
+        } else if (n == 0) {
+            status = TLV_IO_CLOSED;
+            break;
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            status = TLV_IO_AGAIN;
+            break;
+        } else if (errno != EINTR) {
+            TLV_FAIL(TLV_FAILURE_IO, "Error - Failed to read connection: %s", strerror(errno));
+            io->failed = true;
+            return TLV_IO_ERROR;
+        }
+    }
+
+    // An idle connection holds no buffer
+    if (rx->head == rx->tail && status != TLV_IO_FULL) {
+        pool_put(io->pool, rx);
+        io->rx = NULL;
+    }
+
+    return status;
+}
+
+
+tlv_io_status_t tlv_io_next_frame(tlv_io_t *io, tlv_io_frame_t *frame) {
+    tlv_io_status_t status;
+    size_t size;
+
+    if (io == NULL || frame == NULL) {
+        TLV_FAIL(TLV_FAILURE_ARGUMENT, "Error - Connection or frame is null when taking frame");
+        return TLV_IO_ERROR;
+    }
+    if ((status = frame_size(io, &size)) != TLV_IO_OK) {
+        return status;
+    }
+    if (io->rx->tail - io->rx->head < size) {
+        return TLV_IO_AGAIN;
+    }
+    frame->bytes = &io->rx->data[io->rx->head];
+    frame->size = size;
+    frame->tag = (tlv_tag_t) (frame->bytes[1] << 8 | frame->bytes[2]);
+    io->rx->head += size;
+
+    return TLV_IO_OK;
+}
+
+
+bool tlv_io_send(tlv_io_t *io, const uint8_t *barray, const size_t size) {
+    uint8_t *space;
+
+    if (io == NULL || barray == NULL || size == 0) {
+        TLV_FAIL(TLV_FAILURE_ARGUMENT, "Error - Connection or message is null when sending");
+        return false;
+    }
+    if ((space = reserve_tx(io, size)) == NULL) {
+        return false;
+    }
+    memcpy(space, barray, size);
+    io->tx_tail->tail += size;
+    io->pending += size;
+
+    return true;
+}
+
+
+bool tlv_io_send_tlv(tlv_io_t *io, const tlv_t *tlv) {
+    uint8_t *space;
+    size_t size = 0;
+
+    if (io == NULL || tlv == NULL) {
+        TLV_FAIL(TLV_FAILURE_ARGUMENT, "Error - Connection or tlv is null when sending");
+        return false;
+    }
+    tlv_to_buffer(tlv, NULL, 0, &size);
+    if (size == 0) {
+        tlv_debug_cb("Error - Failed to get size of the sent tlv");
+        return false;
+    }
+    if ((space = reserve_tx(io, size)) == NULL) {
+        return false;
+    }
+    if (!tlv_to_buffer(tlv, space, size, &size)) {
+        tlv_debug_cb("Error - Failed to encode the sent tlv");
+        return false;
+    }
+    io->tx_tail->tail += size;
+    io->pending += size;
+
+    return true;
+}
+
+
+tlv_io_status_t tlv_io_flush(tlv_io_t *io) {
+    struct iovec iov[IO_FLUSH_IOV];
+
+    if (io == NULL) {
+        TLV_FAIL(TLV_FAILURE_ARGUMENT, "Error - Connection is null when flushing");
+        return TLV_IO_ERROR;
+    }
+    if (io->failed) {
+        return TLV_IO_ERROR;
+    }
+    while (io->tx_head != NULL) {
+        io_buffer_t *buffer = io->tx_head;
+        size_t requested = 0;
+        ssize_t n;
+        int count = 0;
+
+        // All queued buffers with one call
+        for (; buffer != NULL && count < IO_FLUSH_IOV; buffer = buffer->next, count++) {
+            iov[count].iov_base = &buffer->data[buffer->head];
+            iov[count].iov_len = buffer->tail - buffer->head;
+            requested += iov[count].iov_len;
+        }
+        if ((n = write_iov(io, iov, count)) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return TLV_IO_AGAIN;
+            }
+            io->failed = true;
+            if (errno == EPIPE || errno == ECONNRESET) {
+                return TLV_IO_CLOSED;
+            }
+            TLV_FAIL(TLV_FAILURE_IO, "Error - Failed to write connection: %s", strerror(errno));
+            return TLV_IO_ERROR;
+        }
+        io->pending -= (size_t) n;
+        for (size_t written = (size_t) n; written > 0 || (io->tx_head != NULL && io->tx_head->head == io->tx_head->tail);) {
+            buffer = io->tx_head;
+            if (written < buffer->tail - buffer->head) {
+                buffer->head += written;
+                break;
+            }
+            written -= buffer->tail - buffer->head;
+            io->tx_head = buffer->next;
+            pool_put(io->pool, buffer);
+        }
+        if (io->tx_head == NULL) {
+            io->tx_tail = NULL;
+        }
+        // A short write fills the send buffer of the descriptor
+        if ((size_t) n < requested) {
+            return TLV_IO_AGAIN;
+        }
+    }
+
+    return TLV_IO_OK;
+}
+
+
+size_t tlv_io_pending(const tlv_io_t *io) {
+    return io != NULL ? io->pending : 0;
+}
+
+
+tlv_io_poll_t* tlv_io_poll_new(const size_t max_events) {
+    size_t events = max_events > 0 ? max_events : IO_DEFAULT_EVENTS;
+    tlv_io_poll_t *poll;
+
+    if ((poll = malloc(sizeof (*poll) + events * sizeof (poll->events[0]))) == NULL) {
+        TLV_FAIL(TLV_FAILURE_MEMORY, "Fatal - Out of memory when creating poll");
+        return NULL;
+    }
+    if ((poll->fd = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+        TLV_FAIL(TLV_FAILURE_IO, "Error - Failed to create epoll: %s", strerror(errno));
+        free(poll);
+        return NULL;
+    }
+    poll->max_events = events;
+
+    return poll;
+}
+
+
+void tlv_io_poll_delete(tlv_io_poll_t **poll) {
+    if (poll != NULL && *poll != NULL) {
+        close((*poll)->fd);
+        free(*poll);
+        *poll = NULL;
+    }
+}
+
+
+bool tlv_io_poll_add(tlv_io_poll_t *poll, tlv_io_t *io) {
+    struct epoll_event event;
+
+    if (poll == NULL || io == NULL) {
+        TLV_FAIL(TLV_FAILURE_ARGUMENT, "Error - Poll or connection is null when adding");
+        return false;
+    }
+    // Edge triggered, the output is flushed on every EPOLLOUT without switching the interest
+    event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    event.data.ptr = io;
+    if (epoll_ctl(poll->fd, EPOLL_CTL_ADD, io->fd, &event) != 0) {
+        TLV_FAIL(TLV_FAILURE_IO, "Error - Failed to add connection to epoll: %s", strerror(errno));
+        return false;
+    }
+
+    return true;
+}
+
+
+bool tlv_io_poll_remove(tlv_io_poll_t *poll, tlv_io_t *io) {
+    struct epoll_event event = {0};
+
+    if (poll == NULL || io == NULL) {
+        TLV_FAIL(TLV_FAILURE_ARGUMENT, "Error - Poll or connection is null when removing");
+        return false;
+    }
+    if (epoll_ctl(poll->fd, EPOLL_CTL_DEL, io->fd, &event) != 0) {
+        TLV_FAIL(TLV_FAILURE_IO, "Error - Failed to remove connection from epoll: %s", strerror(errno));
+        return false;
+    }
+
+    return true;
+}
+
+
+int tlv_io_poll_wait(tlv_io_poll_t *poll, const int timeout, tlv_io_handler_t handler, void *arg) {
+    int count;
+
+    if (poll == NULL || handler == NULL) {
+        TLV_FAIL(TLV_FAILURE_ARGUMENT, "Error - Poll or handler is null when waiting");
+        return -1;
+    }
+    if ((count = epoll_wait(poll->fd, poll->events, (int) poll->max_events, timeout)) < 0) {
+        if (errno == EINTR) {
+            return 0;
+        }
+        TLV_FAIL(TLV_FAILURE_IO, "Error - Failed to wait for epoll: %s", strerror(errno));
+        return -1;
+    }
+    for (int i = 0; i < count; i++) {
+        serve(poll->events[i].data.ptr, poll->events[i].events, handler, arg);
+    }
+
+    return count;
+}
+
+
+/********** PRIVATE DEFINITIONS ***********************************************/
+static io_buffer_t* pool_get(tlv_io_pool_t *pool, const size_t size) {
+    io_buffer_t *buffer;
+
+    if (size <= pool->buffer_size && pool->free != NULL) {
+        buffer = pool->free;
+        pool->free = buffer->next;
+        pool->idle--;
+    } else {
+        size_t capacity = size > pool->buffer_size ? size : pool->buffer_size;
+
+        if ((buffer = malloc(sizeof (*buffer) + capacity)) == NULL) {
+            TLV_FAIL(TLV_FAILURE_MEMORY, "Fatal - Out of memory when allocating I/O buffer");
+            return NULL;
+        }
+        buffer->capacity = capacity;
+    }
+    buffer->next = NULL;
+    buffer->head = 0;
+    buffer->tail = 0;
+
+    return buffer;
+}
+
+
+static void pool_put(tlv_io_pool_t *pool, io_buffer_t *buffer) {
+    // Buffers of large frames are never reused
+    if (buffer->capacity != pool->buffer_size || pool->idle >= pool->max_idle) {
+        free(buffer);
+        return;
+    }
+    buffer->next = pool->free;
+    pool->free = buffer;
+    pool->idle++;
+}
+
+
+static tlv_io_status_t frame_size(tlv_io_t *io, size_t *size) {
+    io_buffer_t *rx = io->rx;
+    tlv_header_t header;
+
+    if (io->failed) {
+        return TLV_IO_ERROR;
+    }
+    if (rx == NULL || rx->head == rx->tail) {
+        return TLV_IO_AGAIN;
+    }
+    if (tlv_header_size(rx->data[rx->head]) == 0) {
+        TLV_FAIL(TLV_FAILURE_MALFORMED, "Error - Received bytes are not a TLV object");
+        io->failed = true;
+        return TLV_IO_ERROR;
+    }
+    if (!tlv_header_read(&rx->data[rx->head], rx->tail - rx->head, &header)) {
+        return TLV_IO_AGAIN;
+    }
+    *size = header.size + (size_t) header.length;
+    if (*size > io->max_frame) {
+        TLV_FAIL(TLV_FAILURE_SIZE, "Error - Received frame of %zu bytes exceeds the limit", *size);
+        io->failed = true;
+        return TLV_IO_ERROR;
+    }
+
+    return TLV_IO_OK;
+}
+
+
+static tlv_io_status_t prepare_rx(tlv_io_t *io) {
+    io_buffer_t *rx = io->rx;
+    tlv_io_status_t status;
+    size_t size;
+
+    if (rx == NULL) {
+        return (io->rx = pool_get(io->pool, 0)) != NULL ? TLV_IO_OK : TLV_IO_ERROR;
+    }
+    // The frames returned before are given up, the rest of the next one moves to the front
+    if (rx->head > 0) {
+        memmove(rx->data, &rx->data[rx->head], rx->tail - rx->head);
+        rx->tail -= rx->head;
+        rx->head = 0;
+    }
+    if ((status = frame_size(io, &size)) == TLV_IO_ERROR) {
+        return status;
+    }
+    if (status == TLV_IO_OK && size > rx->capacity) {
+        io_buffer_t *large;
+
+        if ((large = pool_get(io->pool, size)) == NULL) {
+            return TLV_IO_ERROR;
+        }
+        memcpy(large->data, rx->data, rx->tail);
+        large->tail = rx->tail;
+        pool_put(io->pool, rx);
+        io->rx = large;
+    } else if (rx->tail == 0 && rx->capacity != io->pool->buffer_size) {
+        // The large frame was taken, back to a pooled buffer
+        pool_put(io->pool, rx);
+        return (io->rx = pool_get(io->pool, 0)) != NULL ? TLV_IO_OK : TLV_IO_ERROR;
+    }
+
+    return TLV_IO_OK;
+}
+
+
+static uint8_t* reserve_tx(tlv_io_t *io, const size_t size) {
+    io_buffer_t *buffer = io->tx_tail;
+
+    if (io->failed) {
+        TLV_FAIL(TLV_FAILURE_IO, "Error - Connection failed before, nothing is sent");
+        return NULL;
+    }
+    if (buffer == NULL || buffer->capacity - buffer->tail < size) {
+        if ((buffer = pool_get(io->pool, size)) == NULL) {
+            return NULL;
+        }
+        if (io->tx_tail != NULL) {
+            io->tx_tail->next = buffer;
+        } else {
+            io->tx_head = buffer;
+        }
+        io->tx_tail = buffer;
+    }
+
+    return &buffer->data[buffer->tail];
+}
+
+
+static ssize_t write_iov(const tlv_io_t *io, struct iovec *iov, const int count) {
+    struct msghdr message = {0};
+
+    if (!io->socket) {
+        return writev(io->fd, iov, count);
+    }
+    message.msg_iov = iov;
+    message.msg_iovlen = (size_t) count;
+
+    return sendmsg(io->fd, &message, MSG_NOSIGNAL);
+}
+
+
+static bool serve(tlv_io_t *io, const uint32_t events, tlv_io_handler_t handler, void *arg) {
+    tlv_io_frame_t frame;
+    tlv_io_status_t status;
+    tlv_io_status_t next;
+
+    if (events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+        // Edge triggered, so read until the descriptor is drained
+        do {
+            status = tlv_io_read(io);
+            while ((next = tlv_io_next_frame(io, &frame)) == TLV_IO_OK) {
+                if (!handler(io, &frame, arg)) {
+                    return false;
+                }
+            }
+            if (next == TLV_IO_ERROR || status == TLV_IO_CLOSED || status == TLV_IO_ERROR) {
+                handler(io, NULL, arg);
+                return false;
+            }
+        } while (status == TLV_IO_FULL);
+    }
+    // The answers to all frames of the read go out with one write
+    if (io->tx_head != NULL) {
+        status = tlv_io_flush(io);
+        if (status == TLV_IO_CLOSED || status == TLV_IO_ERROR) {
+            handler(io, NULL, arg);
+            return false;
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,218 @@
+#ifndef TLV_IO_H_2016
+#define TLV_IO_H_2016
+
+/**
+ * File:   tlv_io.h
+ *
+ * @brief Framed TLV messages over non-blocking file descriptors
+ * A connection reads as many bytes as fit into its receive buffer with one read and cuts them into
+ * frames, one top level object each. The frames point into the receive buffer, they are valid until
+ * the next tlv_io_read and can be decoded with TLV_DECODE_BORROW or TLV_DECODE_LAZY without copying.
+ *
+ * Outgoing messages are copied or encoded into send buffers and written together with one writev
+ * by tlv_io_flush, the caller can free or modify them as soon as they are queued.
+ *
+ * The buffers come from a pool shared by the connections of an event loop. An idle connection
+ * gives its receive buffer back, so thousands of connections need buffers only for the ones with
+ * data in flight. Frames larger than the pool buffers get a buffer of their own, up to max_frame.
+ *
+ * tlv_io_poll_wait drives the connections with epoll in edge triggered mode: it reads, passes every
+ * frame to a handler and flushes what the handler queued. Pools, connections and polls are not
+ * thread safe, they belong to one event loop. Sockets are written with MSG_NOSIGNAL, other files
+ * raise SIGPIPE as usual when the reader is gone.
+ */
+
+#include "tlv.h"
+
+
+#ifndef TLV_IO_BUFFER_SIZE
+#define TLV_IO_BUFFER_SIZE 65536
+#endif
+
+#define TLV_IO_MAX_FRAME (16 * 1024 * 1024)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    typedef struct stTLVIOPool tlv_io_pool_t;
+    typedef struct stTLVIO tlv_io_t;
+    typedef struct stTLVIOPoll tlv_io_poll_t;
+
+    /**
+     * Results of the I/O functions
+     */
+    typedef enum {
+        TLV_IO_OK = 0,          /**< @brief Done, a frame was returned or all output was written */
+        TLV_IO_AGAIN,           /**< @brief The descriptor would block or no complete frame is buffered */
+        TLV_IO_FULL,            /**< @brief The receive buffer is full, take the frames and read again */
+        TLV_IO_CLOSED,          /**< @brief The peer closed the connection, buffered frames can still be taken */
+        TLV_IO_ERROR            /**< @brief I/O error, malformed or too large frame, the connection is unusable */
+    } tlv_io_status_t;
+
+    /**
+     * A received message
+     */
+    typedef struct {
+        const uint8_t *bytes;   /**< @brief The message with its header, points into the receive buffer */
+        size_t size;            /**< @brief Size of the message */
+        tlv_tag_t tag;          /**< @brief Tag of the message */
+    } tlv_io_frame_t;
+
+    /**
+     * @brief Receives the frames of tlv_io_poll_wait
+     * @param[in] io The connection
+     * @param[in] frame The received frame or NULL if the connection was closed or failed
+     * @param[in] arg User argument of tlv_io_poll_wait
+     * @return True to go on, false if the connection was deleted or is not to be served any more
+     */
+    typedef bool (*tlv_io_handler_t)(tlv_io_t *io, const tlv_io_frame_t *frame, void *arg);
+
+
+    /**
+     * @brief Creates a pool of buffers
+     * @param[in] buffer_size Size of the buffers, 0 for TLV_IO_BUFFER_SIZE
+     * @param[in] max_idle Number of unused buffers kept for reuse, the others are freed
+     * @return The pool or NULL
+     */
+    tlv_io_pool_t* tlv_io_pool_new(const size_t buffer_size, const size_t max_idle);
+
+
+    /**
+     * @brief Deletes a pool, all connections using it must be deleted before
+     * @param[in] pool Pool to delete
+     */
+    void tlv_io_pool_delete(tlv_io_pool_t **pool);
+
+
+    /**
+     * @brief Creates a connection on a file descriptor and makes the descriptor non-blocking
+     * The descriptor stays owned by the caller and is not closed by tlv_io_delete
+     * @param[in] pool Pool of the buffers
+     * @param[in] fd Socket, pipe or other stream descriptor
+     * @param[in] max_frame Largest accepted frame, 0 for TLV_IO_MAX_FRAME
+     * @return The connection or NULL
+     */
+    tlv_io_t* tlv_io_new(tlv_io_pool_t *pool, const int fd, const size_t max_frame);
+
+
+    /**
+     * @brief Deletes a connection, unsent output is dropped
+     * @param[in] io Connection to delete
+     */
+    void tlv_io_delete(tlv_io_t **io);
+
+
+    /**
+     * @brief Returns the file descriptor of a connection
+     * @param[in] io The connection
+     * @return The descriptor
+     */
+    int tlv_io_fd(const tlv_io_t *io);
+
+
+    /**
+     * @brief Reads from the descriptor until it would block or the receive buffer is full
+     * Invalidates the frames returned before.
+     * @param[in] io The connection
+     * @return TLV_IO_AGAIN, TLV_IO_FULL, TLV_IO_CLOSED or TLV_IO_ERROR
+     */
+    tlv_io_status_t tlv_io_read(tlv_io_t *io);
+
+
+    /**
+     * @brief Takes the next complete frame from the receive buffer
+     * @param[in] io The connection
+     * @param[out] frame Return point of the frame
+     * @return TLV_IO_OK, TLV_IO_AGAIN if no complete frame is buffered, or TLV_IO_ERROR if the buffered
+     * bytes are not a TLV object or the frame is larger than max_frame
+     */
+    tlv_io_status_t tlv_io_next_frame(tlv_io_t *io, tlv_io_frame_t *frame);
+
+
+    /**
+     * @brief Queues an encoded message
+     * @param[in] io The connection
+     * @param[in] barray The message, copied into the send buffers
+     * @param[in] size Size of the message
+     * @return True if successful, false otherwise
+     */
+    bool tlv_io_send(tlv_io_t *io, const uint8_t *barray, const size_t size);
+
+
+    /**
+     * @brief Encodes a tlv object with its next chain directly into the send buffers
+     * @param[in] io The connection
+     * @param[in] tlv The tlv object
+     * @return True if successful, false otherwise
+     */
+    bool tlv_io_send_tlv(tlv_io_t *io, const tlv_t *tlv);
+
+
+    /**
+     * @brief Writes the queued messages until the descriptor would block
+     * @param[in] io The connection
+     * @return TLV_IO_OK if all was written, TLV_IO_AGAIN if output is left, TLV_IO_CLOSED or TLV_IO_ERROR
+     */
+    tlv_io_status_t tlv_io_flush(tlv_io_t *io);
+
+
+    /**
+     * @brief Returns the number of queued bytes not written yet
+     * @param[in] io The connection
+     * @return Number of bytes
+     */
+    size_t tlv_io_pending(const tlv_io_t *io);
+
+
+    /**
+     * @brief Creates an epoll instance for connections
+     * @param[in] max_events Number of events taken per wait, 0 for 64
+     * @return The poll or NULL
+     */
+    tlv_io_poll_t* tlv_io_poll_new(const size_t max_events);
+
+
+    /**
+     * @brief Deletes a poll, the connections are not deleted
+     * @param[in] poll Poll to delete
+     */
+    void tlv_io_poll_delete(tlv_io_poll_t **poll);
+
+
+    /**
+     * @brief Adds a connection to a poll
+     * @param[in] poll The poll
+     * @param[in] io The connection
+     * @return True if successful, false otherwise
+     */
+    bool tlv_io_poll_add(tlv_io_poll_t *poll, tlv_io_t *io);
+
+
+    /**
+     * @brief Removes a connection from a poll, to be done before deleting it
+     * @param[in] poll The poll
+     * @param[in] io The connection
+     * @return True if successful, false otherwise
+     */
+    bool tlv_io_poll_remove(tlv_io_poll_t *poll, tlv_io_t *io);
+
+
+    /**
+     * @brief Waits for events and serves the ready connections
+     * Readable connections are read and their frames passed to the handler, then the output of the
+     * connection is flushed. A handler may delete its own connection and return false, but no other
+     * connection of the poll.
+     * @param[in] poll The poll
+     * @param[in] timeout Timeout in milliseconds, -1 to wait forever
+     * @param[in] handler Receiver of the frames
+     * @param[in] arg User argument passed to the handler
+     * @return Number of served connections, 0 on timeout, -1 on error
+     */
+    int tlv_io_poll_wait(tlv_io_poll_t *poll, const int timeout, tlv_io_handler_t handler, void *arg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TLV_IO_H_2016 */
@@ -0,0 +1,250 @@
+/**
+ * File:   tlv_io_test.c
+ *
+ * @brief Tests of tlv_io.h over socket pairs
+ * Run "make test" to build and run the tests
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include "tlv_io.h"
+#include "tlv_test.h"
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define TEST_BUFFER_SIZE 256
+#define TEST_LARGE_VALUE 5000
+#define TEST_FLUSH_COUNT 256
+#define TEST_FLUSH_VALUE 4096
+
+
+/********** PRIVATE DECLARATIONS **********************************************/
+/**
+ * @brief Checks that a frame is a message of tlv_test_message
+ * @param[in] frame The frame
+ * @param[in] tag Expected tag
+ * @param[in] length Expected length of the value
+ * @return True if it matches
+ */
+static bool check_frame(const tlv_io_frame_t *frame, const tlv_tag_t tag, const uint16_t length);
+
+
+/**
+ * @brief Writes all bytes to a blocking descriptor
+ */
+static bool write_all(const int fd, const uint8_t *bytes, const size_t size);
+
+
+/**
+ * A frame sent in pieces is returned once it is complete
+ */
+static bool test_split_frame(void);
+
+
+/**
+ * A frame larger than the pool buffers gets a buffer of its own
+ */
+static bool test_large_frame(void);
+
+
+/**
+ * Output left by a short writev is written by the next flushes in order
+ */
+static bool test_short_write(void);
+
+
+/**
+ * Frames buffered when the peer closes can still be taken
+ */
+static bool test_peer_close(void);
+
+
+/********** PUBLIC DEFINITIONS ************************************************/
+int main(void) {
+    bool ok = true;
+
+    ok = test_split_frame() && ok;
+    ok = test_large_frame() && ok;
+    ok = test_short_write() && ok;
+    ok = test_peer_close() && ok;
+
+    return tlv_test_result("tlv_io_test", ok);
+}
+
+
+/********** PRIVATE DEFINITIONS ***********************************************/
+static bool check_frame(const tlv_io_frame_t *frame, const tlv_tag_t tag, const uint16_t length) {
+    CHECK(frame->tag == tag);
+    CHECK(frame->size == BER_HEADER_BYTE_LENGTH + (size_t) length);
+    for (size_t i = BER_HEADER_BYTE_LENGTH; i < frame->size; i++) {
+        CHECK(frame->bytes[i] == (uint8_t) tag);
+    }
+
+    return true;
+}
+
+
+static bool write_all(const int fd, const uint8_t *bytes, const size_t size) {
+    size_t done = 0;
+
+    while (done < size) {
+        ssize_t n = write(fd, &bytes[done], size - done);
+
+        CHECK(n > 0);
+        done += (size_t) n;
+    }
+
+    return true;
+}
+
+
+static bool test_split_frame(void) {
+    uint8_t message[64];
+    size_t size = tlv_test_message(message, 0x0101, 40);
+    tlv_io_pool_t *pool = tlv_io_pool_new(TEST_BUFFER_SIZE, 1);
+    tlv_io_frame_t frame;
+    tlv_io_t *io;
+    int fds[2];
+
+    CHECK(pool != NULL && socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    CHECK((io = tlv_io_new(pool, fds[0], 0)) != NULL);
+
+    // Not even the header is complete after the first write
+    CHECK(write_all(fds[1], message, 3));
+    CHECK(tlv_io_read(io) == TLV_IO_AGAIN);
+    CHECK(tlv_io_next_frame(io, &frame) == TLV_IO_AGAIN);
+    CHECK(write_all(fds[1], &message[3], 20));
+    CHECK(tlv_io_read(io) == TLV_IO_AGAIN);
+    CHECK(tlv_io_next_frame(io, &frame) == TLV_IO_AGAIN);
+    CHECK(write_all(fds[1], &message[23], size - 23));
+    CHECK(tlv_io_read(io) == TLV_IO_AGAIN);
+    CHECK(tlv_io_next_frame(io, &frame) == TLV_IO_OK);
+    CHECK(check_frame(&frame, 0x0101, 40));
+    CHECK(tlv_io_next_frame(io, &frame) == TLV_IO_AGAIN);
+
+    tlv_io_delete(&io);
+    tlv_io_pool_delete(&pool);
+    close(fds[0]);
+    close(fds[1]);
+
+    return true;
+}
+
+
+static bool test_large_frame(void) {
+    uint8_t *message = malloc(2 * (BER_HEADER_BYTE_LENGTH + TEST_LARGE_VALUE));
+    tlv_io_pool_t *pool = tlv_io_pool_new(TEST_BUFFER_SIZE, 1);
+    tlv_io_frame_t frame;
+    tlv_io_status_t status;
+    size_t size;
+    int frames = 0;
+    tlv_io_t *io;
+    int fds[2];
+
+    // A large frame between two small ones
+    CHECK(message != NULL && pool != NULL && socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    CHECK((io = tlv_io_new(pool, fds[0], 0)) != NULL);
+    size = tlv_test_message(message, 0x0201, 10);
+    size += tlv_test_message(&message[size], 0x0202, TEST_LARGE_VALUE);
+    size += tlv_test_message(&message[size], 0x0203, 10);
+    CHECK(write_all(fds[1], message, size));
+
+    do {
+        CHECK((status = tlv_io_read(io)) == TLV_IO_AGAIN || status == TLV_IO_FULL);
+        while (tlv_io_next_frame(io, &frame) == TLV_IO_OK) {
+            CHECK(check_frame(&frame, (tlv_tag_t) (0x0201 + frames), frames == 1 ? TEST_LARGE_VALUE : 10));
+            frames++;
+        }
+    } while (frames < 3);
+    CHECK(tlv_io_read(io) == TLV_IO_AGAIN);
+    CHECK(tlv_io_next_frame(io, &frame) == TLV_IO_AGAIN);
+
+    tlv_io_delete(&io);
+    tlv_io_pool_delete(&pool);
+    close(fds[0]);
+    close(fds[1]);
+    free(message);
+
+    return true;
+}
+
+
+static bool test_short_write(void) {
+    uint8_t message[TEST_FLUSH_VALUE + 8];
+    tlv_io_pool_t *pool = tlv_io_pool_new(0, 4);
+    tlv_io_frame_t frame;
+    tlv_io_t *sender;
+    tlv_io_t *receiver;
+    size_t total = 0;
+    int frames = 0;
+    int small = 4096;
+    int fds[2];
+
+    // A small send buffer makes the first flush stop long before the queue is written
+    CHECK(pool != NULL && socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    CHECK(setsockopt(fds[0], SOL_SOCKET, SO_SNDBUF, &small, sizeof (small)) == 0);
+    CHECK((sender = tlv_io_new(pool, fds[0], 0)) != NULL && (receiver = tlv_io_new(pool, fds[1], 0)) != NULL);
+    for (int i = 0; i < TEST_FLUSH_COUNT; i++) {
+        size_t size = tlv_test_message(message, (tlv_tag_t) i, TEST_FLUSH_VALUE);
+
+        CHECK(tlv_io_send(sender, message, size));
+        total += size;
+    }
+    CHECK(tlv_io_pending(sender) == total);
+    CHECK(tlv_io_flush(sender) == TLV_IO_AGAIN);
+    CHECK(tlv_io_pending(sender) > 0 && tlv_io_pending(sender) < total);
+
+    while (frames < TEST_FLUSH_COUNT) {
+        tlv_io_status_t status = tlv_io_flush(sender);
+
+        CHECK(status == TLV_IO_OK || status == TLV_IO_AGAIN);
+        CHECK((status = tlv_io_read(receiver)) == TLV_IO_AGAIN || status == TLV_IO_FULL);
+        while (tlv_io_next_frame(receiver, &frame) == TLV_IO_OK) {
+            CHECK(check_frame(&frame, (tlv_tag_t) frames, TEST_FLUSH_VALUE));
+            frames++;
+        }
+    }
+    CHECK(tlv_io_pending(sender) == 0);
+
+    tlv_io_delete(&receiver);
+    tlv_io_delete(&sender);
+    tlv_io_pool_delete(&pool);
+    close(fds[0]);
+    close(fds[1]);
+
+    return true;
+}
+
+
+static bool test_peer_close(void) {
+    uint8_t message[128];
+    tlv_io_pool_t *pool = tlv_io_pool_new(TEST_BUFFER_SIZE, 1);
+    tlv_io_frame_t frame;
+    tlv_io_status_t status;
+    size_t size;
+    tlv_io_t *io;
+    int fds[2];
+
+    CHECK(pool != NULL && socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    CHECK((io = tlv_io_new(pool, fds[0], 0)) != NULL);
+    size = tlv_test_message(message, 0x0301, 30);
+    size += tlv_test_message(&message[size], 0x0302, 50);
+    CHECK(write_all(fds[1], message, size));
+    close(fds[1]);
+
+    // The frames stay buffered after the end of the stream was read
+    while ((status = tlv_io_read(io)) == TLV_IO_AGAIN) {
+    }
+    CHECK(status == TLV_IO_CLOSED);
+    CHECK(tlv_io_next_frame(io, &frame) == TLV_IO_OK);
+    CHECK(check_frame(&frame, 0x0301, 30));
+    CHECK(tlv_io_next_frame(io, &frame) == TLV_IO_OK);
+    CHECK(check_frame(&frame, 0x0302, 50));
+    CHECK(tlv_io_next_frame(io, &frame) == TLV_IO_AGAIN);
+
+    tlv_io_delete(&io);
+    tlv_io_pool_delete(&pool);
+    close(fds[0]);
+
+    return true;
+}
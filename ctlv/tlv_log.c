@@ -0,0 +1,810 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "tlv_log.h"
+#include "tlv_private.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#define CHECKSUM_SIZE 8
+#define RECORD_TRAILER (BER_HEADER_BYTE_LENGTH + CHECKSUM_SIZE)
+#define RECORD_OVERHEAD (BER_WIDE_HEADER_BYTE_LENGTH + RECORD_TRAILER)
+#define INDEX_BUFFER_ENTRIES 1024
+#define INDEX_SUFFIX ".idx"
+#define NO_RECORD UINT32_MAX
+
+
+/**
+ * An entry of the index
+ */
+typedef struct {
+    uint64_t offset;                /**< @brief Offset of the record */
+    uint32_t size;                  /**< @brief Size of the message */
+    tlv_tag_t tag;                  /**< @brief Tag of the first object of the message */
+} log_entry_t;
+
+/**
+ * The writing end of a log, records are collected in the buffers and written together
+ */
+struct stTLVLogWriter {
+    int fd;                         /**< @brief The log file */
+    int index_fd;                   /**< @brief The index file */
+    uint64_t offset;                /**< @brief End of the log, buffered records inclusive */
+    size_t count;                   /**< @brief Number of records, buffered records inclusive */
+    size_t sync_every;              /**< @brief Records between two syncs or 0 */
+    size_t unsynced;                /**< @brief Records appended since the last sync */
+    bool broken;                    /**< @brief A write failed, the files must be recovered by opening them again */
+    size_t used;                    /**< @brief Bytes in the buffer */
+    size_t index_used;              /**< @brief Bytes in the index buffer */
+    uint8_t *buffer;                /**< @brief Records not written yet */
+    uint8_t *index;                 /**< @brief Index entries not written yet */
+};
+
+/**
+ * The reading end of a log, both files are mapped into memory
+ */
+struct stTLVLogReader {
+    const uint8_t *data;            /**< @brief Mapping of the log or NULL if empty */
+    size_t data_size;               /**< @brief Size of the mapping of the log */
+    const uint8_t *index;           /**< @brief Mapping of the index or NULL if empty or missing */
+    size_t index_size;              /**< @brief Size of the mapping of the index */
+    size_t indexed;                 /**< @brief Number of valid entries in the index */
+    log_entry_t *extra;             /**< @brief Complete records behind the indexed ones */
+    size_t extra_count;             /**< @brief Number of extra records */
+    uint32_t *first;                /**< @brief First record by tag, built on the first tag query */
+    uint32_t *next;                 /**< @brief Next record with the same tag by record */
+};
+
+
+/********** PRIVATE DECLARATIONS **********************************************/
+/**
+ * @brief Reads an entry of the index
+ */
+static void entry_read(const uint8_t *bytes, log_entry_t *entry);
+
+/**
+ * @brief Writes an entry of the index
+ */
+static void entry_write(uint8_t *bytes, const log_entry_t *entry);
+
+/**
+ * @brief Checks the record at an offset of a log
+ * @param[out] entry Index entry of the record
+ * @return True if the record is complete
+ */
+static bool record_read(const uint8_t *data, const size_t size, const uint64_t offset, log_entry_t *entry);
+
+/**
+ * @brief Writes the header and the checksum of a record around its message
+ * @param[out] header BER_WIDE_HEADER_BYTE_LENGTH bytes before the message
+ * @param[out] trailer RECORD_TRAILER bytes after the message
+ */
+static void record_wrap(uint8_t *header, uint8_t *trailer, const uint8_t *message, const size_t size);
+
+/**
+ * @brief Finds the complete records of a log
+ * The last valid entry of the index is searched from its end, the complete records behind it are
+ * collected as extra records.
+ * @param[in,out] indexed Number of entries in the index, set to the number of valid entries
+ * @param[out] extra Allocated array of the extra records, NULL if there are none
+ * @param[out] extra_count Number of extra records
+ * @param[out] end End of the last complete record
+ * @return True if successful, false if out of memory
+ */
+static bool recover(const uint8_t *data, const size_t data_size, const uint8_t *index, size_t *indexed,
+        log_entry_t **extra, size_t *extra_count, uint64_t *end);
+
+/**
+ * @brief Maps a whole file read-only
+ * @param[out] bytes The mapping, NULL if the file is empty
+ * @param[out] size Size of the mapping
+ */
+static bool map_file(const int fd, const uint8_t **bytes, size_t *size);
+
+/**
+ * @brief Opens a file, the path is extended with a suffix if not NULL
+ * @return The file descriptor or -1
+ */
+static int open_file(const char *path, const char *suffix, const int flags);
+
+/**
+ * @brief Recovers the files of a writer and positions it at the end of the last complete record
+ */
+static bool writer_recover(tlv_log_writer_t *writer);
+
+/**
+ * @brief Writes an I/O vector completely, retrying partial writes
+ */
+static bool write_all(const int fd, struct iovec *iov, int count);
+
+/**
+ * @brief Writes the buffered records and their index entries, the records first
+ */
+static bool flush(tlv_log_writer_t *writer);
+
+/**
+ * @brief Flushes the buffer if a record with a message of the size does not fit into it
+ */
+static bool make_room(tlv_log_writer_t *writer, const size_t size);
+
+/**
+ * @brief Wraps a message already copied behind the header room in the buffer and indexes it
+ */
+static bool add_buffered(tlv_log_writer_t *writer, const size_t size);
+
+/**
+ * @brief Writes a record larger than the buffer directly and indexes it, the buffer must be empty
+ */
+static bool add_direct(tlv_log_writer_t *writer, const uint8_t *message, const size_t size);
+
+/**
+ * @brief Adds an entry to the index buffer
+ */
+static bool index_push(tlv_log_writer_t *writer, const log_entry_t *entry);
+
+/**
+ * @brief Indexes the record appended last and syncs if sync_every records are not synced
+ */
+static bool index_add(tlv_log_writer_t *writer, const size_t size, const tlv_tag_t tag);
+
+/**
+ * @brief Returns the index entry of a record
+ */
+static void reader_entry(const tlv_log_reader_t *reader, const size_t n, log_entry_t *entry);
+
+/**
+ * @brief Chains the records by their tags
+ */
+static bool group_tags(tlv_log_reader_t *reader);
+
+
+/********** PUBLIC DEFINITIONS ************************************************/
+tlv_log_writer_t* tlv_log_writer_open(const char *path, const size_t sync_every) {
+    tlv_log_writer_t *writer;
+
+    if (path == NULL) {
+        TLV_FAIL(TLV_FAILURE_ARGUMENT, "Error - Path is null when opening log");
+        return NULL;
+    }
+    if ((writer = calloc(1, sizeof (*writer))) == NULL
+            || (writer->buffer = malloc(TLV_LOG_BUFFER_SIZE)) == NULL
+            || (writer->index = malloc(INDEX_BUFFER_ENTRIES * TLV_LOG_INDEX_ENTRY_SIZE)) == NULL) {
+        TLV_FAIL(TLV_FAILURE_MEMORY, "Fatal - Out of memory when opening log");
+        if (writer != NULL) {
+            free(writer->buffer);
+            free(writer);
+        }
+        return NULL;
+    }
+    writer->sync_every = sync_every;
+    writer->fd = open_file(path, NULL, O_RDWR | O_CREAT | O_APPEND);
+    writer->index_fd = open_file(path, INDEX_SUFFIX, O_RDWR | O_CREAT | O_APPEND);
+    if (writer->fd < 0 || writer->index_fd < 0 || !writer_recover(writer)) {
+        tlv_debug_cb("Error - Failed to open log %s", path);
+        if (writer->fd >= 0) {
+            close(writer->fd);
+        }
+        if (writer->index_fd >= 0) {
+            close(writer->index_fd);
+        }
+        free(writer->buffer);
+        free(writer->index);
+        free(writer);
+        return NULL;
+    }
+
+    return writer;
+}
+
+
+bool tlv_log_append(tlv_log_writer_t *writer, const uint8_t *barray, const size_t size) {
+    tlv_header_t header;
+
+    if (writer == NULL || barray == NULL) {
+        TLV_FAIL(TLV_FAILURE_ARGUMENT, "Error - Writer or message is null when appending");
+        return false;
+    }
+    // A record holds exactly one message, a partial or padded one would poison the log for the readers
+    if (!tlv_header_read(barray, size, &header) || header.size + (size_t) header.length != size) {
+        TLV_FAIL(TLV_FAILURE_MALFORMED, "Error - Message is malformed or not %zu bytes long when appending", size);
+        return false;
+    }
+    if (size > UINT32_MAX - RECORD_OVERHEAD) {
+        TLV_FAIL(TLV_FAILURE_SIZE, "Error - Message too large for a log record");
+        return false;
+    }
+    if (!make_room(writer, size)) {
+        return false;
+    }
+    if (size + RECORD_OVERHEAD > TLV_LOG_BUFFER_SIZE) {
+        return add_direct(writer, barray, size);
+    }
+    memcpy(&writer->buffer[writer->used + BER_WIDE_HEADER_BYTE_LENGTH], barray, size);
+
+    return add_buffered(writer, size);
+}
+
+
+bool tlv_log_append_tlv(tlv_log_writer_t *writer, const tlv_t *tlv) {
+    uint8_t *barray;
+    size_t size = 0;
+    bool ok;
+
+    if (writer == NULL || tlv == NULL) {
+        TLV_FAIL(TLV_FAILURE_ARGUMENT, "Error - Writer or tlv is null when appending");
+        return false;
+    }
+    // A record holds exactly one message, as in tlv_log_append
+    if (tlv->next != NULL) {
+        TLV_FAIL(TLV_FAILURE_ARGUMENT, "Error - Tlv has next objects when appending, append them one by one");
+        return false;
+    }
+    tlv_to_buffer(tlv, NULL, 0, &size);
+    if (size == 0) {
+        tlv_debug_cb("Error - Failed to get size of the appended tlv");
+        return false;
+    }
+    if (size > UINT32_MAX - RECORD_OVERHEAD) {
+        TLV_FAIL(TLV_FAILURE_SIZE, "Error - Tlv too large for a log record");
+        return false;
+    }
+    if (!make_room(writer, size)) {
+        return false;
+    }
+    if (size + RECORD_OVERHEAD <= TLV_LOG_BUFFER_SIZE) {
+        // Encoded in place, between the header and the checksum of the record
+        if (!tlv_to_buffer(tlv, &writer->buffer[writer->used + BER_WIDE_HEADER_BYTE_LENGTH], size, &size)) {
+            tlv_debug_cb("Error - Failed to encode the appended tlv");
+            return false;
+        }
+        return add_buffered(writer, size);
+    }
+    if (!tlv_to_byte_array(tlv, &barray, &size)) {
+        tlv_debug_cb("Error - Failed to encode the appended tlv");
+        return false;
+    }
+    ok = add_direct(writer, barray, size);
+    free(barray);
+
+    return ok;
+}
+
+
+bool tlv_log_sync(tlv_log_writer_t *writer) {
+    if (writer == NULL) {
+        TLV_FAIL(TLV_FAILURE_ARGUMENT, "Error - Writer is null when syncing");
+        return false;
+    }
+    if (!flush(writer)) {
+        return false;
+    }
+    // The records first, an index entry never reaches the disk before its record
+    if (fdatasync(writer->fd) != 0 || fdatasync(writer->index_fd) != 0) {
+        TLV_FAIL(TLV_FAILURE_IO, "Error - Failed to sync log: %s", strerror(errno));
+        writer->broken = true;
+        return false;
+    }
+    writer->unsynced = 0;
+
+    return true;
+}
+
+
+size_t tlv_log_writer_count(const tlv_log_writer_t *writer) {
+    return writer != NULL ? writer->count : 0;
+}
+
+
+bool tlv_log_writer_close(tlv_log_writer_t **writer) {
+    bool ok = false;
+
+    if (writer != NULL && *writer != NULL) {
+        tlv_log_writer_t *w = *writer;
+
+        ok = tlv_log_sync(w);
+        close(w->fd);
+        close(w->index_fd);
+        free(w->buffer);
+        free(w->index);
+        free(w);
+        *writer = NULL;
+    }
+
+    return ok;
+}
+
+
+tlv_log_reader_t* tlv_log_reader_open(const char *path) {
+    tlv_log_reader_t *reader;
+    uint64_t end;
+    int fd;
+
+    if (path == NULL) {
+        TLV_FAIL(TLV_FAILURE_ARGUMENT, "Error - Path is null when opening log");
+        return NULL;
+    }
+    if ((reader = calloc(1, sizeof (*reader))) == NULL) {
+        TLV_FAIL(TLV_FAILURE_MEMORY, "Fatal - Out of memory when opening log");
+        return NULL;
+    }
+    if ((fd = open_file(path, NULL, O_RDONLY)) < 0 || !map_file(fd, &reader->data, &reader->data_size)) {
+        tlv_debug_cb("Error - Failed to open log %s", path);
+        if (fd >= 0) {
+            close(fd);
+        }
+        free(reader);
+        return NULL;
+    }
+    close(fd);
+
+    // Without an index all records are found by scanning the log
+    if ((fd = open_file(path, INDEX_SUFFIX, O_RDONLY)) >= 0) {
+        if (!map_file(fd, &reader->index, &reader->index_size)) {
+            reader->index = NULL;
+            reader->index_size = 0;
+        }
+        close(fd);
+    }
+    reader->indexed = reader->index_size / TLV_LOG_INDEX_ENTRY_SIZE;
+    if (!recover(reader->data, reader->data_size, reader->index, &reader->indexed, &reader->extra, &reader->extra_count, &end)) {
+        tlv_log_reader_close(&reader);
+        return NULL;
+    }
+
+    return reader;
+}
+
+
+size_t tlv_log_count(const tlv_log_reader_t *reader) {
+    return reader != NULL ? reader->indexed + reader->extra_count : 0;
+}
+
+
+bool tlv_log_get(const tlv_log_reader_t *reader, const size_t n, tlv_log_record_t *record) {
+    log_entry_t entry;
+
+    if (reader == NULL || record == NULL) {
+        TLV_FAIL(TLV_FAILURE_ARGUMENT, "Error - Reader or record is null when reading log");
+        return false;
+    }
+    if (n >= reader->indexed + reader->extra_count) {
+        return false;
+    }
+    reader_entry(reader, n, &entry);
+    // Only the last indexed record was checked when opening, a damaged index must not lead outside of the log
+    if (entry.offset > reader->data_size || reader->data_size - entry.offset < (uint64_t) entry.size + RECORD_OVERHEAD
+            || reader->data[entry.offset] != TLV_CDO_WIDE) {
+        TLV_FAIL(TLV_FAILURE_MALFORMED, "Error - Index entry %u does not point to a record", (unsigned) n);
+        return false;
+    }
+    record->bytes = &reader->data[entry.offset + BER_WIDE_HEADER_BYTE_LENGTH];
+    record->size = entry.size;
+    record->tag = entry.tag;
+    record->offset = entry.offset;
+
+    return true;
+}
+
+
+size_t tlv_log_find_tag(tlv_log_reader_t *reader, const tlv_tag_t tag) {
+    if (reader == NULL) {
+        TLV_FAIL(TLV_FAILURE_ARGUMENT, "Error - Reader is null when searching log");
+        return TLV_LOG_NONE;
+    }
+    if (!group_tags(reader) || reader->first[tag] == NO_RECORD) {
+        return TLV_LOG_NONE;
+    }
+
+    return reader->first[tag];
+}
+
+
+size_t tlv_log_next_tag(tlv_log_reader_t *reader, const size_t n) {
+    if (reader == NULL) {
+        TLV_FAIL(TLV_FAILURE_ARGUMENT, "Error - Reader is null when searching log");
+        return TLV_LOG_NONE;
+    }
+    if (n >= reader->indexed + reader->extra_count || !group_tags(reader) || reader->next[n] == NO_RECORD) {
+        return TLV_LOG_NONE;
+    }
+
+    return reader->next[n];
+}
+
+
+void tlv_log_reader_close(tlv_log_reader_t **reader) {
+    if (reader != NULL && *reader != NULL) {
+        tlv_log_reader_t *r = *reader;
+
+        if (r->data != NULL) {
+            munmap((void*) r->data, r->data_size);
+        }
+        if (r->index != NULL) {
+            munmap((void*) r->index, r->index_size);
+        }
+        free(r->extra);
+        free(r->first);
+        free(r->next);
+        free(r);
+        *reader = NULL;
+    }
+}
+
+
+/********** PRIVATE DEFINITIONS ***********************************************/
+static void entry_read(const uint8_t *bytes, log_entry_t *entry) {
+    entry->offset = 0;
+    for (size_t i = 0; i < 8; i++) {
+        entry->offset = entry->offset << 8 | bytes[i];
+    }
+    entry->size = (uint32_t) bytes[8] << 24 | (uint32_t) bytes[9] << 16 | (uint32_t) bytes[10] << 8 | bytes[11];
+    entry->tag = (tlv_tag_t) (bytes[12] << 8 | bytes[13]);
+}
+
+
+static void entry_write(uint8_t *bytes, const log_entry_t *entry) {
+    for (size_t i = 0; i < 8; i++) {
+        bytes[i] = (uint8_t) (entry->offset >> (56 - 8 * i));
+    }
+    bytes[8] = (uint8_t) (entry->size >> 24);
+    bytes[9] = (uint8_t) (entry->size >> 16);
+    bytes[10] = (uint8_t) (entry->size >> 8);
+    bytes[11] = (uint8_t) entry->size;
+    bytes[12] = (uint8_t) (entry->tag >> 8);
+    bytes[13] = (uint8_t) entry->tag;
+    bytes[14] = 0;
+    bytes[15] = 0;
+}
+
+
+static bool record_read(const uint8_t *data, const size_t size, const uint64_t offset, log_entry_t *entry) {
+    tlv_header_t header;
+    const uint8_t *message;
+    uint64_t checksum = 0;
+
+    if (offset >= size || !tlv_header_read(&data[offset], size - offset, &header) || header.type != TLV_CDO
+            || header.size != BER_WIDE_HEADER_BYTE_LENGTH || header.tag != TLV_LOG_TAG
+            || header.length < RECORD_TRAILER + BER_HEADER_BYTE_LENGTH
+            || size - offset - header.size < header.length) {
+        return false;
+    }
+    message = &data[offset + header.size];
+    entry->offset = offset;
+    entry->size = header.length - RECORD_TRAILER;
+    entry->tag = (tlv_tag_t) (message[1] << 8 | message[2]);
+
+    // The checksum PDO ends the record, a torn record has no valid one
+    if (!tlv_header_read(&message[entry->size], RECORD_TRAILER, &header) || header.type != TLV_PDO
+            || header.size != BER_HEADER_BYTE_LENGTH || header.tag != TLV_LOG_CHECKSUM || header.length != CHECKSUM_SIZE) {
+        return false;
+    }
+    for (size_t i = 0; i < CHECKSUM_SIZE; i++) {
+        checksum = checksum << 8 | message[entry->size + BER_HEADER_BYTE_LENGTH + i];
+    }
+
+    return checksum == tlv_hash_raw(message, entry->size);
+}
+
+
+static void record_wrap(uint8_t *header, uint8_t *trailer, const uint8_t *message, const size_t size) {
+    uint64_t checksum = tlv_hash_raw(message, size);
+
+    tlv_header_write(header, TLV_CDO, TLV_LOG_TAG, (tlv_length_t) (size + RECORD_TRAILER), true);
+    tlv_header_write(trailer, TLV_PDO, TLV_LOG_CHECKSUM, CHECKSUM_SIZE, false);
+    for (size_t i = 0; i < CHECKSUM_SIZE; i++) {
+        trailer[BER_HEADER_BYTE_LENGTH + i] = (uint8_t) (checksum >> (56 - 8 * i));
+    }
+}
+
+
+static bool recover(const uint8_t *data, const size_t data_size, const uint8_t *index, size_t *indexed,
+        log_entry_t **extra, size_t *extra_count, uint64_t *end) {
+    log_entry_t entry;
+    log_entry_t record;
+    size_t capacity = 0;
+
+    *extra = NULL;
+    *extra_count = 0;
+    *end = 0;
+
+    // Entries of records lost with a torn tail are dropped from the end of the index
+    while (*indexed > 0) {
+        entry_read(&index[(*indexed - 1) * TLV_LOG_INDEX_ENTRY_SIZE], &entry);
+        if (record_read(data, data_size, entry.offset, &record) && record.size == entry.size && record.tag == entry.tag) {
+            *end = entry.offset + RECORD_OVERHEAD + entry.size;
+            break;
+        }
+        (*indexed)--;
+    }
+
+    // Complete records written after the last index entry
+    while (record_read(data, data_size, *end, &record)) {
+        if (*extra_count == capacity) {
+            log_entry_t *grown;
+
+            capacity = capacity == 0 ? 64 : capacity * 2;
+            if ((grown = realloc(*extra, capacity * sizeof (**extra))) == NULL) {
+                TLV_FAIL(TLV_FAILURE_MEMORY, "Fatal - Out of memory when recovering log");
+                free(*extra);
+                *extra = NULL;
+                *extra_count = 0;
+                return false;
+            }
+            *extra = grown;
+        }
+        (*extra)[(*extra_count)++] = record;
+        *end += RECORD_OVERHEAD + record.size;
+    }
+
+    return true;
+}
+
+
+static bool map_file(const int fd, const uint8_t **bytes, size_t *size) {
+    struct stat info;
+    void *mapping;
+
+    *bytes = NULL;
+    *size = 0;
+    if (fstat(fd, &info) != 0) {
+        TLV_FAIL(TLV_FAILURE_IO, "Error - Failed to stat log: %s", strerror(errno));
+        return false;
+    }
+    if (info.st_size == 0) {
+        return true;
+    }
+    if ((mapping = mmap(NULL, (size_t) info.st_size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+        TLV_FAIL(TLV_FAILURE_IO, "Error - Failed to map log: %s", strerror(errno));
+        return false;
+    }
+    *bytes = mapping;
+    *size = (size_t) info.st_size;
+
+    return true;
+}
+
+
+static int open_file(const char *path, const char *suffix, const int flags) {
+    char *name = (char*) path;
+    int fd;
+
+    if (suffix != NULL) {
+        if ((name = malloc(strlen(path) + strlen(suffix) + 1)) == NULL) {
+            TLV_FAIL(TLV_FAILURE_MEMORY, "Fatal - Out of memory when opening log");
+            return -1;
+        }
+        strcpy(name, path);
+        strcat(name, suffix);
+    }
+    if ((fd = open(name, flags | O_CLOEXEC, 0644)) < 0 && !(errno == ENOENT && !(flags & O_CREAT) && suffix != NULL)) {
+        TLV_FAIL(TLV_FAILURE_IO, "Error - Failed to open %s: %s", name, strerror(errno));
+    }
+    if (suffix != NULL) {
+        free(name);
+    }
+
+    return fd;
+}
+
+
+static bool writer_recover(tlv_log_writer_t *writer) {
+    const uint8_t *data;
+    const uint8_t *index;
+    size_t data_size;
+    size_t index_size;
+    size_t indexed;
+    log_entry_t *extra;
+    size_t extra_count;
+    uint64_t end;
+    bool ok;
+
+    if (!map_file(writer->fd, &data, &data_size)) {
+        return false;
+    }
+    if (!map_file(writer->index_fd, &index, &index_size)) {
+        if (data != NULL) {
+            munmap((void*) data, data_size);
+        }
+        return false;
+    }
+    indexed = index_size / TLV_LOG_INDEX_ENTRY_SIZE;
+    ok = recover(data, data_size, index, &indexed, &extra, &extra_count, &end);
+    if (data != NULL) {
+        munmap((void*) data, data_size);
+    }
+    if (index != NULL) {
+        munmap((void*) index, index_size);
+    }
+    if (!ok) {
+        return false;
+    }
+
+    // The torn tail is cut off, then the missing entries are indexed
+    if ((end != data_size && ftruncate(writer->fd, (off_t) end) != 0)
+            || (indexed * TLV_LOG_INDEX_ENTRY_SIZE != index_size
+            && ftruncate(writer->index_fd, (off_t) (indexed * TLV_LOG_INDEX_ENTRY_SIZE)) != 0)) {
+        TLV_FAIL(TLV_FAILURE_IO, "Error - Failed to truncate log: %s", strerror(errno));
+        free(extra);
+        return false;
+    }
+    writer->offset = end;
+    writer->count = indexed + extra_count;
+    for (size_t i = 0; ok && i < extra_count; i++) {
+        ok = index_push(writer, &extra[i]);
+    }
+    free(extra);
+    if (ok && (end != data_size || indexed * TLV_LOG_INDEX_ENTRY_SIZE != index_size || extra_count > 0)) {
+        ok = tlv_log_sync(writer);
+    }
+
+    return ok;
+}
+
+
+static bool write_all(const int fd, struct iovec *iov, int count) {
+    while (count > 0) {
+        ssize_t written = writev(fd, iov, count);
+
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        while (count > 0 && (size_t) written >= iov->iov_len) {
+            written -= (ssize_t) iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0) {
+            iov->iov_base = (uint8_t*) iov->iov_base + written;
+            iov->iov_len -= (size_t) written;
+        }
+    }
+
+    return true;
+}
+
+
+static bool flush(tlv_log_writer_t *writer) {
+    struct iovec iov;
+
+    if (writer->broken) {
+        TLV_FAIL(TLV_FAILURE_IO, "Error - Log is broken by a failed write, it must be opened again");
+        return false;
+    }
+    if (writer->used > 0) {
+        iov.iov_base = writer->buffer;
+        iov.iov_len = writer->used;
+        if (!write_all(writer->fd, &iov, 1)) {
+            TLV_FAIL(TLV_FAILURE_IO, "Error - Failed to write log: %s", strerror(errno));
+            writer->broken = true;
+            return false;
+        }
+        writer->used = 0;
+    }
+    if (writer->index_used > 0) {
+        iov.iov_base = writer->index;
+        iov.iov_len = writer->index_used;
+        if (!write_all(writer->index_fd, &iov, 1)) {
+            TLV_FAIL(TLV_FAILURE_IO, "Error - Failed to write log index: %s", strerror(errno));
+            writer->broken = true;
+            return false;
+        }
+        writer->index_used = 0;
+    }
+
+    return true;
+}
+
+
+static bool make_room(tlv_log_writer_t *writer, const size_t size) {
+    if (writer->broken) {
+        TLV_FAIL(TLV_FAILURE_IO, "Error - Log is broken by a failed write, it must be opened again");
+        return false;
+    }
+
+    return writer->used + size + RECORD_OVERHEAD <= TLV_LOG_BUFFER_SIZE || flush(writer);
+}
+
+
+static bool add_buffered(tlv_log_writer_t *writer, const size_t size) {
+    uint8_t *header = &writer->buffer[writer->used];
+    uint8_t *message = &header[BER_WIDE_HEADER_BYTE_LENGTH];
+
+    record_wrap(header, &message[size], message, size);
+    writer->used += size + RECORD_OVERHEAD;
+
+    return index_add(writer, size, (tlv_tag_t) (message[1] << 8 | message[2]));
+}
+
+
+static bool add_direct(tlv_log_writer_t *writer, const uint8_t *message, const size_t size) {
+    uint8_t header[BER_WIDE_HEADER_BYTE_LENGTH];
+    uint8_t trailer[RECORD_TRAILER];
+    struct iovec iov[3] = {
+        {header, sizeof (header)},
+        {(void*) message, size},
+        {trailer, sizeof (trailer)}
+    };
+
+    record_wrap(header, trailer, message, size);
+    if (!write_all(writer->fd, iov, 3)) {
+        TLV_FAIL(TLV_FAILURE_IO, "Error - Failed to write log: %s", strerror(errno));
+        writer->broken = true;
+        return false;
+    }
+
+    return index_add(writer, size, (tlv_tag_t) (message[1] << 8 | message[2]));
+}
+
+
+static bool index_push(tlv_log_writer_t *writer, const log_entry_t *entry) {
+    if (writer->index_used == INDEX_BUFFER_ENTRIES * TLV_LOG_INDEX_ENTRY_SIZE && !flush(writer)) {
+        return false;
+    }
+    entry_write(&writer->index[writer->index_used], entry);
+    writer->index_used += TLV_LOG_INDEX_ENTRY_SIZE;
+
+    return true;
+}
+
+
+static bool index_add(tlv_log_writer_t *writer, const size_t size, const tlv_tag_t tag) {
+    log_entry_t entry = {writer->offset, (uint32_t) size, tag};
+
+    writer->offset += size + RECORD_OVERHEAD;
+    writer->count++;
+    if (!index_push(writer, &entry)) {
+        return false;
+    }
+    if (writer->sync_every > 0 && ++writer->unsynced >= writer->sync_every) {
+        return tlv_log_sync(writer);
+    }
+
+    return true;
+}
+
+
+static void reader_entry(const tlv_log_reader_t *reader, const size_t n, log_entry_t *entry) {
+    if (n < reader->indexed) {
+        entry_read(&reader->index[n * TLV_LOG_INDEX_ENTRY_SIZE], entry);
+    } else {
+        *entry = reader->extra[n - reader->indexed];
+    }
+}
+
+
+static bool group_tags(tlv_log_reader_t *reader) {
+    size_t count = reader->indexed + reader->extra_count;
+    log_entry_t entry;
+
+    if (reader->first != NULL) {
+        return true;
+    }
+    if (count >= NO_RECORD) {
+        TLV_FAIL(TLV_FAILURE_SIZE, "Error - Too many records to search by tag");
+        return false;
+    }
+    if ((reader->first = malloc((UINT16_MAX + 1) * sizeof (*reader->first))) == NULL
+            || (reader->next = malloc((count > 0 ? count : 1) * sizeof (*reader->next))) == NULL) {
+        TLV_FAIL(TLV_FAILURE_MEMORY, "Fatal - Out of memory when searching log");
+        free(reader->first);
+        reader->first = NULL;
+        return false;
+    }
+    memset(reader->first, 0xFF, (UINT16_MAX + 1) * sizeof (*reader->first));
+
+    // Backwards, so every chain runs in the order of the records
+    for (size_t n = count; n-- > 0;) {
+        reader_entry(reader, n, &entry);
+        reader->next[n] = reader->first[entry.tag];
+        reader->first[entry.tag] = (uint32_t) n;
+    }
+
+    return true;
+}
@@ -0,0 +1,166 @@
+#ifndef TLV_LOG_H_2016
+#define TLV_LOG_H_2016
+
+/**
+ * File:   tlv_log.h
+ *
+ * @brief Append-only log of TLV messages with an index for random access
+ * The log file is a sequence of TLV messages itself, every record wraps one message, which is a single
+ * top level object:
+ *   |cdo+TLV_LOG_TAG|              - always with a wide header
+ *      ...                         - the message as appended
+ *      |pdo+TLV_LOG_CHECKSUM|      - 64-bit hash of the message
+ *
+ * The sidecar file "<path>.idx" holds an entry of TLV_LOG_INDEX_ENTRY_SIZE bytes per record: the offset
+ * of the record (8 bytes), the size of the message (4 bytes), the tag of its first object (2 bytes)
+ * and 2 reserved bytes, big endian. The N'th record is found without reading the records before it.
+ *
+ * A record is complete when its wrapper, its length and its checksum are right. Opening a log checks
+ * the last indexed record and the records behind it. The writer cuts off a torn tail left by a crash,
+ * re-indexes complete records the index missed, and appends after them. The reader skips such
+ * a tail and never modifies the files.
+ *
+ * The reader maps the log into memory, the records point into the mapping and can be decoded with
+ * TLV_DECODE_BORROW or TLV_DECODE_LAZY without copying, as long as the reader is open.
+ */
+
+#include "tlv.h"
+
+
+#ifndef TLV_LOG_BUFFER_SIZE
+#define TLV_LOG_BUFFER_SIZE 65536
+#endif
+
+#define TLV_LOG_TAG 0xFFF1
+#define TLV_LOG_CHECKSUM 1
+#define TLV_LOG_INDEX_ENTRY_SIZE 16
+#define TLV_LOG_NONE SIZE_MAX
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    typedef struct stTLVLogWriter tlv_log_writer_t;
+    typedef struct stTLVLogReader tlv_log_reader_t;
+
+    /**
+     * A record of a log
+     */
+    typedef struct {
+        const uint8_t *bytes;       /**< @brief The message, points into the mapping of the reader */
+        size_t size;                /**< @brief Size of the message */
+        tlv_tag_t tag;              /**< @brief Tag of the first object of the message */
+        uint64_t offset;            /**< @brief Offset of the record in the log file */
+    } tlv_log_record_t;
+
+
+    /**
+     * @brief Opens a log for appending, the files are created if they do not exist
+     * @param[in] path Path of the log file, the index is kept in "<path>.idx"
+     * @param[in] sync_every Number of records after which the log is synced to disk, 0 to sync only
+     * on tlv_log_sync and tlv_log_writer_close
+     * @return The writer or NULL
+     */
+    tlv_log_writer_t* tlv_log_writer_open(const char *path, const size_t sync_every);
+
+
+    /**
+     * @brief Appends an encoded message to the log
+     * The record is buffered, it is written when the buffer is full, on a sync or on close
+     * @param[in] writer The writer
+     * @param[in] barray The encoded message
+     * @param[in] size Size of the message, its header and value, fails if the header gives another size
+     * @return True if successful, false otherwise
+     */
+    bool tlv_log_append(tlv_log_writer_t *writer, const uint8_t *barray, const size_t size);
+
+
+    /**
+     * @brief Encodes a tree and appends it to the log
+     * @param[in] writer The writer
+     * @param[in] tlv The tree, a single top level object, fails if it has next objects
+     * @return True if successful, false otherwise
+     */
+    bool tlv_log_append_tlv(tlv_log_writer_t *writer, const tlv_t *tlv);
+
+
+    /**
+     * @brief Writes the buffered records and syncs the log and its index to disk
+     * @param[in] writer The writer
+     * @return True if successful, false otherwise
+     */
+    bool tlv_log_sync(tlv_log_writer_t *writer);
+
+
+    /**
+     * @brief Returns the number of records in the log, including the buffered ones
+     * @param[in] writer The writer
+     * @return Number of records
+     */
+    size_t tlv_log_writer_count(const tlv_log_writer_t *writer);
+
+
+    /**
+     * @brief Syncs and closes a log
+     * @param[in] writer The writer
+     * @return True if the last records were written and synced, false otherwise
+     */
+    bool tlv_log_writer_close(tlv_log_writer_t **writer);
+
+
+    /**
+     * @brief Opens a log for reading, records appended later are not seen
+     * @param[in] path Path of the log file
+     * @return The reader or NULL
+     */
+    tlv_log_reader_t* tlv_log_reader_open(const char *path);
+
+
+    /**
+     * @brief Returns the number of complete records of a log
+     * @param[in] reader The reader
+     * @return Number of records
+     */
+    size_t tlv_log_count(const tlv_log_reader_t *reader);
+
+
+    /**
+     * @brief Returns a record of a log
+     * @param[in] reader The reader
+     * @param[in] n Number of the record, starting at 0
+     * @param[out] record Return point of the record
+     * @return True if successful, false if there is no such record
+     */
+    bool tlv_log_get(const tlv_log_reader_t *reader, const size_t n, tlv_log_record_t *record);
+
+
+    /**
+     * @brief Returns the first record with a tag
+     * The records are grouped by their tags on the first call
+     * @param[in] reader The reader
+     * @param[in] tag Tag of the first object of the message
+     * @return Number of the record or TLV_LOG_NONE
+     */
+    size_t tlv_log_find_tag(tlv_log_reader_t *reader, const tlv_tag_t tag);
+
+
+    /**
+     * @brief Returns the next record with the tag of a record
+     * @param[in] reader The reader
+     * @param[in] n Number of a record returned by tlv_log_find_tag or tlv_log_next_tag
+     * @return Number of the record or TLV_LOG_NONE
+     */
+    size_t tlv_log_next_tag(tlv_log_reader_t *reader, const size_t n);
+
+
+    /**
+     * @brief Closes a log, the records are no longer valid
+     * @param[in] reader The reader
+     */
+    void tlv_log_reader_close(tlv_log_reader_t **reader);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TLV_LOG_H_2016 */
@@ -0,0 +1,194 @@
+/**
+ * File:   tlv_log_test.c
+ *
+ * @brief Tests of tlv_log.h
+ * Run "make test" to build and run the tests
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include "tlv_log.h"
+#include "tlv_test.h"
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define TEST_LOG_PATH "tlv_log_test.log"
+#define TEST_INDEX_PATH TEST_LOG_PATH ".idx"
+#define TEST_RECORDS 10
+#define TEST_MAX_VALUE 1024
+
+
+/********** PRIVATE DECLARATIONS **********************************************/
+/**
+ * @brief Writes the n'th test message, see tlv_test_message
+ * @param[out] bytes Return point of the message
+ * @param[in] n Number of the message
+ * @return Size of the message
+ */
+static size_t make_message(uint8_t *bytes, const size_t n);
+
+
+/**
+ * @brief Creates a log of the first count test messages
+ */
+static bool write_log(const size_t count);
+
+
+/**
+ * @brief Checks that a log holds the first count test messages
+ */
+static bool check_log(const size_t count);
+
+
+/**
+ * @brief Returns the size of a file or 0
+ */
+static off_t file_size(const char *path);
+
+
+/**
+ * A record torn by a crash is skipped by the reader and cut off by the writer, which appends after
+ * the complete records
+ */
+static bool test_torn_tail(void);
+
+
+/**
+ * Complete records the index missed are found again behind the last indexed one
+ */
+static bool test_short_index(void);
+
+
+/**
+ * A tree is appended as one record, a tree with next objects is refused like such bytes are
+ */
+static bool test_append_tlv(void);
+
+
+/********** PUBLIC DEFINITIONS ************************************************/
+int main(void) {
+    bool ok = true;
+
+    ok = test_torn_tail() && ok;
+    ok = test_short_index() && ok;
+    ok = test_append_tlv() && ok;
+    remove(TEST_LOG_PATH);
+    remove(TEST_INDEX_PATH);
+
+    return tlv_test_result("tlv_log_test", ok);
+}
+
+
+/********** PRIVATE DEFINITIONS ***********************************************/
+static size_t make_message(uint8_t *bytes, const size_t n) {
+    return tlv_test_message(bytes, (tlv_tag_t) n, (uint16_t) (n * 97 % TEST_MAX_VALUE));
+}
+
+
+static bool write_log(const size_t count) {
+    uint8_t message[TEST_MAX_VALUE + 8];
+    tlv_log_writer_t *writer;
+
+    remove(TEST_LOG_PATH);
+    remove(TEST_INDEX_PATH);
+    CHECK((writer = tlv_log_writer_open(TEST_LOG_PATH, 0)) != NULL);
+    for (size_t n = 0; n < count; n++) {
+        CHECK(tlv_log_append(writer, message, make_message(message, n)));
+    }
+    CHECK(tlv_log_writer_close(&writer));
+
+    return true;
+}
+
+
+static bool check_log(const size_t count) {
+    uint8_t message[TEST_MAX_VALUE + 8];
+    tlv_log_reader_t *reader;
+    tlv_log_record_t record;
+    bool ok = true;
+
+    CHECK((reader = tlv_log_reader_open(TEST_LOG_PATH)) != NULL);
+    ok = ok && tlv_log_count(reader) == count;
+    for (size_t n = 0; ok && n < count; n++) {
+        size_t size = make_message(message, n);
+
+        ok = tlv_log_get(reader, n, &record) && record.size == size && memcmp(record.bytes, message, size) == 0;
+    }
+    ok = ok && !tlv_log_get(reader, count, &record);
+    tlv_log_reader_close(&reader);
+    CHECK(ok);
+
+    return true;
+}
+
+
+static off_t file_size(const char *path) {
+    struct stat st;
+
+    return stat(path, &st) == 0 ? st.st_size : 0;
+}
+
+
+static bool test_torn_tail(void) {
+    uint8_t message[TEST_MAX_VALUE + 8];
+    tlv_log_writer_t *writer;
+    off_t torn;
+
+    CHECK(write_log(TEST_RECORDS));
+    torn = file_size(TEST_LOG_PATH) - 3;
+    CHECK(truncate(TEST_LOG_PATH, torn) == 0);
+
+    // The reader sees the complete records and leaves the files as they are
+    CHECK(check_log(TEST_RECORDS - 1));
+    CHECK(file_size(TEST_LOG_PATH) == torn);
+
+    // The writer appends the last message again in place of the torn one
+    CHECK((writer = tlv_log_writer_open(TEST_LOG_PATH, 0)) != NULL);
+    CHECK(tlv_log_writer_count(writer) == TEST_RECORDS - 1);
+    CHECK(tlv_log_append(writer, message, make_message(message, TEST_RECORDS - 1)));
+    CHECK(tlv_log_writer_close(&writer));
+    CHECK(check_log(TEST_RECORDS));
+
+    return true;
+}
+
+
+static bool test_short_index(void) {
+    tlv_log_writer_t *writer;
+
+    // Five entries and a part of the sixth are left
+    CHECK(write_log(TEST_RECORDS));
+    CHECK(truncate(TEST_INDEX_PATH, 5 * TLV_LOG_INDEX_ENTRY_SIZE + 7) == 0);
+    CHECK(check_log(TEST_RECORDS));
+    CHECK((writer = tlv_log_writer_open(TEST_LOG_PATH, 0)) != NULL);
+    CHECK(tlv_log_writer_count(writer) == TEST_RECORDS);
+    CHECK(tlv_log_writer_close(&writer));
+    CHECK(file_size(TEST_INDEX_PATH) == TEST_RECORDS * TLV_LOG_INDEX_ENTRY_SIZE);
+    CHECK(check_log(TEST_RECORDS));
+
+    return true;
+}
+
+
+static bool test_append_tlv(void) {
+    uint8_t message[TEST_MAX_VALUE + 8];
+    tlv_log_writer_t *writer;
+    uint8_t *barray = NULL;
+    size_t size = 0;
+    tlv_t *tlv;
+    bool ok;
+
+    CHECK(write_log(1));
+    CHECK((writer = tlv_log_writer_open(TEST_LOG_PATH, 0)) != NULL);
+    CHECK((tlv = tlv_from_byte_array(message, make_message(message, 1))) != NULL);
+    ok = tlv_log_append_tlv(writer, tlv);
+    ok = ok && tlv_append_next(tlv, tlv_from_byte_array(message, make_message(message, 2))) != NULL;
+    ok = ok && tlv_to_byte_array(tlv, &barray, &size);
+    ok = ok && !tlv_log_append_tlv(writer, tlv) && !tlv_log_append(writer, barray, size);
+    free(barray);
+    tlv_delete_all(&tlv);
+    CHECK(tlv_log_writer_close(&writer));
+    CHECK(ok);
+    CHECK(check_log(2));
+
+    return true;
+}
@@ -0,0 +1,113 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "tlv_metrics.h"
+#include "tlv_private.h"
+#include <string.h>
+#include <time.h>
+
+
+/********** PRIVATE DECLARATIONS **********************************************/
+static const char *api_names[TLV_API_COUNT] = {
+    "decode", "validate", "encode", "encode_buffer", "encode_iovec", "patch", "find", "to_string", "delete", "diff", "apply_delta"
+};
+
+static const char *failure_names[TLV_FAILURE_COUNT] = {
+    "argument", "malformed", "depth", "size", "memory", "io"
+};
+
+#ifdef TLV_METRICS
+__thread tlv_metrics_t tlv_metrics_local;
+
+static bool latency = false;
+static tlv_trace_begin_t trace_begin = NULL;
+static tlv_trace_end_t trace_end = NULL;
+static void *trace_context = NULL;
+
+/**
+ * @brief Returns the monotonic time in ns
+ */
+static uint64_t now_ns(void);
+#else
+static const tlv_metrics_t tlv_metrics_local;
+#endif
+
+
+/********** PUBLIC DEFINITIONS ************************************************/
+const tlv_metrics_t* tlv_metrics_get(void) {
+    return &tlv_metrics_local;
+}
+
+
+void tlv_metrics_reset(void) {
+#ifdef TLV_METRICS
+    memset(&tlv_metrics_local, 0, sizeof (tlv_metrics_local));
+#endif
+}
+
+
+void tlv_metrics_set_latency(bool enabled) {
+#ifdef TLV_METRICS
+    latency = enabled;
+#else
+    (void) enabled;
+#endif
+}
+
+
+void tlv_metrics_set_trace(tlv_trace_begin_t begin, tlv_trace_end_t end, void *context) {
+#ifdef TLV_METRICS
+    trace_begin = begin;
+    trace_end = end;
+    trace_context = context;
+#else
+    (void) begin;
+    (void) end;
+    (void) context;
+#endif
+}
+
+
+const char* tlv_api_name(tlv_api_t api) {
+    return (unsigned) api < TLV_API_COUNT ? api_names[api] : "unknown";
+}
+
+
+const char* tlv_failure_name(tlv_failure_t failure) {
+    return (unsigned) failure < TLV_FAILURE_COUNT ? failure_names[failure] : "unknown";
+}
+
+
+#ifdef TLV_METRICS
+uint64_t tlv_trace_begin(const tlv_api_t api) {
+    if (trace_begin != NULL) {
+        trace_begin(api, trace_context);
+    }
+
+    return latency ? now_ns() : 0;
+}
+
+
+void tlv_trace_end(const tlv_api_t api, const uint64_t start, const bool ok) {
+    if (start != 0) {
+        tlv_histogram_t *histogram = &tlv_metrics_local.latency[api];
+        uint64_t ns = now_ns() - start;
+        unsigned bucket = ns < 2 ? 0 : 63 - (unsigned) __builtin_clzll(ns);
+
+        histogram->calls++;
+        histogram->total_ns += ns;
+        histogram->buckets[bucket < TLV_HISTOGRAM_BUCKETS ? bucket : TLV_HISTOGRAM_BUCKETS - 1]++;
+    }
+    if (trace_end != NULL) {
+        trace_end(api, ok, trace_context);
+    }
+}
+
+
+/********** PRIVATE DEFINITIONS ***********************************************/
+static uint64_t now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+#endif
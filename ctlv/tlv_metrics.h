@@ -0,0 +1,149 @@
+#ifndef TLV_METRICS_H_2016
+#define TLV_METRICS_H_2016
+
+/**
+ * File:   tlv_metrics.h
+ *
+ * @brief Counters, latency histograms and trace hooks of the ctlv library
+ * The instrumentation is compiled in only if the library is built with TLV_METRICS defined
+ * ("make TLV_FLAGS=-DTLV_METRICS"), otherwise the hooks compile to nothing, the functions of this
+ * header do nothing and the counters stay zero.
+ *
+ * The counters are kept per thread without locking, a thread reads and resets its own counters.
+ * tlv_from_byte_array_parallel counts the document and its objects on the calling thread, only failures
+ * on the workers of its pool are counted on those threads.
+ * Latency histograms cost two clock reads per call and are off until enabled. The trace hooks and
+ * the latency switch are global, set them before the library is used from several threads.
+ *
+ * Failures are counted once by their cause, errors which only pass on a failure of a called function
+ * are not counted again. The text of the failures goes to the debug sink, see tlv_set_debug_sink.
+ */
+
+#include "tlv.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TLV_HISTOGRAM_BUCKETS 32
+
+    /**
+     * Instrumented functions of the library
+     */
+    typedef enum {
+        TLV_API_DECODE,             /**< @brief tlv_from_byte_array_ex and the functions built on it */
+        TLV_API_VALIDATE,           /**< @brief tlv_validate */
+        TLV_API_ENCODE,             /**< @brief tlv_to_byte_array */
+        TLV_API_ENCODE_BUFFER,      /**< @brief tlv_to_buffer */
+        TLV_API_ENCODE_IOVEC,       /**< @brief tlv_to_iovec */
+        TLV_API_PATCH,              /**< @brief tlv_patch_byte_array */
+        TLV_API_FIND,               /**< @brief tlv_find_by_tag */
+        TLV_API_TO_STRING,          /**< @brief tlv_to_string */
+        TLV_API_DELETE,             /**< @brief tlv_delete_all */
+        TLV_API_DIFF,               /**< @brief tlv_diff */
+        TLV_API_APPLY_DELTA,        /**< @brief tlv_apply_delta */
+        TLV_API_COUNT
+    } tlv_api_t;
+
+    /**
+     * Causes of failures
+     */
+    typedef enum {
+        TLV_FAILURE_ARGUMENT,       /**< @brief Null or wrong argument */
+        TLV_FAILURE_MALFORMED,      /**< @brief Malformed byte array */
+        TLV_FAILURE_DEPTH,          /**< @brief Deeper than TLV_MAX_DEPTH levels */
+        TLV_FAILURE_SIZE,           /**< @brief Length limit exceeded or not enough room */
+        TLV_FAILURE_MEMORY,         /**< @brief Out of memory */
+        TLV_FAILURE_IO,             /**< @brief Failed file operation */
+        TLV_FAILURE_COUNT
+    } tlv_failure_t;
+
+    /**
+     * Latency histogram of a function, bucket i counts the calls taking from 2^i up to 2^(i+1) ns,
+     * the first bucket also counts faster calls and the last one also slower calls
+     */
+    typedef struct {
+        uint64_t calls;                             /**< @brief Number of measured calls */
+        uint64_t total_ns;                          /**< @brief Sum of the latencies */
+        uint64_t buckets[TLV_HISTOGRAM_BUCKETS];    /**< @brief Number of calls per latency range */
+    } tlv_histogram_t;
+
+    /**
+     * Counters of a thread
+     */
+    typedef struct {
+        uint64_t decoded_messages;                  /**< @brief Byte arrays decoded to trees */
+        uint64_t decoded_bytes;                     /**< @brief Size of the decoded byte arrays */
+        uint64_t encoded_messages;                  /**< @brief Trees encoded to byte arrays */
+        uint64_t encoded_bytes;                     /**< @brief Size of the encoded byte arrays */
+        uint64_t nodes_allocated;                   /**< @brief TLV objects created, also in arenas and blocks */
+        uint64_t failures[TLV_FAILURE_COUNT];       /**< @brief Failures by cause */
+        tlv_histogram_t latency[TLV_API_COUNT];     /**< @brief Latencies by function, if enabled */
+    } tlv_metrics_t;
+
+    /**
+     * @brief Called when an instrumented function is entered
+     * @param[in] api The function
+     * @param[in] context Context given to tlv_metrics_set_trace
+     */
+    typedef void (*tlv_trace_begin_t)(tlv_api_t api, void *context);
+
+    /**
+     * @brief Called when an instrumented function returns
+     * @param[in] api The function
+     * @param[in] ok True if the function succeeded
+     * @param[in] context Context given to tlv_metrics_set_trace
+     */
+    typedef void (*tlv_trace_end_t)(tlv_api_t api, bool ok, void *context);
+
+
+    /**
+     * @brief Returns the counters of the calling thread
+     * @return The counters, valid until the thread exits
+     */
+    const tlv_metrics_t* tlv_metrics_get(void);
+
+
+    /**
+     * @brief Sets the counters of the calling thread to zero
+     */
+    void tlv_metrics_reset(void);
+
+
+    /**
+     * @brief Enables or disables the latency histograms of all threads
+     * @param[in] enabled True to measure the latency of the instrumented functions
+     */
+    void tlv_metrics_set_latency(bool enabled);
+
+
+    /**
+     * @brief Installs trace hooks called around the instrumented functions
+     * @param[in] begin Called on entry or NULL
+     * @param[in] end Called on return or NULL
+     * @param[in] context Passed to the hooks
+     */
+    void tlv_metrics_set_trace(tlv_trace_begin_t begin, tlv_trace_end_t end, void *context);
+
+
+    /**
+     * @brief Returns the name of an instrumented function
+     * @param[in] api The function
+     * @return Name of the function or "unknown"
+     */
+    const char* tlv_api_name(tlv_api_t api);
+
+
+    /**
+     * @brief Returns the name of a cause of failures
+     * @param[in] failure The cause
+     * @return Name of the cause or "unknown"
+     */
+    const char* tlv_failure_name(tlv_failure_t failure);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TLV_METRICS_H_2016 */
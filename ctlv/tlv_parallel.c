@@ -0,0 +1,327 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "tlv_parallel.h"
+#include "tlv_private.h"
+#include <pthread.h>
+#include <unistd.h>
+
+
+/**
+ * A range of children of the root decoded by one thread
+ */
+typedef struct {
+    const uint8_t *bytes;           /**< @brief First byte of the range */
+    size_t size;                    /**< @brief Size of the range */
+    uint32_t flags;                 /**< @brief Decode options */
+    tlv_t *parent;                  /**< @brief Root to link the decoded objects under */
+    tlv_t *first;                   /**< @brief First decoded child or NULL on failure */
+    tlv_t *last;                    /**< @brief Last decoded child */
+    size_t objects;                 /**< @brief Number of decoded objects */
+    bool by_worker;                 /**< @brief True if the range was decoded by a worker of the pool */
+} parallel_range_t;
+
+/**
+ * Workers waiting for the ranges of one decode at a time
+ */
+struct stTLVParallelPool {
+    pthread_mutex_t call;           /**< @brief Held by the running decode */
+    pthread_mutex_t lock;           /**< @brief Guards the members below */
+    pthread_cond_t work;            /**< @brief Signals new ranges or the stop to the workers */
+    pthread_cond_t done;            /**< @brief Signals the last finished range to the caller */
+    parallel_range_t *ranges;       /**< @brief Ranges of the running decode or NULL */
+    size_t count;                   /**< @brief Number of ranges */
+    size_t next;                    /**< @brief Next range to take */
+    size_t pending;                 /**< @brief Number of ranges not finished yet */
+    bool stop;                      /**< @brief True if the workers shall exit */
+    size_t workers;                 /**< @brief Number of started workers */
+    pthread_t threads[];            /**< @brief The workers */
+};
+
+
+/********** PRIVATE DECLARATIONS **********************************************/
+/**
+ * @brief Decodes the ranges of the pool until it is stopped
+ * @param[in] arg The pool
+ * @return Always NULL
+ */
+static void* worker(void *arg);
+
+
+/**
+ * @brief Takes the next range of the running decode
+ * @param[in] pool The pool, its lock is held
+ * @return The range or NULL if all are taken
+ */
+static parallel_range_t* take_range(tlv_parallel_pool_t *pool);
+
+
+/**
+ * @brief Decodes the children of one root CDO on the pool, see tlv_from_byte_array_parallel
+ */
+static tlv_t* decode_parallel(tlv_parallel_pool_t *pool, const uint8_t *barray, const tlv_header_t *header, const size_t count, const uint32_t flags);
+
+
+/**
+ * @brief Decodes a range of children and links them under the root
+ * @param[in,out] range The range to decode
+ */
+static void decode_range(parallel_range_t *range);
+
+
+/**
+ * @brief Splits the children of the root into ranges of about the same size
+ * Only the headers of the children are read, their contents are skipped
+ * @param[in] barray Byte array holding the root
+ * @param[in] header Header of the root
+ * @param[out] ranges Ranges to fill
+ * @param[in] count Maximum number of ranges
+ * @return Number of ranges or 0 if a child is malformed
+ */
+static size_t split_children(const uint8_t *barray, const tlv_header_t *header, parallel_range_t *ranges, const size_t count);
+
+
+/********** PUBLIC DEFINITIONS ************************************************/
+tlv_parallel_pool_t* tlv_parallel_pool_new(const size_t threads) {
+    size_t count = threads;
+    tlv_parallel_pool_t *pool;
+
+    if (count == 0) {
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        count = cores > 0 ? (size_t) cores : 1;
+    }
+    // The calling thread decodes as well, it is not a worker
+    if ((pool = calloc(1, sizeof (*pool) + (count - 1) * sizeof (pool->threads[0]))) == NULL) {
+        TLV_FAIL(TLV_FAILURE_MEMORY, "Fatal - Out of memory when creating thread pool");
+        return NULL;
+    }
+    pthread_mutex_init(&pool->call, NULL);
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work, NULL);
+    pthread_cond_init(&pool->done, NULL);
+    for (; pool->workers < count - 1; pool->workers++) {
+        if (pthread_create(&pool->threads[pool->workers], NULL, worker, pool) != 0) {
+            TLV_FAIL(TLV_FAILURE_MEMORY, "Fatal - Failed to start thread %zu of the pool", pool->workers);
+            tlv_parallel_pool_delete(&pool);
+            return NULL;
+        }
+    }
+
+    return pool;
+}
+
+
+void tlv_parallel_pool_delete(tlv_parallel_pool_t **pool) {
+    if (pool != NULL && *pool != NULL) {
+        tlv_parallel_pool_t *p = *pool;
+
+        pthread_mutex_lock(&p->lock);
+        p->stop = true;
+        pthread_cond_broadcast(&p->work);
+        pthread_mutex_unlock(&p->lock);
+        for (size_t i = 0; i < p->workers; i++) {
+            pthread_join(p->threads[i], NULL);
+        }
+        pthread_cond_destroy(&p->done);
+        pthread_cond_destroy(&p->work);
+        pthread_mutex_destroy(&p->lock);
+        pthread_mutex_destroy(&p->call);
+        free(p);
+        *pool = NULL;
+    }
+}
+
+
+tlv_t* tlv_from_byte_array_parallel(tlv_parallel_pool_t *pool, const uint8_t *barray, const size_t size, const uint32_t flags) {
+    tlv_header_t header;
+    size_t count;
+
+    if (barray == NULL || size < BER_HEADER_BYTE_LENGTH) {
+        TLV_FAIL(TLV_FAILURE_MALFORMED, "Error - Wrong byte array when converting in parallel");
+        return NULL;
+    }
+    count = pool != NULL ? pool->workers + 1 : 1;
+    if (count > size / TLV_PARALLEL_MIN_CHUNK) {
+        count = size / TLV_PARALLEL_MIN_CHUNK;
+    }
+    // Anything else than one root CDO with children is left to the sequential decoder, a lazy decode
+    // only reads the top level and gains nothing from threads
+    if (count < 2 || (flags & TLV_DECODE_LAZY) || !tlv_header_read(barray, size, &header) || header.type != TLV_CDO
+            || header.length == 0 || header.size + (size_t) header.length != size) {
+        return tlv_from_byte_array_ex(barray, size, NULL, flags);
+    }
+
+    TLV_TRACE_BEGIN(TLV_API_DECODE);
+    tlv_t *tlv = decode_parallel(pool, barray, &header, count, flags);
+
+    // The ranges are decoded without counting, the document is one message
+    if (tlv != NULL) {
+        TLV_COUNT(decoded_messages, 1);
+        TLV_COUNT(decoded_bytes, size);
+    }
+    TLV_TRACE_END(TLV_API_DECODE, tlv != NULL);
+
+    return tlv;
+}
+
+
+/********** PRIVATE DEFINITIONS ***********************************************/
+static void* worker(void *arg) {
+    tlv_parallel_pool_t *pool = arg;
+
+    pthread_mutex_lock(&pool->lock);
+    while (true) {
+        parallel_range_t *range = NULL;
+
+        while (!pool->stop && (range = take_range(pool)) == NULL) {
+            pthread_cond_wait(&pool->work, &pool->lock);
+        }
+        if (pool->stop) {
+            break;
+        }
+        pthread_mutex_unlock(&pool->lock);
+        range->by_worker = true;
+        decode_range(range);
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->pending == 0) {
+            pthread_cond_signal(&pool->done);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    return NULL;
+}
+
+
+static parallel_range_t* take_range(tlv_parallel_pool_t *pool) {
+    if (pool->ranges == NULL || pool->next == pool->count) {
+        return NULL;
+    }
+
+    return &pool->ranges[pool->next++];
+}
+
+
+static tlv_t* decode_parallel(tlv_parallel_pool_t *pool, const uint8_t *barray, const tlv_header_t *header, const size_t count, const uint32_t flags) {
+    parallel_range_t *ranges;
+    parallel_range_t *range;
+    size_t used;
+    tlv_t *root;
+    bool ok = true;
+
+    if ((ranges = calloc(count, sizeof (*ranges))) == NULL) {
+        TLV_FAIL(TLV_FAILURE_MEMORY, "Fatal - Out of memory when converting in parallel");
+        return NULL;
+    }
+    if ((used = split_children(barray, header, ranges, count)) == 0 || (root = tlv_new_cdo(header->tag)) == NULL) {
+        free(ranges);
+        return NULL;
+    }
+    root->length = header->length;
+    if (header->size == BER_HEADER_BYTE_LENGTH) {
+        root->flags |= TLV_FLAG_SIZED;
+    }
+    for (size_t i = 0; i < used; i++) {
+        ranges[i].flags = flags & ~(uint32_t) TLV_DECODE_PREALLOC;
+        ranges[i].parent = root;
+    }
+
+    // The calling thread takes ranges like the workers and waits for the ones still decoded by them
+    pthread_mutex_lock(&pool->call);
+    pthread_mutex_lock(&pool->lock);
+    pool->ranges = ranges;
+    pool->count = used;
+    pool->next = 0;
+    pool->pending = used;
+    pthread_cond_broadcast(&pool->work);
+    while ((range = take_range(pool)) != NULL) {
+        pthread_mutex_unlock(&pool->lock);
+        decode_range(range);
+        pthread_mutex_lock(&pool->lock);
+        pool->pending--;
+    }
+    while (pool->pending > 0) {
+        pthread_cond_wait(&pool->done, &pool->lock);
+    }
+    pool->ranges = NULL;
+    pthread_mutex_unlock(&pool->lock);
+    pthread_mutex_unlock(&pool->call);
+
+    for (size_t i = 0; i < used; i++) {
+        ok = ok && ranges[i].first != NULL;
+        // Objects allocated on a worker are counted there, the calling thread keeps the counters
+        if (ranges[i].by_worker) {
+            TLV_COUNT(nodes_allocated, ranges[i].objects);
+        }
+    }
+    if (!ok) {
+        for (size_t i = 0; i < used; i++) {
+            tlv_delete_all(&ranges[i].first);
+        }
+        tlv_delete(&root);
+        tlv_debug_cb("ERROR - Converting to tlv in parallel failed");
+    } else {
+        root->child = ranges[0].first;
+        for (size_t i = 1; i < used; i++) {
+            ranges[i - 1].last->next = ranges[i].first;
+        }
+    }
+    free(ranges);
+
+    return root;
+}
+
+
+static void decode_range(parallel_range_t *range) {
+    tlv_t *tlv;
+
+    if ((range->first = tlv_decode_array(range->bytes, range->size, NULL, range->flags)) == NULL) {
+        return;
+    }
+    for (tlv = range->first; tlv != NULL; tlv = tlv->next) {
+        tlv->parent = range->parent;
+        range->last = tlv;
+    }
+
+    // The range was decoded as top level objects, every object moves one level down under the root
+    tlv = range->first;
+    while (tlv != NULL) {
+        tlv->level++;
+        range->objects++;
+        if (tlv->child != NULL) {
+            tlv = tlv->child;
+            continue;
+        }
+        while (tlv != range->parent && tlv->next == NULL) {
+            tlv = tlv->parent;
+        }
+        tlv = tlv != range->parent ? tlv->next : NULL;
+    }
+}
+
+
+static size_t split_children(const uint8_t *barray, const tlv_header_t *header, parallel_range_t *ranges, const size_t count) {
+    size_t chunk = header->length / count;
+    size_t end = header->size + (size_t) header->length;
+    size_t start = header->size;
+    size_t index = start;
+    size_t used = 0;
+
+    while (index < end) {
+        tlv_header_t child;
+
+        if (!tlv_header_read(&barray[index], end - index, &child) || child.length > end - index - child.size) {
+            TLV_FAIL(TLV_FAILURE_MALFORMED, "ERROR - Failed to deserialize, wrong child of the root at %u", (unsigned) index);
+            return 0;
+        }
+        index += child.size + (size_t) child.length;
+        if (index - start >= chunk && used < count - 1 && index < end) {
+            ranges[used].bytes = &barray[start];
+            ranges[used++].size = index - start;
+            start = index;
+        }
+    }
+    ranges[used].bytes = &barray[start];
+    ranges[used++].size = end - start;
+
+    return used;
+}
@@ -0,0 +1,70 @@
+#ifndef TLV_PARALLEL_H_2016
+#define TLV_PARALLEL_H_2016
+
+/**
+ * File:   tlv_parallel.h
+ *
+ * @brief Parallel decoding of large TLV documents
+ * The header of every CDO holds the length of its children, so the children of the root are located
+ * by skipping from header to header without reading their contents. The children are split into
+ * ranges of about the same size, decoded by the workers of a pool together with the calling thread
+ * and linked under the root. The result is the same tree as tlv_from_byte_array produces.
+ *
+ * The workers of a pool are started once and wait for ranges between the calls, so a decode costs
+ * no thread creation. Documents smaller than TLV_PARALLEL_MIN_CHUNK bytes per thread use fewer
+ * threads, small documents are decoded in the calling thread.
+ */
+
+#include "tlv.h"
+
+//
+// Minimum number of bytes decoded by one thread.
+// Define TLV_PARALLEL_MIN_CHUNK when building the library to change the limit.
+//
+#ifndef TLV_PARALLEL_MIN_CHUNK
+#define TLV_PARALLEL_MIN_CHUNK 65536
+#endif
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    typedef struct stTLVParallelPool tlv_parallel_pool_t;
+
+
+    /**
+     * @brief Creates a pool of decoding threads
+     * @param[in] threads Number of threads inclusive the calling one, 0 for the number of online cores
+     * @return The pool or NULL, a pool of one thread has no workers and decodes in the calling thread
+     */
+    tlv_parallel_pool_t* tlv_parallel_pool_new(const size_t threads);
+
+
+    /**
+     * @brief Stops the workers of a pool and deletes it, no decode may be running on it
+     * @param[in] pool Pool to delete
+     */
+    void tlv_parallel_pool_delete(tlv_parallel_pool_t **pool);
+
+
+    /**
+     * @brief Converts a byte array to a TLV object using the threads of a pool
+     * The objects are allocated with malloc and the tree is deleted with tlv_delete_all as usual.
+     * TLV_DECODE_BORROW is supported, TLV_DECODE_PREALLOC is ignored since every thread allocates its own objects.
+     * An array which does not hold exactly one root CDO is decoded in the calling thread, and so is every
+     * array with TLV_DECODE_LAZY, which returns the same lazy root as tlv_from_byte_array_ex.
+     * Calls sharing a pool from several threads run one after the other.
+     * @param[in] pool Pool of the threads, NULL to decode in the calling thread
+     * @param[in] barray Byte array to convert
+     * @param[in] size The size of the byte array
+     * @param[in] flags Decode options, see tlv_decode_flags_t
+     * @return TLV object converted from the byte array or NULL if conversion failed
+     */
+    tlv_t* tlv_from_byte_array_parallel(tlv_parallel_pool_t *pool, const uint8_t *barray, const size_t size, const uint32_t flags);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TLV_PARALLEL_H_2016 */
@@ -0,0 +1,198 @@
+#include "tlv_parser.h"
+#include "tlv_private.h"
+#include <string.h>
+
+
+/********** PRIVATE DECLARATIONS **********************************************/
+/**
+ * @brief Handles a completely received header
+ * @param[in] parser Parser holding the header
+ * @return True if successful, false otherwise
+ */
+static bool parse_header(tlv_parser_t *parser);
+
+
+/**
+ * @brief Closes the CDO's ending at the current position and reports a complete message
+ * @param[in] parser Parser which completed an object
+ * @return True if successful, false otherwise
+ */
+static bool complete_object(tlv_parser_t *parser);
+
+
+/**
+ * @brief Puts the parser into error state
+ * @param[in] parser Parser to stop
+ * @return Always false
+ */
+static bool parser_fail(tlv_parser_t *parser);
+
+
+/**
+ * @brief Returns the number of header bytes the parser needs
+ * @param[in] parser Parser reading a header
+ * @return Size of the header, BER_HEADER_BYTE_LENGTH until the type byte is known
+ */
+static size_t header_needed(const tlv_parser_t *parser);
+
+
+/********** PUBLIC DEFINITIONS ************************************************/
+void tlv_parser_init(tlv_parser_t *parser, const tlv_parser_callbacks_t *callbacks, void *arg) {
+    if (parser != NULL) {
+        memset(parser, 0, sizeof (*parser));
+        if (callbacks != NULL) {
+            parser->callbacks = *callbacks;
+        }
+        parser->arg = arg;
+        tlv_parser_reset(parser);
+    }
+}
+
+
+void tlv_parser_reset(tlv_parser_t *parser) {
+    if (parser != NULL) {
+        parser->state = TLV_PARSER_HEADER;
+        parser->header_length = 0;
+        parser->position = 0;
+        parser->depth = 0;
+    }
+}
+
+
+bool tlv_parser_feed(tlv_parser_t *parser, const uint8_t *bytes, const size_t size) {
+    size_t index = 0;
+
+    if (parser == NULL || (bytes == NULL && size > 0)) {
+        return false;
+    }
+
+    while (index < size) {
+        if (parser->state == TLV_PARSER_ERROR) {
+            return false;
+        }
+
+        if (parser->state == TLV_PARSER_HEADER) {
+            // The size of the header is known from its first byte, a wide header is longer than the others
+            size_t taken = header_needed(parser) - parser->header_length;
+            if (taken > size - index) {
+                taken = size - index;
+            }
+            memcpy(&parser->header[parser->header_length], &bytes[index], taken);
+            parser->header_length += (uint8_t) taken;
+            parser->position += taken;
+            index += taken;
+
+            if (parser->header_length == header_needed(parser) && !parse_header(parser)) {
+                return false;
+            }
+        } else {
+            size_t taken = parser->length - parser->offset;
+            if (taken > size - index) {
+                taken = size - index;
+            }
+            if (parser->callbacks.pdo != NULL
+                    && !parser->callbacks.pdo(parser->arg, parser->tag, parser->length, parser->offset, &bytes[index], taken)) {
+                return parser_fail(parser);
+            }
+            parser->offset += taken;
+            parser->position += taken;
+            index += taken;
+
+            if (parser->offset == parser->length) {
+                parser->state = TLV_PARSER_HEADER;
+                if (!complete_object(parser)) {
+                    return false;
+                }
+            }
+        }
+    }
+
+    return parser->state != TLV_PARSER_ERROR;
+}
+
+
+bool tlv_parser_is_idle(const tlv_parser_t *parser) {
+    return parser != NULL && parser->state == TLV_PARSER_HEADER && parser->position == 0;
+}
+
+
+/********** PRIVATE DEFINITIONS ***********************************************/
+static bool parse_header(tlv_parser_t *parser) {
+    tlv_header_t header;
+
+    if (!tlv_header_read(parser->header, parser->header_length, &header)) {
+        TLV_FAIL(TLV_FAILURE_MALFORMED, "Error - Parser got unknown type: 0x%02X", parser->header[0]);
+        return parser_fail(parser);
+    }
+    parser->header_length = 0;
+    if (parser->depth > 0 && parser->position + header.length > parser->stack[parser->depth - 1].end) {
+        TLV_FAIL(TLV_FAILURE_MALFORMED, "Error - Parser got object(%u) exceeding its CDO", header.tag);
+        return parser_fail(parser);
+    }
+
+    if (header.type == TLV_PDO) {
+        parser->tag = header.tag;
+        parser->length = header.length;
+        parser->offset = 0;
+        if (header.length > 0) {
+            parser->state = TLV_PARSER_VALUE;
+            return true;
+        }
+        if (parser->callbacks.pdo != NULL && !parser->callbacks.pdo(parser->arg, header.tag, 0, 0, NULL, 0)) {
+            return parser_fail(parser);
+        }
+        return complete_object(parser);
+    }
+
+    // Only a CDO with children needs a stack entry, the consumer sees no enter_cdo that is not left
+    if (header.length > 0 && parser->depth == TLV_MAX_DEPTH) {
+        TLV_FAIL(TLV_FAILURE_DEPTH, "Error - Parser got message deeper than %u levels", TLV_MAX_DEPTH);
+        return parser_fail(parser);
+    }
+    if (parser->callbacks.enter_cdo != NULL && !parser->callbacks.enter_cdo(parser->arg, header.tag, header.length)) {
+        return parser_fail(parser);
+    }
+    if (header.length == 0) {
+        if (parser->callbacks.leave_cdo != NULL && !parser->callbacks.leave_cdo(parser->arg, header.tag)) {
+            return parser_fail(parser);
+        }
+        return complete_object(parser);
+    }
+    parser->stack[parser->depth].tag = header.tag;
+    parser->stack[parser->depth++].end = parser->position + header.length;
+
+    return complete_object(parser);
+}
+
+
+static bool complete_object(tlv_parser_t *parser) {
+    while (parser->depth > 0 && parser->position == parser->stack[parser->depth - 1].end) {
+        parser->depth--;
+        if (parser->callbacks.leave_cdo != NULL && !parser->callbacks.leave_cdo(parser->arg, parser->stack[parser->depth].tag)) {
+            return parser_fail(parser);
+        }
+    }
+
+    if (parser->depth == 0) {
+        parser->position = 0;
+        if (parser->callbacks.message != NULL && !parser->callbacks.message(parser->arg)) {
+            return parser_fail(parser);
+        }
+    }
+
+    return true;
+}
+
+
+static bool parser_fail(tlv_parser_t *parser) {
+    parser->state = TLV_PARSER_ERROR;
+    return false;
+}
+
+
+static size_t header_needed(const tlv_parser_t *parser) {
+    size_t size = parser->header_length > 0 ? tlv_header_size(parser->header[0]) : 0;
+
+    // Unknown types are reported by parse_header
+    return size > 0 ? size : BER_HEADER_BYTE_LENGTH;
+}
@@ -0,0 +1,137 @@
+#ifndef TLV_PARSER_H_2016
+#define TLV_PARSER_H_2016
+
+/**
+ * File:   tlv_parser.h
+ *
+ * @brief Incremental push parser of TLV messages
+ * The parser is fed with chunks of bytes as they arrive, for example from a socket, and reports
+ * the objects through callbacks without building a tree. The state has a fixed size and the
+ * parser never allocates memory, it can be embedded in other structures or live on the stack.
+ *
+ * Values of PDO's are reported in spans pointing into the fed chunks, a value split over several
+ * chunks is reported in several spans. The spans are only valid during the callback.
+ * A stream may hold several messages after each other, every complete top level object is
+ * reported through the message callback.
+ */
+
+#include "tlv.h"
+
+/**
+ * Size of the header buffer of the parser, BER_WIDE_HEADER_BYTE_LENGTH is not a constant expression in C
+ */
+#define TLV_PARSER_HEADER_SIZE 7
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    typedef struct stTLVParser tlv_parser_t;
+
+    /**
+     * Callbacks of the parser, all of them are optional
+     * A callback returning false stops the parser, the following tlv_parser_feed calls fail
+     */
+    typedef struct {
+        /**
+         * @brief Called when the header of a CDO was parsed
+         * @param[in] arg User argument of the parser
+         * @param[in] tag Tag of the CDO
+         * @param[in] length Length of the children of the CDO
+         */
+        bool (*enter_cdo)(void *arg, const tlv_tag_t tag, const tlv_length_t length);
+
+        /**
+         * @brief Called with the value of a PDO, once per span of the value
+         * An empty PDO is reported once with a NULL span. The value is complete when offset + span_length == length.
+         * @param[in] arg User argument of the parser
+         * @param[in] tag Tag of the PDO
+         * @param[in] length Total length of the value
+         * @param[in] offset Offset of the span in the value
+         * @param[in] span Part of the value
+         * @param[in] span_length Length of the span
+         */
+        bool (*pdo)(void *arg, const tlv_tag_t tag, const tlv_length_t length, const size_t offset, const uint8_t *span, const size_t span_length);
+
+        /**
+         * @brief Called when all children of a CDO were parsed
+         * @param[in] arg User argument of the parser
+         * @param[in] tag Tag of the CDO
+         */
+        bool (*leave_cdo)(void *arg, const tlv_tag_t tag);
+
+        /**
+         * @brief Called when a top level object was parsed completely
+         * @param[in] arg User argument of the parser
+         */
+        bool (*message)(void *arg);
+    } tlv_parser_callbacks_t;
+
+    /**
+     * Represents the states of the parser
+     */
+    typedef enum {
+        TLV_PARSER_HEADER = 0,  /**< @brief Waiting for (the rest of) a header */
+        TLV_PARSER_VALUE,       /**< @brief Waiting for (the rest of) a PDO value */
+        TLV_PARSER_ERROR        /**< @brief Stopped by a malformed message or a callback */
+    } tlv_parser_state_t;
+
+    /**
+     * Struct representing a parser, the members are private
+     */
+    struct stTLVParser {
+        tlv_parser_callbacks_t callbacks;           /**< @brief Callbacks to report the objects through */
+        void *arg;                                  /**< @brief User argument of the callbacks */
+        tlv_parser_state_t state;                   /**< @brief State of the parser */
+        uint8_t header[TLV_PARSER_HEADER_SIZE];     /**< @brief Bytes of the header being parsed */
+        uint8_t header_length;                      /**< @brief Number of bytes in header */
+        tlv_tag_t tag;                              /**< @brief Tag of the PDO being parsed */
+        tlv_length_t length;                        /**< @brief Length of the PDO being parsed */
+        size_t offset;                              /**< @brief Number of value bytes of the PDO reported */
+        size_t position;                            /**< @brief Number of bytes parsed in the current message */
+        size_t depth;                               /**< @brief Number of open CDO's */
+        struct {
+            tlv_tag_t tag;                          /**< @brief Tag of the open CDO */
+            size_t end;                             /**< @brief Position of the end of the CDO */
+        } stack[TLV_MAX_DEPTH];                     /**< @brief The open CDO's */
+    };
+
+
+    /**
+     * @brief Initializes a parser
+     * @param[out] parser Parser to initialize
+     * @param[in] callbacks Callbacks to report the objects through, copied into the parser
+     * @param[in] arg User argument passed to the callbacks
+     */
+    void tlv_parser_init(tlv_parser_t *parser, const tlv_parser_callbacks_t *callbacks, void *arg);
+
+
+    /**
+     * @brief Resets a parser to wait for a new message, the callbacks are kept
+     * @param[in] parser Parser to reset
+     */
+    void tlv_parser_reset(tlv_parser_t *parser);
+
+
+    /**
+     * @brief Feeds the parser with the next chunk of bytes
+     * @param[in] parser Parser to feed
+     * @param[in] bytes Chunk of bytes
+     * @param[in] size Size of the chunk
+     * @return True if the chunk was parsed, false if the message is malformed or a callback stopped the parser
+     */
+    bool tlv_parser_feed(tlv_parser_t *parser, const uint8_t *bytes, const size_t size);
+
+
+    /**
+     * @brief Tells if the parser is between two messages
+     * @param[in] parser Parser to check
+     * @return True if no message is partially parsed, false otherwise
+     */
+    bool tlv_parser_is_idle(const tlv_parser_t *parser);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TLV_PARSER_H_2016 */
@@ -0,0 +1,168 @@
+/**
+ * File:   tlv_parser_test.c
+ *
+ * @brief Tests of tlv_parser.h
+ * Run "make test" to build and run the tests
+ */
+#include "tlv_parser.h"
+#include "tlv_test.h"
+
+/**
+ * Size of a message of TLV_MAX_DEPTH + 1 nested CDO's around a PDO
+ */
+#define TEST_NESTED_SIZE ((TLV_MAX_DEPTH + 2) * 5 + 1)
+
+/**
+ * Counts the callbacks of a parser
+ */
+typedef struct {
+    size_t entered;
+    size_t left;
+    size_t pdos;
+    size_t messages;
+} test_counts_t;
+
+
+/********** PRIVATE DECLARATIONS **********************************************/
+/**
+ * @brief Writes a message of nested CDO's, the innermost one holds an one byte PDO or is empty
+ * @param[out] bytes Return point of the message, TEST_NESTED_SIZE bytes
+ * @param[in] cdos Number of nested CDO's
+ * @param[in] pdo True if the innermost CDO holds a PDO
+ * @return Size of the message
+ */
+static size_t make_nested(uint8_t *bytes, const size_t cdos, const bool pdo);
+
+
+/**
+ * @brief Parses a message with counting callbacks, in one chunk or byte by byte
+ * @param[in] bytes The message
+ * @param[in] size Size of the message
+ * @param[in] chunk Size of the chunks fed to the parser
+ * @param[out] counts Return point of the counted callbacks
+ * @return Result of the last tlv_parser_feed
+ */
+static bool parse(const uint8_t *bytes, const size_t size, const size_t chunk, test_counts_t *counts);
+
+
+static bool count_enter_cdo(void *arg, const tlv_tag_t tag, const tlv_length_t length);
+static bool count_pdo(void *arg, const tlv_tag_t tag, const tlv_length_t length, const size_t offset, const uint8_t *span, const size_t span_length);
+static bool count_leave_cdo(void *arg, const tlv_tag_t tag);
+static bool count_message(void *arg);
+
+
+/**
+ * A message with TLV_MAX_DEPTH nested CDO's is parsed, one level more is refused before the
+ * consumer sees the CDO that is too deep
+ */
+static bool test_max_depth(void);
+
+
+/********** PUBLIC DEFINITIONS ************************************************/
+int main(void) {
+    bool ok = true;
+
+    ok = test_max_depth() && ok;
+
+    return tlv_test_result("tlv_parser_test", ok);
+}
+
+
+/********** PRIVATE DEFINITIONS ***********************************************/
+static size_t make_nested(uint8_t *bytes, const size_t cdos, const bool pdo) {
+    size_t size = cdos * BER_HEADER_BYTE_LENGTH + (pdo ? BER_HEADER_BYTE_LENGTH + 1 : 0);
+
+    for (size_t i = 0; i < cdos; i++) {
+        uint8_t *header = &bytes[i * BER_HEADER_BYTE_LENGTH];
+        size_t length = size - (i + 1) * BER_HEADER_BYTE_LENGTH;
+
+        header[0] = TLV_CDO;
+        header[1] = 0;
+        header[2] = (uint8_t) (i + 1);
+        header[3] = (uint8_t) (length >> 8);
+        header[4] = (uint8_t) length;
+    }
+    if (pdo) {
+        tlv_test_message(&bytes[cdos * BER_HEADER_BYTE_LENGTH], 0x00FF, 1);
+    }
+
+    return size;
+}
+
+
+static bool parse(const uint8_t *bytes, const size_t size, const size_t chunk, test_counts_t *counts) {
+    const tlv_parser_callbacks_t callbacks = {count_enter_cdo, count_pdo, count_leave_cdo, count_message};
+    tlv_parser_t parser;
+    bool ok = true;
+
+    memset(counts, 0, sizeof (*counts));
+    tlv_parser_init(&parser, &callbacks, counts);
+    for (size_t i = 0; ok && i < size; i += chunk) {
+        ok = tlv_parser_feed(&parser, &bytes[i], size - i < chunk ? size - i : chunk);
+    }
+
+    return ok && tlv_parser_is_idle(&parser);
+}
+
+
+static bool count_enter_cdo(void *arg, const tlv_tag_t tag, const tlv_length_t length) {
+    ((test_counts_t *) arg)->entered++;
+
+    return true;
+}
+
+
+static bool count_pdo(void *arg, const tlv_tag_t tag, const tlv_length_t length, const size_t offset, const uint8_t *span, const size_t span_length) {
+    ((test_counts_t *) arg)->pdos++;
+
+    return true;
+}
+
+
+static bool count_leave_cdo(void *arg, const tlv_tag_t tag) {
+    ((test_counts_t *) arg)->left++;
+
+    return true;
+}
+
+
+static bool count_message(void *arg) {
+    ((test_counts_t *) arg)->messages++;
+
+    return true;
+}
+
+
+static bool test_max_depth(void) {
+    uint8_t bytes[TEST_NESTED_SIZE];
+    test_counts_t counts;
+    tlv_t *tlv;
+    size_t size;
+
+    // TLV_MAX_DEPTH levels are parsed and decoded
+    size = make_nested(bytes, TLV_MAX_DEPTH, true);
+    for (size_t chunk = 1; chunk <= size; chunk += size - 1) {
+        CHECK(parse(bytes, size, chunk, &counts));
+        CHECK(counts.entered == TLV_MAX_DEPTH && counts.left == TLV_MAX_DEPTH);
+        CHECK(counts.pdos == 1 && counts.messages == 1);
+    }
+    CHECK((tlv = tlv_from_byte_array(bytes, size)) != NULL);
+    tlv_delete_all(&tlv);
+
+    // One level more is refused without entering the CDO that is too deep
+    size = make_nested(bytes, TLV_MAX_DEPTH + 1, true);
+    for (size_t chunk = 1; chunk <= size; chunk += size - 1) {
+        CHECK(!parse(bytes, size, chunk, &counts));
+        CHECK(counts.entered == TLV_MAX_DEPTH && counts.left == 0);
+        CHECK(counts.pdos == 0 && counts.messages == 0);
+    }
+    CHECK(tlv_from_byte_array(bytes, size) == NULL);
+
+    // An empty CDO at the limit needs no stack entry
+    size = make_nested(bytes, TLV_MAX_DEPTH + 1, false);
+    CHECK(parse(bytes, size, size, &counts));
+    CHECK(counts.entered == TLV_MAX_DEPTH + 1 && counts.left == TLV_MAX_DEPTH + 1);
+    CHECK(counts.messages == 1);
+
+    return true;
+}
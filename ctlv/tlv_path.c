@@ -0,0 +1,148 @@
+#include "tlv_path.h"
+#include "tlv_private.h"
+
+
+/********** PRIVATE DECLARATIONS **********************************************/
+/**
+ * @brief Walks the objects of a byte array selected by a path
+ * @param[in] path Compiled path
+ * @param[in] barray Encoded TLV message
+ * @param[in] size Size of the message
+ * @param[out] matches Return point of the selected objects or NULL
+ * @param[in] capacity Capacity of matches
+ * @param[in] first True to stop at the first match
+ * @param[out] count Number of selected objects
+ * @return True if successful, false if the message is malformed on the way
+ */
+static bool path_walk(const tlv_path_t *path, const uint8_t *barray, const size_t size, tlv_path_match_t *matches, const size_t capacity, const bool first, size_t *count);
+
+
+/********** PUBLIC DEFINITIONS ************************************************/
+bool tlv_path_compile(tlv_path_t *path, const char *expression) {
+    const char *c = expression;
+
+    if (path == NULL || expression == NULL) {
+        return false;
+    }
+    path->count = 0;
+    if (*c == '/') {
+        c++;
+    }
+
+    while (true) {
+        if (path->count == TLV_MAX_DEPTH) {
+            TLV_FAIL(TLV_FAILURE_DEPTH, "Error - Path is deeper than %u levels: %s", TLV_MAX_DEPTH, expression);
+            path->count = 0;
+            return false;
+        }
+        if (*c == '*') {
+            path->steps[path->count].any = true;
+            path->steps[path->count].tag = 0;
+            c++;
+        } else {
+            uint32_t tag = 0;
+            const char *start = c;
+
+            while (*c >= '0' && *c <= '9' && tag <= UINT16_MAX) {
+                tag = tag * 10 + (uint32_t) (*c++ - '0');
+            }
+            if (c == start || tag > UINT16_MAX) {
+                TLV_FAIL(TLV_FAILURE_ARGUMENT, "Error - Wrong tag in path at %u: %s", (unsigned) (start - expression), expression);
+                path->count = 0;
+                return false;
+            }
+            path->steps[path->count].any = false;
+            path->steps[path->count].tag = (tlv_tag_t) tag;
+        }
+        path->count++;
+
+        if (*c == '\0') {
+            return true;
+        }
+        if (*c++ != '/') {
+            TLV_FAIL(TLV_FAILURE_ARGUMENT, "Error - Wrong separator in path at %u: %s", (unsigned) (c - 1 - expression), expression);
+            path->count = 0;
+            return false;
+        }
+    }
+}
+
+
+bool tlv_path_find(const tlv_path_t *path, const uint8_t *barray, const size_t size, tlv_path_match_t *match) {
+    size_t count = 0;
+
+    return path_walk(path, barray, size, match, match != NULL ? 1 : 0, true, &count) && count > 0;
+}
+
+
+bool tlv_path_find_all(const tlv_path_t *path, const uint8_t *barray, const size_t size, tlv_path_match_t *matches, size_t *count) {
+    size_t capacity;
+
+    if (count == NULL) {
+        return false;
+    }
+    capacity = matches != NULL ? *count : 0;
+
+    return path_walk(path, barray, size, matches, capacity, false, count);
+}
+
+
+/********** PRIVATE DEFINITIONS ***********************************************/
+static bool path_walk(const tlv_path_t *path, const uint8_t *barray, const size_t size, tlv_path_match_t *matches, const size_t capacity, const bool first, size_t *count) {
+    size_t stack[TLV_MAX_DEPTH];
+    size_t depth = 0;
+    size_t index = 0;
+    size_t end = size;
+    size_t found = 0;
+
+    *count = 0;
+    if (path == NULL || path->count == 0 || barray == NULL) {
+        return false;
+    }
+
+    // depth is the level of the path matched against, non matching objects are skipped with their contents
+    while (true) {
+        while (index < end) {
+            tlv_header_t header;
+
+            if (!tlv_header_read(&barray[index], end - index, &header) || header.length > end - index - header.size) {
+                TLV_FAIL(TLV_FAILURE_MALFORMED, "Error - Wrong header at %u when running path", (unsigned) index);
+                *count = found;
+                return false;
+            }
+            index += header.size;
+            if (!path->steps[depth].any && path->steps[depth].tag != header.tag) {
+                index += header.length;
+                continue;
+            }
+
+            if (depth + 1 == path->count) {
+                if (found < capacity) {
+                    matches[found].value = &barray[index];
+                    matches[found].length = header.length;
+                    matches[found].tag = header.tag;
+                    matches[found].type = header.type;
+                }
+                found++;
+                if (first) {
+                    *count = found;
+                    return true;
+                }
+                index += header.length;
+            } else if (header.type == TLV_CDO) {
+                stack[depth++] = end;
+                end = index + header.length;
+            } else {
+                index += header.length;
+            }
+        }
+
+        if (depth == 0) {
+            break;
+        }
+        end = stack[--depth];
+    }
+    *count = found;
+
+    return true;
+}
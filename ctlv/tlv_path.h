@@ -0,0 +1,86 @@
+#ifndef TLV_PATH_H_2016
+#define TLV_PATH_H_2016
+
+/**
+ * File:   tlv_path.h
+ *
+ * @brief Path queries evaluated on encoded TLV messages
+ * A path is a list of tags separated by '/', one tag per level starting with the root, "*" matches
+ * any tag on its level. For example "1/3/35" selects the objects with tag 35 in the CDO's with tag 3
+ * in the root with tag 1, with a "*" in place of the 3 it selects tag 35 in any CDO of the root.
+ *
+ * A path is compiled once and then run against byte arrays without decoding them. CDO's which do not
+ * match are skipped by their length, the matches are returned as spans pointing into the byte array.
+ * Nothing is allocated, the compiled path has a fixed size and can live on the stack.
+ * Only the objects on the way to the matches are read, the rest of the array is not validated.
+ */
+
+#include "tlv.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    typedef struct stTLVPath tlv_path_t;
+
+    /**
+     * Struct representing a compiled path, the members are private
+     */
+    struct stTLVPath {
+        size_t count;                   /**< @brief Number of levels in the path */
+        struct {
+            tlv_tag_t tag;              /**< @brief Tag to match on the level */
+            bool any;                   /**< @brief True if any tag matches on the level */
+        } steps[TLV_MAX_DEPTH];         /**< @brief The levels of the path, the first one is the root */
+    };
+
+    /**
+     * An object selected by a path
+     */
+    typedef struct {
+        const uint8_t *value;           /**< @brief Value of a PDO or the encoded children of a CDO */
+        tlv_length_t length;            /**< @brief Length of the value */
+        tlv_tag_t tag;                  /**< @brief Tag of the object */
+        tlv_type_t type;                /**< @brief Type of the object (CDO/PDO) */
+    } tlv_path_match_t;
+
+
+    /**
+     * @brief Compiles a path expression
+     * @param[out] path Path to compile into
+     * @param[in] expression Tags or "*" separated by '/', at most TLV_MAX_DEPTH levels
+     * @return True if successful, false if the expression is malformed
+     */
+    bool tlv_path_compile(tlv_path_t *path, const char *expression);
+
+
+    /**
+     * @brief Finds the first object selected by a path in a byte array
+     * The search stops at the first match, so it can be used as a filter on every message
+     * @param[in] path Compiled path
+     * @param[in] barray Encoded TLV message
+     * @param[in] size Size of the message
+     * @param[out] match Return point of the selected object, may be NULL
+     * @return True if an object was found, false if not or the message is malformed on the way
+     */
+    bool tlv_path_find(const tlv_path_t *path, const uint8_t *barray, const size_t size, tlv_path_match_t *match);
+
+
+    /**
+     * @brief Finds all objects selected by a path in a byte array
+     * The objects are returned in the order of the message
+     * @param[in] path Compiled path
+     * @param[in] barray Encoded TLV message
+     * @param[in] size Size of the message
+     * @param[out] matches Return point of the selected objects, may be NULL to only count them
+     * @param[in,out] count Capacity of matches, on return the number of selected objects, also beyond the capacity
+     * @return True if successful, false if the message is malformed on the way
+     */
+    bool tlv_path_find_all(const tlv_path_t *path, const uint8_t *barray, const size_t size, tlv_path_match_t *matches, size_t *count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TLV_PATH_H_2016 */
@@ -0,0 +1,251 @@
+#ifndef TLV_PRIVATE_H_2016
+#define TLV_PRIVATE_H_2016
+
+/**
+ * File:   tlv_private.h
+ *
+ * @brief Helpers shared by the modules of the ctlv library
+ * This header is not part of the public interface and is not installed
+ */
+
+#include "tlv.h"
+#include "tlv_metrics.h"
+
+
+/**
+ * Decoded header of a TLV object
+ */
+typedef struct {
+    tlv_type_t type;                /**< @brief Type of the TLV (CDO/PDO), also for wide headers */
+    tlv_tag_t tag;                  /**< @brief Tag of the TLV */
+    tlv_length_t length;            /**< @brief Length of the value (PDO) or of the children (CDO) */
+    uint8_t size;                   /**< @brief Size of the header in bytes */
+} tlv_header_t;
+
+
+/**
+ * @brief Returns the size of a header from its type byte
+ * @param[in] type Type byte of the header
+ * @return BER_HEADER_BYTE_LENGTH, BER_WIDE_HEADER_BYTE_LENGTH or 0 for unknown types
+ */
+static inline uint8_t tlv_header_size(const uint8_t type) {
+    switch (type) {
+        case TLV_CDO:
+        case TLV_PDO:
+            return BER_HEADER_BYTE_LENGTH;
+        case TLV_CDO_WIDE:
+        case TLV_PDO_WIDE:
+            return BER_WIDE_HEADER_BYTE_LENGTH;
+        default:
+            return 0;
+    }
+}
+
+
+/**
+ * @brief Reads a TLV header from a byte array
+ * The value length is not checked against the array, it is up to the caller
+ * @param[in] bytes Byte array starting with the header
+ * @param[in] size Number of bytes available in the array
+ * @param[out] header Return point of the decoded header
+ * @return True if a complete header with a known type was read, false otherwise
+ */
+static inline bool tlv_header_read(const uint8_t *bytes, const size_t size, tlv_header_t *header) {
+    if (size == 0 || (header->size = tlv_header_size(bytes[0])) == 0 || size < header->size) {
+        return false;
+    }
+    header->type = (bytes[0] == TLV_CDO || bytes[0] == TLV_CDO_WIDE) ? TLV_CDO : TLV_PDO;
+    header->tag = (tlv_tag_t) (bytes[1] << 8 | bytes[2]);
+    if (header->size == BER_HEADER_BYTE_LENGTH) {
+        header->length = (tlv_length_t) (bytes[3] << 8 | bytes[4]);
+    } else {
+        header->length = (tlv_length_t) bytes[3] << 24 | (tlv_length_t) bytes[4] << 16 | (tlv_length_t) bytes[5] << 8 | bytes[6];
+    }
+
+    return true;
+}
+
+
+/**
+ * @brief Writes a TLV header into a byte array
+ * The array must have room for BER_HEADER_BYTE_LENGTH or BER_WIDE_HEADER_BYTE_LENGTH bytes
+ * @param[out] bytes Byte array to write the header in
+ * @param[in] type Type of the TLV (CDO/PDO)
+ * @param[in] tag Tag of the TLV
+ * @param[in] length Length of the value (PDO) or of the children (CDO), at most UINT16_MAX if not wide
+ * @param[in] wide True to write a wide header with 32-bit length
+ * @return Size of the written header
+ */
+static inline uint8_t tlv_header_write(uint8_t *bytes, const tlv_type_t type, const tlv_tag_t tag, const tlv_length_t length, const bool wide) {
+    bytes[1] = (uint8_t) (tag >> 8);
+    bytes[2] = (uint8_t) (tag & 0x00ff);
+    if (!wide) {
+        bytes[0] = type;
+        bytes[3] = (uint8_t) (length >> 8);
+        bytes[4] = (uint8_t) (length & 0x00ff);
+        return BER_HEADER_BYTE_LENGTH;
+    }
+    bytes[0] = type == TLV_CDO ? TLV_CDO_WIDE : TLV_PDO_WIDE;
+    bytes[3] = (uint8_t) (length >> 24);
+    bytes[4] = (uint8_t) (length >> 16);
+    bytes[5] = (uint8_t) (length >> 8);
+    bytes[6] = (uint8_t) (length & 0x00ff);
+
+    return BER_WIDE_HEADER_BYTE_LENGTH;
+}
+
+
+/**
+ * @brief Clears the sized flag of a CDO and of its parents
+ * Called when the children of a CDO change, parents of an unsized CDO are never sized
+ * @param[in] tlv CDO whose children changed
+ */
+static inline void tlv_invalidate_length(tlv_t *tlv) {
+    while (tlv != NULL && (tlv->flags & TLV_FLAG_SIZED)) {
+        tlv->flags &= (uint8_t) ~TLV_FLAG_SIZED;
+        tlv = tlv->parent;
+    }
+}
+
+
+/**
+ * @brief Sets the dirty flag of an object and of its parents
+ * @param[in] tlv Modified object
+ */
+static inline void tlv_mark_dirty(tlv_t *tlv) {
+    while (tlv != NULL && !(tlv->flags & TLV_FLAG_DIRTY)) {
+        tlv->flags |= TLV_FLAG_DIRTY;
+        tlv = tlv->parent;
+    }
+}
+
+
+/** @brief Start value of the hashes */
+#define TLV_HASH_SEED 0x9E3779B97F4A7C15ULL
+
+/**
+ * @brief Mixes a 64-bit word into a hash, used by the structural and the byte hashes
+ * @param[in] hash The hash so far
+ * @param[in] word Word to mix in
+ * @return The new hash
+ */
+static inline uint64_t tlv_hash_mix(uint64_t hash, uint64_t word) {
+    word *= 0x87C37B91114253D5ULL;
+    word = word << 31 | word >> 33;
+    word *= 0x4CF5AD432745937FULL;
+    hash ^= word;
+    hash = hash << 27 | hash >> 37;
+
+    return hash * 5 + 0x52DCE729;
+}
+
+
+/**
+ * @brief Finishes a hash, every bit of the state changes every bit of the result
+ * @param[in] hash The mixed hash
+ * @return The final hash
+ */
+static inline uint64_t tlv_hash_final(uint64_t hash) {
+    hash ^= hash >> 33;
+    hash *= 0xFF51AFD7ED558CCDULL;
+    hash ^= hash >> 33;
+    hash *= 0xC4CEB9FE1A85EC53ULL;
+
+    return hash ^ (hash >> 33);
+}
+
+
+/**
+ * @brief Reads 8 bytes as a little endian word, the same on every platform
+ * @param[in] bytes The bytes
+ * @return The word
+ */
+static inline uint64_t tlv_load_le64(const uint8_t *bytes) {
+    return (uint64_t) bytes[0] | (uint64_t) bytes[1] << 8 | (uint64_t) bytes[2] << 16 | (uint64_t) bytes[3] << 24
+            | (uint64_t) bytes[4] << 32 | (uint64_t) bytes[5] << 40 | (uint64_t) bytes[6] << 48 | (uint64_t) bytes[7] << 56;
+}
+
+
+/**
+ * @brief Hashes the bytes of a byte array, not its structure
+ * @param[in] bytes The byte array
+ * @param[in] size Size of the byte array
+ * @return The 64-bit hash
+ */
+static inline uint64_t tlv_hash_raw(const uint8_t *bytes, const size_t size) {
+    uint64_t lanes[4] = {TLV_HASH_SEED, TLV_HASH_SEED + 1, TLV_HASH_SEED + 2, TLV_HASH_SEED + 3};
+    uint64_t hash = TLV_HASH_SEED ^ size;
+    size_t i = 0;
+
+    // Four independent lanes, the mixing of one word does not wait for the previous one
+    for (; i + 32 <= size; i += 32) {
+        lanes[0] = tlv_hash_mix(lanes[0], tlv_load_le64(&bytes[i]));
+        lanes[1] = tlv_hash_mix(lanes[1], tlv_load_le64(&bytes[i + 8]));
+        lanes[2] = tlv_hash_mix(lanes[2], tlv_load_le64(&bytes[i + 16]));
+        lanes[3] = tlv_hash_mix(lanes[3], tlv_load_le64(&bytes[i + 24]));
+    }
+    for (size_t lane = 0; lane < 4; lane++) {
+        hash = tlv_hash_mix(hash, lanes[lane]);
+    }
+    for (; i + 8 <= size; i += 8) {
+        hash = tlv_hash_mix(hash, tlv_load_le64(&bytes[i]));
+    }
+    if (i < size) {
+        uint64_t tail = 0;
+
+        for (unsigned shift = 0; i < size; i++, shift += 8) {
+            tail |= (uint64_t) bytes[i] << shift;
+        }
+        hash = tlv_hash_mix(hash, tail);
+    }
+
+    return tlv_hash_final(hash);
+}
+
+
+/**
+ * @brief Converts a byte array to a TLV object like tlv_from_byte_array_ex, but without counting it
+ * For decoders which count a message made of several decoded parts once themselves
+ */
+tlv_t* tlv_decode_array(const uint8_t *barray, const size_t size, tlv_arena_t *arena, const uint32_t flags);
+
+
+/*
+ * Instrumentation, see tlv_metrics.h. Without TLV_METRICS the macros compile to nothing and
+ * TLV_FAIL only passes the text to the debug callback.
+ */
+#ifdef TLV_METRICS
+
+/** @brief Counters of the calling thread */
+extern __thread tlv_metrics_t tlv_metrics_local;
+
+/**
+ * @brief Calls the begin hook and starts the latency measurement of a function
+ * @param[in] api The function
+ * @return Start time in ns or 0 if latencies are not measured
+ */
+uint64_t tlv_trace_begin(const tlv_api_t api);
+
+/**
+ * @brief Records the latency of a function and calls the end hook
+ * @param[in] api The function
+ * @param[in] start Return value of tlv_trace_begin
+ * @param[in] ok True if the function succeeded
+ */
+void tlv_trace_end(const tlv_api_t api, const uint64_t start, const bool ok);
+
+#define TLV_COUNT(counter, n) (tlv_metrics_local.counter += (n))
+#define TLV_TRACE_BEGIN(api) uint64_t tlv_trace_start = tlv_trace_begin(api)
+#define TLV_TRACE_END(api, ok) tlv_trace_end(api, tlv_trace_start, ok)
+#define TLV_FAIL(failure, ...) do { tlv_metrics_local.failures[failure]++; tlv_debug_cb(__VA_ARGS__); } while (0)
+
+#else
+
+#define TLV_COUNT(counter, n) ((void) 0)
+#define TLV_TRACE_BEGIN(api) ((void) 0)
+#define TLV_TRACE_END(api, ok) ((void) 0)
+#define TLV_FAIL(failure, ...) tlv_debug_cb(__VA_ARGS__)
+
+#endif
+
+#endif /* TLV_PRIVATE_H_2016 */
@@ -0,0 +1,619 @@
+#ifndef TLV_SCHEMA_HPP_2016
+#define TLV_SCHEMA_HPP_2016
+
+/**
+ * File:   tlv_schema.hpp
+ *
+ * @brief Compile time TLV codecs for C++ structs, header only, C++17
+ * The layout of a message is declared as a type listing the tag of every member of a struct.
+ * The decoder reads the byte array straight into the struct and the encoder writes the struct
+ * straight into a buffer, no tlv_t tree is built. The tag dispatch of every CDO is a chain of
+ * constant comparisons which the compiler turns into a switch table.
+ *
+ * A member of type std::optional<T> is optional, all other members are required. Unknown tags are
+ * skipped when decoding. PDO values are encoded big endian with the size of the member type, other
+ * value types are supported by specializing tlv::schema::codec. Messages longer than 65535 bytes are
+ * encoded with wide headers like tlv_to_byte_array does, the decoder accepts both kinds of headers.
+ *
+ * Usage:
+ *   struct Point { uint32_t x; uint32_t y; std::optional<std::string> name; };
+ *   struct Shape { uint16_t id; Point origin; };
+ *
+ *   using PointFields = tlv::schema::fields<
+ *       tlv::schema::pdo<10, &Point::x>,
+ *       tlv::schema::pdo<11, &Point::y>,
+ *       tlv::schema::pdo<12, &Point::name>>;
+ *   using ShapeMessage = tlv::schema::message<1, tlv::schema::fields<
+ *       tlv::schema::pdo<2, &Shape::id>,
+ *       tlv::schema::cdo<3, &Shape::origin, PointFields>>>;
+ *
+ *   Shape shape;
+ *   if (ShapeMessage::decode(bytes, size, shape)) { ... }
+ *   std::vector<uint8_t> out;
+ *   ShapeMessage::encode(shape, out);
+ */
+
+#include "tlv.h"
+#include <array>
+#include <cstring>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace tlv {
+    namespace schema {
+
+        namespace detail {
+
+            /**
+             * Decoded header of a TLV object
+             */
+            struct header {
+                uint8_t type;           /**< @brief TLV_CDO or TLV_PDO, also for wide headers */
+                tlv_tag_t tag;          /**< @brief Tag of the object */
+                uint32_t length;        /**< @brief Length of the value or of the children */
+                uint8_t size;           /**< @brief Size of the header in bytes */
+            };
+
+
+            /**
+             * @brief Reads a header from a byte array
+             * @param[in] bytes Byte array starting with the header
+             * @param[in] size Number of bytes available
+             * @param[out] h Return point of the header
+             * @return True if a complete header with a known type was read
+             */
+            inline bool read_header(const uint8_t *bytes, const size_t size, header &h) {
+                if (size < BER_HEADER_BYTE_LENGTH) {
+                    return false;
+                }
+                switch (bytes[0]) {
+                    case TLV_CDO:
+                    case TLV_PDO:
+                        h.size = BER_HEADER_BYTE_LENGTH;
+                        h.length = static_cast<uint32_t> (bytes[3] << 8 | bytes[4]);
+                        break;
+                    case TLV_CDO_WIDE:
+                    case TLV_PDO_WIDE:
+                        if (size < BER_WIDE_HEADER_BYTE_LENGTH) {
+                            return false;
+                        }
+                        h.size = BER_WIDE_HEADER_BYTE_LENGTH;
+                        h.length = static_cast<uint32_t> (bytes[3]) << 24 | static_cast<uint32_t> (bytes[4]) << 16
+                                | static_cast<uint32_t> (bytes[5]) << 8 | bytes[6];
+                        break;
+                    default:
+                        return false;
+                }
+                h.type = (bytes[0] == TLV_CDO || bytes[0] == TLV_CDO_WIDE) ? TLV_CDO : TLV_PDO;
+                h.tag = static_cast<tlv_tag_t> (bytes[1] << 8 | bytes[2]);
+
+                return true;
+            }
+
+
+            /**
+             * @brief Writes a header into a byte array
+             * @param[out] bytes Byte array with room for the header
+             * @param[in] type TLV_CDO or TLV_PDO
+             * @param[in] tag Tag of the object
+             * @param[in] length Length of the value or of the children
+             * @param[in] wide True to write a wide header
+             * @return Size of the written header
+             */
+            inline size_t write_header(uint8_t *bytes, const uint8_t type, const tlv_tag_t tag, const size_t length, const bool wide) {
+                bytes[1] = static_cast<uint8_t> (tag >> 8);
+                bytes[2] = static_cast<uint8_t> (tag);
+                if (!wide) {
+                    bytes[0] = type;
+                    bytes[3] = static_cast<uint8_t> (length >> 8);
+                    bytes[4] = static_cast<uint8_t> (length);
+                    return BER_HEADER_BYTE_LENGTH;
+                }
+                bytes[0] = type == TLV_CDO ? TLV_CDO_WIDE : TLV_PDO_WIDE;
+                bytes[3] = static_cast<uint8_t> (length >> 24);
+                bytes[4] = static_cast<uint8_t> (length >> 16);
+                bytes[5] = static_cast<uint8_t> (length >> 8);
+                bytes[6] = static_cast<uint8_t> (length);
+                return BER_WIDE_HEADER_BYTE_LENGTH;
+            }
+
+
+            /**
+             * Owner and type of a pointer to member
+             */
+            template <typename T> struct member_traits;
+
+            template <typename S, typename M> struct member_traits<M S::*> {
+                using owner = S;
+                using type = M;
+            };
+
+            template <typename T> struct optional_traits {
+                static constexpr bool optional = false;
+                using type = T;
+            };
+
+            template <typename T> struct optional_traits<std::optional<T>> {
+                static constexpr bool optional = true;
+                using type = T;
+            };
+
+
+            /**
+             * Access to a member which may be a std::optional
+             */
+            template <auto Member>
+            struct member_access {
+                using owner = typename member_traits<decltype(Member)>::owner;
+                using member = typename member_traits<decltype(Member)>::type;
+                using value_type = typename optional_traits<member>::type;
+                static constexpr bool optional = optional_traits<member>::optional;
+
+                static bool present(const owner &s) {
+                    if constexpr (optional) {
+                        return (s.*Member).has_value();
+                    } else {
+                        return true;
+                    }
+                }
+
+                static const value_type& get(const owner &s) {
+                    if constexpr (optional) {
+                        return *(s.*Member);
+                    } else {
+                        return s.*Member;
+                    }
+                }
+
+                static void reset(owner &s) {
+                    if constexpr (optional) {
+                        (s.*Member).reset();
+                    }
+                }
+
+                static value_type& set(owner &s) {
+                    if constexpr (optional) {
+                        return (s.*Member).emplace();
+                    } else {
+                        return s.*Member;
+                    }
+                }
+            };
+
+
+            /**
+             * Unsigned integer of the size of an integral or enum type
+             */
+            template <typename T, bool = std::is_enum_v<T>> struct unsigned_of {
+                using type = std::make_unsigned_t<T>;
+            };
+
+            template <typename T> struct unsigned_of<T, true> {
+                using type = std::make_unsigned_t<std::underlying_type_t<T>>;
+            };
+
+
+            template <typename U> inline void write_be(U value, uint8_t *bytes) {
+                for (size_t i = sizeof (U); i > 0; i--) {
+                    bytes[i - 1] = static_cast<uint8_t> (value);
+                    value = static_cast<U> (value >> 8);
+                }
+            }
+
+            template <typename U> inline U read_be(const uint8_t *bytes) {
+                U value = 0;
+                for (size_t i = 0; i < sizeof (U); i++) {
+                    value = static_cast<U> (value << 8 | bytes[i]);
+                }
+                return value;
+            }
+
+
+            template <size_t N> constexpr bool unique_tags(const std::array<tlv_tag_t, N> &tags) {
+                for (size_t i = 0; i < N; i++) {
+                    for (size_t j = i + 1; j < N; j++) {
+                        if (tags[i] == tags[j]) {
+                            return false;
+                        }
+                    }
+                }
+                return true;
+            }
+
+        } // namespace detail
+
+
+        /**
+         * Converts a member type to the value of a PDO and back
+         * Specializations provide size(value), write(value, bytes) and read(bytes, length, value)
+         */
+        template <typename T, typename Enable = void> struct codec;
+
+        /**
+         * Integers and enums, big endian with the size of the type
+         */
+        template <typename T>
+        struct codec<T, std::enable_if_t<(std::is_integral_v<T> && !std::is_same_v<T, bool>) || std::is_enum_v<T>>> {
+            using U = typename detail::unsigned_of<T>::type;
+
+            static size_t size(const T &) {
+                return sizeof (T);
+            }
+
+            static void write(const T &value, uint8_t *bytes) {
+                detail::write_be(static_cast<U> (value), bytes);
+            }
+
+            static bool read(const uint8_t *bytes, const size_t length, T &value) {
+                if (length != sizeof (T)) {
+                    return false;
+                }
+                value = static_cast<T> (detail::read_be<U>(bytes));
+                return true;
+            }
+        };
+
+        /**
+         * Booleans, one byte
+         */
+        template <> struct codec<bool> {
+            static size_t size(const bool &) {
+                return 1;
+            }
+
+            static void write(const bool &value, uint8_t *bytes) {
+                bytes[0] = value ? 1 : 0;
+            }
+
+            static bool read(const uint8_t *bytes, const size_t length, bool &value) {
+                if (length != 1) {
+                    return false;
+                }
+                value = bytes[0] != 0;
+                return true;
+            }
+        };
+
+        /**
+         * Floating point numbers, the IEEE 754 representation big endian
+         */
+        template <typename T>
+        struct codec<T, std::enable_if_t<std::is_floating_point_v<T>>> {
+            using U = std::conditional_t<sizeof (T) == 4, uint32_t, uint64_t>;
+            static_assert(sizeof (T) == sizeof (U), "Only float and double are supported");
+
+            static size_t size(const T &) {
+                return sizeof (T);
+            }
+
+            static void write(const T &value, uint8_t *bytes) {
+                U bits;
+                std::memcpy(&bits, &value, sizeof (bits));
+                detail::write_be(bits, bytes);
+            }
+
+            static bool read(const uint8_t *bytes, const size_t length, T &value) {
+                if (length != sizeof (T)) {
+                    return false;
+                }
+                U bits = detail::read_be<U>(bytes);
+                std::memcpy(&value, &bits, sizeof (value));
+                return true;
+            }
+        };
+
+        /**
+         * Byte containers, the value as it is
+         * A std::string_view points into the decoded byte array, which must outlive the struct
+         */
+        template <typename T>
+        struct codec<T, std::enable_if_t<std::is_same_v<T, std::string> || std::is_same_v<T, std::string_view>
+                || std::is_same_v<T, std::vector<uint8_t>>>> {
+            static size_t size(const T &value) {
+                return value.size();
+            }
+
+            static void write(const T &value, uint8_t *bytes) {
+                if (!value.empty()) {
+                    std::memcpy(bytes, value.data(), value.size());
+                }
+            }
+
+            static bool read(const uint8_t *bytes, const size_t length, T &value) {
+                if constexpr (std::is_same_v<T, std::vector<uint8_t>>) {
+                    value.assign(bytes, bytes + length);
+                } else {
+                    value = T(reinterpret_cast<const char*> (bytes), length);
+                }
+                return true;
+            }
+        };
+
+        /**
+         * Fixed size byte arrays, the length must match
+         */
+        template <size_t N> struct codec<std::array<uint8_t, N>> {
+            static size_t size(const std::array<uint8_t, N> &) {
+                return N;
+            }
+
+            static void write(const std::array<uint8_t, N> &value, uint8_t *bytes) {
+                std::memcpy(bytes, value.data(), N);
+            }
+
+            static bool read(const uint8_t *bytes, const size_t length, std::array<uint8_t, N> &value) {
+                if (length != N) {
+                    return false;
+                }
+                std::memcpy(value.data(), bytes, N);
+                return true;
+            }
+        };
+
+
+        /**
+         * A member of a struct encoded as a PDO
+         * @tparam Tag Tag of the PDO
+         * @tparam Member Pointer to the member, optional if it is a std::optional
+         */
+        template <tlv_tag_t Tag, auto Member>
+        struct pdo {
+            using access = detail::member_access<Member>;
+            using owner = typename access::owner;
+            using value_type = typename access::value_type;
+            static constexpr tlv_tag_t tag = Tag;
+            static constexpr bool optional = access::optional;
+
+            static bool present(const owner &s) {
+                return access::present(s);
+            }
+
+            static void reset(owner &s) {
+                access::reset(s);
+            }
+
+            static size_t size(const owner &s, const bool wide) {
+                return (wide ? BER_WIDE_HEADER_BYTE_LENGTH : BER_HEADER_BYTE_LENGTH) + codec<value_type>::size(access::get(s));
+            }
+
+            static size_t write(const owner &s, uint8_t *bytes, const bool wide) {
+                const value_type &value = access::get(s);
+                size_t length = codec<value_type>::size(value);
+                size_t header = detail::write_header(bytes, TLV_PDO, Tag, length, wide);
+
+                codec<value_type>::write(value, bytes + header);
+                return header + length;
+            }
+
+            static bool read(const detail::header &h, const uint8_t *value, owner &s) {
+                return h.type == TLV_PDO && codec<value_type>::read(value, h.length, access::set(s));
+            }
+        };
+
+
+        /**
+         * A member struct encoded as a CDO
+         * @tparam Tag Tag of the CDO
+         * @tparam Member Pointer to the member, optional if it is a std::optional
+         * @tparam Fields The fields of the member struct, a tlv::schema::fields
+         */
+        template <tlv_tag_t Tag, auto Member, typename Fields>
+        struct cdo {
+            using access = detail::member_access<Member>;
+            using owner = typename access::owner;
+            static constexpr tlv_tag_t tag = Tag;
+            static constexpr bool optional = access::optional;
+
+            static bool present(const owner &s) {
+                return access::present(s);
+            }
+
+            static void reset(owner &s) {
+                access::reset(s);
+            }
+
+            static size_t size(const owner &s, const bool wide) {
+                return (wide ? BER_WIDE_HEADER_BYTE_LENGTH : BER_HEADER_BYTE_LENGTH) + Fields::size(access::get(s), wide);
+            }
+
+            static size_t write(const owner &s, uint8_t *bytes, const bool wide) {
+                // The length is written when the children are written, as tlv_to_byte_array does
+                size_t header = detail::write_header(bytes, TLV_CDO, Tag, 0, wide);
+                size_t length = Fields::write(access::get(s), bytes + header, wide);
+
+                detail::write_header(bytes, TLV_CDO, Tag, length, wide);
+                return header + length;
+            }
+
+            static bool read(const detail::header &h, const uint8_t *value, owner &s) {
+                return h.type == TLV_CDO && Fields::read(value, h.length, access::set(s));
+            }
+        };
+
+
+        /**
+         * The children of a CDO, one pdo or cdo per member of a struct
+         * @tparam F The members, at most 64 with distinct tags
+         */
+        template <typename... F>
+        struct fields {
+            static_assert(sizeof...(F) <= 64, "At most 64 fields per CDO");
+            static_assert(detail::unique_tags(std::array<tlv_tag_t, sizeof...(F)>{F::tag...}), "Tags of the fields must be distinct");
+
+            /**
+             * @brief Returns the encoded length of the children
+             * @param[in] s Struct to encode
+             * @param[in] wide True to count wide headers
+             */
+            template <typename S>
+            static size_t size(const S &s, const bool wide) {
+                return (size_t{0} + ... + (F::present(s) ? F::size(s, wide) : 0));
+            }
+
+            /**
+             * @brief Writes the children, the buffer must have room for size(s, wide) bytes
+             * @param[in] s Struct to encode
+             * @param[out] bytes Buffer to write to
+             * @param[in] wide True to write wide headers
+             * @return Number of bytes written
+             */
+            template <typename S>
+            static size_t write(const S &s, uint8_t *bytes, const bool wide) {
+                size_t index = 0;
+                ((index += F::present(s) ? F::write(s, bytes + index, wide) : 0), ...);
+                return index;
+            }
+
+            /**
+             * @brief Reads the children into a struct
+             * The optional members are reset first, so a struct can be reused for the next message
+             * @param[in] bytes Encoded children
+             * @param[in] size Length of the children
+             * @param[out] s Struct to decode into
+             * @return True if successful, false if malformed or a required member is missing
+             */
+            template <typename S>
+            static bool read(const uint8_t *bytes, const size_t size, S &s) {
+                uint64_t seen = 0;
+                size_t index = 0;
+
+                (F::reset(s), ...);
+                while (index < size) {
+                    detail::header h;
+
+                    if (!detail::read_header(bytes + index, size - index, h) || h.length > size - index - h.size) {
+                        return false;
+                    }
+                    if (!dispatch(h, bytes + index + h.size, s, seen, std::index_sequence_for<F...>{})) {
+                        return false;
+                    }
+                    index += h.size + h.length;
+                }
+
+                return (seen & required) == required;
+            }
+
+        private:
+            template <size_t... I>
+            static constexpr uint64_t required_mask(std::index_sequence<I...>) {
+                return (uint64_t{0} | ... | (F::optional ? uint64_t{0} : uint64_t{1} << I));
+            }
+
+            static constexpr uint64_t required = required_mask(std::index_sequence_for<F...>{});
+
+            template <typename S, size_t... I>
+            static bool dispatch(const detail::header &h, const uint8_t *value, S &s, uint64_t &seen, std::index_sequence<I...>) {
+                bool ok = true;
+
+                // Unknown tags are skipped
+                ((h.tag == F::tag && ((ok = F::read(h, value, s)), seen |= uint64_t{1} << I, true)) || ...);
+                return ok;
+            }
+        };
+
+
+        /**
+         * A message with a root CDO
+         * @tparam Tag Tag of the root CDO
+         * @tparam Fields The fields of the message struct, a tlv::schema::fields
+         */
+        template <tlv_tag_t Tag, typename Fields>
+        struct message {
+
+            /**
+             * @brief Converts a byte array into a struct
+             * @param[in] bytes Byte array holding exactly one message
+             * @param[in] size Size of the byte array
+             * @param[out] s Struct to decode into
+             * @return True if successful, false otherwise
+             */
+            template <typename S>
+            static bool decode(const uint8_t *bytes, const size_t size, S &s) {
+                detail::header h;
+
+                if (bytes == nullptr || !detail::read_header(bytes, size, h) || h.type != TLV_CDO || h.tag != Tag
+                        || h.size + static_cast<size_t> (h.length) != size) {
+                    return false;
+                }
+                return Fields::read(bytes + h.size, h.length, s);
+            }
+
+            /**
+             * @brief Returns the encoded size of a struct
+             * @param[in] s Struct to encode
+             * @param[out] wide True if the message needs wide headers, may be NULL
+             * @return The size or 0 if the message is too long
+             */
+            template <typename S>
+            static size_t encoded_size(const S &s, bool *wide = nullptr) {
+                size_t length = Fields::size(s, false);
+                bool is_wide = length > UINT16_MAX;
+
+                // Every length in a message is at most the length of the root
+                if (is_wide && (length = Fields::size(s, true)) > UINT32_MAX) {
+                    return 0;
+                }
+                if (wide != nullptr) {
+                    *wide = is_wide;
+                }
+                return (is_wide ? BER_WIDE_HEADER_BYTE_LENGTH : BER_HEADER_BYTE_LENGTH) + length;
+            }
+
+            /**
+             * @brief Converts a struct into a caller supplied buffer
+             * @param[in] s Struct to encode
+             * @param[out] buffer Buffer to write to
+             * @param[in] capacity Size of the buffer
+             * @param[out] size Number of bytes written, or the needed size if the buffer is too small
+             * @return True if successful, false if the buffer is too small or the message too long
+             */
+            template <typename S>
+            static bool encode(const S &s, uint8_t *buffer, const size_t capacity, size_t &size) {
+                bool wide = false;
+
+                size = encoded_size(s, &wide);
+                if (size == 0 || buffer == nullptr || size > capacity) {
+                    return false;
+                }
+                write(s, buffer, wide);
+                return true;
+            }
+
+            /**
+             * @brief Appends the encoding of a struct to a vector
+             * @param[in] s Struct to encode
+             * @param[in,out] out Vector to append to, grown once
+             * @return True if successful, false if the message is too long
+             */
+            template <typename S>
+            static bool encode(const S &s, std::vector<uint8_t> &out) {
+                bool wide = false;
+                size_t size = encoded_size(s, &wide);
+                size_t offset = out.size();
+
+                if (size == 0) {
+                    return false;
+                }
+                out.resize(offset + size);
+                write(s, out.data() + offset, wide);
+                return true;
+            }
+
+        private:
+            template <typename S>
+            static void write(const S &s, uint8_t *bytes, const bool wide) {
+                size_t header = detail::write_header(bytes, TLV_CDO, Tag, 0, wide);
+                size_t length = Fields::write(s, bytes + header, wide);
+
+                detail::write_header(bytes, TLV_CDO, Tag, length, wide);
+            }
+        };
+
+    } // namespace schema
+} // namespace tlv
+
+#endif /* TLV_SCHEMA_HPP_2016 */
@@ -0,0 +1,370 @@
+#include "tlv_tag_index.h"
+#include "tlv_private.h"
+#include <string.h>
+
+#define INDEX_INITIAL_CAPACITY 64
+
+
+/**
+ * Slot of the tag table, holds the range of the objects with the tag
+ */
+typedef struct {
+    uint32_t start;                 /**< @brief Index of the first object with the tag */
+    uint32_t count;                 /**< @brief Number of objects with the tag */
+    tlv_tag_t tag;                  /**< @brief Tag of the slot */
+    bool used;                      /**< @brief True if the slot holds a tag */
+} tag_slot_t;
+
+
+/**
+ * Slot of the object table, maps an object to its pre-order number
+ */
+typedef struct {
+    const tlv_t *object;            /**< @brief Indexed object or NULL if the slot is free */
+    uint32_t order;                 /**< @brief Pre-order number of the object */
+} object_slot_t;
+
+
+/**
+ * Struct representing a tag index
+ */
+struct stTLVTagIndex {
+    tag_slot_t *tags;               /**< @brief Open addressing table of the tags */
+    size_t tag_mask;                /**< @brief Size of the tag table minus one */
+    unsigned tag_bits;              /**< @brief Number of bits addressing the tag table */
+    object_slot_t *objects_table;   /**< @brief Open addressing table of the objects, start of the allocated block */
+    size_t object_mask;             /**< @brief Size of the object table minus one */
+    unsigned object_bits;           /**< @brief Number of bits addressing the object table */
+    const tlv_t **objects;          /**< @brief Objects grouped by tag, in pre-order within a tag */
+    uint32_t *order;                /**< @brief Pre-order number of each entry in objects */
+    uint32_t *end;                  /**< @brief Pre-order number after the subtree, by pre-order number */
+    size_t count;                   /**< @brief Number of indexed objects */
+};
+
+
+/********** PRIVATE DECLARATIONS **********************************************/
+/**
+ * @brief Collects the objects of a tree in pre-order with the end of their subtrees
+ * @param[in] tlv Tlv object to walk
+ * @param[out] all Return point of the objects in pre-order
+ * @param[out] end Return point of the subtree ends
+ * @param[out] count Number of collected objects
+ * @return True if successful, false otherwise
+ */
+static bool collect(const tlv_t *tlv, const tlv_t ***all, uint32_t **end, size_t *count);
+
+
+/**
+ * @brief Returns the slot of a tag
+ * @param[in] index Index to search
+ * @param[in] tag Tag to search for
+ * @param[in] insert True if a free slot shall be taken for a missing tag
+ * @return The slot or NULL if the tag is missing
+ */
+static tag_slot_t* tag_slot(const tlv_tag_index_t *index, const tlv_tag_t tag, const bool insert);
+
+
+/**
+ * @brief Returns the pre-order number of an object
+ * @param[in] index Index to search
+ * @param[in] object Object to search for
+ * @param[out] order Return point of the pre-order number
+ * @return True if the object is indexed, false otherwise
+ */
+static bool object_order(const tlv_tag_index_t *index, const tlv_t *object, uint32_t *order);
+
+
+/**
+ * @brief Returns the start slot of an object in the object table
+ * @param[in] index Index holding the table
+ * @param[in] object Object to hash
+ * @return Slot number
+ */
+static size_t object_hash(const tlv_tag_index_t *index, const tlv_t *object);
+
+
+/**
+ * @brief Returns the smallest power of two greater than or equal to twice the count
+ * @param[in] count Number of entries of a table
+ * @return Size of the table
+ */
+static size_t table_size(const size_t count);
+
+
+/**
+ * @brief Returns the number of bits needed to address the slots of a table
+ * @param[in] size Size of the table, a power of two
+ * @return Number of bits
+ */
+static unsigned table_bits(const size_t size);
+
+
+/********** PUBLIC DEFINITIONS ************************************************/
+tlv_tag_index_t* tlv_tag_index_new(const tlv_t *tlv) {
+    tlv_tag_index_t *index;
+    const tlv_t **all = NULL;
+
+    if (tlv == NULL) {
+        TLV_FAIL(TLV_FAILURE_ARGUMENT, "Error - Tlv is null when building tag index");
+        return NULL;
+    }
+    if ((index = calloc(1, sizeof (*index))) == NULL) {
+        TLV_FAIL(TLV_FAILURE_MEMORY, "Fatal - Out of memory when allocating tag index");
+        return NULL;
+    }
+    if (!collect(tlv, &all, &index->end, &index->count)) {
+        free(all);
+        tlv_tag_index_delete(&index);
+        return NULL;
+    }
+
+    size_t tags = table_size(index->count < 65536 ? index->count : 65536);
+    size_t objects = table_size(index->count);
+    index->tag_mask = tags - 1;
+    index->object_mask = objects - 1;
+    index->tag_bits = table_bits(tags);
+    index->object_bits = table_bits(objects);
+
+    // The tables share one block, only the slots of the hash tables need to be cleared
+    size_t tags_size = tags * sizeof (*index->tags);
+    size_t objects_size = objects * sizeof (*index->objects_table);
+    uint8_t *block = malloc(tags_size + objects_size + index->count * (sizeof (*index->objects) + sizeof (*index->order)));
+    if (block == NULL) {
+        TLV_FAIL(TLV_FAILURE_MEMORY, "Fatal - Out of memory when building tag index");
+        free(all);
+        tlv_tag_index_delete(&index);
+        return NULL;
+    }
+    memset(block, 0, tags_size + objects_size);
+    index->objects_table = (object_slot_t*) block;
+    index->tags = (tag_slot_t*) (block + objects_size);
+    index->objects = (const tlv_t**) (block + objects_size + tags_size);
+    index->order = (uint32_t*) (block + objects_size + tags_size + index->count * sizeof (*index->objects));
+
+    // Count the objects per tag, then place them in their ranges keeping the pre-order
+    for (size_t i = 0; i < index->count; i++) {
+        tag_slot(index, all[i]->tag, true)->count++;
+    }
+    uint32_t start = 0;
+    for (size_t i = 0; i <= index->tag_mask; i++) {
+        if (index->tags[i].used) {
+            index->tags[i].start = start;
+            start += index->tags[i].count;
+            index->tags[i].count = 0;
+        }
+    }
+    for (size_t i = 0; i < index->count; i++) {
+        tag_slot_t *slot = tag_slot(index, all[i]->tag, false);
+        uint32_t position = slot->start + slot->count++;
+
+        index->objects[position] = all[i];
+        index->order[position] = (uint32_t) i;
+
+        size_t hash = object_hash(index, all[i]);
+        while (index->objects_table[hash].object != NULL) {
+            hash = (hash + 1) & index->object_mask;
+        }
+        index->objects_table[hash].object = all[i];
+        index->objects_table[hash].order = (uint32_t) i;
+    }
+    free(all);
+
+    return index;
+}
+
+
+void tlv_tag_index_delete(tlv_tag_index_t **index) {
+    if (index != NULL && *index != NULL) {
+        free((*index)->objects_table);
+        free((*index)->end);
+        free(*index);
+        *index = NULL;
+    }
+}
+
+
+const tlv_t* tlv_tag_index_find(const tlv_tag_index_t *index, const tlv_tag_t tag) {
+    const tlv_t * const *objects;
+
+    if (tlv_tag_index_find_all(index, tag, &objects) > 0) {
+        return objects[0];
+    }
+
+    return NULL;
+}
+
+
+size_t tlv_tag_index_find_all(const tlv_tag_index_t *index, const tlv_tag_t tag, const tlv_t * const **objects) {
+    const tag_slot_t *slot;
+
+    if (index == NULL || objects == NULL || (slot = tag_slot(index, tag, false)) == NULL) {
+        return 0;
+    }
+    *objects = &index->objects[slot->start];
+
+    return slot->count;
+}
+
+
+size_t tlv_tag_index_find_all_in(const tlv_tag_index_t *index, const tlv_t *cdo, const tlv_tag_t tag, const tlv_t * const **objects) {
+    const tag_slot_t *slot;
+    uint32_t first;
+
+    if (index == NULL || objects == NULL || (slot = tag_slot(index, tag, false)) == NULL) {
+        return 0;
+    }
+    if (!object_order(index, cdo, &first)) {
+        TLV_FAIL(TLV_FAILURE_ARGUMENT, "Error - Cdo is not part of the indexed tree");
+        return 0;
+    }
+
+    // The subtree of the CDO is the pre-order range after the CDO up to its end
+    const uint32_t *order = &index->order[slot->start];
+    uint32_t last = index->end[first];
+    size_t low = 0;
+    size_t high = slot->count;
+
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        if (order[middle] <= first) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    size_t begin = low;
+    high = slot->count;
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        if (order[middle] < last) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    *objects = &index->objects[slot->start + begin];
+
+    return low - begin;
+}
+
+
+const tlv_t* tlv_tag_index_find_in(const tlv_tag_index_t *index, const tlv_t *cdo, const tlv_tag_t tag) {
+    const tlv_t * const *objects;
+
+    if (tlv_tag_index_find_all_in(index, cdo, tag, &objects) > 0) {
+        return objects[0];
+    }
+
+    return NULL;
+}
+
+
+/********** PRIVATE DEFINITIONS ***********************************************/
+static bool collect(const tlv_t *tlv, const tlv_t ***all, uint32_t **end, size_t *count) {
+    uint32_t stack[TLV_MAX_DEPTH];
+    size_t depth = 0;
+    size_t capacity = 0;
+
+    *count = 0;
+    while (tlv != NULL) {
+        if (*count == capacity) {
+            capacity = capacity ? capacity * 2 : INDEX_INITIAL_CAPACITY;
+            const tlv_t **new_all = realloc(*all, capacity * sizeof (**all));
+            if (new_all != NULL) {
+                *all = new_all;
+            }
+            uint32_t *new_end = realloc(*end, capacity * sizeof (**end));
+            if (new_end != NULL) {
+                *end = new_end;
+            }
+            if (new_all == NULL || new_end == NULL) {
+                TLV_FAIL(TLV_FAILURE_MEMORY, "Fatal - Out of memory when building tag index");
+                return false;
+            }
+        }
+        uint32_t order = (uint32_t) (*count)++;
+        (*all)[order] = tlv;
+        (*end)[order] = order + 1;
+
+        if (tlv->child != NULL) {
+            if (depth == TLV_MAX_DEPTH) {
+                TLV_FAIL(TLV_FAILURE_DEPTH, "Error - Tlv is deeper than %u levels", TLV_MAX_DEPTH);
+                return false;
+            }
+            stack[depth++] = order;
+            tlv = tlv->child;
+            continue;
+        }
+        tlv = tlv->next;
+        while (tlv == NULL && depth > 0) {
+            order = stack[--depth];
+            (*end)[order] = (uint32_t) *count;
+            tlv = (*all)[order]->next;
+        }
+    }
+
+    return true;
+}
+
+
+static tag_slot_t* tag_slot(const tlv_tag_index_t *index, const tlv_tag_t tag, const bool insert) {
+    size_t hash = (tag ^ (tag >> index->tag_bits)) & index->tag_mask;
+
+    while (index->tags[hash].used) {
+        if (index->tags[hash].tag == tag) {
+            return &index->tags[hash];
+        }
+        hash = (hash + 1) & index->tag_mask;
+    }
+    if (insert) {
+        index->tags[hash].used = true;
+        index->tags[hash].tag = tag;
+        return &index->tags[hash];
+    }
+
+    return NULL;
+}
+
+
+static bool object_order(const tlv_tag_index_t *index, const tlv_t *object, uint32_t *order) {
+    size_t hash = object_hash(index, object);
+
+    while (index->objects_table[hash].object != NULL) {
+        if (index->objects_table[hash].object == object) {
+            *order = index->objects_table[hash].order;
+            return true;
+        }
+        hash = (hash + 1) & index->object_mask;
+    }
+
+    return false;
+}
+
+
+static size_t object_hash(const tlv_tag_index_t *index, const tlv_t *object) {
+    uintptr_t address = (uintptr_t) object >> 4;
+
+    return (size_t) (address ^ (address >> index->object_bits)) & index->object_mask;
+}
+
+
+static size_t table_size(const size_t count) {
+    size_t size = 16;
+
+    while (size < count * 2) {
+        size <<= 1;
+    }
+
+    return size;
+}
+
+
+static unsigned table_bits(const size_t size) {
+    unsigned bits = 0;
+
+    while (((size_t) 1 << bits) < size) {
+        bits++;
+    }
+
+    return bits;
+}
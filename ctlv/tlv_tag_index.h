@@ -0,0 +1,83 @@
+#ifndef TLV_TAG_INDEX_H_2016
+#define TLV_TAG_INDEX_H_2016
+
+/**
+ * File:   tlv_tag_index.h
+ *
+ * @brief Index of the tags of a TLV structure
+ * The index is built once per tree with a single walk and answers tag lookups in constant time.
+ * All objects sharing a tag are kept in pre-order. tlv_find_by_tag() searches the next chain before the
+ * children, so with a tag used more than once the two may return different objects.
+ * The tree must not be modified or deleted while the index is in use. Children of lazy CDO's are not indexed.
+ */
+
+#include "tlv.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    typedef struct stTLVTagIndex tlv_tag_index_t;
+
+
+    /**
+     * @brief Builds a tag index over a tlv object, its children and its next chain
+     * @param[in] tlv Tlv object to index
+     * @return The index or NULL if building failed
+     */
+    tlv_tag_index_t* tlv_tag_index_new(const tlv_t *tlv);
+
+
+    /**
+     * @brief Deletes a tag index, the indexed tree is not touched
+     * @param[in] index Index to delete
+     */
+    void tlv_tag_index_delete(tlv_tag_index_t **index);
+
+
+    /**
+     * @brief Finds the first tlv object with the specified tag
+     * @param[in] index Index to search
+     * @param[in] tag Tag of the tlv to search for
+     * @return The first tlv object in pre-order or NULL if not found
+     */
+    const tlv_t* tlv_tag_index_find(const tlv_tag_index_t *index, const tlv_tag_t tag);
+
+
+    /**
+     * @brief Finds all tlv objects with the specified tag
+     * @param[in] index Index to search
+     * @param[in] tag Tag of the tlv to search for
+     * @param[out] objects Return point of the array of objects in pre-order, owned by the index
+     * @return Number of objects in the array
+     */
+    size_t tlv_tag_index_find_all(const tlv_tag_index_t *index, const tlv_tag_t tag, const tlv_t * const **objects);
+
+
+    /**
+     * @brief Finds all tlv objects with the specified tag below a CDO
+     * Only the children of the CDO and their descendants are returned, not the CDO itself
+     * @param[in] index Index to search
+     * @param[in] cdo CDO to search in, must be part of the indexed tree
+     * @param[in] tag Tag of the tlv to search for
+     * @param[out] objects Return point of the array of objects in pre-order, owned by the index
+     * @return Number of objects in the array
+     */
+    size_t tlv_tag_index_find_all_in(const tlv_tag_index_t *index, const tlv_t *cdo, const tlv_tag_t tag, const tlv_t * const **objects);
+
+
+    /**
+     * @brief Finds the first tlv object with the specified tag below a CDO
+     * @param[in] index Index to search
+     * @param[in] cdo CDO to search in, must be part of the indexed tree
+     * @param[in] tag Tag of the tlv to search for
+     * @return The first tlv object in pre-order or NULL if not found
+     */
+    const tlv_t* tlv_tag_index_find_in(const tlv_tag_index_t *index, const tlv_t *cdo, const tlv_tag_t tag);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TLV_TAG_INDEX_H_2016 */
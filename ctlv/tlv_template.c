@@ -0,0 +1,406 @@
+#include "tlv_template.h"
+#include "tlv_path.h"
+#include "tlv_private.h"
+#include <string.h>
+
+
+/**
+ * A slot, the offsets refer to the encoding of the prototype
+ */
+typedef struct {
+    char *name;                     /**< @brief Name of the slot */
+    size_t offset;                  /**< @brief Offset of the header of the PDO */
+    tlv_length_t length;            /**< @brief Length of the PDO in the prototype */
+    tlv_length_t max_length;        /**< @brief Maximum length of a variable slot, 0 for a fixed slot */
+    size_t parents;                 /**< @brief Index of the enclosing CDO's in the parents of the template */
+    size_t depth;                   /**< @brief Number of enclosing CDO's */
+    size_t variable;                /**< @brief Index of the variable slot in the deltas of a message */
+} template_slot_t;
+
+/**
+ * The encoded prototype and its slots
+ */
+struct stTLVTemplate {
+    uint8_t *bytes;                 /**< @brief Encoding of the prototype */
+    size_t size;                    /**< @brief Size of the encoding */
+    size_t capacity;                /**< @brief Size of a message with all variable slots at their maximum */
+    template_slot_t *slots;         /**< @brief The slots */
+    size_t count;                   /**< @brief Number of slots */
+    size_t *parents;                /**< @brief Header offsets of the CDO's enclosing the slots, the outermost first */
+    size_t parent_count;            /**< @brief Number of parents */
+    size_t *variables;              /**< @brief The variable slots by their offset */
+    size_t variable_count;          /**< @brief Number of variable slots */
+};
+
+/**
+ * A message made from a template
+ */
+struct stTLVTemplateMsg {
+    const tlv_template_t *tmpl;     /**< @brief The template */
+    uint8_t *bytes;                 /**< @brief Encoding of the message, of the capacity of the template */
+    size_t size;                    /**< @brief Size of the encoding */
+    int64_t deltas[];               /**< @brief Length of each variable slot minus its length in the prototype */
+};
+
+
+/********** PRIVATE DECLARATIONS **********************************************/
+/**
+ * @brief Records the slot of a spec
+ */
+static bool add_slot(tlv_template_t *tmpl, const tlv_template_slot_spec_t *spec);
+
+/**
+ * @brief Finds the header of a PDO and the CDO's enclosing it in an encoding
+ * @param[in] value Offset of the value of the PDO
+ * @param[out] header Offset of the header of the PDO
+ * @param[out] parents Header offsets of the enclosing CDO's, TLV_MAX_DEPTH entries
+ * @param[out] depth Number of enclosing CDO's
+ */
+static bool locate(const uint8_t *bytes, const size_t size, const size_t value, size_t *header, size_t *parents, size_t *depth);
+
+/**
+ * @brief Returns the offset in a message of an offset in the prototype
+ * Only variable slots before the offset move it
+ */
+static size_t position(const tlv_template_msg_t *msg, const size_t offset);
+
+/**
+ * @brief Changes the length of a variable slot, moves the rest of the message and fixes the lengths up
+ */
+static bool resize(tlv_template_msg_t *msg, const template_slot_t *slot, const size_t at, const tlv_length_t length);
+
+
+/********** PUBLIC DEFINITIONS ************************************************/
+tlv_template_t* tlv_template_new(const tlv_t *prototype, const tlv_template_slot_spec_t *specs, const size_t count) {
+    tlv_template_t *tmpl;
+
+    if (prototype == NULL || (specs == NULL && count > 0)) {
+        TLV_FAIL(TLV_FAILURE_ARGUMENT, "Error - Prototype or slots are null when creating template");
+        return NULL;
+    }
+    if ((tmpl = calloc(1, sizeof (*tmpl))) == NULL
+            || (count > 0 && ((tmpl->slots = calloc(count, sizeof (*tmpl->slots))) == NULL
+            || (tmpl->variables = malloc(count * sizeof (*tmpl->variables))) == NULL))) {
+        TLV_FAIL(TLV_FAILURE_MEMORY, "Fatal - Out of memory when creating template");
+        tlv_template_delete(&tmpl);
+        return NULL;
+    }
+    if (!tlv_to_byte_array(prototype, &tmpl->bytes, &tmpl->size)) {
+        tlv_debug_cb("Error - Failed to encode the prototype of the template");
+        tlv_template_delete(&tmpl);
+        return NULL;
+    }
+    tmpl->capacity = tmpl->size;
+    for (size_t i = 0; i < count; i++) {
+        if (!add_slot(tmpl, &specs[i])) {
+            tlv_template_delete(&tmpl);
+            return NULL;
+        }
+    }
+
+    // Variable slots ordered by offset, a message sums up the deltas of the ones before an offset
+    for (size_t i = 1; i < tmpl->variable_count; i++) {
+        size_t v = tmpl->variables[i];
+        size_t j = i;
+
+        for (; j > 0 && tmpl->slots[tmpl->variables[j - 1]].offset > tmpl->slots[v].offset; j--) {
+            tmpl->variables[j] = tmpl->variables[j - 1];
+        }
+        tmpl->variables[j] = v;
+    }
+    for (size_t i = 0; i < tmpl->variable_count; i++) {
+        tmpl->slots[tmpl->variables[i]].variable = i;
+    }
+
+    return tmpl;
+}
+
+
+void tlv_template_delete(tlv_template_t **tmpl) {
+    if (tmpl != NULL && *tmpl != NULL) {
+        tlv_template_t *t = *tmpl;
+
+        for (size_t i = 0; t->slots != NULL && i < t->count; i++) {
+            free(t->slots[i].name);
+        }
+        free(t->slots);
+        free(t->parents);
+        free(t->variables);
+        free(t->bytes);
+        free(t);
+        *tmpl = NULL;
+    }
+}
+
+
+size_t tlv_template_slot(const tlv_template_t *tmpl, const char *name) {
+    if (tmpl == NULL || name == NULL) {
+        TLV_FAIL(TLV_FAILURE_ARGUMENT, "Error - Template or name is null when searching slot");
+        return TLV_TEMPLATE_NONE;
+    }
+    for (size_t i = 0; i < tmpl->count; i++) {
+        if (strcmp(tmpl->slots[i].name, name) == 0) {
+            return i;
+        }
+    }
+
+    return TLV_TEMPLATE_NONE;
+}
+
+
+tlv_template_msg_t* tlv_template_msg_new(const tlv_template_t *tmpl) {
+    tlv_template_msg_t *msg;
+
+    if (tmpl == NULL) {
+        TLV_FAIL(TLV_FAILURE_ARGUMENT, "Error - Template is null when creating message");
+        return NULL;
+    }
+    if ((msg = malloc(sizeof (*msg) + tmpl->variable_count * sizeof (msg->deltas[0]))) == NULL
+            || (msg->bytes = malloc(tmpl->capacity)) == NULL) {
+        TLV_FAIL(TLV_FAILURE_MEMORY, "Fatal - Out of memory when creating message");
+        free(msg);
+        return NULL;
+    }
+    msg->tmpl = tmpl;
+    tlv_template_msg_reset(msg);
+
+    return msg;
+}
+
+
+void tlv_template_msg_delete(tlv_template_msg_t **msg) {
+    if (msg != NULL && *msg != NULL) {
+        free((*msg)->bytes);
+        free(*msg);
+        *msg = NULL;
+    }
+}
+
+
+void tlv_template_msg_reset(tlv_template_msg_t *msg) {
+    if (msg != NULL) {
+        memcpy(msg->bytes, msg->tmpl->bytes, msg->tmpl->size);
+        msg->size = msg->tmpl->size;
+        memset(msg->deltas, 0, msg->tmpl->variable_count * sizeof (msg->deltas[0]));
+    }
+}
+
+
+bool tlv_template_msg_set(tlv_template_msg_t *msg, const size_t slot, const uint8_t *value, const tlv_length_t length) {
+    const template_slot_t *s;
+    size_t at;
+
+    if (msg == NULL || slot >= msg->tmpl->count || (value == NULL && length > 0)) {
+        TLV_FAIL(TLV_FAILURE_ARGUMENT, "Error - Message, slot or value is wrong when setting slot");
+        return false;
+    }
+    s = &msg->tmpl->slots[slot];
+    at = position(msg, s->offset);
+    if (s->max_length == 0 && length != s->length) {
+        TLV_FAIL(TLV_FAILURE_ARGUMENT, "Error - Value of %u bytes does not fit fixed slot %s", (unsigned) length, s->name);
+        return false;
+    }
+    if (s->max_length > 0 && !resize(msg, s, at, length)) {
+        return false;
+    }
+    if (length > 0) {
+        memcpy(&msg->bytes[at + tlv_header_size(msg->bytes[at])], value, length);
+    }
+
+    return true;
+}
+
+
+bool tlv_template_msg_set_u8(tlv_template_msg_t *msg, const size_t slot, const uint8_t value) {
+    return tlv_template_msg_set(msg, slot, &value, 1);
+}
+
+
+bool tlv_template_msg_set_u16(tlv_template_msg_t *msg, const size_t slot, const uint16_t value) {
+    uint8_t bytes[2] = {(uint8_t) (value >> 8), (uint8_t) value};
+
+    return tlv_template_msg_set(msg, slot, bytes, sizeof (bytes));
+}
+
+
+bool tlv_template_msg_set_u32(tlv_template_msg_t *msg, const size_t slot, const uint32_t value) {
+    uint8_t bytes[4] = {(uint8_t) (value >> 24), (uint8_t) (value >> 16), (uint8_t) (value >> 8), (uint8_t) value};
+
+    return tlv_template_msg_set(msg, slot, bytes, sizeof (bytes));
+}
+
+
+bool tlv_template_msg_set_u64(tlv_template_msg_t *msg, const size_t slot, const uint64_t value) {
+    uint8_t bytes[8];
+
+    for (size_t i = 0; i < sizeof (bytes); i++) {
+        bytes[i] = (uint8_t) (value >> (56 - 8 * i));
+    }
+
+    return tlv_template_msg_set(msg, slot, bytes, sizeof (bytes));
+}
+
+
+const uint8_t* tlv_template_msg_bytes(const tlv_template_msg_t *msg, size_t *size) {
+    if (msg == NULL || size == NULL) {
+        TLV_FAIL(TLV_FAILURE_ARGUMENT, "Error - Message or size is null when getting bytes");
+        return NULL;
+    }
+    *size = msg->size;
+
+    return msg->bytes;
+}
+
+
+/********** PRIVATE DEFINITIONS ***********************************************/
+static bool add_slot(tlv_template_t *tmpl, const tlv_template_slot_spec_t *spec) {
+    template_slot_t *slot = &tmpl->slots[tmpl->count];
+    size_t parents[TLV_MAX_DEPTH];
+    tlv_path_match_t match;
+    tlv_path_t path;
+    size_t *grown = tmpl->parents;
+
+    if (spec->name == NULL || spec->path == NULL) {
+        TLV_FAIL(TLV_FAILURE_ARGUMENT, "Error - Name or path of a slot is null");
+        return false;
+    }
+    if (tlv_template_slot(tmpl, spec->name) != TLV_TEMPLATE_NONE) {
+        TLV_FAIL(TLV_FAILURE_ARGUMENT, "Error - Slot %s is defined twice", spec->name);
+        return false;
+    }
+    if (!tlv_path_compile(&path, spec->path) || !tlv_path_find(&path, tmpl->bytes, tmpl->size, &match)
+            || match.type != TLV_PDO) {
+        TLV_FAIL(TLV_FAILURE_ARGUMENT, "Error - Path %s of slot %s selects no PDO", spec->path, spec->name);
+        return false;
+    }
+    if (!locate(tmpl->bytes, tmpl->size, (size_t) (match.value - tmpl->bytes), &slot->offset, parents, &slot->depth)) {
+        TLV_FAIL(TLV_FAILURE_MALFORMED, "Error - PDO of slot %s not found in the prototype", spec->name);
+        return false;
+    }
+    for (size_t i = 0; i < tmpl->count; i++) {
+        if (tmpl->slots[i].offset == slot->offset) {
+            TLV_FAIL(TLV_FAILURE_ARGUMENT, "Error - Slots %s and %s select the same PDO", tmpl->slots[i].name, spec->name);
+            return false;
+        }
+    }
+    if ((slot->name = malloc(strlen(spec->name) + 1)) == NULL
+            || (slot->depth > 0 && (grown = realloc(tmpl->parents, (tmpl->parent_count + slot->depth) * sizeof (*grown))) == NULL)) {
+        TLV_FAIL(TLV_FAILURE_MEMORY, "Fatal - Out of memory when creating template");
+        free(slot->name);
+        slot->name = NULL;
+        return false;
+    }
+    strcpy(slot->name, spec->name);
+    tmpl->parents = grown;
+    if (slot->depth > 0) {
+        memcpy(&tmpl->parents[tmpl->parent_count], parents, slot->depth * sizeof (*parents));
+    }
+    slot->parents = tmpl->parent_count;
+    tmpl->parent_count += slot->depth;
+    slot->length = match.length;
+    slot->max_length = spec->max_length;
+    if (slot->max_length > 0) {
+        tmpl->variables[tmpl->variable_count++] = tmpl->count;
+        if (slot->max_length > slot->length) {
+            tmpl->capacity += slot->max_length - slot->length;
+        }
+    }
+    tmpl->count++;
+
+    return true;
+}
+
+
+static bool locate(const uint8_t *bytes, const size_t size, const size_t value, size_t *header, size_t *parents, size_t *depth) {
+    size_t start = 0;
+    size_t end = size;
+
+    *depth = 0;
+    while (start < end) {
+        tlv_header_t h;
+        size_t object_end;
+
+        if (!tlv_header_read(&bytes[start], end - start, &h) || end - start - h.size < h.length) {
+            return false;
+        }
+        object_end = start + h.size + h.length;
+        // The value of an empty PDO at the end of a CDO starts where the CDO ends
+        if (value < start + h.size || value > object_end) {
+            start = object_end;
+        } else if (h.type == TLV_PDO) {
+            *header = start;
+            return value == start + h.size;
+        } else {
+            if (*depth == TLV_MAX_DEPTH) {
+                return false;
+            }
+            parents[(*depth)++] = start;
+            start += h.size;
+            end = object_end;
+        }
+    }
+
+    return false;
+}
+
+
+static size_t position(const tlv_template_msg_t *msg, const size_t offset) {
+    const tlv_template_t *tmpl = msg->tmpl;
+    int64_t shift = 0;
+
+    for (size_t i = 0; i < tmpl->variable_count && tmpl->slots[tmpl->variables[i]].offset < offset; i++) {
+        shift += msg->deltas[i];
+    }
+
+    return (size_t) ((int64_t) offset + shift);
+}
+
+
+static bool resize(tlv_template_msg_t *msg, const template_slot_t *slot, const size_t at, const tlv_length_t length) {
+    const size_t *parents = &msg->tmpl->parents[slot->parents];
+    size_t positions[TLV_MAX_DEPTH];
+    tlv_header_t headers[TLV_MAX_DEPTH];
+    tlv_header_t header;
+    size_t value;
+    int64_t delta;
+
+    if (length > slot->max_length) {
+        TLV_FAIL(TLV_FAILURE_SIZE, "Error - Value of %u bytes exceeds variable slot %s", (unsigned) length, slot->name);
+        return false;
+    }
+    if (!tlv_header_read(&msg->bytes[at], msg->size - at, &header)) {
+        TLV_FAIL(TLV_FAILURE_MALFORMED, "Error - Header of slot %s is malformed", slot->name);
+        return false;
+    }
+    if ((delta = (int64_t) length - (int64_t) header.length) == 0) {
+        return true;
+    }
+    if (header.size == BER_HEADER_BYTE_LENGTH && length > UINT16_MAX) {
+        TLV_FAIL(TLV_FAILURE_SIZE, "Error - Value of %u bytes exceeds the narrow header of slot %s", (unsigned) length, slot->name);
+        return false;
+    }
+
+    // Every enclosing CDO must still fit its header before anything is changed
+    for (size_t i = 0; i < slot->depth; i++) {
+        positions[i] = position(msg, parents[i]);
+        if (!tlv_header_read(&msg->bytes[positions[i]], msg->size - positions[i], &headers[i])) {
+            TLV_FAIL(TLV_FAILURE_MALFORMED, "Error - Header of a CDO enclosing slot %s is malformed", slot->name);
+            return false;
+        }
+        if ((int64_t) headers[i].length + delta > (headers[i].size == BER_HEADER_BYTE_LENGTH ? UINT16_MAX : UINT32_MAX)) {
+            TLV_FAIL(TLV_FAILURE_SIZE, "Error - CDO(%u) enclosing slot %s grows beyond its header", headers[i].tag, slot->name);
+            return false;
+        }
+    }
+    value = at + header.size;
+    memmove(&msg->bytes[value + length], &msg->bytes[value + header.length], msg->size - value - header.length);
+    msg->size = (size_t) ((int64_t) msg->size + delta);
+    tlv_header_write(&msg->bytes[at], TLV_PDO, header.tag, length, header.size != BER_HEADER_BYTE_LENGTH);
+    for (size_t i = 0; i < slot->depth; i++) {
+        tlv_header_write(&msg->bytes[positions[i]], TLV_CDO, headers[i].tag, (tlv_length_t) ((int64_t) headers[i].length + delta),
+                headers[i].size != BER_HEADER_BYTE_LENGTH);
+    }
+    msg->deltas[slot->variable] = (int64_t) length - (int64_t) slot->length;
+
+    return true;
+}
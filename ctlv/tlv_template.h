@@ -0,0 +1,141 @@
+#ifndef TLV_TEMPLATE_H_2016
+#define TLV_TEMPLATE_H_2016
+
+/**
+ * File:   tlv_template.h
+ *
+ * @brief Pre-encoded messages with patchable value slots
+ * A template is the encoding of a prototype tree together with the byte offsets of some of its PDO's,
+ * the slots. The slots are selected by path expressions, see tlv_path.h, and found by name.
+ *
+ * A message made from a template is a copy of the encoding in which only the slots are written,
+ * no tree is built and nothing is sized or encoded. A fixed slot keeps the length of its PDO in the
+ * prototype. A variable slot takes values up to its maximum length, the rest of the message is moved
+ * and the lengths of the enclosing CDO's are fixed up. The header widths of the prototype are kept,
+ * so a CDO encoded with a narrow header can not grow beyond 65535 bytes.
+ *
+ * Values of the integer setters are written big endian, as the lengths in the headers.
+ */
+
+#include "tlv.h"
+
+
+#define TLV_TEMPLATE_NONE SIZE_MAX
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    typedef struct stTLVTemplate tlv_template_t;
+    typedef struct stTLVTemplateMsg tlv_template_msg_t;
+
+    /**
+     * Selects a slot of a template
+     */
+    typedef struct {
+        const char *name;               /**< @brief Name of the slot */
+        const char *path;               /**< @brief Path of the PDO, the first selected PDO is the slot */
+        tlv_length_t max_length;        /**< @brief Maximum length of a variable slot, 0 for a fixed slot */
+    } tlv_template_slot_spec_t;
+
+
+    /**
+     * @brief Encodes a prototype and records its slots
+     * @param[in] prototype Tree to encode with its next chain, not needed after the call
+     * @param[in] specs The slots
+     * @param[in] count Number of slots
+     * @return The template or NULL if a path selects no PDO, a name is used twice or two slots select the same PDO
+     */
+    tlv_template_t* tlv_template_new(const tlv_t *prototype, const tlv_template_slot_spec_t *specs, const size_t count);
+
+
+    /**
+     * @brief Deletes a template, the messages made from it must be deleted before
+     * @param[in] tmpl Template to delete
+     */
+    void tlv_template_delete(tlv_template_t **tmpl);
+
+
+    /**
+     * @brief Finds a slot by name, to be done once and not per message
+     * @param[in] tmpl The template
+     * @param[in] name Name of the slot
+     * @return Number of the slot or TLV_TEMPLATE_NONE
+     */
+    size_t tlv_template_slot(const tlv_template_t *tmpl, const char *name);
+
+
+    /**
+     * @brief Creates a message of a template, holding the encoding of the prototype
+     * @param[in] tmpl The template
+     * @return The message or NULL
+     */
+    tlv_template_msg_t* tlv_template_msg_new(const tlv_template_t *tmpl);
+
+
+    /**
+     * @brief Deletes a message
+     * @param[in] msg Message to delete
+     */
+    void tlv_template_msg_delete(tlv_template_msg_t **msg);
+
+
+    /**
+     * @brief Resets a message to the encoding of the prototype
+     * @param[in] msg The message
+     */
+    void tlv_template_msg_reset(tlv_template_msg_t *msg);
+
+
+    /**
+     * @brief Writes the value of a slot
+     * @param[in] msg The message
+     * @param[in] slot Number of the slot
+     * @param[in] value The value, may be NULL if length is 0
+     * @param[in] length Length of the value, the length of a fixed slot or up to the maximum of a variable slot
+     * @return True if successful, false otherwise
+     */
+    bool tlv_template_msg_set(tlv_template_msg_t *msg, const size_t slot, const uint8_t *value, const tlv_length_t length);
+
+
+    /**
+     * @brief Writes a 1 byte value into a slot
+     * @return True if successful, false if the slot can not hold 1 byte
+     */
+    bool tlv_template_msg_set_u8(tlv_template_msg_t *msg, const size_t slot, const uint8_t value);
+
+
+    /**
+     * @brief Writes a big endian 2 byte value into a slot
+     * @return True if successful, false if the slot can not hold 2 bytes
+     */
+    bool tlv_template_msg_set_u16(tlv_template_msg_t *msg, const size_t slot, const uint16_t value);
+
+
+    /**
+     * @brief Writes a big endian 4 byte value into a slot
+     * @return True if successful, false if the slot can not hold 4 bytes
+     */
+    bool tlv_template_msg_set_u32(tlv_template_msg_t *msg, const size_t slot, const uint32_t value);
+
+
+    /**
+     * @brief Writes a big endian 8 byte value into a slot
+     * @return True if successful, false if the slot can not hold 8 bytes
+     */
+    bool tlv_template_msg_set_u64(tlv_template_msg_t *msg, const size_t slot, const uint64_t value);
+
+
+    /**
+     * @brief Returns the encoding of a message
+     * @param[in] msg The message
+     * @param[out] size Size of the encoding
+     * @return The encoding, valid until the message is changed or deleted
+     */
+    const uint8_t* tlv_template_msg_bytes(const tlv_template_msg_t *msg, size_t *size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TLV_TEMPLATE_H_2016 */
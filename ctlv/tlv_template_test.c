@@ -0,0 +1,154 @@
+/**
+ * File:   tlv_template_test.c
+ *
+ * @brief Tests of tlv_template.h
+ * Run "make test" to build and run the tests
+ */
+#include "tlv_template.h"
+#include "tlv_test.h"
+
+#define TEST_NAME_MAX 64
+
+/**
+ * An event with a fixed id and stamp and a variable name, followed by a second top level object
+ */
+typedef struct {
+    uint32_t id;
+    uint64_t stamp;
+    const char *name;
+} test_event_t;
+
+
+/********** PRIVATE DECLARATIONS **********************************************/
+/**
+ * @brief Builds the tree of an event directly
+ * @param[in] event The event
+ * @return The tree or NULL
+ */
+static tlv_t* build_event(const test_event_t *event);
+
+
+/**
+ * @brief Checks that a message holds the encoding of the tree of an event
+ * @param[in] msg The message
+ * @param[in] event The event
+ * @return True if the encodings are equal
+ */
+static bool check_message(const tlv_template_msg_t *msg, const test_event_t *event);
+
+
+/**
+ * Messages of a template equal the encodings of the trees built with the same values
+ */
+static bool test_messages(void);
+
+
+/********** PUBLIC DEFINITIONS ************************************************/
+int main(void) {
+    return tlv_test_result("tlv_template_test", test_messages());
+}
+
+
+/********** PRIVATE DEFINITIONS ***********************************************/
+static tlv_t* build_event(const test_event_t *event) {
+    tlv_builder_t *builder = tlv_builder_new(NULL);
+    uint8_t id[4];
+    uint8_t stamp[8];
+    bool ok;
+    tlv_t *tlv = NULL;
+
+    for (size_t i = 0; i < sizeof (id); i++) {
+        id[i] = (uint8_t) (event->id >> (8 * (sizeof (id) - 1 - i)));
+    }
+    for (size_t i = 0; i < sizeof (stamp); i++) {
+        stamp[i] = (uint8_t) (event->stamp >> (8 * (sizeof (stamp) - 1 - i)));
+    }
+    ok = builder != NULL
+            && tlv_builder_begin_cdo(builder, 1)
+            && tlv_builder_add_pdo(builder, 9, 3, (const uint8_t *) "abc")
+            && tlv_builder_begin_cdo(builder, 2)
+            && tlv_builder_add_pdo(builder, 1, sizeof (id), id)
+            && tlv_builder_add_pdo(builder, 2, sizeof (stamp), stamp)
+            && tlv_builder_add_pdo(builder, 3, (tlv_length_t) strlen(event->name), (const uint8_t *) event->name)
+            && tlv_builder_end_cdo(builder)
+            && tlv_builder_add_pdo(builder, 4, 4, (const uint8_t *) "tail")
+            && tlv_builder_end_cdo(builder)
+            && tlv_builder_add_pdo(builder, 5, 4, (const uint8_t *) "next");
+    if (ok) {
+        tlv = tlv_builder_finish(builder);
+    }
+    tlv_builder_delete(&builder);
+
+    return tlv;
+}
+
+
+static bool check_message(const tlv_template_msg_t *msg, const test_event_t *event) {
+    tlv_t *tlv = build_event(event);
+    const uint8_t *bytes;
+    uint8_t *barray = NULL;
+    size_t size = 0;
+    size_t length;
+    bool ok;
+
+    CHECK(tlv != NULL && tlv_to_byte_array(tlv, &barray, &length));
+    bytes = tlv_template_msg_bytes(msg, &size);
+    ok = bytes != NULL && size == length && memcmp(bytes, barray, size) == 0;
+    free(barray);
+    tlv_delete_all(&tlv);
+    CHECK(ok);
+
+    return true;
+}
+
+
+static bool test_messages(void) {
+    const tlv_template_slot_spec_t specs[] = {{"id", "1/2/1", 0}, {"stamp", "1/2/2", 0}, {"name", "1/2/3", TEST_NAME_MAX}};
+    const test_event_t prototype = {0, 0, ""};
+    const test_event_t events[] = {
+        {1, 2, "x"},
+        {0xDEADBEEF, 0x0102030405060708ULL, "a longer name"},
+        {7, 8, ""},
+        {9, 10, "0123456789012345678901234567890123456789012345678901234567890123"},
+        {11, 12, "short again"},
+    };
+    char too_long[TEST_NAME_MAX + 1];
+    tlv_template_msg_t *msg = NULL;
+    tlv_template_t *tmpl;
+    tlv_t *tlv;
+    size_t id;
+    size_t stamp;
+    size_t name;
+
+    CHECK((tlv = build_event(&prototype)) != NULL);
+    tmpl = tlv_template_new(tlv, specs, sizeof (specs) / sizeof (specs[0]));
+    tlv_delete_all(&tlv);
+    CHECK(tmpl != NULL && (msg = tlv_template_msg_new(tmpl)) != NULL);
+    id = tlv_template_slot(tmpl, "id");
+    stamp = tlv_template_slot(tmpl, "stamp");
+    name = tlv_template_slot(tmpl, "name");
+    CHECK(id != TLV_TEMPLATE_NONE && stamp != TLV_TEMPLATE_NONE && name != TLV_TEMPLATE_NONE);
+    CHECK(tlv_template_slot(tmpl, "missing") == TLV_TEMPLATE_NONE);
+    CHECK(check_message(msg, &prototype));
+
+    // Every message starts from the previous one, the variable slot grows and shrinks
+    for (size_t i = 0; i < sizeof (events) / sizeof (events[0]); i++) {
+        CHECK(tlv_template_msg_set_u32(msg, id, events[i].id));
+        CHECK(tlv_template_msg_set_u64(msg, stamp, events[i].stamp));
+        CHECK(tlv_template_msg_set(msg, name, (const uint8_t *) events[i].name, (tlv_length_t) strlen(events[i].name)));
+        CHECK(check_message(msg, &events[i]));
+    }
+
+    // Values which do not fit a slot leave the message as it was
+    memset(too_long, 'z', sizeof (too_long));
+    CHECK(!tlv_template_msg_set(msg, name, (const uint8_t *) too_long, sizeof (too_long)));
+    CHECK(!tlv_template_msg_set_u16(msg, id, 1));
+    CHECK(check_message(msg, &events[sizeof (events) / sizeof (events[0]) - 1]));
+    tlv_template_msg_reset(msg);
+    CHECK(check_message(msg, &prototype));
+
+    tlv_template_msg_delete(&msg);
+    tlv_template_delete(&tmpl);
+
+    return true;
+}
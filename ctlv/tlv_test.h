@@ -0,0 +1,120 @@
+#ifndef TLV_TEST_H_2016
+#define TLV_TEST_H_2016
+
+/**
+ * File:   tlv_test.h
+ *
+ * @brief Helpers shared by the tests of the ctlv library
+ * A test is a function returning true if it passed, CHECK returns false from it on the first failed
+ * condition. The tests are built and run by "make test".
+ */
+
+#include "tlv.h"
+#include "tlv_builder.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CHECK(condition) do { \
+        if (!(condition)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            return false; \
+        } \
+    } while (0)
+
+
+/**
+ * @brief Writes a narrow PDO with a value filled with the low byte of its tag
+ * @param[out] bytes Return point of the message, BER_HEADER_BYTE_LENGTH + length bytes
+ * @param[in] tag Tag of the message
+ * @param[in] length Length of the value
+ * @return Size of the message
+ */
+static inline size_t tlv_test_message(uint8_t *bytes, const tlv_tag_t tag, const uint16_t length) {
+    bytes[0] = TLV_PDO;
+    bytes[1] = (uint8_t) (tag >> 8);
+    bytes[2] = (uint8_t) tag;
+    bytes[3] = (uint8_t) (length >> 8);
+    bytes[4] = (uint8_t) length;
+    memset(&bytes[BER_HEADER_BYTE_LENGTH], (uint8_t) tag, length);
+
+    return BER_HEADER_BYTE_LENGTH + (size_t) length;
+}
+
+
+/**
+ * @brief Adds the objects of a tree text up to the end of the open CDO, see tlv_test_build
+ * @param[in] builder The builder
+ * @param[in,out] text Position in the text, moved behind the added objects
+ * @return True if successful, false otherwise
+ */
+static inline bool tlv_test_build_objects(tlv_builder_t *builder, const char **text) {
+    const char *s = *text;
+
+    while (true) {
+        tlv_tag_t tag;
+        char *end;
+
+        while (*s == ' ') {
+            s++;
+        }
+        if (*s == '\0' || *s == '}') {
+            break;
+        }
+        tag = (tlv_tag_t) strtoul(s, &end, 10);
+        s = end;
+        if (*s == '{') {
+            s++;
+            if (!tlv_builder_begin_cdo(builder, tag) || !tlv_test_build_objects(builder, &s) || *s++ != '}'
+                    || !tlv_builder_end_cdo(builder)) {
+                return false;
+            }
+        } else if (*s == '=') {
+            size_t length = strcspn(++s, " {}");
+
+            if (!tlv_builder_add_pdo(builder, tag, (tlv_length_t) length, (const uint8_t *) s)) {
+                return false;
+            }
+            s += length;
+        } else {
+            return false;
+        }
+    }
+    *text = s;
+
+    return true;
+}
+
+
+/**
+ * @brief Builds a tree from a text of tags with "{...}" for the children of a CDO or "=value" for a PDO,
+ * values hold no spaces or braces, for example "1{2=abc 3{}} 4="
+ * @param[in] text The tree
+ * @return The tree or NULL for an empty or wrong text
+ */
+static inline tlv_t* tlv_test_build(const char *text) {
+    tlv_builder_t *builder = tlv_builder_new(NULL);
+    tlv_t *tlv = NULL;
+
+    if (builder != NULL && tlv_test_build_objects(builder, &text) && *text == '\0') {
+        tlv = tlv_builder_finish(builder);
+    }
+    tlv_builder_delete(&builder);
+
+    return tlv;
+}
+
+
+/**
+ * @brief Prints the result of a test program
+ * @param[in] name Name of the program
+ * @param[in] ok True if all tests passed
+ * @return Exit code of the program
+ */
+static inline int tlv_test_result(const char *name, const bool ok) {
+    printf("%s: %s\n", name, ok ? "passed" : "FAILED");
+
+    return ok ? 0 : 1;
+}
+
+#endif /* TLV_TEST_H_2016 */